@@ -0,0 +1,145 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <neodb/protocol.hpp>
+
+namespace neodb
+{
+    struct server_busy : std::runtime_error { server_busy() : std::runtime_error{ "neodb::server_busy" } {} };
+    struct server_error : std::runtime_error { server_error(std::string const& aReason) : std::runtime_error{ "neodb::server_error: " + aReason } {} };
+    struct connection_lost : std::runtime_error { connection_lost() : std::runtime_error{ "neodb::connection_lost" } {} };
+
+    struct client_options
+    {
+        std::size_t connections = 1;
+        // requests in flight per connection; no more than the server's pipeline_limit is useful
+        std::size_t pipelineLimit = 128;
+        // inserts (or lookups) into one table are queued and sent as one request once there are this
+        // many of them or the first has waited batchDelay, whichever is sooner
+        std::size_t batchRows = 256;
+        std::chrono::microseconds batchDelay{ 200 };
+    };
+
+    // The rows of a Scan response, encoded as described by the table's row_layout.
+    class row_batch
+    {
+    public:
+        row_batch() = default;
+        row_batch(message aPayload, std::size_t aOffset, std::size_t aRowSize, std::size_t aRowCount, bool aMore);
+    public:
+        std::size_t size() const;
+        std::size_t row_size() const;
+        // the scan stopped at a batch limit: scan again from the last row's key, excluding it
+        bool more() const;
+        std::uint8_t const* operator[](std::size_t aIndex) const;
+    private:
+        message iPayload;
+        std::size_t iOffset = 0u;
+        std::size_t iRowSize = 0u;
+        std::size_t iRowCount = 0u;
+        bool iMore = false;
+    };
+
+    // Keys are index keys (see index_key.hpp); an empty key leaves that end of the range open.
+    struct key_range
+    {
+        std::vector<std::uint8_t> low;
+        std::vector<std::uint8_t> high;
+        bool excludeLow = false; // scans only
+    };
+
+    template <typename T>
+    struct completion_type { typedef std::function<void(std::exception_ptr aError, T aResult)> type; };
+    template <>
+    struct completion_type<void> { typedef std::function<void(std::exception_ptr aError)> type; };
+    template <typename T>
+    using completion = typename completion_type<T>::type;
+
+    // A connection (or several) to a server, kept open for the client's lifetime. Requests may be made
+    // from any thread and never wait for the server: each returns a future, or takes a completion that
+    // is called on the client's I/O thread (so must not block) once the response arrives. Up to
+    // pipelineLimit requests are in flight per connection, written together when several are ready.
+    // Inserts and lookups are batched per table into single Insert and Find requests; any other request
+    // first sends the batches queued before it. The server executes pipelined requests concurrently so
+    // requests may execute in any order, except that a find, scan or count of a table is only sent once
+    // the inserts into that table made before it have completed, and a commit once every request made
+    // before it has.
+    class client
+    {
+    public:
+        typedef std::vector<std::uint8_t> row;
+    public:
+        client(std::string const& aHost, unsigned short aPort, client_options const& aOptions = {});
+        // waits for the responses to the requests already made
+        ~client();
+    public:
+        std::future<void> create_table(i_schema const& aSchema, table_options const& aOptions = {});
+        void create_table(i_schema const& aSchema, table_options const& aOptions, completion<void> aCompletion);
+        std::future<protocol::table_definition> describe_table(std::string const& aTable);
+        void describe_table(std::string const& aTable, completion<protocol::table_definition> aCompletion);
+        // batched; false if the table already has a row with the row's key
+        std::future<bool> insert(std::string const& aTable, void const* aRow, std::size_t aRowSize);
+        void insert(std::string const& aTable, void const* aRow, std::size_t aRowSize, completion<bool> aCompletion);
+        // all of aCount rows stored back to back or, if any of their keys is taken, none
+        std::future<void> bulk_insert(std::string const& aTable, void const* aRows, std::size_t aCount, std::size_t aRowSize);
+        void bulk_insert(std::string const& aTable, void const* aRows, std::size_t aCount, std::size_t aRowSize, completion<void> aCompletion);
+        // batched
+        std::future<std::optional<row>> find(std::string const& aTable, void const* aKey, std::size_t aKeySize);
+        void find(std::string const& aTable, void const* aKey, std::size_t aKeySize, completion<std::optional<row>> aCompletion);
+        // rows in primary key order; aLimit zero for as many as the server sends in one batch
+        std::future<row_batch> scan(std::string const& aTable, key_range const& aRange = {}, std::uint32_t aLimit = 0u);
+        void scan(std::string const& aTable, key_range const& aRange, std::uint32_t aLimit, completion<row_batch> aCompletion);
+        std::future<std::uint64_t> count(std::string const& aTable, key_range const& aRange = {});
+        void count(std::string const& aTable, key_range const& aRange, completion<std::uint64_t> aCompletion);
+        std::future<void> commit();
+        void commit(completion<void> aCompletion);
+        // send the queued batches now
+        void flush();
+    private:
+        struct implementation;
+        std::unique_ptr<implementation> iImplementation;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,732 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <array>
+#include <deque>
+#include <map>
+#include <set>
+#include <thread>
+#include <utility>
+#include <boost/asio.hpp>
+#include <client.hpp>
+
+namespace neodb
+{
+    namespace
+    {
+        enum class response_status : std::uint8_t
+        {
+            Ok      = 0x00,
+            Busy    = 0x01,
+            Error   = 0x02
+        };
+
+        typedef std::function<void(std::exception_ptr aError, message aPayload)> response_handler;
+
+        template <typename T>
+        std::pair<std::future<T>, completion<T>> promised()
+        {
+            auto promise = std::make_shared<std::promise<T>>();
+            auto future = promise->get_future();
+            if constexpr (std::is_void_v<T>)
+                return { std::move(future), [promise](std::exception_ptr aError)
+                {
+                    if (aError)
+                        promise->set_exception(aError);
+                    else
+                        promise->set_value();
+                } };
+            else
+                return { std::move(future), [promise](std::exception_ptr aError, T aResult)
+                {
+                    if (aError)
+                        promise->set_exception(aError);
+                    else
+                        promise->set_value(std::move(aResult));
+                } };
+        }
+
+        template <typename T>
+        T failed()
+        {
+            return T{};
+        }
+
+        template <>
+        protocol::table_definition failed<protocol::table_definition>()
+        {
+            return protocol::table_definition{ schema{ string{}, std::vector<neolib::ref_ptr<i_field_spec>>{} }, {} };
+        }
+
+        // a response handler decoding the payload with aDecode, a malformed payload failing the request
+        template <typename T, typename Decode>
+        response_handler respond(completion<T> aCompletion, Decode aDecode)
+        {
+            return [aCompletion = std::move(aCompletion), aDecode](std::exception_ptr aError, message aPayload)
+            {
+                if constexpr (std::is_void_v<T>)
+                    aCompletion(aError);
+                else
+                {
+                    if (!aError)
+                    {
+                        try
+                        {
+                            auto result = aDecode(aPayload);
+                            aCompletion({}, std::move(result));
+                            return;
+                        }
+                        catch (...)
+                        {
+                            aError = std::current_exception();
+                        }
+                    }
+                    aCompletion(aError, failed<T>());
+                }
+            };
+        }
+
+        template <typename T>
+        response_handler respond(completion<T> aCompletion)
+        {
+            static_assert(std::is_void_v<T>);
+            return respond<T>(std::move(aCompletion), [](message const&) {});
+        }
+
+        message request_payload(protocol::opcode aOpcode, std::string const& aTable = {})
+        {
+            message result;
+            protocol::writer writer{ result };
+            writer.put(aOpcode);
+            if (aOpcode != protocol::opcode::Commit)
+                writer.put_string(aTable);
+            return result;
+        }
+
+        void put_range(protocol::writer& aWriter, key_range const& aRange, bool aScan)
+        {
+            std::uint8_t flags = 0u;
+            if (!aRange.low.empty())
+                flags |= protocol::HasLowKey;
+            if (!aRange.high.empty())
+                flags |= protocol::HasHighKey;
+            if (aScan && aRange.excludeLow && !aRange.low.empty())
+                flags |= protocol::ExcludeLowKey;
+            aWriter.put(flags);
+            aWriter.put_bytes(aRange.low.data(), aRange.low.size());
+            aWriter.put_bytes(aRange.high.data(), aRange.high.size());
+        }
+    }
+
+    row_batch::row_batch(message aPayload, std::size_t aOffset, std::size_t aRowSize, std::size_t aRowCount, bool aMore) :
+        iPayload{ std::move(aPayload) }, iOffset{ aOffset }, iRowSize{ aRowSize }, iRowCount{ aRowCount }, iMore{ aMore }
+    {
+    }
+
+    std::size_t row_batch::size() const
+    {
+        return iRowCount;
+    }
+
+    std::size_t row_batch::row_size() const
+    {
+        return iRowSize;
+    }
+
+    bool row_batch::more() const
+    {
+        return iMore;
+    }
+
+    std::uint8_t const* row_batch::operator[](std::size_t aIndex) const
+    {
+        return &iPayload[iOffset + aIndex * iRowSize];
+    }
+
+    // Everything below runs on the I/O thread; the public member functions post to it.
+    struct client::implementation
+    {
+        struct request
+        {
+            std::uint64_t id;
+            message frame;
+            response_handler handler;
+        };
+        struct connection
+        {
+            explicit connection(boost::asio::io_context& aIo) :
+                socket{ aIo }
+            {
+            }
+
+            boost::asio::ip::tcp::socket socket;
+            std::deque<request> queued;
+            // written or being written, in order, as responses arrive in request order
+            std::deque<std::pair<std::uint64_t, response_handler>> awaiting;
+            std::vector<message> writing;
+            std::array<std::uint8_t, 5> header = {};
+            message payload;
+            bool broken = false;
+        };
+        struct insert_batch
+        {
+            std::size_t rowSize = 0u;
+            message rows;
+            std::vector<completion<bool>> completions;
+        };
+        struct find_batch
+        {
+            std::size_t keySize = 0u;
+            message keys;
+            std::vector<completion<std::optional<row>>> completions;
+        };
+
+        client_options const options;
+        boost::asio::io_context io;
+        std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work;
+        std::vector<std::unique_ptr<connection>> connections;
+        boost::asio::steady_timer batchTimer;
+        bool batchTimerSet = false;
+        std::map<std::string, insert_batch> inserts;
+        std::map<std::string, find_batch> finds;
+        std::uint64_t nextId = 0u;
+        std::set<std::uint64_t> unfinished;
+        std::map<std::string, std::uint64_t> lastWrites; // per table, the latest insert or bulk insert request
+        std::deque<std::pair<std::uint64_t, std::function<void()>>> barriers;
+        std::thread thread;
+
+        implementation(std::string const& aHost, unsigned short aPort, client_options const& aOptions) :
+            options{ aOptions }, work{ boost::asio::make_work_guard(io) }, batchTimer{ io }
+        {
+            boost::asio::ip::tcp::resolver resolver{ io };
+            auto const endpoints = resolver.resolve(aHost, std::to_string(aPort));
+            for (std::size_t index = 0; index < std::max<std::size_t>(options.connections, 1u); ++index)
+            {
+                connections.push_back(std::make_unique<connection>(io));
+                boost::asio::connect(connections.back()->socket, endpoints);
+                connections.back()->socket.set_option(boost::asio::ip::tcp::no_delay{ true });
+                read_header(*connections.back());
+            }
+            thread = std::thread{ [this]() { io.run(); } };
+        }
+
+        ~implementation()
+        {
+            std::promise<void> drained;
+            boost::asio::post(io, [&]()
+            {
+                flush();
+                barrier([&]() { drained.set_value(); });
+            });
+            drained.get_future().wait();
+            boost::asio::post(io, [&]()
+            {
+                batchTimer.cancel();
+                work.reset();
+                for (auto& existing : connections)
+                {
+                    boost::system::error_code ignored;
+                    existing->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+                    existing->socket.close(ignored);
+                }
+            });
+            thread.join();
+        }
+
+        template <typename Work>
+        void post(Work&& aWork)
+        {
+            boost::asio::post(io, std::forward<Work>(aWork));
+        }
+
+        std::uint64_t send(message aPayload, response_handler aHandler)
+        {
+            auto const id = reserve();
+            send(id, std::move(aPayload), std::move(aHandler));
+            return id;
+        }
+
+        // a request's place in the order requests are made, taken before it is sent
+        std::uint64_t reserve()
+        {
+            auto const id = nextId++;
+            unfinished.insert(id);
+            return id;
+        }
+
+        void send(std::uint64_t aId, message aPayload, response_handler aHandler)
+        {
+            connection* target = nullptr;
+            for (auto& candidate : connections)
+                if (!candidate->broken && (target == nullptr || candidate->queued.size() + candidate->awaiting.size() < target->queued.size() + target->awaiting.size()))
+                    target = &*candidate;
+            if (target == nullptr)
+            {
+                finish(aId, aHandler, std::make_exception_ptr(connection_lost()), {});
+                return;
+            }
+            message frame(4u);
+            store_little(frame.data(), static_cast<std::uint32_t>(aPayload.size()));
+            frame.insert(frame.end(), aPayload.begin(), aPayload.end());
+            target->queued.push_back(request{ aId, std::move(frame), std::move(aHandler) });
+            if (target->writing.empty())
+                write(*target);
+        }
+
+        // a request that is not batched first sends the batches queued before it
+        void send_unbatched(message aPayload, response_handler aHandler)
+        {
+            flush();
+            send(std::move(aPayload), std::move(aHandler));
+        }
+
+        // The server executes pipelined requests concurrently, so a read of a table made after writes
+        // to it is held back until every request up to the latest of those writes has completed.
+        void send_read(std::string const& aTable, message aPayload, response_handler aHandler)
+        {
+            auto const lastWrite = lastWrites.find(aTable);
+            if (lastWrite == lastWrites.end() || (barriers.empty() && (unfinished.empty() || *unfinished.begin() > lastWrite->second)))
+            {
+                send(std::move(aPayload), std::move(aHandler));
+                return;
+            }
+            auto const id = reserve();
+            barriers.emplace_back(lastWrite->second, [this, id, payload = std::move(aPayload), handler = std::move(aHandler)]() mutable
+            {
+                send(id, std::move(payload), std::move(handler));
+            });
+        }
+
+        void send_write(std::string const& aTable, message aPayload, response_handler aHandler)
+        {
+            lastWrites[aTable] = send(std::move(aPayload), std::move(aHandler));
+        }
+
+        void write(connection& aConnection)
+        {
+            std::vector<boost::asio::const_buffer> buffers;
+            while (!aConnection.queued.empty() && aConnection.awaiting.size() < options.pipelineLimit)
+            {
+                auto& next = aConnection.queued.front();
+                aConnection.awaiting.emplace_back(next.id, std::move(next.handler));
+                aConnection.writing.push_back(std::move(next.frame));
+                buffers.push_back(boost::asio::buffer(aConnection.writing.back()));
+                aConnection.queued.pop_front();
+            }
+            if (buffers.empty())
+                return;
+            boost::asio::async_write(aConnection.socket, buffers, [this, &aConnection](boost::system::error_code const& aError, std::size_t)
+            {
+                aConnection.writing.clear();
+                if (aError)
+                    fail(aConnection);
+                else
+                    write(aConnection);
+            });
+        }
+
+        void read_header(connection& aConnection)
+        {
+            boost::asio::async_read(aConnection.socket, boost::asio::buffer(aConnection.header), [this, &aConnection](boost::system::error_code const& aError, std::size_t)
+            {
+                if (aError)
+                {
+                    fail(aConnection);
+                    return;
+                }
+                aConnection.payload.resize(load_little<std::uint32_t>(aConnection.header.data()));
+                boost::asio::async_read(aConnection.socket, boost::asio::buffer(aConnection.payload), [this, &aConnection](boost::system::error_code const& aError, std::size_t)
+                {
+                    if (aError || aConnection.awaiting.empty())
+                    {
+                        fail(aConnection);
+                        return;
+                    }
+                    auto [id, handler] = std::move(aConnection.awaiting.front());
+                    aConnection.awaiting.pop_front();
+                    std::exception_ptr error;
+                    switch (static_cast<response_status>(aConnection.header[4]))
+                    {
+                    case response_status::Ok:
+                        break;
+                    case response_status::Busy:
+                        error = std::make_exception_ptr(server_busy());
+                        break;
+                    default:
+                        error = std::make_exception_ptr(server_error(std::string{ aConnection.payload.begin(), aConnection.payload.end() }));
+                        break;
+                    }
+                    finish(id, handler, error, std::move(aConnection.payload));
+                    if (aConnection.writing.empty())
+                        write(aConnection);
+                    read_header(aConnection);
+                });
+            });
+        }
+
+        void finish(std::uint64_t aId, response_handler const& aHandler, std::exception_ptr aError, message aPayload)
+        {
+            try
+            {
+                aHandler(aError, std::move(aPayload));
+            }
+            catch (...)
+            {
+                // a completion that throws must not take the I/O thread down
+            }
+            unfinished.erase(aId);
+            while (!barriers.empty() && (unfinished.empty() || *unfinished.begin() > barriers.front().first))
+            {
+                auto released = std::move(barriers.front().second);
+                barriers.pop_front();
+                released();
+            }
+        }
+
+        void fail(connection& aConnection)
+        {
+            if (aConnection.broken)
+                return;
+            aConnection.broken = true;
+            boost::system::error_code ignored;
+            aConnection.socket.close(ignored);
+            auto awaiting = std::move(aConnection.awaiting);
+            auto queued = std::move(aConnection.queued);
+            for (auto& [id, handler] : awaiting)
+                finish(id, handler, std::make_exception_ptr(connection_lost()), {});
+            for (auto& lost : queued)
+                finish(lost.id, lost.handler, std::make_exception_ptr(connection_lost()), {});
+        }
+
+        // Call aWork once every request made so far has completed. Held back work is released in the
+        // order it was held back, which is never later than it could be as each only waits for requests
+        // made before it.
+        void barrier(std::function<void()> aWork)
+        {
+            if (unfinished.empty())
+                aWork();
+            else
+                barriers.emplace_back(nextId - 1u, std::move(aWork));
+        }
+
+        void batched()
+        {
+            if (batchTimerSet)
+                return;
+            batchTimerSet = true;
+            batchTimer.expires_after(options.batchDelay);
+            batchTimer.async_wait([this](boost::system::error_code const& aError)
+            {
+                batchTimerSet = false;
+                if (!aError)
+                    flush();
+            });
+        }
+
+        void flush()
+        {
+            // inserts first so that lookups of a table queued after inserts into it wait for them
+            for (auto& [table, batch] : inserts)
+                send_inserts(table, batch);
+            inserts.clear();
+            for (auto& [table, batch] : finds)
+                send_finds(table, batch);
+            finds.clear();
+        }
+
+        void insert(std::string const& aTable, message aRow, completion<bool> aCompletion)
+        {
+            auto& batch = inserts[aTable];
+            if (!batch.completions.empty() && batch.rowSize != aRow.size())
+                send_inserts(aTable, batch);
+            batch.rowSize = aRow.size();
+            batch.rows.insert(batch.rows.end(), aRow.begin(), aRow.end());
+            batch.completions.push_back(std::move(aCompletion));
+            if (batch.completions.size() >= options.batchRows)
+                send_inserts(aTable, batch);
+            else
+                batched();
+        }
+
+        void send_inserts(std::string const& aTable, insert_batch& aBatch)
+        {
+            if (aBatch.completions.empty())
+                return;
+            auto payload = request_payload(protocol::opcode::Insert, aTable);
+            protocol::writer{ payload }.put(static_cast<std::uint32_t>(aBatch.completions.size())).put_bytes(aBatch.rows.data(), aBatch.rows.size());
+            send_write(aTable, std::move(payload), [completions = std::move(aBatch.completions)](std::exception_ptr aError, message aPayload)
+            {
+                std::uint8_t const* inserted = nullptr;
+                if (!aError)
+                {
+                    try
+                    {
+                        protocol::reader reader{ aPayload };
+                        if (reader.get<std::uint32_t>() != completions.size())
+                            throw bad_message();
+                        inserted = reader.get_bytes(protocol::bitmap_size(completions.size()));
+                    }
+                    catch (...)
+                    {
+                        aError = std::current_exception();
+                    }
+                }
+                for (std::size_t index = 0; index < completions.size(); ++index)
+                    completions[index](aError, !aError && protocol::test_bit(inserted, index));
+            });
+            aBatch = insert_batch{};
+        }
+
+        void find(std::string const& aTable, message aKey, completion<std::optional<row>> aCompletion)
+        {
+            auto& batch = finds[aTable];
+            if (!batch.completions.empty() && batch.keySize != aKey.size())
+                send_finds(aTable, batch);
+            batch.keySize = aKey.size();
+            batch.keys.insert(batch.keys.end(), aKey.begin(), aKey.end());
+            batch.completions.push_back(std::move(aCompletion));
+            if (batch.completions.size() >= options.batchRows)
+                send_finds(aTable, batch);
+            else
+                batched();
+        }
+
+        void send_finds(std::string const& aTable, find_batch& aBatch)
+        {
+            if (aBatch.completions.empty())
+                return;
+            auto payload = request_payload(protocol::opcode::Find, aTable);
+            protocol::writer{ payload }.put(static_cast<std::uint32_t>(aBatch.completions.size())).put_bytes(aBatch.keys.data(), aBatch.keys.size());
+            send_read(aTable, std::move(payload), [completions = std::move(aBatch.completions)](std::exception_ptr aError, message aPayload)
+            {
+                std::vector<std::optional<row>> results(completions.size());
+                if (!aError)
+                {
+                    try
+                    {
+                        protocol::reader reader{ aPayload };
+                        auto const header = reader.get_bytes(sizeof(protocol::row_batch_header));
+                        auto const rowSize = load_little<std::uint32_t>(header);
+                        auto const found = reader.get_bytes(protocol::bitmap_size(completions.size()));
+                        for (std::size_t index = 0; index < completions.size(); ++index)
+                            if (protocol::test_bit(found, index))
+                            {
+                                auto const data = reader.get_bytes(rowSize);
+                                results[index].emplace(data, data + rowSize);
+                            }
+                    }
+                    catch (...)
+                    {
+                        aError = std::current_exception();
+                    }
+                }
+                for (std::size_t index = 0; index < completions.size(); ++index)
+                    completions[index](aError, aError ? std::nullopt : std::move(results[index]));
+            });
+            aBatch = find_batch{};
+        }
+    };
+
+    client::client(std::string const& aHost, unsigned short aPort, client_options const& aOptions) :
+        iImplementation{ std::make_unique<implementation>(aHost, aPort, aOptions) }
+    {
+    }
+
+    client::~client()
+    {
+    }
+
+    std::future<void> client::create_table(i_schema const& aSchema, table_options const& aOptions)
+    {
+        auto [future, completion] = promised<void>();
+        create_table(aSchema, aOptions, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::create_table(i_schema const& aSchema, table_options const& aOptions, completion<void> aCompletion)
+    {
+        message payload;
+        protocol::writer writer{ payload };
+        writer.put(protocol::opcode::CreateTable);
+        protocol::write_table_definition(writer, aSchema, aOptions);
+        iImplementation->post([this, payload = std::move(payload), aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->send_unbatched(std::move(payload), respond<void>(std::move(aCompletion)));
+        });
+    }
+
+    std::future<protocol::table_definition> client::describe_table(std::string const& aTable)
+    {
+        auto [future, completion] = promised<protocol::table_definition>();
+        describe_table(aTable, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::describe_table(std::string const& aTable, completion<protocol::table_definition> aCompletion)
+    {
+        iImplementation->post([this, payload = request_payload(protocol::opcode::DescribeTable, aTable), aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->send_unbatched(std::move(payload), respond<protocol::table_definition>(std::move(aCompletion), [](message const& aPayload)
+            {
+                protocol::reader reader{ aPayload };
+                return protocol::read_table_definition(reader);
+            }));
+        });
+    }
+
+    std::future<bool> client::insert(std::string const& aTable, void const* aRow, std::size_t aRowSize)
+    {
+        auto [future, completion] = promised<bool>();
+        insert(aTable, aRow, aRowSize, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::insert(std::string const& aTable, void const* aRow, std::size_t aRowSize, completion<bool> aCompletion)
+    {
+        auto const bytes = static_cast<std::uint8_t const*>(aRow);
+        iImplementation->post([this, table = aTable, row = message{ bytes, bytes + aRowSize }, aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->insert(table, std::move(row), std::move(aCompletion));
+        });
+    }
+
+    std::future<void> client::bulk_insert(std::string const& aTable, void const* aRows, std::size_t aCount, std::size_t aRowSize)
+    {
+        auto [future, completion] = promised<void>();
+        bulk_insert(aTable, aRows, aCount, aRowSize, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::bulk_insert(std::string const& aTable, void const* aRows, std::size_t aCount, std::size_t aRowSize, completion<void> aCompletion)
+    {
+        auto payload = request_payload(protocol::opcode::BulkInsert, aTable);
+        protocol::writer{ payload }.put(static_cast<std::uint32_t>(aCount)).put_bytes(aRows, aCount * aRowSize);
+        iImplementation->post([this, table = aTable, payload = std::move(payload), aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->flush();
+            iImplementation->send_write(table, std::move(payload), respond<void>(std::move(aCompletion)));
+        });
+    }
+
+    std::future<std::optional<client::row>> client::find(std::string const& aTable, void const* aKey, std::size_t aKeySize)
+    {
+        auto [future, completion] = promised<std::optional<row>>();
+        find(aTable, aKey, aKeySize, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::find(std::string const& aTable, void const* aKey, std::size_t aKeySize, completion<std::optional<row>> aCompletion)
+    {
+        auto const bytes = static_cast<std::uint8_t const*>(aKey);
+        iImplementation->post([this, table = aTable, key = message{ bytes, bytes + aKeySize }, aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->find(table, std::move(key), std::move(aCompletion));
+        });
+    }
+
+    std::future<row_batch> client::scan(std::string const& aTable, key_range const& aRange, std::uint32_t aLimit)
+    {
+        auto [future, completion] = promised<row_batch>();
+        scan(aTable, aRange, aLimit, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::scan(std::string const& aTable, key_range const& aRange, std::uint32_t aLimit, completion<row_batch> aCompletion)
+    {
+        auto payload = request_payload(protocol::opcode::Scan, aTable);
+        protocol::writer writer{ payload };
+        put_range(writer, aRange, true);
+        writer.put(aLimit);
+        iImplementation->post([this, table = aTable, payload = std::move(payload), aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->flush();
+            iImplementation->send_read(table, std::move(payload), respond<row_batch>(std::move(aCompletion), [](message& aPayload)
+            {
+                protocol::reader reader{ aPayload };
+                auto const header = reader.get_bytes(sizeof(protocol::row_batch_header));
+                auto const rowSize = load_little<std::uint32_t>(header);
+                auto const rowCount = load_little<std::uint32_t>(header + 4);
+                bool const more = (header[8] & protocol::More) != 0u;
+                reader.get_bytes(static_cast<std::size_t>(rowSize) * rowCount);
+                return row_batch{ std::move(aPayload), sizeof(protocol::row_batch_header), rowSize, rowCount, more };
+            }));
+        });
+    }
+
+    std::future<std::uint64_t> client::count(std::string const& aTable, key_range const& aRange)
+    {
+        auto [future, completion] = promised<std::uint64_t>();
+        count(aTable, aRange, std::move(completion));
+        return std::move(future);
+    }
+
+    void client::count(std::string const& aTable, key_range const& aRange, completion<std::uint64_t> aCompletion)
+    {
+        auto payload = request_payload(protocol::opcode::Count, aTable);
+        protocol::writer writer{ payload };
+        put_range(writer, aRange, false);
+        iImplementation->post([this, table = aTable, payload = std::move(payload), aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->flush();
+            iImplementation->send_read(table, std::move(payload), respond<std::uint64_t>(std::move(aCompletion), [](message const& aPayload)
+            {
+                return protocol::reader{ aPayload }.get<std::uint64_t>();
+            }));
+        });
+    }
+
+    std::future<void> client::commit()
+    {
+        auto [future, completion] = promised<void>();
+        commit(std::move(completion));
+        return std::move(future);
+    }
+
+    void client::commit(completion<void> aCompletion)
+    {
+        iImplementation->post([this, aCompletion = std::move(aCompletion)]() mutable
+        {
+            iImplementation->flush();
+            iImplementation->barrier([this, aCompletion = std::move(aCompletion)]() mutable
+            {
+                iImplementation->send(request_payload(protocol::opcode::Commit), respond<void>(std::move(aCompletion)));
+            });
+        });
+    }
+
+    void client::flush()
+    {
+        iImplementation->post([this]() { iImplementation->flush(); });
+    }
+}
\ No newline at end of file
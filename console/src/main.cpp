@@ -1,40 +1,197 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#include <iostream>
-
-int main()
-{
-    std::cout << "Hello, world!" << std::endl;
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <neodb/file_database.hpp>
+#include <neodb/delimited_import.hpp>
+
+namespace
+{
+    void usage()
+    {
+        std::cerr <<
+            "usage: console import <database> <table> <file> --columns <columns> [options]\n"
+            "  <columns>        comma separated name:type[:key] where type is one of bool, int8, int16,\n"
+            "                   int32, int64, uint8, uint16, uint32, uint64, float, double, char,\n"
+            "                   char(N), varchar(N), uuid or time, suffixed with ? if nullable\n"
+            "  --tsv            tab separated, unquoted fields\n"
+            "  --delimiter <c>  field delimiter (default ,)\n"
+            "  --header         skip the first line\n"
+            "  --threads <n>    parsing threads (default one per core)\n"
+            "  --columnar       create the table with columnar storage\n";
+    }
+
+    neodb::data_type parse_data_type(std::string_view aName, std::size_t& aLayout)
+    {
+        using neodb::data_type;
+        bool const nullable = !aName.empty() && aName.back() == '?';
+        if (nullable)
+            aName.remove_suffix(1);
+        aLayout = 1;
+        auto sized = [&](std::string_view aPrefix)
+        {
+            if (aName.size() <= aPrefix.size() + 2 || aName.substr(0, aPrefix.size() + 1) != std::string{ aPrefix } + "(" || aName.back() != ')')
+                return false;
+            aLayout = std::stoul(std::string{ aName.substr(aPrefix.size() + 1, aName.size() - aPrefix.size() - 2) });
+            return aLayout != 0;
+        };
+        data_type result;
+        if (aName == "bool") result = data_type::Bool;
+        else if (aName == "int8") result = data_type::Int8;
+        else if (aName == "int16") result = data_type::Int16;
+        else if (aName == "int32") result = data_type::Int32;
+        else if (aName == "int64") result = data_type::Int64;
+        else if (aName == "uint8") result = data_type::Uint8;
+        else if (aName == "uint16") result = data_type::Uint16;
+        else if (aName == "uint32") result = data_type::Uint32;
+        else if (aName == "uint64") result = data_type::Uint64;
+        else if (aName == "float") result = data_type::Float;
+        else if (aName == "double") result = data_type::Double;
+        else if (aName == "char") result = data_type::Char;
+        else if (aName == "uuid") result = data_type::Uuid;
+        else if (aName == "time") result = data_type::Time;
+        else if (sized("char")) result = data_type::CharString;
+        else if (sized("varchar")) result = data_type::VarcharString;
+        else
+            throw std::invalid_argument{ "unknown column type: " + std::string{ aName } };
+        return nullable ? neodb::nullable(result) : result;
+    }
+
+    std::vector<neolib::ref_ptr<neodb::i_field_spec>> parse_columns(std::string_view aColumns)
+    {
+        std::vector<neolib::ref_ptr<neodb::i_field_spec>> result;
+        while (!aColumns.empty())
+        {
+            auto const column = aColumns.substr(0, aColumns.find(','));
+            aColumns.remove_prefix(std::min(aColumns.size(), column.size() + 1));
+            auto const nameEnd = column.find(':');
+            if (nameEnd == std::string_view::npos)
+                throw std::invalid_argument{ "column without a type: " + std::string{ column } };
+            auto type = column.substr(nameEnd + 1);
+            auto const typeEnd = type.find(':');
+            bool const key = typeEnd != std::string_view::npos && type.substr(typeEnd + 1) == "key";
+            if (typeEnd != std::string_view::npos && !key)
+                throw std::invalid_argument{ "bad column: " + std::string{ column } };
+            type = type.substr(0, typeEnd);
+            std::size_t layout;
+            auto const dataType = parse_data_type(type, layout);
+            result.push_back(neolib::make_ref<neodb::dynamic_field_spec>(neodb::string{ std::string{ column.substr(0, nameEnd) } },
+                key ? neodb::field_type::PrimaryKey : neodb::field_type::Datum, dataType, layout));
+        }
+        return result;
+    }
+
+    int import(std::vector<std::string> const& aArguments)
+    {
+        if (aArguments.size() < 4)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        std::string columns;
+        neodb::delimited_import_options importOptions;
+        neodb::table_options tableOptions;
+        for (std::size_t index = 4; index < aArguments.size(); ++index)
+        {
+            auto const& argument = aArguments[index];
+            bool const hasValue = index + 1 < aArguments.size();
+            if (argument == "--columns" && hasValue)
+                columns = aArguments[++index];
+            else if (argument == "--tsv")
+            {
+                importOptions.delimiter = '\t';
+                importOptions.quoted = false;
+            }
+            else if (argument == "--delimiter" && hasValue && aArguments[index + 1].size() == 1u)
+                importOptions.delimiter = aArguments[++index][0];
+            else if (argument == "--header")
+                importOptions.header = true;
+            else if (argument == "--threads" && hasValue)
+                importOptions.threads = std::stoul(aArguments[++index]);
+            else if (argument == "--columnar")
+                tableOptions.storage = neodb::table_storage::Columns;
+            else
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+        if (columns.empty())
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        std::ifstream input{ aArguments[3], std::ios::binary };
+        if (!input)
+        {
+            std::cerr << "cannot open " << aArguments[3] << std::endl;
+            return EXIT_FAILURE;
+        }
+        // room for the pages of a chunk's rows, which stay resident until they are committed
+        neodb::file_database_options databaseOptions;
+        databaseOptions.bufferPoolCapacity = 16384;
+        neodb::file_database database{ aArguments[1], databaseOptions };
+        database.create_table(neodb::schema{ neodb::string{ aArguments[2] }, parse_columns(columns) }, tableOptions);
+        importOptions.inserted = [&](std::uint64_t) { database.commit(); };
+        auto const start = std::chrono::steady_clock::now();
+        auto const rows = neodb::import_delimited(*database.tables().back(), input, importOptions);
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        auto const bytes = static_cast<double>(std::filesystem::file_size(aArguments[3]));
+        std::cout << rows << " rows imported in " << elapsed.count() << "s (" << bytes / 1048576.0 / elapsed.count() << " MiB/s)" << std::endl;
+        return EXIT_SUCCESS;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> const arguments{ argv + std::min(argc, 1), argv + argc };
+    try
+    {
+        if (!arguments.empty() && arguments[0] == "import")
+            return import(arguments);
+        usage();
+        return EXIT_FAILURE;
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
 }
\ No newline at end of file
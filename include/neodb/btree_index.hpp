@@ -0,0 +1,841 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <optional>
+#include <vector>
+#include <utility>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/record.hpp>
+#include <neodb/index_key.hpp>
+
+namespace neodb
+{
+    struct bad_index : std::runtime_error { bad_index() : std::runtime_error{ "neodb::bad_index" } {} };
+
+    // B+tree mapping fixed-width keys that order by memcmp (see index_key.hpp) to 64-bit values (row
+    // record addresses). Each node is an Index record of MAXIMUM_RECORD_CAPACITY holding a header, room
+    // for "order" keys and then room for order + 1 values: child node addresses in branch nodes, one
+    // value per key in leaves. Leaves are chained in key order for range scans. The root address and
+    // height are kept in a small anchor record whose address identifies the index.
+    //
+    // Concurrency is by optimistic lock coupling. Every node has a version latch (from a table of
+    // latches indexed by node address, so none is ever written to storage). Readers note the version,
+    // read the node and check that the version is still the same, restarting if it changed; they
+    // never write a latch. Nor do they pin pages that are already in memory: a node is read in place
+    // from its page's frame (see i_database::peek_page), which is also checked for having been reused
+    // before what was read is trusted. A writer latches only the nodes it modifies: the leaf, and
+    // when that leaf is full, the ancestors that split and the one that takes the new separator.
+    // Nodes are never freed, so an address read from a validated node always leads to a node.
+    class btree_index
+    {
+    public:
+        typedef page::pointer_type pointer_type;
+        typedef std::uint64_t value_type;
+        static constexpr std::size_t NODE_SIZE = MAXIMUM_RECORD_CAPACITY - sizeof(record_header);
+    private:
+        static constexpr std::uint64_t ANCHOR_MAGIC = 0x31305844494F454E; // NEOIDX01
+        struct anchor
+        {
+            little_uint64_t magic;
+            little_uint64_t root;
+            little_uint64_t height;
+            little_uint64_t keyWidth;
+            little_uint64_t order;
+            little_uint64_t count;  // as of the last change of root; recounted on open
+        };
+        struct node_header
+        {
+            little_uint16_t leaf;
+            little_uint16_t count;
+            little_uint32_t reserved;
+            little_uint64_t next;
+        };
+        // An even version, odd while a writer holds the latch.
+        struct alignas(64) latch
+        {
+            std::atomic<std::uint64_t> version{ 0u };
+
+            std::uint64_t read() const
+            {
+                for (;;)
+                {
+                    auto const current = version.load(std::memory_order_acquire);
+                    if ((current & 1u) == 0u)
+                        return current;
+                    std::this_thread::yield();
+                }
+            }
+            bool validate(std::uint64_t aVersion) const
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return version.load(std::memory_order_relaxed) == aVersion;
+            }
+            bool try_lock(std::uint64_t aVersion)
+            {
+                return version.compare_exchange_strong(aVersion, aVersion + 1u, std::memory_order_acquire);
+            }
+            void lock()
+            {
+                while (!try_lock(read()))
+                    ;
+            }
+            void unlock()
+            {
+                version.fetch_add(1u, std::memory_order_release);
+            }
+            // release without a change, so readers that saw the version before the latch still validate
+            void unlock_unchanged()
+            {
+                version.fetch_sub(1u, std::memory_order_release);
+            }
+        };
+        static constexpr std::size_t LATCH_COUNT = 1024;
+        // a branch on the way down to a leaf: the child taken and whether the branch was full
+        struct path_step
+        {
+            pointer_type address;
+            std::uint64_t version;
+            std::size_t slot;
+            bool full;
+        };
+        class node
+        {
+        public:
+            node(btree_index const& aIndex, pointer_type aAddress) :
+                iPage{ std::in_place, aIndex.iDatabase, aAddress - aAddress % page::size },
+                iData{ record_payload(**iPage, aAddress) },
+                iKeyWidth{ aIndex.iKeyWidth },
+                iOrder{ aIndex.iOrder }
+            {
+            }
+            // read only, in a page that is not pinned (see peek_node)
+            node(btree_index const& aIndex, pointer_type aAddress, page const& aPage) :
+                iData{ record_payload(const_cast<page&>(aPage), aAddress) },
+                iKeyWidth{ aIndex.iKeyWidth },
+                iOrder{ aIndex.iOrder }
+            {
+            }
+        public:
+            node_header& header()
+            {
+                return *reinterpret_cast<node_header*>(iData);
+            }
+            bool leaf()
+            {
+                return header().leaf != 0u;
+            }
+            // clamped so that a reader seeing a node mid-change stays within it
+            std::size_t count()
+            {
+                return std::min<std::size_t>(header().count, iOrder);
+            }
+            std::uint8_t* key(std::size_t aSlot)
+            {
+                return iData + sizeof(node_header) + aSlot * iKeyWidth;
+            }
+            little_uint64_t& value(std::size_t aSlot)
+            {
+                return reinterpret_cast<little_uint64_t*>(iData + sizeof(node_header) + iOrder * iKeyWidth)[aSlot];
+            }
+            // first slot whose key is not less than aKey
+            std::size_t lower_bound(void const* aKey)
+            {
+                std::size_t first = 0;
+                for (std::size_t length = count(); length > 0;)
+                {
+                    auto const half = length / 2;
+                    if (std::memcmp(key(first + half), aKey, iKeyWidth) < 0)
+                    {
+                        first += half + 1;
+                        length -= half + 1;
+                    }
+                    else
+                        length = half;
+                }
+                return first;
+            }
+            // first slot whose key is greater than aKey
+            std::size_t upper_bound(void const* aKey)
+            {
+                std::size_t first = 0;
+                for (std::size_t length = count(); length > 0;)
+                {
+                    auto const half = length / 2;
+                    if (std::memcmp(key(first + half), aKey, iKeyWidth) <= 0)
+                    {
+                        first += half + 1;
+                        length -= half + 1;
+                    }
+                    else
+                        length = half;
+                }
+                return first;
+            }
+            void set_dirty()
+            {
+                iPage->set_dirty();
+            }
+        private:
+            std::optional<pinned_page> iPage;
+            std::uint8_t* iData;
+            std::size_t iKeyWidth;
+            std::size_t iOrder;
+        };
+    public:
+        static constexpr std::size_t max_order(std::size_t aKeyWidth)
+        {
+            return (NODE_SIZE - sizeof(node_header) - sizeof(little_uint64_t)) / (aKeyWidth + sizeof(little_uint64_t));
+        }
+    public:
+        // create an empty index; aOrder (maximum keys per node) defaults to as many as fit in a node
+        btree_index(i_database& aDatabase, std::size_t aKeyWidth, std::size_t aOrder = 0) :
+            iDatabase{ aDatabase },
+            iKeyWidth{ aKeyWidth },
+            iOrder{ aOrder == 0 ? max_order(aKeyWidth) : std::min(aOrder, max_order(aKeyWidth)) },
+            iHeight{ 1 },
+            iCount{ 0 },
+            iLatches{ std::make_unique<latch[]>(LATCH_COUNT) }
+        {
+            if (aKeyWidth == 0 || iOrder < 3)
+                throw std::invalid_argument{ "neodb::btree_index: unsupported key width or order" };
+            iAnchor = iDatabase.allocate_record(record_type::Index, sizeof(anchor))->address();
+            iRoot = new_node(true);
+            store_anchor();
+        }
+        // open an existing index
+        btree_index(i_database& aDatabase, pointer_type aAnchor) :
+            iDatabase{ aDatabase },
+            iAnchor{ aAnchor },
+            iLatches{ std::make_unique<latch[]>(LATCH_COUNT) }
+        {
+            pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+            auto const& existing = *reinterpret_cast<anchor const*>(record_payload(*anchorPage, iAnchor));
+            if (existing.magic != ANCHOR_MAGIC)
+                throw bad_index();
+            iRoot = existing.root;
+            iHeight = static_cast<std::size_t>(existing.height);
+            iKeyWidth = static_cast<std::size_t>(existing.keyWidth);
+            iOrder = static_cast<std::size_t>(existing.order);
+            iCount = count_entries();
+        }
+        btree_index(btree_index const&) = delete;
+        btree_index& operator=(btree_index const&) = delete;
+    public:
+        pointer_type anchor_address() const
+        {
+            return iAnchor;
+        }
+        std::size_t key_width() const
+        {
+            return iKeyWidth;
+        }
+        std::size_t order() const
+        {
+            return iOrder;
+        }
+        std::size_t height() const
+        {
+            return iHeight.load(std::memory_order_acquire);
+        }
+        std::uint64_t size() const
+        {
+            return iCount.load(std::memory_order_acquire);
+        }
+    public:
+        // reads one node per level
+        std::optional<value_type> find(void const* aKey) const
+        {
+            for (;;)
+            {
+                pointer_type leafAddress;
+                std::uint64_t version;
+                if (!descend(aKey, nullptr, leafAddress, version))
+                    continue;
+                std::optional<value_type> result;
+                bool const read = peek_node(leafAddress, [&](node& aLeaf)
+                {
+                    auto const slot = aLeaf.lower_bound(aKey);
+                    if (slot < aLeaf.count() && std::memcmp(aLeaf.key(slot), aKey, iKeyWidth) == 0)
+                        result = static_cast<value_type>(aLeaf.value(slot));
+                });
+                if (read && latch_of(leafAddress).validate(version))
+                    return result;
+            }
+        }
+        // replace the value of an existing key; returns false if it is not in the index
+        bool assign(void const* aKey, value_type aValue)
+        {
+            for (;;)
+            {
+                pointer_type leafAddress;
+                std::uint64_t version;
+                if (!descend(aKey, nullptr, leafAddress, version))
+                    continue;
+                node leaf{ *this, leafAddress };
+                auto const slot = leaf.lower_bound(aKey);
+                bool const found = slot < leaf.count() && std::memcmp(leaf.key(slot), aKey, iKeyWidth) == 0;
+                if (!latch_of(leafAddress).validate(version))
+                    continue;
+                if (!found)
+                    return false;
+                if (!latch_of(leafAddress).try_lock(version))
+                    continue;
+                leaf.value(slot) = aValue;
+                leaf.set_dirty();
+                latch_of(leafAddress).unlock();
+                return true;
+            }
+        }
+        void insert(void const* aKey, value_type aValue)
+        {
+            for (;;)
+            {
+                std::vector<path_step> path;
+                pointer_type leafAddress;
+                std::uint64_t version;
+                if (!descend(aKey, &path, leafAddress, version))
+                    continue;
+                {
+                    node leaf{ *this, leafAddress };
+                    auto const slot = leaf.lower_bound(aKey);
+                    bool const duplicate = slot < leaf.count() && std::memcmp(leaf.key(slot), aKey, iKeyWidth) == 0;
+                    bool const full = leaf.count() >= iOrder;
+                    if (!latch_of(leafAddress).validate(version))
+                        continue;
+                    if (duplicate)
+                        throw duplicate_key();
+                    if (!full)
+                    {
+                        if (!latch_of(leafAddress).try_lock(version))
+                            continue;
+                        insert_entry(leaf, slot, aKey, aValue);
+                        latch_of(leafAddress).unlock();
+                        ++iCount;
+                        return;
+                    }
+                }
+                if (split_path(aKey, aValue, path, leafAddress, version))
+                {
+                    ++iCount;
+                    return;
+                }
+            }
+        }
+        // Build an empty index bottom-up from aCount entries whose keys (aCount * key_width() bytes) are
+        // strictly increasing. Leaves are filled left to right with up to aFill entries (by default the
+        // order) and each level of branches above them likewise, so no node is ever split; entries are
+        // spread evenly over each level's nodes so the last one is not left nearly empty.
+        void bulk_load(void const* aKeys, value_type const* aValues, std::size_t aCount, std::size_t aFill = 0)
+        {
+            // an empty index is a single leaf; latching it holds off inserts until the load is done
+            pointer_type const root = iRoot.load(std::memory_order_acquire);
+            auto& rootLatch = latch_of(root);
+            rootLatch.lock();
+            bool empty;
+            {
+                node rootNode{ *this, root };
+                empty = rootNode.leaf() && rootNode.count() == 0u;
+            }
+            if (!empty)
+            {
+                rootLatch.unlock_unchanged();
+                throw std::logic_error{ "neodb::btree_index::bulk_load: index not empty" };
+            }
+            try
+            {
+                load(root, aKeys, aValues, aCount, aFill);
+            }
+            catch (...)
+            {
+                rootLatch.unlock();
+                throw;
+            }
+            rootLatch.unlock();
+        }
+        // Visit entries with keys in [aLow, aHigh] in key order (a null bound is unbounded) until aVisitor,
+        // called as aVisitor(std::uint8_t const* aKey, value_type aValue), returns false. Each leaf's
+        // entries are copied out before they are visited so the visitor runs with nothing latched;
+        // entries inserted concurrently may or may not be visited.
+        template <typename Visitor>
+        void scan(void const* aLow, void const* aHigh, Visitor aVisitor) const
+        {
+            pointer_type address;
+            std::uint64_t version;
+            while (!descend(aLow, nullptr, address, version))
+                ;
+            std::vector<std::uint8_t> keys(iOrder * iKeyWidth);
+            std::vector<value_type> values(iOrder);
+            std::vector<std::uint8_t> last;
+            while (address != 0u)
+            {
+                std::size_t first = 0;
+                std::size_t end = 0;
+                bool beyond = false;
+                pointer_type next = 0u;
+                read_node(address, [&](node& aLeaf)
+                {
+                    first = !last.empty() ? aLeaf.upper_bound(last.data()) : aLow != nullptr ? aLeaf.lower_bound(aLow) : 0u;
+                    end = aHigh != nullptr ? aLeaf.upper_bound(aHigh) : aLeaf.count();
+                    beyond = end < aLeaf.count();
+                    end = std::max(first, end);
+                    std::memcpy(keys.data(), aLeaf.key(first), (end - first) * iKeyWidth);
+                    for (std::size_t slot = first; slot < end; ++slot)
+                        values[slot - first] = aLeaf.value(slot);
+                    next = aLeaf.header().next;
+                });
+                for (std::size_t entry = 0; entry < end - first; ++entry)
+                    if (!aVisitor(static_cast<std::uint8_t const*>(&keys[entry * iKeyWidth]), values[entry]))
+                        return;
+                if (beyond)
+                    return;
+                if (end != first)
+                    last.assign(&keys[(end - first - 1) * iKeyWidth], &keys[(end - first) * iKeyWidth]);
+                address = next;
+            }
+        }
+        // Keys dividing the index into at most aParts key ranges, each covering a run of leaves of about
+        // the same length (morsels for a parallel scan), back to back in key order. They are separators
+        // taken from the branch levels, going no deeper than needed to have aParts - 1 of them, so only
+        // branch nodes are read. A node that splits while the levels are read keeps the lower part of
+        // its key range so the separators still come out in order, merely missing the new sibling's.
+        std::vector<std::uint8_t> partition(std::size_t aParts) const
+        {
+            std::vector<std::uint8_t> separators;
+            std::vector<pointer_type> level{ iRoot.load(std::memory_order_acquire) };
+            // the separators found so far lie between consecutive nodes of the level below them
+            for (bool branches = true; branches && separators.size() / iKeyWidth + 1 < aParts;)
+            {
+                std::vector<std::uint8_t> merged;
+                std::vector<pointer_type> children;
+                for (std::size_t index = 0; branches && index < level.size(); ++index)
+                {
+                    auto const mergedSize = merged.size();
+                    auto const childCount = children.size();
+                    read_node(level[index], [&](node& aBranch)
+                    {
+                        merged.resize(mergedSize);
+                        children.resize(childCount);
+                        branches = !aBranch.leaf();
+                        if (!branches)
+                            return;
+                        merged.insert(merged.end(), aBranch.key(0), aBranch.key(0) + aBranch.count() * iKeyWidth);
+                        for (std::size_t slot = 0; slot <= aBranch.count(); ++slot)
+                            children.push_back(aBranch.value(slot));
+                    });
+                    if (branches && index + 1 < level.size())
+                        merged.insert(merged.end(), &separators[index * iKeyWidth], &separators[(index + 1) * iKeyWidth]);
+                }
+                if (!branches)
+                    break;
+                separators = std::move(merged);
+                level = std::move(children);
+            }
+            auto const available = separators.size() / iKeyWidth;
+            if (aParts == 0 || available < aParts)
+                return separators;
+            std::vector<std::uint8_t> result((aParts - 1) * iKeyWidth);
+            for (std::size_t part = 1; part < aParts; ++part)
+            {
+                auto const chosen = (available + 1) * part / aParts - 1;
+                std::memcpy(&result[(part - 1) * iKeyWidth], &separators[chosen * iKeyWidth], iKeyWidth);
+            }
+            return result;
+        }
+    private:
+        latch& latch_of(pointer_type aNode) const
+        {
+            return iLatches[(static_cast<std::uint64_t>(aNode) / MAXIMUM_RECORD_CAPACITY * 0x9E3779B97F4A7C15ull) >> 54];
+        }
+        // Find the leaf that holds aKey (the leftmost leaf if aKey is null) and the version of it that
+        // was seen, noting the branches passed in aPath. Each child address is used only once its
+        // parent has been validated; false if a node changed on the way and the descent must restart.
+        bool descend(void const* aKey, std::vector<path_step>* aPath, pointer_type& aLeaf, std::uint64_t& aVersion) const
+        {
+            pointer_type address = iRoot.load(std::memory_order_acquire);
+            auto version = latch_of(address).read();
+            if (iRoot.load(std::memory_order_acquire) != address)
+                return false;
+            for (;;)
+            {
+                bool leaf = false;
+                std::size_t slot = 0u;
+                pointer_type child = 0u;
+                bool full = false;
+                if (!peek_node(address, [&](node& aCurrent)
+                {
+                    leaf = aCurrent.leaf();
+                    if (leaf)
+                        return;
+                    slot = aKey != nullptr ? aCurrent.upper_bound(aKey) : 0u;
+                    child = aCurrent.value(slot);
+                    full = aCurrent.count() >= iOrder;
+                }))
+                    return false;
+                if (leaf)
+                {
+                    aLeaf = address;
+                    aVersion = version;
+                    return true;
+                }
+                if (aPath != nullptr)
+                    aPath->push_back(path_step{ address, version, slot, full });
+                auto const childVersion = latch_of(child).read();
+                if (!latch_of(address).validate(version))
+                    return false;
+                address = child;
+                version = childVersion;
+            }
+        }
+        // call aRead with the node at aAddress until it reads the node without it changing
+        template <typename Read>
+        void read_node(pointer_type aAddress, Read aRead) const
+        {
+            auto& nodeLatch = latch_of(aAddress);
+            for (;;)
+            {
+                auto const version = nodeLatch.read();
+                if (peek_node(aAddress, aRead) && nodeLatch.validate(version))
+                    return;
+            }
+        }
+        // Call aRead with the node at aAddress, read in place if its page is in memory and pinned only if
+        // not; false if the page's frame was reused meanwhile so what aRead saw must be thrown away. The
+        // caller still validates the node's latch.
+        template <typename Read>
+        bool peek_node(pointer_type aAddress, Read aRead) const
+        {
+            page_peek peek;
+            if (!iDatabase.peek_page(aAddress - aAddress % page::size, peek))
+            {
+                node pinned{ *this, aAddress };
+                aRead(pinned);
+                return true;
+            }
+            node current{ *this, aAddress, *peek.contents };
+            aRead(current);
+            return peek.unchanged();
+        }
+        // Insert into the full leaf found by a descent, splitting it and the full branches above it.
+        // The nodes that change (up to the nearest branch with room, or all of them and the root) are
+        // latched at the versions the descent saw; false if any has changed since.
+        bool split_path(void const* aKey, value_type aValue, std::vector<path_step> const& aPath, pointer_type aLeaf, std::uint64_t aVersion)
+        {
+            auto top = aPath.size();
+            while (top > 0 && aPath[top - 1].full)
+                --top;
+            std::vector<latch*> held;
+            auto const release = [&]()
+            {
+                for (auto existing = held.rbegin(); existing != held.rend(); ++existing)
+                    (**existing).unlock_unchanged();
+            };
+            auto const acquire = [&](pointer_type aNode, std::uint64_t aNodeVersion)
+            {
+                auto& nodeLatch = latch_of(aNode);
+                if (std::find(held.begin(), held.end(), &nodeLatch) != held.end())
+                    return nodeLatch.version.load(std::memory_order_relaxed) == aNodeVersion + 1u;
+                if (!nodeLatch.try_lock(aNodeVersion))
+                    return false;
+                held.push_back(&nodeLatch);
+                return true;
+            };
+            for (auto step = top > 0 ? top - 1 : 0u; step < aPath.size(); ++step)
+                if (!acquire(aPath[step].address, aPath[step].version))
+                {
+                    release();
+                    return false;
+                }
+            if (!acquire(aLeaf, aVersion))
+            {
+                release();
+                return false;
+            }
+            std::vector<std::uint8_t> separator(iKeyWidth);
+            pointer_type sibling = split_leaf(aLeaf, aKey, aValue, separator.data());
+            bool placed = false;
+            for (auto step = aPath.size(); !placed && step > 0; --step)
+            {
+                auto const& [parent, parentVersion, slot, full] = aPath[step - 1];
+                if (!full)
+                {
+                    node branch{ *this, parent };
+                    insert_child(branch, slot, separator.data(), sibling);
+                    placed = true;
+                }
+                else
+                    sibling = split_branch(parent, slot, separator.data(), sibling);
+            }
+            if (!placed)
+            {
+                auto const oldRoot = iRoot.load(std::memory_order_relaxed);
+                auto const newRoot = new_node(false);
+                {
+                    node root{ *this, newRoot };
+                    std::memcpy(root.key(0), separator.data(), iKeyWidth);
+                    root.value(0) = oldRoot;
+                    root.value(1) = sibling;
+                    root.header().count = 1u;
+                    root.set_dirty();
+                }
+                iRoot.store(newRoot, std::memory_order_release);
+                ++iHeight;
+                store_anchor();
+            }
+            for (auto existing = held.rbegin(); existing != held.rend(); ++existing)
+                (**existing).unlock();
+            return true;
+        }
+        // bulk_load with the empty root leaf latched
+        void load(pointer_type aRoot, void const* aKeys, value_type const* aValues, std::size_t aCount, std::size_t aFill)
+        {
+            auto const keys = static_cast<std::uint8_t const*>(aKeys);
+            for (std::size_t index = 1; index < aCount; ++index)
+            {
+                auto const order = std::memcmp(keys + (index - 1) * iKeyWidth, keys + index * iKeyWidth, iKeyWidth);
+                if (order == 0)
+                    throw duplicate_key();
+                if (order > 0)
+                    throw std::invalid_argument{ "neodb::btree_index::bulk_load: keys not in order" };
+            }
+            if (aCount == 0)
+                return;
+            std::size_t const fill = aFill == 0 ? iOrder : std::clamp<std::size_t>(aFill, 2u, iOrder);
+            // each level's nodes with the entry index of the smallest key beneath them
+            std::vector<pointer_type> level;
+            std::vector<std::size_t> firsts;
+            std::size_t const leafCount = (aCount + fill - 1) / fill;
+            for (std::size_t leafIndex = 0, begin = 0; leafIndex < leafCount; ++leafIndex)
+            {
+                std::size_t const end = aCount * (leafIndex + 1) / leafCount;
+                auto const address = leafIndex == 0 ? aRoot : new_node(true);
+                {
+                    node leaf{ *this, address };
+                    std::memcpy(leaf.key(0), keys + begin * iKeyWidth, (end - begin) * iKeyWidth);
+                    for (std::size_t entry = begin; entry < end; ++entry)
+                        leaf.value(entry - begin) = aValues[entry];
+                    leaf.header().count = static_cast<std::uint16_t>(end - begin);
+                    leaf.set_dirty();
+                }
+                if (!level.empty())
+                {
+                    node previous{ *this, level.back() };
+                    previous.header().next = address;
+                    previous.set_dirty();
+                }
+                level.push_back(address);
+                firsts.push_back(begin);
+                begin = end;
+            }
+            while (level.size() > 1)
+            {
+                std::vector<pointer_type> parents;
+                std::vector<std::size_t> parentFirsts;
+                std::size_t const branchCount = (level.size() + fill) / (fill + 1);
+                for (std::size_t branchIndex = 0, begin = 0; branchIndex < branchCount; ++branchIndex)
+                {
+                    std::size_t const end = level.size() * (branchIndex + 1) / branchCount;
+                    auto const address = new_node(false);
+                    node branch{ *this, address };
+                    for (std::size_t child = begin; child < end; ++child)
+                    {
+                        if (child != begin)
+                            std::memcpy(branch.key(child - begin - 1), keys + firsts[child] * iKeyWidth, iKeyWidth);
+                        branch.value(child - begin) = level[child];
+                    }
+                    branch.header().count = static_cast<std::uint16_t>(end - begin - 1);
+                    branch.set_dirty();
+                    parents.push_back(address);
+                    parentFirsts.push_back(firsts[begin]);
+                    begin = end;
+                }
+                level.swap(parents);
+                firsts.swap(parentFirsts);
+                ++iHeight;
+            }
+            iRoot.store(level[0], std::memory_order_release);
+            iCount = aCount;
+            store_anchor();
+        }
+        std::uint64_t count_entries() const
+        {
+            pointer_type address = iRoot.load(std::memory_order_acquire);
+            for (;;)
+            {
+                node current{ *this, address };
+                if (current.leaf())
+                    break;
+                address = current.value(0);
+            }
+            std::uint64_t result = 0;
+            while (address != 0u)
+            {
+                node leaf{ *this, address };
+                result += leaf.count();
+                address = leaf.header().next;
+            }
+            return result;
+        }
+        pointer_type new_node(bool aLeaf)
+        {
+            auto const address = iDatabase.allocate_record(record_type::Index, NODE_SIZE)->address();
+            node newNode{ *this, address };
+            newNode.header() = node_header{};
+            newNode.header().leaf = aLeaf ? 1u : 0u;
+            newNode.set_dirty();
+            return address;
+        }
+        // The anchor only has to change with the root, so writers do not all dirty its page.
+        void store_anchor()
+        {
+            std::scoped_lock lock{ iAnchorMutex };
+            pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+            auto& existing = *reinterpret_cast<anchor*>(record_payload(*anchorPage, iAnchor));
+            existing.magic = ANCHOR_MAGIC;
+            existing.root = iRoot.load(std::memory_order_acquire);
+            existing.height = iHeight.load(std::memory_order_acquire);
+            existing.keyWidth = iKeyWidth;
+            existing.order = iOrder;
+            existing.count = iCount.load(std::memory_order_acquire);
+            anchorPage.set_dirty();
+        }
+        void insert_entry(node& aLeaf, std::size_t aSlot, void const* aKey, value_type aValue)
+        {
+            auto const count = aLeaf.count();
+            std::memmove(aLeaf.key(aSlot + 1), aLeaf.key(aSlot), (count - aSlot) * iKeyWidth);
+            std::memmove(&aLeaf.value(aSlot + 1), &aLeaf.value(aSlot), (count - aSlot) * sizeof(little_uint64_t));
+            std::memcpy(aLeaf.key(aSlot), aKey, iKeyWidth);
+            aLeaf.value(aSlot) = aValue;
+            aLeaf.header().count = static_cast<std::uint16_t>(count + 1);
+            aLeaf.set_dirty();
+        }
+        // insert aKey at aSlot with aChild (holding keys not less than aKey) to its right
+        void insert_child(node& aBranch, std::size_t aSlot, void const* aKey, pointer_type aChild)
+        {
+            auto const count = aBranch.count();
+            std::memmove(aBranch.key(aSlot + 1), aBranch.key(aSlot), (count - aSlot) * iKeyWidth);
+            std::memmove(&aBranch.value(aSlot + 2), &aBranch.value(aSlot + 1), (count - aSlot) * sizeof(little_uint64_t));
+            std::memcpy(aBranch.key(aSlot), aKey, iKeyWidth);
+            aBranch.value(aSlot + 1) = aChild;
+            aBranch.header().count = static_cast<std::uint16_t>(count + 1);
+            aBranch.set_dirty();
+        }
+        // Split a full leaf inserting a new entry; returns the new right sibling and its first key.
+        pointer_type split_leaf(pointer_type aLeaf, void const* aKey, value_type aValue, std::uint8_t* aSeparator)
+        {
+            auto const sibling = new_node(true);
+            node left{ *this, aLeaf };
+            node right{ *this, sibling };
+            auto const count = left.count();
+            auto const slot = left.lower_bound(aKey);
+            std::size_t const leftCount = (count + 1) / 2;
+            if (slot < leftCount)
+            {
+                // the new entry lands in the left half which gives up one more existing entry
+                auto const moved = count - (leftCount - 1);
+                std::memcpy(right.key(0), left.key(leftCount - 1), moved * iKeyWidth);
+                std::memcpy(&right.value(0), &left.value(leftCount - 1), moved * sizeof(little_uint64_t));
+                right.header().count = static_cast<std::uint16_t>(moved);
+                left.header().count = static_cast<std::uint16_t>(leftCount - 1);
+                insert_entry(left, slot, aKey, aValue);
+            }
+            else
+            {
+                auto const moved = count - leftCount;
+                std::memcpy(right.key(0), left.key(leftCount), moved * iKeyWidth);
+                std::memcpy(&right.value(0), &left.value(leftCount), moved * sizeof(little_uint64_t));
+                right.header().count = static_cast<std::uint16_t>(moved);
+                left.header().count = static_cast<std::uint16_t>(leftCount);
+                insert_entry(right, slot - leftCount, aKey, aValue);
+            }
+            right.header().next = left.header().next;
+            left.header().next = sibling;
+            std::memcpy(aSeparator, right.key(0), iKeyWidth);
+            left.set_dirty();
+            right.set_dirty();
+            return sibling;
+        }
+        // Split a full branch inserting aKey/aChild at aSlot; returns the new right sibling with the key
+        // promoted to the parent in aKey.
+        pointer_type split_branch(pointer_type aBranch, std::size_t aSlot, std::uint8_t* aKey, pointer_type aChild)
+        {
+            auto const sibling = new_node(false);
+            node left{ *this, aBranch };
+            node right{ *this, sibling };
+            auto const count = left.count();
+            // gather the count + 1 keys and count + 2 children then deal them out around the middle key
+            std::vector<std::uint8_t> keys((count + 1) * iKeyWidth);
+            std::vector<pointer_type> children(count + 2);
+            std::memcpy(&keys[0], left.key(0), aSlot * iKeyWidth);
+            std::memcpy(&keys[aSlot * iKeyWidth], aKey, iKeyWidth);
+            std::memcpy(&keys[(aSlot + 1) * iKeyWidth], left.key(aSlot), (count - aSlot) * iKeyWidth);
+            for (std::size_t index = 0, source = 0; index < count + 2; ++index)
+                children[index] = index == aSlot + 1 ? pointer_type{ aChild } : pointer_type{ left.value(source++) };
+            std::size_t const leftCount = (count + 1) / 2;
+            std::size_t const rightCount = count - leftCount;
+            std::memcpy(left.key(0), &keys[0], leftCount * iKeyWidth);
+            for (std::size_t index = 0; index <= leftCount; ++index)
+                left.value(index) = children[index];
+            std::memcpy(right.key(0), &keys[(leftCount + 1) * iKeyWidth], rightCount * iKeyWidth);
+            for (std::size_t index = 0; index <= rightCount; ++index)
+                right.value(index) = children[leftCount + 1 + index];
+            left.header().count = static_cast<std::uint16_t>(leftCount);
+            right.header().count = static_cast<std::uint16_t>(rightCount);
+            std::memcpy(aKey, &keys[leftCount * iKeyWidth], iKeyWidth);
+            left.set_dirty();
+            right.set_dirty();
+            return sibling;
+        }
+    private:
+        i_database& iDatabase;
+        pointer_type iAnchor;
+        std::atomic<std::uint64_t> iRoot;
+        std::size_t iKeyWidth;
+        std::size_t iOrder;
+        std::atomic<std::size_t> iHeight;
+        std::atomic<std::uint64_t> iCount;
+        std::unique_ptr<latch[]> iLatches;
+        std::mutex iAnchorMutex;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,386 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_page_io.hpp>
+
+namespace neodb
+{
+    struct buffer_pool_exhausted : std::runtime_error { buffer_pool_exhausted() : std::runtime_error{ "neodb::buffer_pool_exhausted" } {} };
+    struct page_not_resident : std::logic_error { page_not_resident() : std::logic_error{ "neodb::page_not_resident" } {} };
+
+    struct buffer_pool_stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t writeBacks = 0;
+    };
+
+    // Fixed number of page frames between a database and its page I/O; victims are chosen by CLOCK
+    // (second chance) so a frame that is touched between two sweeps of the hand survives.
+    //
+    // Resident pages can also be peeked at without the mutex or a pin: a table of hints indexed by page
+    // address suggests a frame, which each frame confirms by publishing the page it holds once its
+    // contents are in place. A frame's stamp is bumped before its contents are replaced, so a peek
+    // that reads a frame as it is reused finds the stamp changed and is retried.
+    class buffer_pool
+    {
+    public:
+        typedef page::pointer_type pointer_type;
+        static constexpr std::size_t DEFAULT_CAPACITY = 1024;
+    private:
+        static constexpr std::uint64_t NO_PAGE = ~std::uint64_t{};
+        struct frame
+        {
+            page contents;
+            std::unique_ptr<page> base;
+            std::uint64_t address = NO_PAGE;
+            std::uint32_t pinCount = 0;
+            bool dirty = false;
+            bool referenced = false;
+            std::atomic<std::uint64_t> resident{ NO_PAGE };
+            std::atomic<std::uint64_t> stamp{ 0u };
+        };
+    public:
+        buffer_pool(i_page_io& aIo, std::size_t aCapacity = DEFAULT_CAPACITY) :
+            iIo{ aIo },
+            iCapacity{ std::max<std::size_t>(aCapacity, 1) },
+            iFrames{ std::make_unique<frame[]>(iCapacity) },
+            iHand{ 0 },
+            iHintMask{ std::bit_ceil(iCapacity * 2) - 1 },
+            iHints{ std::make_unique<std::atomic<std::size_t>[]>(iHintMask + 1) }
+        {
+            iPageTable.reserve(iCapacity);
+        }
+        buffer_pool(buffer_pool const&) = delete;
+        buffer_pool& operator=(buffer_pool const&) = delete;
+    public:
+        std::size_t capacity() const
+        {
+            return iCapacity;
+        }
+        buffer_pool_stats stats() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iStats;
+        }
+        void reset_stats()
+        {
+            std::scoped_lock lock{ iMutex };
+            iStats = {};
+        }
+    public:
+        page& pin(pointer_type aAddress)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto existing = iPageTable.find(aAddress);
+            if (existing != iPageTable.end())
+            {
+                ++iStats.hits;
+                auto& f = iFrames[existing->second];
+                ++f.pinCount;
+                f.referenced = true;
+                capture_base(f);
+                return f.contents;
+            }
+            ++iStats.misses;
+            auto& f = claim(aAddress);
+            try
+            {
+                iIo.read_page(aAddress, f.contents);
+            }
+            catch (...)
+            {
+                iPageTable.erase(f.address);
+                reset(f);
+                throw;
+            }
+            publish(f);
+            capture_base(f);
+            return f.contents;
+        }
+        // Pin a frame for a page that has just been allocated; nothing is read, the frame starts zeroed and dirty.
+        page& pin_new(pointer_type aAddress)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto existing = iPageTable.find(aAddress);
+            auto& f = (existing != iPageTable.end() ? iFrames[existing->second] : claim(aAddress));
+            if (existing != iPageTable.end())
+            {
+                ++f.pinCount;
+                f.referenced = true;
+                retire(f);
+            }
+            f.contents.clear();
+            f.dirty = true;
+            publish(f);
+            capture_base(f);
+            return f.contents;
+        }
+        void unpin(pointer_type aAddress, bool aDirty)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto existing = iPageTable.find(aAddress);
+            if (existing == iPageTable.end())
+                throw page_not_resident();
+            auto& f = iFrames[existing->second];
+            if (f.pinCount == 0)
+                throw page_not_resident();
+            --f.pinCount;
+            f.dirty = f.dirty || aDirty;
+        }
+        // Drop any frame for a page that has been freed; its contents are never written back.
+        void discard(pointer_type aAddress)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto existing = iPageTable.find(aAddress);
+            if (existing == iPageTable.end())
+                return;
+            auto& f = iFrames[existing->second];
+            if (f.pinCount != 0)
+                throw std::logic_error{ "neodb::buffer_pool::discard: page is pinned" };
+            iPageTable.erase(existing);
+            reset(f);
+        }
+        // While change tracking is on, the first pin of a page after it was last collected snapshots the
+        // page so collect_changes() can diff against it; a frame holding changes that have not been
+        // collected is never chosen as an eviction victim.
+        void track_changes(bool aTrackChanges)
+        {
+            std::scoped_lock lock{ iMutex };
+            iTrackChanges = aTrackChanges;
+        }
+        // Dirty frames whose page carries an LSN beyond aLsn are not chosen as eviction victims, so a page
+        // never reaches storage ahead of the log record describing it. The limit only ever rises.
+        void set_durable_lsn(std::uint64_t aLsn)
+        {
+            std::scoped_lock lock{ iMutex };
+            iDurableLsn = std::max(iDurableLsn, aLsn);
+        }
+        // Call aVisitor(address, base, current) for every page that may have changed since it was last
+        // collected; the visitor returns whether it did. The page then becomes evictable once its LSN is
+        // durable.
+        template <typename Visitor>
+        void collect_changes(Visitor aVisitor)
+        {
+            std::scoped_lock lock{ iMutex };
+            for (std::size_t index = 0; index < iCapacity; ++index)
+            {
+                auto& f = iFrames[index];
+                if (!f.base)
+                    continue;
+                if ((f.dirty || f.pinCount != 0) && aVisitor(static_cast<pointer_type>(f.address), static_cast<page const&>(*f.base), f.contents))
+                    f.dirty = true;
+                if (f.pinCount != 0)
+                    *f.base = f.contents;
+                else
+                    f.base.reset();
+            }
+        }
+        // Write back every dirty frame as one batch so the page I/O can overlap the transfers; the caller
+        // makes sure the log is durable first. While changes are tracked a frame that may hold changes
+        // not yet collected is written as it was when they were last collected, and stays dirty.
+        void flush()
+        {
+            std::scoped_lock lock{ iMutex };
+            std::vector<page_write> writes;
+            std::vector<frame*> written;
+            for (std::size_t index = 0; index < iCapacity; ++index)
+            {
+                auto& f = iFrames[index];
+                if (f.address != NO_PAGE && f.dirty)
+                {
+                    writes.push_back(page_write{ f.address, f.base ? f.base.get() : &f.contents });
+                    if (!f.base)
+                        written.push_back(&f);
+                }
+            }
+            if (writes.empty())
+                return;
+            iIo.write_pages(writes.data(), writes.size());
+            for (auto* f : written)
+                f->dirty = false;
+            iStats.writeBacks += writes.size();
+        }
+        // Read any of the given pages that are not resident as one batch, leaving them unpinned; used
+        // ahead of scans so their page reads overlap.
+        void prefetch(pointer_type const* aAddresses, std::size_t aCount)
+        {
+            std::scoped_lock lock{ iMutex };
+            std::vector<page_read> reads;
+            std::vector<frame*> claimed;
+            try
+            {
+                for (std::size_t index = 0; index < aCount && claimed.size() < iCapacity / 2; ++index)
+                {
+                    if (iPageTable.find(aAddresses[index]) != iPageTable.end())
+                        continue;
+                    auto& f = claim(aAddresses[index]);
+                    reads.push_back(page_read{ aAddresses[index], &f.contents });
+                    claimed.push_back(&f);
+                }
+                iStats.misses += reads.size();
+                if (!reads.empty())
+                    iIo.read_pages(reads.data(), reads.size());
+            }
+            catch (...)
+            {
+                // a frame claimed but not read still holds its previous page's contents
+                for (auto* f : claimed)
+                {
+                    iPageTable.erase(f->address);
+                    reset(*f);
+                }
+                throw;
+            }
+            for (auto* f : claimed)
+            {
+                f->pinCount = 0;
+                publish(*f);
+            }
+        }
+        // The frame holding aAddress if it is resident, without pinning it or taking the mutex; false
+        // if no frame is known to hold it, in which case the caller pins the page instead.
+        bool peek(pointer_type aAddress, page_peek& aPeek) const
+        {
+            auto const hint = iHints[hint_of(aAddress)].load(std::memory_order_relaxed);
+            if (hint == 0u)
+                return false;
+            auto const& f = iFrames[hint - 1u];
+            // a frame's stamp is bumped after it stops publishing its page, so a stamp read before
+            // the page is seen published still belongs to that page
+            auto const stamp = f.stamp.load(std::memory_order_acquire);
+            if (f.resident.load(std::memory_order_acquire) != aAddress)
+                return false;
+            aPeek = page_peek{ &f.contents, &f.stamp, stamp };
+            return true;
+        }
+    private:
+        frame& claim(pointer_type aAddress)
+        {
+            auto& f = iFrames[victim()];
+            if (f.address != NO_PAGE)
+            {
+                if (f.dirty)
+                    write_back(f);
+                iPageTable.erase(f.address);
+                retire(f);
+                ++iStats.evictions;
+            }
+            f.base.reset();
+            f.address = aAddress;
+            f.pinCount = 1;
+            f.dirty = false;
+            f.referenced = true;
+            iPageTable[aAddress] = static_cast<std::size_t>(&f - &iFrames[0]);
+            return f;
+        }
+        std::size_t victim()
+        {
+            // two full sweeps: the first clears reference bits, the second must then find an unpinned frame
+            for (std::size_t step = 0; step < iCapacity * 2; ++step)
+            {
+                auto const candidate = iHand;
+                iHand = (iHand + 1) % iCapacity;
+                auto& f = iFrames[candidate];
+                if (f.pinCount != 0 || (f.dirty && (f.base || f.contents.header.lsn > iDurableLsn)))
+                    continue;
+                if (f.address == NO_PAGE || !f.referenced)
+                    return candidate;
+                f.referenced = false;
+            }
+            throw buffer_pool_exhausted();
+        }
+        std::size_t hint_of(pointer_type aAddress) const
+        {
+            return static_cast<std::size_t>((aAddress / page::size * 0x9E3779B97F4A7C15ull) >> 32) & iHintMask;
+        }
+        // the frame's contents are in place: let peeks find them
+        void publish(frame& aFrame)
+        {
+            aFrame.resident.store(aFrame.address, std::memory_order_release);
+            iHints[hint_of(aFrame.address)].store(static_cast<std::size_t>(&aFrame - &iFrames[0]) + 1u, std::memory_order_relaxed);
+        }
+        // the frame's contents are about to be replaced: fail the peeks of the page it held
+        void retire(frame& aFrame)
+        {
+            aFrame.resident.store(NO_PAGE, std::memory_order_relaxed);
+            aFrame.stamp.fetch_add(1u, std::memory_order_release);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+        void reset(frame& aFrame)
+        {
+            retire(aFrame);
+            aFrame.base.reset();
+            aFrame.address = NO_PAGE;
+            aFrame.pinCount = 0;
+            aFrame.dirty = false;
+            aFrame.referenced = false;
+        }
+        void capture_base(frame& aFrame)
+        {
+            if (iTrackChanges && !aFrame.base)
+                aFrame.base = std::make_unique<page>(aFrame.contents);
+        }
+        void write_back(frame& aFrame)
+        {
+            iIo.write_page(aFrame.address, aFrame.contents);
+            aFrame.dirty = false;
+            ++iStats.writeBacks;
+        }
+    private:
+        mutable std::mutex iMutex;
+        i_page_io& iIo;
+        std::size_t const iCapacity;
+        std::unique_ptr<frame[]> iFrames;
+        std::size_t iHand;
+        std::size_t const iHintMask;
+        std::unique_ptr<std::atomic<std::size_t>[]> iHints;
+        std::unordered_map<std::uint64_t, std::size_t> iPageTable;
+        bool iTrackChanges = false;
+        std::uint64_t iDurableLsn = 0;
+        buffer_pool_stats iStats;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <neodb/i_page_io.hpp>
+#include <neodb/crc32c.hpp>
+
+namespace neodb
+{
+    struct bad_page_checksum : std::runtime_error { bad_page_checksum() : std::runtime_error{ "neodb::bad_page_checksum" } {} };
+
+    // CRC-32C of every byte of a page but its checksum field.
+    inline std::uint32_t page_checksum(page const& aPage)
+    {
+        std::size_t constexpr CHECKSUM_OFFSET = offsetof(page_header, checksum);
+        std::size_t constexpr CHECKSUM_END = CHECKSUM_OFFSET + sizeof(page_header::checksum);
+        auto const bytes = reinterpret_cast<std::uint8_t const*>(&aPage);
+        return crc32c(bytes + CHECKSUM_END, sizeof(page) - CHECKSUM_END, crc32c(bytes, CHECKSUM_OFFSET));
+    }
+
+    // A page that has never been written (a hole in the file) reads as zeros and has no checksum.
+    inline bool verify_page_checksum(page const& aPage)
+    {
+        if (aPage.header.checksum == page_checksum(aPage))
+            return true;
+        auto const bytes = reinterpret_cast<std::uint8_t const*>(&aPage);
+        for (std::size_t index = 0; index < sizeof(page); ++index)
+            if (bytes[index] != 0u)
+                return false;
+        return true;
+    }
+
+    // Stamps pages with their checksum on their way to another backend and verifies them on their way
+    // back, throwing bad_page_checksum for a torn or decayed page. Buffer frames are left untouched:
+    // pages are checksummed in a per-thread copy as they are written.
+    class checksummed_page_io : public i_page_io
+    {
+    public:
+        checksummed_page_io(std::unique_ptr<i_page_io> aNext) :
+            iNext{ std::move(aNext) }
+        {
+        }
+    public:
+        i_page_io& next() const
+        {
+            return *iNext;
+        }
+    public:
+        void read_page(page::pointer_type aAddress, page& aPage) override
+        {
+            iNext->read_page(aAddress, aPage);
+            if (!verify_page_checksum(aPage))
+                throw bad_page_checksum();
+        }
+        void write_page(page::pointer_type aAddress, page const& aPage) override
+        {
+            auto& stamped = *stamping_buffer(1u);
+            stamped = aPage;
+            stamped.header.checksum = page_checksum(stamped);
+            iNext->write_page(aAddress, stamped);
+        }
+        void read_pages(page_read const* aReads, std::size_t aCount) override
+        {
+            iNext->read_pages(aReads, aCount);
+            for (std::size_t index = 0; index < aCount; ++index)
+                if (!verify_page_checksum(*aReads[index].destination))
+                    throw bad_page_checksum();
+        }
+        void write_pages(page_write const* aWrites, std::size_t aCount) override
+        {
+            auto const stamped = stamping_buffer(aCount);
+            thread_local std::vector<page_write> tWrites;
+            tWrites.assign(aWrites, aWrites + aCount);
+            for (std::size_t index = 0; index < aCount; ++index)
+            {
+                stamped[index] = *aWrites[index].source;
+                stamped[index].header.checksum = page_checksum(stamped[index]);
+                tWrites[index].source = &stamped[index];
+            }
+            iNext->write_pages(tWrites.data(), aCount);
+        }
+        void sync() override
+        {
+            iNext->sync();
+        }
+    private:
+        // the copies pages are stamped in are kept per thread and reused, growing to the largest batch
+        static page* stamping_buffer(std::size_t aCount)
+        {
+            thread_local std::vector<page> tStamped;
+            if (tStamped.size() < aCount)
+                tStamped.resize(aCount);
+            return tStamped.data();
+        }
+    private:
+        std::unique_ptr<i_page_io> iNext;
+    };
+}
\ No newline at end of file
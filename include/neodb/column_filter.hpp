@@ -0,0 +1,735 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <bit>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <neodb/data_type.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/i_table.hpp>
+#include <neodb/string_dictionary.hpp>
+#include <neodb/cpu_features.hpp>
+
+namespace neodb
+{
+    struct unsupported_filter : std::logic_error { unsupported_filter() : std::logic_error{ "neodb::unsupported_filter" } {} };
+
+    enum class compare_op : std::uint32_t
+    {
+        Equal,
+        NotEqual,
+        Less,
+        LessEqual,
+        Greater,
+        GreaterEqual
+    };
+
+    // A bit per row, 64 rows to a word; bits past the last row are zero.
+    class selection_bitmap
+    {
+    public:
+        selection_bitmap(std::size_t aRows = 0u) :
+            iRows{ aRows }, iWords((aRows + 63) / 64)
+        {
+        }
+    public:
+        std::size_t rows() const
+        {
+            return iRows;
+        }
+        void resize(std::size_t aRows)
+        {
+            iRows = aRows;
+            iWords.resize((aRows + 63) / 64);
+        }
+        std::uint64_t const* data() const
+        {
+            return iWords.data();
+        }
+        std::uint64_t* data()
+        {
+            return iWords.data();
+        }
+        bool test(std::size_t aRow) const
+        {
+            return (iWords[aRow / 64] >> (aRow % 64)) & 1u;
+        }
+        std::size_t count() const
+        {
+            std::size_t result = 0;
+            for (auto word : iWords)
+                result += static_cast<std::size_t>(std::popcount(word));
+            return result;
+        }
+        selection_bitmap& operator&=(selection_bitmap const& aOther)
+        {
+            for (std::size_t word = 0; word < iWords.size(); ++word)
+                iWords[word] &= aOther.iWords[word];
+            return *this;
+        }
+        selection_bitmap& operator|=(selection_bitmap const& aOther)
+        {
+            for (std::size_t word = 0; word < iWords.size(); ++word)
+                iWords[word] |= aOther.iWords[word];
+            return *this;
+        }
+    private:
+        std::size_t iRows;
+        std::vector<std::uint64_t> iWords;
+    };
+
+    namespace detail
+    {
+        // The kernels see column values as K: bool as uint8_t and time as int64_t nanoseconds.
+        template <typename Visitor>
+        inline decltype(auto) visit_filter_type(data_type aType, Visitor&& aVisitor)
+        {
+            return visit_data_type(aType, [&](auto aValueType) -> decltype(auto)
+            {
+                typedef typename decltype(aValueType)::type value_type;
+                if constexpr (std::is_same_v<value_type, bool>)
+                    return aVisitor(aValueType, std::type_identity<std::uint8_t>{});
+                else if constexpr (std::is_same_v<value_type, time>)
+                    return aVisitor(aValueType, std::type_identity<std::int64_t>{});
+                else if constexpr (std::is_arithmetic_v<value_type> && !std::is_same_v<value_type, char>)
+                    return aVisitor(aValueType, std::type_identity<value_type>{});
+                else
+                    return aVisitor(aValueType, std::type_identity<void>{});
+            });
+        }
+
+        template <typename K>
+        inline K kernel_value(std::uint64_t aBits)
+        {
+            K result;
+            std::memcpy(&result, &aBits, sizeof(K));
+            return result;
+        }
+
+        template <typename K>
+        inline std::uint64_t kernel_bits(K aValue)
+        {
+            std::uint64_t result = 0u;
+            std::memcpy(&result, &aValue, sizeof(K));
+            return result;
+        }
+
+        template <typename K>
+        inline bool in_range(std::uint8_t const* aValue, K aLow, K aHigh)
+        {
+            auto const value = load_little<K>(aValue);
+            return value >= aLow && value <= aHigh;
+        }
+
+        // rows [aFirst, aRows), aFirst a multiple of 64
+        template <typename K>
+        inline void scalar_range(std::uint8_t const* aValues, std::size_t aFirst, std::size_t aRows, K aLow, K aHigh, bool aOutside, std::uint64_t* aSelection)
+        {
+            for (std::size_t row = aFirst; row < aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t bit = 0; bit < 64 && row + bit < aRows; ++bit)
+                    word |= std::uint64_t{ in_range(aValues + (row + bit) * sizeof(K), aLow, aHigh) != aOutside } << bit;
+                aSelection[row / 64] = word;
+            }
+        }
+
+        template <typename K>
+        inline void scalar_in(std::uint8_t const* aValues, std::size_t aFirst, std::size_t aRows, K const* aList, std::size_t aListSize, std::uint64_t* aSelection)
+        {
+            for (std::size_t row = aFirst; row < aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t bit = 0; bit < 64 && row + bit < aRows; ++bit)
+                {
+                    auto const value = load_little<K>(aValues + (row + bit) * sizeof(K));
+                    auto const match = std::lower_bound(aList, aList + aListSize, value);
+                    word |= std::uint64_t{ match != aList + aListSize && *match == value } << bit;
+                }
+                aSelection[row / 64] = word;
+            }
+        }
+
+#ifdef NEODB_X86
+        // Lanes of K in a vector register. Unsigned values are biased by their sign bit so that the
+        // signed compares order them correctly. mask() packs one bit per lane, lane 0 lowest.
+        template <typename K>
+        struct sse42_integer_lanes
+        {
+            typedef __m128i vector;
+            static constexpr std::size_t count = 16 / sizeof(K);
+            NEODB_TARGET("sse4.2") static vector splat(K aValue)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm_set1_epi8(static_cast<char>(aValue));
+                else if constexpr (sizeof(K) == 2)
+                    return _mm_set1_epi16(static_cast<short>(aValue));
+                else if constexpr (sizeof(K) == 4)
+                    return _mm_set1_epi32(static_cast<int>(aValue));
+                else
+                    return _mm_set1_epi64x(static_cast<long long>(aValue));
+            }
+            NEODB_TARGET("sse4.2") static vector bias()
+            {
+                if constexpr (std::is_signed_v<K>)
+                    return _mm_setzero_si128();
+                else
+                    return splat(static_cast<K>(K{ 1 } << (sizeof(K) * 8 - 1)));
+            }
+            NEODB_TARGET("sse4.2") static vector broadcast(K aValue)
+            {
+                return _mm_xor_si128(splat(aValue), bias());
+            }
+            NEODB_TARGET("sse4.2") static vector load(std::uint8_t const* aValues)
+            {
+                return _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<__m128i const*>(aValues)), bias());
+            }
+            NEODB_TARGET("sse4.2") static vector greater(vector aLhs, vector aRhs)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm_cmpgt_epi8(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 2)
+                    return _mm_cmpgt_epi16(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 4)
+                    return _mm_cmpgt_epi32(aLhs, aRhs);
+                else
+                    return _mm_cmpgt_epi64(aLhs, aRhs);
+            }
+            NEODB_TARGET("sse4.2") static vector equal(vector aLhs, vector aRhs)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm_cmpeq_epi8(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 2)
+                    return _mm_cmpeq_epi16(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 4)
+                    return _mm_cmpeq_epi32(aLhs, aRhs);
+                else
+                    return _mm_cmpeq_epi64(aLhs, aRhs);
+            }
+            NEODB_TARGET("sse4.2") static std::uint32_t mask(vector aMask)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return static_cast<std::uint32_t>(_mm_movemask_epi8(aMask));
+                else if constexpr (sizeof(K) == 2)
+                    return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_packs_epi16(aMask, aMask))) & 0xFFu;
+                else if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(aMask)));
+                else
+                    return static_cast<std::uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(aMask)));
+            }
+            NEODB_TARGET("sse4.2") static std::uint32_t within(vector aValue, vector aLow, vector aHigh)
+            {
+                return mask(_mm_andnot_si128(_mm_or_si128(greater(aLow, aValue), greater(aValue, aHigh)), _mm_set1_epi32(-1)));
+            }
+            NEODB_TARGET("sse4.2") static std::uint32_t matches(vector aValue, vector aConstant)
+            {
+                return mask(equal(aValue, aConstant));
+            }
+        };
+
+        template <typename K> struct sse42_float_vector { typedef __m128 type; };
+        template <> struct sse42_float_vector<double> { typedef __m128d type; };
+
+        template <typename K>
+        struct sse42_float_lanes
+        {
+            typedef typename sse42_float_vector<K>::type vector;
+            static constexpr std::size_t count = 16 / sizeof(K);
+            NEODB_TARGET("sse4.2") static vector broadcast(K aValue)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return _mm_set1_ps(aValue);
+                else
+                    return _mm_set1_pd(aValue);
+            }
+            NEODB_TARGET("sse4.2") static vector load(std::uint8_t const* aValues)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return _mm_loadu_ps(reinterpret_cast<float const*>(aValues));
+                else
+                    return _mm_loadu_pd(reinterpret_cast<double const*>(aValues));
+            }
+            NEODB_TARGET("sse4.2") static std::uint32_t within(vector aValue, vector aLow, vector aHigh)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(aValue, aLow), _mm_cmple_ps(aValue, aHigh))));
+                else
+                    return static_cast<std::uint32_t>(_mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(aValue, aLow), _mm_cmple_pd(aValue, aHigh))));
+            }
+            NEODB_TARGET("sse4.2") static std::uint32_t matches(vector aValue, vector aConstant)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm_movemask_ps(_mm_cmpeq_ps(aValue, aConstant)));
+                else
+                    return static_cast<std::uint32_t>(_mm_movemask_pd(_mm_cmpeq_pd(aValue, aConstant)));
+            }
+        };
+
+        template <typename K>
+        struct avx2_integer_lanes
+        {
+            typedef __m256i vector;
+            static constexpr std::size_t count = 32 / sizeof(K);
+            NEODB_TARGET("avx2") static vector splat(K aValue)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm256_set1_epi8(static_cast<char>(aValue));
+                else if constexpr (sizeof(K) == 2)
+                    return _mm256_set1_epi16(static_cast<short>(aValue));
+                else if constexpr (sizeof(K) == 4)
+                    return _mm256_set1_epi32(static_cast<int>(aValue));
+                else
+                    return _mm256_set1_epi64x(static_cast<long long>(aValue));
+            }
+            NEODB_TARGET("avx2") static vector bias()
+            {
+                if constexpr (std::is_signed_v<K>)
+                    return _mm256_setzero_si256();
+                else
+                    return splat(static_cast<K>(K{ 1 } << (sizeof(K) * 8 - 1)));
+            }
+            NEODB_TARGET("avx2") static vector broadcast(K aValue)
+            {
+                return _mm256_xor_si256(splat(aValue), bias());
+            }
+            NEODB_TARGET("avx2") static vector load(std::uint8_t const* aValues)
+            {
+                return _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(aValues)), bias());
+            }
+            NEODB_TARGET("avx2") static vector greater(vector aLhs, vector aRhs)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm256_cmpgt_epi8(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 2)
+                    return _mm256_cmpgt_epi16(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 4)
+                    return _mm256_cmpgt_epi32(aLhs, aRhs);
+                else
+                    return _mm256_cmpgt_epi64(aLhs, aRhs);
+            }
+            NEODB_TARGET("avx2") static vector equal(vector aLhs, vector aRhs)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return _mm256_cmpeq_epi8(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 2)
+                    return _mm256_cmpeq_epi16(aLhs, aRhs);
+                else if constexpr (sizeof(K) == 4)
+                    return _mm256_cmpeq_epi32(aLhs, aRhs);
+                else
+                    return _mm256_cmpeq_epi64(aLhs, aRhs);
+            }
+            NEODB_TARGET("avx2") static std::uint32_t mask(vector aMask)
+            {
+                if constexpr (sizeof(K) == 1)
+                    return static_cast<std::uint32_t>(_mm256_movemask_epi8(aMask));
+                else if constexpr (sizeof(K) == 2)
+                    // packing works within 128-bit halves; gather both halves' bytes into the low half
+                    return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_permute4x64_epi64(_mm256_packs_epi16(aMask, aMask), 0xD8))) & 0xFFFFu;
+                else if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(aMask)));
+                else
+                    return static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(aMask)));
+            }
+            NEODB_TARGET("avx2") static std::uint32_t within(vector aValue, vector aLow, vector aHigh)
+            {
+                return mask(_mm256_andnot_si256(_mm256_or_si256(greater(aLow, aValue), greater(aValue, aHigh)), _mm256_set1_epi32(-1)));
+            }
+            NEODB_TARGET("avx2") static std::uint32_t matches(vector aValue, vector aConstant)
+            {
+                return mask(equal(aValue, aConstant));
+            }
+        };
+
+        template <typename K> struct avx2_float_vector { typedef __m256 type; };
+        template <> struct avx2_float_vector<double> { typedef __m256d type; };
+
+        template <typename K>
+        struct avx2_float_lanes
+        {
+            typedef typename avx2_float_vector<K>::type vector;
+            static constexpr std::size_t count = 32 / sizeof(K);
+            NEODB_TARGET("avx2") static vector broadcast(K aValue)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return _mm256_set1_ps(aValue);
+                else
+                    return _mm256_set1_pd(aValue);
+            }
+            NEODB_TARGET("avx2") static vector load(std::uint8_t const* aValues)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return _mm256_loadu_ps(reinterpret_cast<float const*>(aValues));
+                else
+                    return _mm256_loadu_pd(reinterpret_cast<double const*>(aValues));
+            }
+            NEODB_TARGET("avx2") static std::uint32_t within(vector aValue, vector aLow, vector aHigh)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(aValue, aLow, _CMP_GE_OQ), _mm256_cmp_ps(aValue, aHigh, _CMP_LE_OQ))));
+                else
+                    return static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_and_pd(_mm256_cmp_pd(aValue, aLow, _CMP_GE_OQ), _mm256_cmp_pd(aValue, aHigh, _CMP_LE_OQ))));
+            }
+            NEODB_TARGET("avx2") static std::uint32_t matches(vector aValue, vector aConstant)
+            {
+                if constexpr (sizeof(K) == 4)
+                    return static_cast<std::uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(aValue, aConstant, _CMP_EQ_OQ)));
+                else
+                    return static_cast<std::uint32_t>(_mm256_movemask_pd(_mm256_cmp_pd(aValue, aConstant, _CMP_EQ_OQ)));
+            }
+        };
+
+        template <typename K>
+        using sse42_lanes = std::conditional_t<std::is_floating_point_v<K>, sse42_float_lanes<K>, sse42_integer_lanes<K>>;
+        template <typename K>
+        using avx2_lanes = std::conditional_t<std::is_floating_point_v<K>, avx2_float_lanes<K>, avx2_integer_lanes<K>>;
+
+        // The vector loops cover whole 64-row words and return the first row left for the scalar kernel.
+        // They are spelled out once per instruction set as each must be compiled for its own target.
+        template <typename K>
+        NEODB_TARGET("sse4.2") inline std::size_t sse42_range(std::uint8_t const* aValues, std::size_t aRows, K aLow, K aHigh, bool aOutside, std::uint64_t* aSelection)
+        {
+            typedef sse42_lanes<K> lanes;
+            auto const low = lanes::broadcast(aLow);
+            auto const high = lanes::broadcast(aHigh);
+            std::uint64_t const flip = aOutside ? ~std::uint64_t{} : std::uint64_t{};
+            std::size_t row = 0;
+            for (; row + 64 <= aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t lane = 0; lane < 64; lane += lanes::count)
+                    word |= std::uint64_t{ lanes::within(lanes::load(aValues + (row + lane) * sizeof(K)), low, high) } << lane;
+                aSelection[row / 64] = word ^ flip;
+            }
+            return row;
+        }
+
+        template <typename K, std::size_t ListLimit>
+        NEODB_TARGET("sse4.2") inline std::size_t sse42_in(std::uint8_t const* aValues, std::size_t aRows, K const* aList, std::size_t aListSize, std::uint64_t* aSelection)
+        {
+            typedef sse42_lanes<K> lanes;
+            typename lanes::vector list[ListLimit];
+            for (std::size_t index = 0; index < aListSize; ++index)
+                list[index] = lanes::broadcast(aList[index]);
+            std::size_t row = 0;
+            for (; row + 64 <= aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t lane = 0; lane < 64; lane += lanes::count)
+                {
+                    auto const value = lanes::load(aValues + (row + lane) * sizeof(K));
+                    std::uint32_t matched = 0u;
+                    for (std::size_t index = 0; index < aListSize; ++index)
+                        matched |= lanes::matches(value, list[index]);
+                    word |= std::uint64_t{ matched } << lane;
+                }
+                aSelection[row / 64] = word;
+            }
+            return row;
+        }
+
+        template <typename K>
+        NEODB_TARGET("avx2") inline std::size_t avx2_range(std::uint8_t const* aValues, std::size_t aRows, K aLow, K aHigh, bool aOutside, std::uint64_t* aSelection)
+        {
+            typedef avx2_lanes<K> lanes;
+            auto const low = lanes::broadcast(aLow);
+            auto const high = lanes::broadcast(aHigh);
+            std::uint64_t const flip = aOutside ? ~std::uint64_t{} : std::uint64_t{};
+            std::size_t row = 0;
+            for (; row + 64 <= aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t lane = 0; lane < 64; lane += lanes::count)
+                    word |= std::uint64_t{ lanes::within(lanes::load(aValues + (row + lane) * sizeof(K)), low, high) } << lane;
+                aSelection[row / 64] = word ^ flip;
+            }
+            return row;
+        }
+
+        template <typename K, std::size_t ListLimit>
+        NEODB_TARGET("avx2") inline std::size_t avx2_in(std::uint8_t const* aValues, std::size_t aRows, K const* aList, std::size_t aListSize, std::uint64_t* aSelection)
+        {
+            typedef avx2_lanes<K> lanes;
+            typename lanes::vector list[ListLimit];
+            for (std::size_t index = 0; index < aListSize; ++index)
+                list[index] = lanes::broadcast(aList[index]);
+            std::size_t row = 0;
+            for (; row + 64 <= aRows; row += 64)
+            {
+                std::uint64_t word = 0u;
+                for (std::size_t lane = 0; lane < 64; lane += lanes::count)
+                {
+                    auto const value = lanes::load(aValues + (row + lane) * sizeof(K));
+                    std::uint32_t matched = 0u;
+                    for (std::size_t index = 0; index < aListSize; ++index)
+                        matched |= lanes::matches(value, list[index]);
+                    word |= std::uint64_t{ matched } << lane;
+                }
+                aSelection[row / 64] = word;
+            }
+            return row;
+        }
+#endif
+    }
+
+    // A predicate over one fixed-width column (integer, floating point, bool or time) evaluated a
+    // chunk at a time into a selection bitmap. Comparisons reduce to an inclusive range or, for
+    // NotEqual, its complement; NaN compares as IEEE 754 says. Null values are never selected.
+    // Equality and IN-list predicates on a dictionary encoded string column compare its codes.
+    class column_predicate
+    {
+    public:
+        static constexpr std::size_t VECTOR_LIST_LIMIT = 16;
+    private:
+        enum class kind
+        {
+            Nothing,
+            Range,
+            OutsideRange,
+            In
+        };
+    public:
+        column_predicate(field_layout const& aField, compare_op aOp, data_value_type const& aValue) :
+            iType{ non_nullable(aField.dataType) }, iKind{ kind::Range }
+        {
+            detail::visit_filter_type(iType, [&](auto aValueType, auto aKernelType)
+            {
+                typedef typename decltype(aKernelType)::type kernel_type;
+                if constexpr (std::is_void_v<kernel_type>)
+                    throw unsupported_filter();
+                else
+                {
+                    auto const value = constant<kernel_type>(aValueType, aValue);
+                    typedef std::numeric_limits<kernel_type> limits;
+                    kernel_type low = limits::has_infinity ? -limits::infinity() : limits::lowest();
+                    kernel_type high = limits::has_infinity ? limits::infinity() : limits::max();
+                    switch (aOp)
+                    {
+                    case compare_op::Equal:
+                        low = high = value;
+                        break;
+                    case compare_op::NotEqual:
+                        low = high = value;
+                        iKind = kind::OutsideRange;
+                        break;
+                    case compare_op::Less:
+                        if (value == low)
+                            iKind = kind::Nothing;
+                        if constexpr (std::is_floating_point_v<kernel_type>)
+                            high = std::nextafter(value, low);
+                        else
+                            high = static_cast<kernel_type>(value - 1);
+                        break;
+                    case compare_op::LessEqual:
+                        high = value;
+                        break;
+                    case compare_op::Greater:
+                        if (value == high)
+                            iKind = kind::Nothing;
+                        if constexpr (std::is_floating_point_v<kernel_type>)
+                            low = std::nextafter(value, high);
+                        else
+                            low = static_cast<kernel_type>(value + 1);
+                        break;
+                    case compare_op::GreaterEqual:
+                        low = value;
+                        break;
+                    }
+                    iLow = detail::kernel_bits(low);
+                    iHigh = detail::kernel_bits(high);
+                }
+            });
+        }
+        column_predicate(field_layout const& aField, data_value_type const& aLow, data_value_type const& aHigh) :
+            iType{ non_nullable(aField.dataType) }, iKind{ kind::Range }
+        {
+            detail::visit_filter_type(iType, [&](auto aValueType, auto aKernelType)
+            {
+                typedef typename decltype(aKernelType)::type kernel_type;
+                if constexpr (std::is_void_v<kernel_type>)
+                    throw unsupported_filter();
+                else
+                {
+                    iLow = detail::kernel_bits(constant<kernel_type>(aValueType, aLow));
+                    iHigh = detail::kernel_bits(constant<kernel_type>(aValueType, aHigh));
+                }
+            });
+        }
+        column_predicate(field_layout const& aField, std::vector<data_value_type> const& aValues) :
+            iType{ non_nullable(aField.dataType) }, iKind{ kind::In }
+        {
+            detail::visit_filter_type(iType, [&](auto aValueType, auto aKernelType)
+            {
+                typedef typename decltype(aKernelType)::type kernel_type;
+                if constexpr (std::is_void_v<kernel_type>)
+                    throw unsupported_filter();
+                else
+                {
+                    std::vector<kernel_type> values;
+                    for (auto const& value : aValues)
+                        values.push_back(constant<kernel_type>(aValueType, value));
+                    std::sort(values.begin(), values.end());
+                    values.erase(std::unique(values.begin(), values.end()), values.end());
+                    for (auto value : values)
+                        iList.push_back(detail::kernel_bits(value));
+                }
+            });
+        }
+        column_predicate(string_dictionary const& aDictionary, field_layout const& aField, compare_op aOp, data_value_type const& aValue) :
+            iType{ data_type::Uint32 }, iKind{ kind::Range }
+        {
+            if (aOp != compare_op::Equal && aOp != compare_op::NotEqual)
+                throw unsupported_filter();
+            auto const code = aDictionary.find(aField, aValue);
+            if (code)
+                iLow = iHigh = *code;
+            else if (aOp == compare_op::Equal)
+                iKind = kind::Nothing;
+            else
+                iLow = 1u; // empty range: its complement selects every row
+            if (aOp == compare_op::NotEqual)
+                iKind = kind::OutsideRange;
+        }
+        column_predicate(string_dictionary const& aDictionary, field_layout const& aField, std::vector<data_value_type> const& aValues) :
+            iType{ data_type::Uint32 }, iKind{ kind::In }
+        {
+            std::vector<string_dictionary::code_type> codes;
+            for (auto const& value : aValues)
+                if (auto const code = aDictionary.find(aField, value))
+                    codes.push_back(*code);
+            std::sort(codes.begin(), codes.end());
+            codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+            iList.assign(codes.begin(), codes.end());
+            if (iList.empty())
+                iKind = kind::Nothing;
+        }
+    public:
+        // Select the matching rows among aRows values of aColumn, writing (aRows + 63) / 64 words.
+        void evaluate(column_data const& aColumn, std::size_t aRows, std::uint64_t* aSelection, simd_level aLevel = detected_simd_level()) const
+        {
+            aLevel = std::min(aLevel, detected_simd_level());
+            auto const values = static_cast<std::uint8_t const*>(aColumn.values);
+            std::size_t const words = (aRows + 63) / 64;
+            if (iKind == kind::Nothing)
+                std::fill(aSelection, aSelection + words, std::uint64_t{});
+            else
+            {
+                detail::visit_filter_type(iType, [&](auto, auto aKernelType)
+                {
+                    typedef typename decltype(aKernelType)::type kernel_type;
+                    if constexpr (!std::is_void_v<kernel_type>)
+                        evaluate<kernel_type>(values, aRows, aSelection, aLevel);
+                });
+            }
+            if (aColumn.nulls != nullptr)
+                for (std::size_t word = 0; word < words; ++word)
+                {
+                    std::uint64_t nulls = 0u;
+                    std::memcpy(&nulls, aColumn.nulls + word * 8, std::min<std::size_t>(8u, (aRows + 7) / 8 - word * 8));
+                    aSelection[word] &= ~boost::endian::little_to_native(nulls);
+                }
+            if (aRows % 64 != 0u)
+                aSelection[words - 1] &= (std::uint64_t{ 1 } << (aRows % 64)) - 1u;
+        }
+        void evaluate(column_data const& aColumn, std::size_t aRows, selection_bitmap& aSelection, simd_level aLevel = detected_simd_level()) const
+        {
+            aSelection.resize(aRows);
+            evaluate(aColumn, aRows, aSelection.data(), aLevel);
+        }
+    private:
+        template <typename K, typename ValueType>
+        static K constant(ValueType, data_value_type const& aValue)
+        {
+            typedef typename ValueType::type value_type;
+            value_type const* value = std::get_if<value_type>(&aValue);
+            if (value == nullptr)
+            {
+                auto const optionalValue = std::get_if<optional<value_type>>(&aValue);
+                if (optionalValue == nullptr || !*optionalValue)
+                    throw field_type_mismatch();
+                value = &**optionalValue;
+            }
+            if constexpr (std::is_same_v<value_type, time>)
+                return to_stored_time(*value);
+            else
+                return static_cast<K>(*value);
+        }
+        template <typename K>
+        void evaluate(std::uint8_t const* aValues, std::size_t aRows, std::uint64_t* aSelection, simd_level aLevel) const
+        {
+            std::size_t first = 0;
+            if (iKind == kind::In)
+            {
+                std::vector<K> list;
+                for (auto bits : iList)
+                    list.push_back(detail::kernel_value<K>(bits));
+#ifdef NEODB_X86
+                if (list.size() <= VECTOR_LIST_LIMIT)
+                {
+                    if (aLevel == simd_level::Avx2)
+                        first = detail::avx2_in<K, VECTOR_LIST_LIMIT>(aValues, aRows, list.data(), list.size(), aSelection);
+                    else if (aLevel == simd_level::Sse42)
+                        first = detail::sse42_in<K, VECTOR_LIST_LIMIT>(aValues, aRows, list.data(), list.size(), aSelection);
+                }
+#endif
+                detail::scalar_in<K>(aValues, first, aRows, list.data(), list.size(), aSelection);
+                return;
+            }
+            auto const low = detail::kernel_value<K>(iLow);
+            auto const high = detail::kernel_value<K>(iHigh);
+            bool const outside = iKind == kind::OutsideRange;
+#ifdef NEODB_X86
+            if (aLevel == simd_level::Avx2)
+                first = detail::avx2_range<K>(aValues, aRows, low, high, outside, aSelection);
+            else if (aLevel == simd_level::Sse42)
+                first = detail::sse42_range<K>(aValues, aRows, low, high, outside, aSelection);
+#endif
+            detail::scalar_range<K>(aValues, first, aRows, low, high, outside, aSelection);
+        }
+    private:
+        data_type iType;
+        kind iKind;
+        std::uint64_t iLow = 0u;
+        std::uint64_t iHigh = 0u;
+        std::vector<std::uint64_t> iList;
+    };
+}
\ No newline at end of file
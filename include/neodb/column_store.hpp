@@ -0,0 +1,385 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/record.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/string_dictionary.hpp>
+
+namespace neodb
+{
+    struct bad_column_store : std::runtime_error { bad_column_store() : std::runtime_error{ "neodb::bad_column_store" } {} };
+
+    // Where each column of a PAX page lives: every field has a minipage holding the page's values
+    // for that field back to back (encoded exactly as in a row, or as little-endian 32-bit codes for
+    // a dictionary encoded field) and every nullable field a further minipage holding its null bits.
+    // Minipages start on 8-byte boundaries.
+    class column_page_layout
+    {
+    public:
+        static constexpr std::size_t PAGE_DATA_SIZE = std::tuple_size_v<page::data_type>;
+    public:
+        column_page_layout(row_layout const& aRowLayout, std::vector<bool> const& aDictionaryEncoded = {}) :
+            iCapacity{ 0 }
+        {
+            auto value_size = [&](std::size_t aField)
+            {
+                bool const encoded = aField < aDictionaryEncoded.size() && aDictionaryEncoded[aField];
+                return encoded ? sizeof(string_dictionary::code_type) : aRowLayout.field(aField).size;
+            };
+            std::size_t bitsPerRow = 0;
+            std::size_t minipages = 0;
+            for (std::size_t index = 0; index < aRowLayout.field_count(); ++index)
+            {
+                auto const& field = aRowLayout.field(index);
+                bitsPerRow += value_size(index) * 8 + (field.nullBit != NOT_NULLABLE ? 1 : 0);
+                minipages += field.nullBit != NOT_NULLABLE ? 2 : 1;
+            }
+            iValues.resize(aRowLayout.field_count());
+            iNulls.resize(aRowLayout.field_count());
+            iSizes.resize(aRowLayout.field_count());
+            if (bitsPerRow == 0)
+                return;
+            for (iCapacity = (PAGE_DATA_SIZE - minipages * 8) * 8 / bitsPerRow; iCapacity > 0; --iCapacity)
+            {
+                std::size_t offset = 0;
+                for (std::size_t index = 0; index < aRowLayout.field_count(); ++index)
+                {
+                    auto const& field = aRowLayout.field(index);
+                    iSizes[index] = value_size(index);
+                    iValues[index] = offset;
+                    offset = align(offset + iCapacity * iSizes[index]);
+                    iNulls[index] = NO_NULLS;
+                    if (field.nullBit != NOT_NULLABLE)
+                    {
+                        iNulls[index] = offset;
+                        offset = align(offset + (iCapacity + 7) / 8);
+                    }
+                }
+                if (offset <= PAGE_DATA_SIZE)
+                    break;
+            }
+        }
+    public:
+        static constexpr std::size_t NO_NULLS = ~std::size_t{};
+        // rows per page
+        std::size_t capacity() const
+        {
+            return iCapacity;
+        }
+        std::size_t values_offset(std::size_t aField) const
+        {
+            return iValues[aField];
+        }
+        std::size_t nulls_offset(std::size_t aField) const
+        {
+            return iNulls[aField];
+        }
+        std::size_t value_size(std::size_t aField) const
+        {
+            return iSizes[aField];
+        }
+    private:
+        static std::size_t align(std::size_t aOffset)
+        {
+            return (aOffset + 7) / 8 * 8;
+        }
+    private:
+        std::size_t iCapacity;
+        std::vector<std::size_t> iValues;
+        std::vector<std::size_t> iNulls;
+        std::vector<std::size_t> iSizes;
+    };
+
+    // Rows of a table with columnar storage, appended to a chain of PAX pages. A page's header "used"
+    // field counts its rows and the address of a row is its page's address plus its slot. The chain's
+    // first and last pages, the row count and the anchors of any string dictionaries are kept in an
+    // anchor record.
+    class column_store
+    {
+    public:
+        typedef page::pointer_type pointer_type;
+    private:
+        static constexpr std::uint64_t ANCHOR_MAGIC = 0x31304C4F434F454E; // NEOCOL01
+        struct anchor
+        {
+            little_uint64_t magic;
+            little_uint64_t first;
+            little_uint64_t last;
+            little_uint64_t rows;
+            little_uint64_t fields;
+            // followed by a dictionary anchor (or zero) per field
+        };
+    public:
+        // create an empty store, optionally dictionary encoding its CharString and VarcharString fields
+        column_store(i_database& aDatabase, neodb::row_layout const& aRowLayout, bool aDictionaryEncoding = false) :
+            iDatabase{ aDatabase }, iRowLayout{ aRowLayout }, iDictionaries(aRowLayout.field_count()),
+            iPageLayout{ aRowLayout, dictionary_encoded(aRowLayout, aDictionaryEncoding) }, iFirst{ 0u }, iLast{ 0u }, iRows{ 0u }
+        {
+            if (iPageLayout.capacity() == 0)
+                throw bad_column_store();
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+                if (dictionary_encoded(aRowLayout, aDictionaryEncoding)[index])
+                    iDictionaries[index] = std::make_unique<string_dictionary>(iDatabase, iRowLayout.field(index));
+            iAnchor = iDatabase.allocate_record(record_type::Table, anchor_size())->address();
+            store_anchor();
+        }
+        // open an existing store
+        column_store(i_database& aDatabase, neodb::row_layout const& aRowLayout, pointer_type aAnchor) :
+            iDatabase{ aDatabase }, iRowLayout{ aRowLayout }, iDictionaries(aRowLayout.field_count()),
+            iPageLayout{ aRowLayout, open_dictionaries(aDatabase, aRowLayout, aAnchor, iDictionaries) }, iAnchor{ aAnchor }
+        {
+            pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+            auto const& existing = *reinterpret_cast<anchor const*>(record_payload(*anchorPage, iAnchor));
+            iFirst = existing.first;
+            iLast = existing.last;
+            iRows = existing.rows;
+        }
+    public:
+        pointer_type anchor_address() const
+        {
+            return iAnchor;
+        }
+        column_page_layout const& page_layout() const
+        {
+            return iPageLayout;
+        }
+        std::uint64_t row_count() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iRows;
+        }
+        // The page chain as of now, taken under the store's lock: pages before the last are full and
+        // no longer change, so a scan that stops at the last page with its row count from here never
+        // reads a count or next link an append is updating.
+        struct page_chain
+        {
+            pointer_type first;
+            pointer_type last;
+            std::size_t lastRows;
+        };
+        page_chain pages() const
+        {
+            std::scoped_lock lock{ iMutex };
+            if (iLast == 0u)
+                return page_chain{ 0u, 0u, 0u };
+            return page_chain{ iFirst, iLast, static_cast<std::size_t>(pinned_page{ iDatabase, iLast }->header.pageLink.used) };
+        }
+        // the dictionary of a dictionary encoded field, otherwise null
+        string_dictionary const* dictionary(std::size_t aField) const
+        {
+            return iDictionaries[aField].get();
+        }
+    public:
+        // scatter an encoded row into the last page's columns, starting a new page when it is full
+        pointer_type append(void const* aRow)
+        {
+            std::scoped_lock lock{ iMutex };
+            if (iLast == 0u || pinned_page{ iDatabase, iLast }->header.pageLink.used == iPageLayout.capacity())
+                add_page();
+            pinned_page lastPage{ iDatabase, iLast };
+            std::size_t const slot = static_cast<std::size_t>(lastPage->header.pageLink.used);
+            store_row(*lastPage, slot, aRow);
+            lastPage->header.pageLink.used = slot + 1;
+            lastPage.set_dirty();
+            ++iRows;
+            store_anchor();
+            return iLast + slot;
+        }
+        // Append aCount rows stored back to back, filling each page in turn with the page pinned once;
+        // the rows' addresses are written to aAddresses.
+        void append(void const* aRows, std::size_t aCount, pointer_type* aAddresses)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto const rows = static_cast<std::uint8_t const*>(aRows);
+            for (std::size_t appended = 0; appended < aCount;)
+            {
+                if (iLast == 0u || pinned_page{ iDatabase, iLast }->header.pageLink.used == iPageLayout.capacity())
+                    add_page();
+                pinned_page lastPage{ iDatabase, iLast };
+                std::size_t slot = static_cast<std::size_t>(lastPage->header.pageLink.used);
+                for (; slot < iPageLayout.capacity() && appended < aCount; ++slot, ++appended)
+                {
+                    store_row(*lastPage, slot, rows + appended * iRowLayout.size());
+                    aAddresses[appended] = iLast + slot;
+                }
+                lastPage->header.pageLink.used = slot;
+                lastPage.set_dirty();
+            }
+            iRows += aCount;
+            store_anchor();
+        }
+        // undo the most recent append
+        void remove_last(pointer_type aRow)
+        {
+            std::scoped_lock lock{ iMutex };
+            pinned_page lastPage{ iDatabase, iLast };
+            if (aRow != iLast + lastPage->header.pageLink.used - 1u)
+                throw std::logic_error{ "neodb::column_store::remove_last: not the last row" };
+            lastPage->header.pageLink.used = lastPage->header.pageLink.used - 1u;
+            clear_nulls(*lastPage, static_cast<std::size_t>(lastPage->header.pageLink.used));
+            lastPage.set_dirty();
+            --iRows;
+            store_anchor();
+        }
+        // gather a row's fields into its row form
+        void read(pointer_type aRow, void* aRowData) const
+        {
+            auto const pageAddress = aRow - aRow % page::size;
+            std::size_t const slot = static_cast<std::size_t>(aRow % page::size);
+            pinned_page rowPage{ iDatabase, pageAddress };
+            auto const row = static_cast<std::uint8_t*>(aRowData);
+            std::memset(row, 0, iRowLayout.size());
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+            {
+                auto const& field = iRowLayout.field(index);
+                auto const value = &rowPage->data[iPageLayout.values_offset(index) + slot * iPageLayout.value_size(index)];
+                bool const null = field.nullBit != NOT_NULLABLE && (rowPage->data[iPageLayout.nulls_offset(index) + slot / 8] & (1u << (slot % 8))) != 0u;
+                if (!iDictionaries[index])
+                    std::memcpy(row + field.offset, value, field.size);
+                else if (!null)
+                    std::memcpy(row + field.offset, iDictionaries[index]->value(load_little<string_dictionary::code_type>(value)), field.size);
+                if (field.nullBit != NOT_NULLABLE)
+                    set_null(field, row, null);
+            }
+        }
+    private:
+        static std::vector<bool> dictionary_encoded(neodb::row_layout const& aRowLayout, bool aDictionaryEncoding)
+        {
+            std::vector<bool> result(aRowLayout.field_count());
+            for (std::size_t index = 0; aDictionaryEncoding && index < aRowLayout.field_count(); ++index)
+            {
+                auto const type = non_nullable(aRowLayout.field(index).dataType);
+                result[index] = type == data_type::CharString || type == data_type::VarcharString;
+            }
+            return result;
+        }
+        static std::vector<bool> open_dictionaries(i_database& aDatabase, neodb::row_layout const& aRowLayout, pointer_type aAnchor, 
+            std::vector<std::unique_ptr<string_dictionary>>& aDictionaries)
+        {
+            pinned_page anchorPage{ aDatabase, aAnchor - aAnchor % page::size };
+            auto const payload = record_payload(*anchorPage, aAnchor);
+            auto const& existing = *reinterpret_cast<anchor const*>(payload);
+            if (existing.magic != ANCHOR_MAGIC || existing.fields != aRowLayout.field_count())
+                throw bad_column_store();
+            std::vector<bool> result(aRowLayout.field_count());
+            for (std::size_t index = 0; index < aRowLayout.field_count(); ++index)
+            {
+                auto const dictionary = load_little<std::uint64_t>(payload + sizeof(anchor) + index * sizeof(little_uint64_t));
+                if (dictionary != 0u)
+                    aDictionaries[index] = std::make_unique<string_dictionary>(aDatabase, aRowLayout.field(index), dictionary);
+                result[index] = dictionary != 0u;
+            }
+            return result;
+        }
+        std::size_t anchor_size() const
+        {
+            return sizeof(anchor) + iRowLayout.field_count() * sizeof(little_uint64_t);
+        }
+        void store_row(page& aPage, std::size_t aSlot, void const* aRow)
+        {
+            auto const row = static_cast<std::uint8_t const*>(aRow);
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+            {
+                auto const& field = iRowLayout.field(index);
+                auto const value = &aPage.data[iPageLayout.values_offset(index) + aSlot * iPageLayout.value_size(index)];
+                if (iDictionaries[index])
+                    store_little<string_dictionary::code_type>(value, is_null(field, aRow) ? 0u : iDictionaries[index]->intern(row + field.offset));
+                else
+                    std::memcpy(value, row + field.offset, field.size);
+                // a slot's null bit is clear until it is appended (pages start zeroed and remove_last clears
+                // it) and the byte is shared with rows a scan may be reading, so it is only ever set atomically
+                if (field.nullBit != NOT_NULLABLE && is_null(field, aRow))
+                    std::atomic_ref<std::uint8_t>{ aPage.data[iPageLayout.nulls_offset(index) + aSlot / 8] }.fetch_or(
+                        static_cast<std::uint8_t>(1u << (aSlot % 8)), std::memory_order_relaxed);
+            }
+        }
+        void clear_nulls(page& aPage, std::size_t aSlot)
+        {
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+                if (iRowLayout.field(index).nullBit != NOT_NULLABLE)
+                    std::atomic_ref<std::uint8_t>{ aPage.data[iPageLayout.nulls_offset(index) + aSlot / 8] }.fetch_and(
+                        static_cast<std::uint8_t>(~(1u << (aSlot % 8))), std::memory_order_relaxed);
+        }
+        void add_page()
+        {
+            auto const newPage = iDatabase.allocate_page();
+            {
+                pinned_page added{ iDatabase, newPage };
+                added->header.pageLink = link{ iLast, 0u, 0u };
+                added->data = page::data_type{};
+                added.set_dirty();
+            }
+            if (iLast != 0u)
+            {
+                pinned_page previous{ iDatabase, iLast };
+                previous->header.pageLink.next = newPage;
+                previous.set_dirty();
+            }
+            else
+                iFirst = newPage;
+            iLast = newPage;
+        }
+        void store_anchor()
+        {
+            pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+            auto const payload = record_payload(*anchorPage, iAnchor);
+            *reinterpret_cast<anchor*>(payload) = anchor{ ANCHOR_MAGIC, iFirst, iLast, iRows, iRowLayout.field_count() };
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+                store_little<std::uint64_t>(payload + sizeof(anchor) + index * sizeof(little_uint64_t),
+                    iDictionaries[index] ? iDictionaries[index]->anchor_address() : pointer_type{ 0u });
+            anchorPage.set_dirty();
+        }
+    private:
+        i_database& iDatabase;
+        neodb::row_layout const& iRowLayout;
+        std::vector<std::unique_ptr<string_dictionary>> iDictionaries;
+        column_page_layout iPageLayout;
+        pointer_type iAnchor;
+        pointer_type iFirst;
+        pointer_type iLast;
+        std::uint64_t iRows;
+        mutable std::mutex iMutex;
+    };
+}
\ No newline at end of file
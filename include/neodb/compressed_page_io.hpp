@@ -0,0 +1,240 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+#include <zlib.h>
+#include <neodb/i_page_io.hpp>
+#include <neodb/os_file.hpp>
+
+namespace neodb
+{
+    // Pages compressed with zlib into variable-length slots of a slot file. A page-translation map file
+    // holds a 16-byte entry per page (indexed by page address / page::size) giving its slot's offset
+    // and length; pages without an entry read as zeros. Pages that do not compress are stored as is.
+    // Map entries written since the last sync() reach the map file, after the slots they refer to are
+    // durable, at the next sync(); a slot given up in the meantime is only reused after that, so the
+    // durable map never refers to a slot holding another page.
+    class compressed_page_io : public i_page_io
+    {
+    public:
+        static constexpr std::size_t SLOT_GRANULE = 512;
+    private:
+        static constexpr std::uint32_t PRESENT = 0x1;
+        static constexpr std::uint32_t STORED = 0x2; // uncompressed
+        struct map_entry
+        {
+            little_uint64_t offset;
+            little_uint32_t length;
+            little_uint32_t flags;
+        };
+        static_assert(sizeof(map_entry) == 16);
+    public:
+        compressed_page_io(os_file& aSlotFile, os_file& aMapFile, int aLevel = Z_DEFAULT_COMPRESSION) :
+            iSlotFile{ aSlotFile }, iMapFile{ aMapFile }, iLevel{ aLevel }, iEndOfSlots{ 0u }, iStoredBytes{ 0u }
+        {
+            iMap.resize(static_cast<std::size_t>(iMapFile.size() / sizeof(map_entry)));
+            if (!iMap.empty() && iMapFile.read_at(0, iMap.data(), iMap.size() * sizeof(map_entry)) != iMap.size() * sizeof(map_entry))
+                throw page_io_error();
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> used;
+            for (auto const& entry : iMap)
+                if (entry.flags & PRESENT)
+                {
+                    used.emplace_back(entry.offset, slot_capacity(entry.length));
+                    iStoredBytes += entry.length;
+                }
+            std::sort(used.begin(), used.end());
+            for (auto const& slot : used)
+            {
+                if (slot.first > iEndOfSlots)
+                    release(iEndOfSlots, slot.first - iEndOfSlots);
+                iEndOfSlots = std::max(iEndOfSlots, slot.first + slot.second);
+            }
+        }
+    public:
+        // total length of the pages' slots in use, for monitoring the compression ratio
+        std::uint64_t stored_bytes() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iStoredBytes;
+        }
+        std::uint64_t slot_file_size() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iEndOfSlots;
+        }
+    public:
+        void read_page(page::pointer_type aAddress, page& aPage) override
+        {
+            map_entry entry{};
+            {
+                std::scoped_lock lock{ iMutex };
+                auto const index = static_cast<std::size_t>(aAddress / page::size);
+                if (index < iMap.size())
+                    entry = iMap[index];
+            }
+            if (!(entry.flags & PRESENT))
+            {
+                aPage.clear();
+                return;
+            }
+            if (entry.flags & STORED)
+            {
+                if (entry.length != sizeof(page) || iSlotFile.read_at(entry.offset, &aPage, sizeof(page)) != sizeof(page))
+                    throw page_io_error();
+                return;
+            }
+            std::vector<std::uint8_t> compressed(entry.length);
+            if (iSlotFile.read_at(entry.offset, compressed.data(), compressed.size()) != compressed.size())
+                throw page_io_error();
+            uLongf length = sizeof(page);
+            if (::uncompress(reinterpret_cast<Bytef*>(&aPage), &length, compressed.data(), static_cast<uLong>(compressed.size())) != Z_OK || length != sizeof(page))
+                throw page_io_error();
+        }
+        void write_page(page::pointer_type aAddress, page const& aPage) override
+        {
+            std::vector<std::uint8_t> compressed(::compressBound(sizeof(page)));
+            uLongf length = static_cast<uLongf>(compressed.size());
+            if (::compress2(compressed.data(), &length, reinterpret_cast<Bytef const*>(&aPage), sizeof(page), iLevel) != Z_OK)
+                throw page_io_error();
+            bool const stored = slot_capacity(length) >= sizeof(page);
+            void const* const data = stored ? static_cast<void const*>(&aPage) : compressed.data();
+            std::uint32_t const dataLength = stored ? static_cast<std::uint32_t>(sizeof(page)) : static_cast<std::uint32_t>(length);
+            std::uint64_t offset;
+            {
+                std::scoped_lock lock{ iMutex };
+                auto const index = static_cast<std::size_t>(aAddress / page::size);
+                if (index >= iMap.size())
+                    iMap.resize(index + 1);
+                auto& entry = iMap[index];
+                if (entry.flags & PRESENT)
+                {
+                    iPendingFree.emplace_back(entry.offset, slot_capacity(entry.length));
+                    iStoredBytes -= entry.length;
+                }
+                offset = allocate(slot_capacity(dataLength));
+                entry = map_entry{ offset, dataLength, PRESENT | (stored ? STORED : 0u) };
+                iStoredBytes += dataLength;
+                iDirty.insert(index);
+            }
+            iSlotFile.write_at(offset, data, dataLength);
+        }
+        void read_pages(page_read const* aReads, std::size_t aCount) override
+        {
+            for (std::size_t index = 0; index < aCount; ++index)
+                read_page(aReads[index].address, *aReads[index].destination);
+        }
+        void write_pages(page_write const* aWrites, std::size_t aCount) override
+        {
+            for (std::size_t index = 0; index < aCount; ++index)
+                write_page(aWrites[index].address, *aWrites[index].source);
+        }
+        void sync() override
+        {
+            std::set<std::size_t> dirty;
+            std::vector<std::pair<std::uint64_t, std::uint64_t>> pendingFree;
+            std::vector<map_entry> entries;
+            {
+                std::scoped_lock lock{ iMutex };
+                dirty.swap(iDirty);
+                pendingFree.swap(iPendingFree);
+                for (auto index : dirty)
+                    entries.push_back(iMap[index]);
+            }
+            iSlotFile.sync();
+            // write runs of consecutive entries together
+            auto entry = entries.begin();
+            for (auto run = dirty.begin(); run != dirty.end();)
+            {
+                auto end = std::next(run);
+                auto last = *run;
+                while (end != dirty.end() && *end == last + 1)
+                    last = *end++;
+                auto const count = static_cast<std::size_t>(std::distance(run, end));
+                iMapFile.write_at(*run * sizeof(map_entry), &*entry, count * sizeof(map_entry));
+                entry += count;
+                run = end;
+            }
+            iMapFile.sync();
+            std::scoped_lock lock{ iMutex };
+            for (auto const& slot : pendingFree)
+                release(slot.first, slot.second);
+        }
+    private:
+        static std::uint64_t slot_capacity(std::uint64_t aLength)
+        {
+            return (aLength + SLOT_GRANULE - 1) / SLOT_GRANULE * SLOT_GRANULE;
+        }
+        // best fit from the free slots, splitting off any remainder, else from the end of the slot file
+        std::uint64_t allocate(std::uint64_t aCapacity)
+        {
+            auto fit = iFree.lower_bound(aCapacity);
+            if (fit == iFree.end())
+            {
+                auto const offset = iEndOfSlots;
+                iEndOfSlots += aCapacity;
+                return offset;
+            }
+            auto const capacity = fit->first;
+            auto const offset = fit->second;
+            iFree.erase(fit);
+            if (capacity > aCapacity)
+                iFree.emplace(capacity - aCapacity, offset + aCapacity);
+            return offset;
+        }
+        void release(std::uint64_t aOffset, std::uint64_t aCapacity)
+        {
+            iFree.emplace(aCapacity, aOffset);
+        }
+    private:
+        os_file& iSlotFile;
+        os_file& iMapFile;
+        int const iLevel;
+        mutable std::mutex iMutex;
+        std::vector<map_entry> iMap;
+        std::multimap<std::uint64_t, std::uint64_t> iFree; // capacity -> offset
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> iPendingFree; // offset, capacity
+        std::set<std::size_t> iDirty;
+        std::uint64_t iEndOfSlots;
+        std::uint64_t iStoredBytes;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define NEODB_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define NEODB_TARGET(isa)
+#else
+#define NEODB_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace neodb
+{
+    // Instruction set extensions available at run time; kernels built for them with NEODB_TARGET are
+    // only called when the running CPU has them.
+    struct cpu_features
+    {
+        bool sse42 = false;
+        bool pclmul = false;
+        bool avx2 = false;
+    };
+
+    enum class simd_level : std::uint32_t
+    {
+        Scalar,
+        Sse42,
+        Avx2
+    };
+
+    inline cpu_features const& detected_cpu_features()
+    {
+        static cpu_features const sFeatures = []()
+        {
+            cpu_features result;
+#ifdef NEODB_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+            int info[4];
+            __cpuid(info, 1);
+            result.sse42 = (info[2] & (1 << 20)) != 0;
+            result.pclmul = (info[2] & (1 << 1)) != 0;
+            bool const osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+            __cpuidex(info, 7, 0);
+            result.avx2 = osAvx && (info[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            result.sse42 = __builtin_cpu_supports("sse4.2");
+            result.pclmul = __builtin_cpu_supports("pclmul");
+            result.avx2 = __builtin_cpu_supports("avx2");
+#endif
+#endif
+            return result;
+        }();
+        return sFeatures;
+    }
+
+    inline simd_level detected_simd_level()
+    {
+        auto const& features = detected_cpu_features();
+        return features.avx2 ? simd_level::Avx2 : features.sse42 ? simd_level::Sse42 : simd_level::Scalar;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,187 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <boost/endian/conversion.hpp>
+#include <neodb/cpu_features.hpp>
+
+namespace neodb
+{
+    enum class crc32c_implementation : std::uint32_t
+    {
+        Software,       // slicing-by-8 tables
+        Sse42,          // crc32 instruction, one stream
+        Sse42Pclmul,    // crc32 instruction, three interleaved streams combined by carry-less multiplication
+        Best
+    };
+
+    namespace detail
+    {
+        std::uint32_t constexpr CRC32C_POLYNOMIAL = 0x82F63B78u; // Castagnoli, reflected
+
+        inline constexpr std::array<std::array<std::uint32_t, 256>, 8> crc32c_tables()
+        {
+            std::array<std::array<std::uint32_t, 256>, 8> tables{};
+            for (std::uint32_t byte = 0; byte < 256; ++byte)
+            {
+                std::uint32_t crc = byte;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = (crc >> 1) ^ ((crc & 1u) ? CRC32C_POLYNOMIAL : 0u);
+                tables[0][byte] = crc;
+            }
+            for (std::uint32_t byte = 0; byte < 256; ++byte)
+                for (std::size_t table = 1; table < 8; ++table)
+                    tables[table][byte] = (tables[table - 1][byte] >> 8) ^ tables[0][tables[table - 1][byte] & 0xFFu];
+            return tables;
+        }
+
+        inline constexpr std::array<std::array<std::uint32_t, 256>, 8> CRC32C_TABLES = crc32c_tables();
+
+        // CRC register update, without the initial and final inversions
+        inline std::uint32_t crc32c_software(std::uint32_t aCrc, std::uint8_t const* aData, std::size_t aLength)
+        {
+            auto const& t = CRC32C_TABLES;
+            for (; aLength >= 8; aData += 8, aLength -= 8)
+            {
+                std::uint32_t low;
+                std::uint32_t high;
+                std::memcpy(&low, aData, 4);
+                std::memcpy(&high, aData + 4, 4);
+                low = boost::endian::little_to_native(low) ^ aCrc;
+                high = boost::endian::little_to_native(high);
+                aCrc = t[7][low & 0xFFu] ^ t[6][(low >> 8) & 0xFFu] ^ t[5][(low >> 16) & 0xFFu] ^ t[4][low >> 24] ^
+                    t[3][high & 0xFFu] ^ t[2][(high >> 8) & 0xFFu] ^ t[1][(high >> 16) & 0xFFu] ^ t[0][high >> 24];
+            }
+            for (; aLength > 0; ++aData, --aLength)
+                aCrc = (aCrc >> 8) ^ t[0][(aCrc ^ *aData) & 0xFFu];
+            return aCrc;
+        }
+
+        // x^aPower mod P, reflected
+        inline std::uint32_t crc32c_x_power(std::uint64_t aPower)
+        {
+            std::uint32_t result = 0x80000000u;
+            for (; aPower > 0; --aPower)
+                result = (result >> 1) ^ ((result & 1u) ? CRC32C_POLYNOMIAL : 0u);
+            return result;
+        }
+
+#ifdef NEODB_X86
+        NEODB_TARGET("sse4.2") inline std::uint32_t crc32c_sse42(std::uint32_t aCrc, std::uint8_t const* aData, std::size_t aLength)
+        {
+            std::uint64_t crc = aCrc;
+            for (; aLength >= 8; aData += 8, aLength -= 8)
+            {
+                std::uint64_t value;
+                std::memcpy(&value, aData, 8);
+                crc = _mm_crc32_u64(crc, value);
+            }
+            for (; aLength > 0; ++aData, --aLength)
+                crc = _mm_crc32_u8(static_cast<std::uint32_t>(crc), *aData);
+            return static_cast<std::uint32_t>(crc);
+        }
+
+        // The crc32 instruction has a latency of three cycles but a throughput of one per cycle, so three
+        // independent streams over consecutive blocks keep it busy. A stream's CRC is moved past the
+        // blocks after it by multiplying by x^(8n) mod P: a carry-less multiply by x^(8n-33) mod P then a
+        // crc32 of the 64-bit product (which contributes the remaining x^33) reduces it.
+        template <std::size_t Block>
+        struct crc32c_shift_constants
+        {
+            std::uint64_t one = crc32c_x_power(Block * 8 - 33);
+            std::uint64_t two = crc32c_x_power(Block * 16 - 33);
+        };
+
+        NEODB_TARGET("sse4.2,pclmul") inline std::uint32_t crc32c_shift(std::uint32_t aCrc, std::uint64_t aConstant)
+        {
+            auto const product = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(aCrc)), _mm_cvtsi64_si128(static_cast<long long>(aConstant)), 0);
+            return static_cast<std::uint32_t>(_mm_crc32_u64(0u, static_cast<std::uint64_t>(_mm_cvtsi128_si64(product))));
+        }
+
+        template <std::size_t Block>
+        NEODB_TARGET("sse4.2,pclmul") inline std::uint32_t crc32c_three_way(std::uint32_t aCrc, std::uint8_t const*& aData, std::size_t& aLength)
+        {
+            static crc32c_shift_constants<Block> const sConstants;
+            for (; aLength >= Block * 3; aData += Block * 3, aLength -= Block * 3)
+            {
+                std::uint64_t crc0 = aCrc;
+                std::uint64_t crc1 = 0u;
+                std::uint64_t crc2 = 0u;
+                for (std::size_t offset = 0; offset < Block; offset += 8)
+                {
+                    std::uint64_t value0, value1, value2;
+                    std::memcpy(&value0, aData + offset, 8);
+                    std::memcpy(&value1, aData + Block + offset, 8);
+                    std::memcpy(&value2, aData + Block * 2 + offset, 8);
+                    crc0 = _mm_crc32_u64(crc0, value0);
+                    crc1 = _mm_crc32_u64(crc1, value1);
+                    crc2 = _mm_crc32_u64(crc2, value2);
+                }
+                aCrc = crc32c_shift(static_cast<std::uint32_t>(crc0), sConstants.two) ^ crc32c_shift(static_cast<std::uint32_t>(crc1), sConstants.one) ^
+                    static_cast<std::uint32_t>(crc2);
+            }
+            return aCrc;
+        }
+
+        NEODB_TARGET("sse4.2,pclmul") inline std::uint32_t crc32c_sse42_pclmul(std::uint32_t aCrc, std::uint8_t const* aData, std::size_t aLength)
+        {
+            aCrc = crc32c_three_way<2048>(aCrc, aData, aLength);
+            aCrc = crc32c_three_way<256>(aCrc, aData, aLength);
+            return crc32c_sse42(aCrc, aData, aLength);
+        }
+#endif
+    }
+
+    // CRC-32C (Castagnoli) of aLength bytes, continuing from the CRC of preceding data if given.
+    inline std::uint32_t crc32c(void const* aData, std::size_t aLength, std::uint32_t aPrevious = 0u, crc32c_implementation aImplementation = crc32c_implementation::Best)
+    {
+        auto const data = static_cast<std::uint8_t const*>(aData);
+        std::uint32_t const crc = ~aPrevious;
+#ifdef NEODB_X86
+        auto const& features = detected_cpu_features();
+        if (aImplementation == crc32c_implementation::Best)
+            aImplementation = features.sse42 && features.pclmul ? crc32c_implementation::Sse42Pclmul :
+                features.sse42 ? crc32c_implementation::Sse42 : crc32c_implementation::Software;
+        if (aImplementation == crc32c_implementation::Sse42Pclmul && features.sse42 && features.pclmul)
+            return ~detail::crc32c_sse42_pclmul(crc, data, aLength);
+        if (aImplementation != crc32c_implementation::Software && features.sse42)
+            return ~detail::crc32c_sse42(crc, data, aLength);
+#endif
+        return ~detail::crc32c_software(crc, data, aLength);
+    }
+}
\ No newline at end of file
@@ -1,102 +1,149 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <unordered_map>
-#include <neodb/data_type.hpp>
-#include <neodb/i_database.hpp>
-#include <neodb/record.hpp>
-#include <neodb/table.hpp>
-
-namespace neodb
-{
-    class database : public i_database
-    {
-    public:
-        typedef vector<ref_ptr<table>> table_list;
-    public:
-        database(string const& aDatabaseName) :
-            iName{ aDatabaseName },
-            iRoot{}
-        {
-        }
-    public:
-        i_string const& name() const override
-        {
-            return iName;
-        }
-        table_list const& tables() const override
-        {
-            return iTables;
-        }
-        void create_table(i_schema const& aSchema) override
-        {
-            auto schemaRecord = allocate_record(record_type::Schema, schema_record_size(aSchema));
-            *schemaRecord << aSchema;
-            iTables.push_back(make_ref<table>(*this, aSchema));
-        }
-    public:
-        root_page const& root() const override
-        {
-            return iRoot;
-        }
-        root_page& root() override
-        {
-            return iRoot;
-        }
-        using i_database::allocate_record;
-        void allocate_record(record_type aRecordType, link::size_type aRecordSize, i_ref_ptr<i_record>& aNewRecord) override
-        {
-            // todo: use a pool of records to reduce number of memory allocations.
-            aNewRecord = make_ref<record>(*this, aRecordType, aRecordSize);
-            iActiveRecords[&*aNewRecord] = aNewRecord;
-        }
-        void free_record(i_record& aExistingRecord) override
-        {
-            // todo: use a pool of records to reduce number of memory allocations.
-            auto existing = iActiveRecords.find(&aExistingRecord);
-            if (existing != iActiveRecords.end())
-                iActiveRecords.erase(existing);
-        }
-    protected:
-        virtual page::pointer_type allocate_page() = 0;
-        virtual void free_page(page::pointer_type aAddress) = 0;
-    private:
-        string iName;
-        root_page iRoot;
-        table_list iTables;
-        std::unordered_map<i_record*, weak_ref_ptr<i_record>> iActiveRecords;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <neodb/data_type.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/record.hpp>
+#include <neodb/table.hpp>
+#include <neodb/page_allocator.hpp>
+#include <neodb/record_allocator.hpp>
+
+namespace neodb
+{
+    class database : public i_database
+    {
+    public:
+        typedef vector<ref_ptr<table>> table_list;
+    public:
+        database(string const& aDatabaseName) :
+            iName{ aDatabaseName },
+            iRoot{},
+            iVersions{ iRoot.header.versionClock },
+            iPageAllocator{ *this, [this](std::uint64_t aPageCount) { return extend(aPageCount); } },
+            iRecordAllocator{ *this }
+        {
+        }
+    public:
+        i_string const& name() const override
+        {
+            return iName;
+        }
+        table_list const& tables() const override
+        {
+            return iTables;
+        }
+        using i_database::create_table;
+        void create_table(i_schema const& aSchema, table_options const& aOptions) override
+        {
+            // the hash index lives in memory only and is rebuilt from the ordered index on reopen
+            if (persistent() && !(aOptions.primaryIndex & primary_index_type::Ordered))
+                throw primary_index_not_persistent();
+            auto schemaRecord = allocate_record(record_type::Schema, schema_record_size(aSchema));
+            *schemaRecord << aSchema;
+            iTables.push_back(make_ref<table>(*this, aSchema, aOptions));
+        }
+    public:
+        root_page const& root() const override
+        {
+            return iRoot;
+        }
+        root_page& root() override
+        {
+            return iRoot;
+        }
+        using i_database::allocate_record;
+        void allocate_record(record_type aRecordType, link::size_type aRecordSize, i_ref_ptr<i_record>& aNewRecord) override
+        {
+            auto const address = iRecordAllocator.allocate(aRecordType, aRecordSize);
+            aNewRecord = make_ref<record>(*this, iActiveRecords, aRecordType, aRecordSize, address);
+        }
+        void free_record(i_record& aExistingRecord) override
+        {
+            iRecordAllocator.free(aExistingRecord.type(), aExistingRecord.address());
+        }
+        void free_record(record_type aRecordType, page::pointer_type aAddress) override
+        {
+            iRecordAllocator.free(aRecordType, aAddress);
+        }
+        void allocate_records(record_type aRecordType, link::size_type aRecordSize, std::size_t aCount, page::pointer_type* aAddresses) override
+        {
+            iRecordAllocator.allocate_packed(aRecordType, static_cast<std::size_t>(aRecordSize), aCount, aAddresses);
+        }
+        neodb::version_clock& versions() override
+        {
+            return iVersions;
+        }
+        std::size_t collect_garbage() override
+        {
+            auto const horizon = iVersions.horizon();
+            std::size_t collected = 0;
+            for (auto& existing : iTables)
+                collected += existing->collect_garbage(horizon);
+            return collected;
+        }
+        active_record_list const& active_records() const
+        {
+            return iActiveRecords;
+        }
+        page::pointer_type allocate_pages(std::uint64_t aPageCount) override
+        {
+            return iPageAllocator.allocate(aPageCount);
+        }
+        void free_pages(page::pointer_type aAddress, std::uint64_t aPageCount) override
+        {
+            iPageAllocator.free(aAddress, aPageCount);
+        }
+        neodb::page_allocator const& page_allocator() const
+        {
+            return iPageAllocator;
+        }
+    protected:
+        // grow the underlying storage by aPageCount zeroed pages, returning the address of the first
+        virtual page::pointer_type extend(std::uint64_t aPageCount) = 0;
+        void load_free_pages()
+        {
+            iPageAllocator.load();
+        }
+    private:
+        string iName;
+        root_page iRoot;
+        neodb::version_clock iVersions;
+        neodb::page_allocator iPageAllocator;
+        neodb::record_allocator iRecordAllocator;
+        active_record_list iActiveRecords;
+        table_list iTables;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,442 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <deque>
+#include <functional>
+#include <future>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <neodb/cpu_features.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/i_table.hpp>
+
+namespace neodb
+{
+    struct bad_import_record : std::runtime_error
+    {
+        bad_import_record(std::uint64_t aOffset, std::string const& aReason) :
+            std::runtime_error{ "neodb::bad_import_record: " + aReason + " at byte " + std::to_string(aOffset) } {}
+    };
+
+    struct delimited_import_options
+    {
+        char delimiter = ',';
+        // fields may be enclosed in double quotes, within which delimiters and line breaks are data and
+        // a doubled quote stands for one; an empty unquoted field is null
+        bool quoted = true;
+        bool header = false; // skip the first record
+        std::size_t threads = 0; // parsing threads, zero for one per core
+        std::size_t chunkSize = 4 * 1024 * 1024;
+        // called on the reading thread after each chunk's rows are inserted with the running row count;
+        // a file database would commit here so that its buffer pool can evict the inserted pages
+        std::function<void(std::uint64_t aRows)> inserted;
+    };
+
+    namespace detail
+    {
+        // Append the offsets of every delimiter, line feed and quote character in aText[aBegin, aLength);
+        // the SIMD kernels return how far they got, leaving the tail to the scalar one.
+        inline void find_separators_scalar(char const* aText, std::size_t aBegin, std::size_t aLength, char aDelimiter, char aQuote, std::vector<std::uint32_t>& aOffsets)
+        {
+            for (std::size_t offset = aBegin; offset < aLength; ++offset)
+                if (aText[offset] == aDelimiter || aText[offset] == '\n' || aText[offset] == aQuote)
+                    aOffsets.push_back(static_cast<std::uint32_t>(offset));
+        }
+
+#ifdef NEODB_X86
+        NEODB_TARGET("sse4.2") inline std::size_t find_separators_sse42(char const* aText, std::size_t aLength, char aDelimiter, char aQuote, std::vector<std::uint32_t>& aOffsets)
+        {
+            auto const delimiter = _mm_set1_epi8(aDelimiter);
+            auto const lineFeed = _mm_set1_epi8('\n');
+            auto const quote = _mm_set1_epi8(aQuote);
+            std::size_t offset = 0;
+            for (; offset + 16 <= aLength; offset += 16)
+            {
+                auto const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(aText + offset));
+                auto const separators = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, delimiter), _mm_cmpeq_epi8(bytes, lineFeed)), _mm_cmpeq_epi8(bytes, quote));
+                for (auto mask = static_cast<std::uint32_t>(_mm_movemask_epi8(separators)); mask != 0u; mask &= mask - 1u)
+                    aOffsets.push_back(static_cast<std::uint32_t>(offset + std::countr_zero(mask)));
+            }
+            return offset;
+        }
+
+        NEODB_TARGET("avx2") inline std::size_t find_separators_avx2(char const* aText, std::size_t aLength, char aDelimiter, char aQuote, std::vector<std::uint32_t>& aOffsets)
+        {
+            auto const delimiter = _mm256_set1_epi8(aDelimiter);
+            auto const lineFeed = _mm256_set1_epi8('\n');
+            auto const quote = _mm256_set1_epi8(aQuote);
+            std::size_t offset = 0;
+            for (; offset + 32 <= aLength; offset += 32)
+            {
+                auto const bytes = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(aText + offset));
+                auto const separators = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, delimiter), _mm256_cmpeq_epi8(bytes, lineFeed)), _mm256_cmpeq_epi8(bytes, quote));
+                for (auto mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(separators)); mask != 0u; mask &= mask - 1u)
+                    aOffsets.push_back(static_cast<std::uint32_t>(offset + std::countr_zero(mask)));
+            }
+            return offset;
+        }
+#endif
+
+        // Without quoting aQuote should repeat aDelimiter.
+        inline void find_separators(char const* aText, std::size_t aLength, char aDelimiter, char aQuote, std::vector<std::uint32_t>& aOffsets, simd_level aLevel = detected_simd_level())
+        {
+            aOffsets.clear();
+            std::size_t done = 0;
+#ifdef NEODB_X86
+            if (aLevel == simd_level::Avx2)
+                done = find_separators_avx2(aText, aLength, aDelimiter, aQuote, aOffsets);
+            else if (aLevel == simd_level::Sse42)
+                done = find_separators_sse42(aText, aLength, aDelimiter, aQuote, aOffsets);
+#endif
+            find_separators_scalar(aText, done, aLength, aDelimiter, aQuote, aOffsets);
+        }
+
+        // The length of the longest prefix of aText made of whole records, npos if there is none: the
+        // offset after its last line feed that is not within quotes.
+        inline std::size_t whole_records(char const* aText, std::size_t aLength, bool aQuoted, std::vector<std::uint32_t>& aScratch)
+        {
+            if (!aQuoted)
+            {
+                for (std::size_t offset = aLength; offset > 0; --offset)
+                    if (aText[offset - 1] == '\n')
+                        return offset;
+                return std::string_view::npos;
+            }
+            find_separators(aText, aLength, '\n', '"', aScratch);
+            std::size_t result = std::string_view::npos;
+            bool inQuotes = false;
+            for (auto offset : aScratch)
+            {
+                if (aText[offset] == '"')
+                    inQuotes = !inQuotes;
+                else if (!inQuotes)
+                    result = offset + 1u;
+            }
+            return result;
+        }
+
+        inline int hex_digit(char aDigit)
+        {
+            if (aDigit >= '0' && aDigit <= '9')
+                return aDigit - '0';
+            if (aDigit >= 'a' && aDigit <= 'f')
+                return aDigit - 'a' + 10;
+            if (aDigit >= 'A' && aDigit <= 'F')
+                return aDigit - 'A' + 10;
+            return -1;
+        }
+
+        // Parse a field's text straight into its place in a row. Integers and floating point numbers
+        // are as read by std::from_chars, Bool is true/false or 1/0, Time is nanoseconds since the
+        // epoch and Uuid is 32 hex digits optionally grouped by hyphens and within braces.
+        inline bool parse_field_value(field_layout const& aField, std::string_view aText, std::uint8_t* aDestination)
+        {
+            return visit_data_type(aField.dataType, [&](auto aType) -> bool
+            {
+                typedef typename decltype(aType)::type value_type;
+                if constexpr (std::is_same_v<value_type, bool>)
+                {
+                    bool const isTrue = aText == "true" || aText == "1";
+                    if (!isTrue && aText != "false" && aText != "0")
+                        return false;
+                    store_little(aDestination, isTrue);
+                    return true;
+                }
+                else if constexpr (std::is_same_v<value_type, char>)
+                {
+                    if (aText.size() != 1u)
+                        return false;
+                    *aDestination = static_cast<std::uint8_t>(aText[0]);
+                    return true;
+                }
+                else if constexpr (std::is_arithmetic_v<value_type> || std::is_same_v<value_type, time>)
+                {
+                    typedef std::conditional_t<std::is_same_v<value_type, time>, std::int64_t, value_type> number_type;
+                    number_type value{};
+                    auto const begin = aText.data() + (aText.size() > 1u && aText[0] == '+' ? 1 : 0);
+                    auto const [end, error] = std::from_chars(begin, aText.data() + aText.size(), value);
+                    if (error != std::errc{} || end != aText.data() + aText.size())
+                        return false;
+                    store_little(aDestination, value);
+                    return true;
+                }
+                else if constexpr (std::is_same_v<value_type, c_string> || std::is_same_v<value_type, vc_string>)
+                {
+                    bool const varchar = std::is_same_v<value_type, vc_string>;
+                    std::size_t const capacity = varchar ? aField.size - 2 : aField.size;
+                    if (aText.size() > capacity)
+                        throw field_value_too_long();
+                    if (varchar)
+                    {
+                        store_little<uint16_t>(aDestination, static_cast<uint16_t>(aText.size()));
+                        aDestination += 2;
+                    }
+                    std::memcpy(aDestination, aText.data(), aText.size());
+                    std::memset(aDestination + aText.size(), 0, capacity - aText.size());
+                    return true;
+                }
+                else if constexpr (std::is_same_v<value_type, uuid>)
+                {
+                    if (aText.size() > 2u && aText.front() == '{' && aText.back() == '}')
+                        aText = aText.substr(1, aText.size() - 2);
+                    std::uint8_t bytes[16] = {};
+                    std::size_t digits = 0;
+                    for (auto character : aText)
+                    {
+                        if (character == '-')
+                            continue;
+                        auto const digit = hex_digit(character);
+                        if (digit < 0 || digits == 32)
+                            return false;
+                        bytes[digits / 2] = static_cast<std::uint8_t>(bytes[digits / 2] << 4 | digit);
+                        ++digits;
+                    }
+                    if (digits != 32)
+                        return false;
+                    uuid value{};
+                    value.part1 = static_cast<std::uint32_t>(bytes[0]) << 24 | static_cast<std::uint32_t>(bytes[1]) << 16 | static_cast<std::uint32_t>(bytes[2]) << 8 | bytes[3];
+                    value.part2 = static_cast<std::uint16_t>(bytes[4] << 8 | bytes[5]);
+                    value.part3 = static_cast<std::uint16_t>(bytes[6] << 8 | bytes[7]);
+                    value.part4 = static_cast<std::uint16_t>(bytes[8] << 8 | bytes[9]);
+                    std::copy(bytes + 10, bytes + 16, value.part5.begin());
+                    encode_field_value(aField, value, aDestination);
+                    return true;
+                }
+                else
+                    throw unsupported_field_type();
+            });
+        }
+
+        struct parsed_chunk
+        {
+            std::vector<std::uint8_t> rows;
+            std::size_t count = 0;
+        };
+
+        // Parse whole records of delimited text into encoded rows. aOffset is the text's position in the
+        // input, for error reports.
+        inline parsed_chunk parse_records(neodb::row_layout const& aLayout, std::vector<char> const& aText, std::uint64_t aOffset, delimited_import_options const& aOptions, bool aSkipFirst)
+        {
+            parsed_chunk result;
+            std::vector<std::uint32_t> separators;
+            find_separators(aText.data(), aText.size(), aOptions.delimiter, aOptions.quoted ? '"' : aOptions.delimiter, separators);
+            separators.push_back(static_cast<std::uint32_t>(aText.size())); // end of the final record when it has no line feed
+            std::size_t const rowSize = aLayout.size();
+            std::size_t const fieldCount = aLayout.field_count();
+            result.rows.reserve((aText.size() / std::max<std::size_t>(rowSize, 16u) + 1) * rowSize);
+            bool skip = aSkipFirst;
+            std::size_t field = 0;
+            std::size_t fieldBegin = 0;
+            std::size_t fieldEnd = 0;
+            bool inQuotes = false;
+            bool wasQuoted = false;
+            bool escaped = false;
+            std::string unescaped;
+            auto fail = [&](std::size_t aPosition, std::string const& aReason)
+            {
+                throw bad_import_record{ aOffset + aPosition, aReason };
+            };
+            auto end_field = [&](std::size_t aEnd)
+            {
+                if (!wasQuoted)
+                    fieldEnd = aEnd;
+                if (!skip)
+                {
+                    if (field == fieldCount)
+                        fail(aEnd, "too many fields");
+                    if (field == 0)
+                        result.rows.resize(result.rows.size() + rowSize);
+                    auto const row = &result.rows[result.count * rowSize];
+                    auto const& layout = aLayout.field(field);
+                    std::string_view text{ aText.data() + fieldBegin, fieldEnd - fieldBegin };
+                    if (escaped)
+                    {
+                        unescaped.clear();
+                        for (std::size_t index = 0; index < text.size(); ++index)
+                            if (text[index] != '"' || index + 1 == text.size() || text[++index] == '"')
+                                unescaped += text[index];
+                        text = unescaped;
+                    }
+                    if (!wasQuoted && text.empty() && layout.nullBit != NOT_NULLABLE)
+                        set_null(layout, row, true);
+                    else
+                    {
+                        try
+                        {
+                            if (!parse_field_value(layout, text, row + layout.offset))
+                                fail(fieldBegin, "bad value for field " + std::to_string(field));
+                        }
+                        catch (field_value_too_long const&)
+                        {
+                            fail(fieldBegin, "value too long for field " + std::to_string(field));
+                        }
+                    }
+                }
+                ++field;
+                wasQuoted = false;
+                escaped = false;
+            };
+            auto end_record = [&](std::size_t aEnd)
+            {
+                if (!skip && field != fieldCount)
+                    fail(aEnd, "too few fields");
+                if (!skip)
+                    ++result.count;
+                skip = false;
+                field = 0;
+            };
+            for (std::size_t index = 0; index < separators.size(); ++index)
+            {
+                std::size_t const position = separators[index];
+                if (position == aText.size())
+                {
+                    if (inQuotes)
+                        fail(fieldBegin, "unterminated quoted field");
+                    if (field != 0 || wasQuoted || fieldBegin < aText.size())
+                    {
+                        end_field(position);
+                        end_record(position);
+                    }
+                    break;
+                }
+                char const character = aText[position];
+                if (inQuotes)
+                {
+                    if (character != '"')
+                        continue;
+                    if (position + 1 < aText.size() && aText[position + 1] == '"')
+                    {
+                        escaped = true;
+                        ++index;
+                    }
+                    else
+                    {
+                        inQuotes = false;
+                        fieldEnd = position;
+                    }
+                }
+                else if (character == aOptions.delimiter)
+                {
+                    end_field(position);
+                    fieldBegin = position + 1;
+                }
+                else if (character == '\n')
+                {
+                    std::size_t const lineEnd = position > fieldBegin && aText[position - 1] == '\r' && !wasQuoted ? position - 1 : position;
+                    // a blank line is no record
+                    if (field != 0 || wasQuoted || lineEnd != fieldBegin)
+                    {
+                        end_field(lineEnd);
+                        end_record(position);
+                    }
+                    fieldBegin = position + 1;
+                }
+                else if (position == fieldBegin)
+                {
+                    // an opening quote; a quote elsewhere in an unquoted field is data
+                    inQuotes = true;
+                    wasQuoted = true;
+                    fieldBegin = position + 1;
+                }
+            }
+            return result;
+        }
+    }
+
+    // Stream delimited text (CSV, or TSV with a tab delimiter and no quoting) into a table with fixed
+    // width rows, converting each field by the table's row layout. The input is read a chunk at a
+    // time, cut at the last record boundary, and the chunks are parsed on up to options.threads
+    // threads at once while the reading thread hands parsed chunks, in input order, to the table's
+    // bulk_insert(); so at most a few chunks are ever held in memory. Returns the number of rows.
+    inline std::uint64_t import_delimited(i_table& aTable, std::istream& aInput, delimited_import_options const& aOptions = {})
+    {
+        auto const& layout = aTable.row_layout();
+        if (!layout.fixed_width())
+            throw unsupported_field_type();
+        std::size_t const threads = aOptions.threads != 0 ? aOptions.threads : std::max(1u, std::thread::hardware_concurrency());
+        std::size_t const chunkSize = std::max<std::size_t>(aOptions.chunkSize, 64u);
+        std::deque<std::future<detail::parsed_chunk>> parsing;
+        std::uint64_t rows = 0;
+        auto insert_next = [&]()
+        {
+            auto const chunk = parsing.front().get();
+            parsing.pop_front();
+            if (chunk.count != 0)
+                aTable.bulk_insert(chunk.rows.data(), chunk.count);
+            rows += chunk.count;
+            if (aOptions.inserted)
+                aOptions.inserted(rows);
+        };
+        std::vector<char> buffer;
+        std::vector<std::uint32_t> scratch;
+        std::uint64_t offset = 0;
+        bool first = true;
+        for (bool more = true; more;)
+        {
+            std::size_t const carried = buffer.size();
+            buffer.resize(carried + chunkSize);
+            aInput.read(buffer.data() + carried, static_cast<std::streamsize>(chunkSize));
+            buffer.resize(carried + static_cast<std::size_t>(aInput.gcount()));
+            more = static_cast<bool>(aInput);
+            std::size_t const end = more ? detail::whole_records(buffer.data(), buffer.size(), aOptions.quoted, scratch) : buffer.size();
+            if (end == std::string_view::npos)
+                continue; // a record longer than a chunk
+            std::vector<char> chunk{ buffer.begin() + end, buffer.end() };
+            chunk.swap(buffer);
+            chunk.resize(end);
+            if (parsing.size() == threads)
+                insert_next();
+            parsing.push_back(std::async(std::launch::async, [&layout, &aOptions, offset, skipFirst = first && aOptions.header, text = std::move(chunk)]()
+            {
+                return detail::parse_records(layout, text, offset, aOptions, skipFirst);
+            }));
+            offset += end;
+            first = false;
+        }
+        while (!parsing.empty())
+            insert_next();
+        return rows;
+    }
+}
\ No newline at end of file
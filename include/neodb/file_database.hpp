@@ -1,82 +1,450 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <filesystem>
-#include <fstream>
-#include <neodb/database.hpp>
-
-namespace neodb
-{
-    class file_database : public database
-    {
-    public:
-        file_database(std::filesystem::path const& aDatabasePath) :
-            database{ aDatabasePath.filename().stem().generic_string() }
-        {
-            root().clear();
-            if (!std::filesystem::exists(aDatabasePath.parent_path()))
-                std::filesystem::create_directories(aDatabasePath.parent_path());
-            bool newDatabase = !std::filesystem::exists(aDatabasePath);
-            iFile.emplace(aDatabasePath.generic_string(), std::ios::binary | std::ios::in | std::ios::out | std::ios::app);
-            if (!file())
-                throw std::runtime_error{ "Failed to open database file '" + aDatabasePath.generic_string() + "'" };
-            file().seekg(0);
-            file().seekp(0);
-            if (newDatabase)
-                file() << root();
-            else
-                file() >> root();
-            if (!file())
-                throw std::runtime_error{ "Failed to initialise database '" + aDatabasePath.generic_string() + "'" };
-        }
-    protected:
-        page::pointer_type allocate_page() override
-        {
-            return 0;
-        }
-        void free_page(page::pointer_type aAddress) override
-        {
-        }
-    private:
-        std::fstream& file()
-        {
-            return *iFile;
-        }
-        void commit();
-    private:
-        std::optional<std::fstream> iFile;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <map>
+#include <set>
+#include <unordered_set>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <neodb/database.hpp>
+#include <neodb/buffer_pool.hpp>
+#include <neodb/os_file.hpp>
+#include <neodb/file_page_io.hpp>
+#include <neodb/uring_page_io.hpp>
+#include <neodb/compressed_page_io.hpp>
+#include <neodb/checksummed_page_io.hpp>
+#include <neodb/write_ahead_log.hpp>
+
+namespace neodb
+{
+    struct file_database_options
+    {
+        std::size_t bufferPoolCapacity = buffer_pool::DEFAULT_CAPACITY;
+        bool writeAheadLog = true;
+        std::uint64_t checkpointThreshold = 64 * 1024 * 1024;
+        bool asynchronousIo = true; // io_uring where built in (NEODB_IO_URING) and permitted by the kernel
+        // Keep pages zlib compressed in a slot file beside the database; the database file itself then
+        // only holds the root page. A database created with compressed pages is always opened with them.
+        bool compressedPages = false;
+        int compressionLevel = Z_DEFAULT_COMPRESSION;
+        // re-read and verify every page's checksum this often in the background; zero for never
+        std::chrono::milliseconds scrubInterval{ 0 };
+        // a commit filling at least this many previously blank pages writes them to the database file
+        // and syncs it instead of logging their contents; zero to always log them
+        std::size_t minimalLoggingThreshold = 16;
+    };
+
+    // With the write-ahead log enabled commit() logs the byte ranges of every page (and of the root page)
+    // changed since the previous commit, stamping the pages with the commit's LSN, and returns once the
+    // log is durable; dirty pages reach the database file later, on eviction or at a checkpoint. Pages
+    // holding changes that have not been committed, or whose log record is not yet durable, are never
+    // evicted, so the log only ever needs redoing. The first change to a page after a checkpoint logs
+    // the whole page so that a page torn by a crash while being written out is rebuilt from the log.
+    // Every page but the root page carries a CRC-32C checksum, verified whenever it is read back.
+    class file_database : public database
+    {
+    public:
+        file_database(std::filesystem::path const& aDatabasePath, file_database_options const& aOptions = {}) :
+            database{ aDatabasePath.filename().stem().generic_string() },
+            iPath{ aDatabasePath },
+            iOptions{ aOptions },
+            iFile{ prepare_path(aDatabasePath) },
+            iPageIo{ std::make_unique<checksummed_page_io>(create_page_io(aOptions)) },
+            iBufferPool{ *iPageIo, aOptions.bufferPoolCapacity },
+            iEndOfFile{ page::size }
+        {
+            root().clear();
+            bool const newDatabase = iFile.size() == 0;
+            if (newDatabase)
+                iFile.write_at(0, &root(), sizeof(root_page));
+            else
+            {
+                if (iFile.read_at(0, &root(), sizeof(root_page)) != sizeof(root_page))
+                    throw std::runtime_error{ "Failed to initialise database '" + aDatabasePath.generic_string() + "'" };
+                if (root().header.magic != MAGIC)
+                    throw bad_magic();
+            }
+            iEndOfFile = std::max<std::uint64_t>((iFile.size() + page::size - 1) / page::size * page::size, page::size);
+            if (iOptions.writeAheadLog)
+            {
+                iLog.emplace(log_path());
+                recover();
+                iBufferPool.set_durable_lsn(iLog->durable_lsn());
+                iBufferPool.track_changes(true);
+            }
+            iCommittedRoot = root();
+            if (!newDatabase)
+                load_free_pages();
+            if (iOptions.scrubInterval.count() > 0)
+                iScrubber = std::thread{ [this]() { scrub_periodically(); } };
+        }
+        file_database(std::filesystem::path const& aDatabasePath, std::size_t aBufferPoolCapacity) :
+            file_database{ aDatabasePath, file_database_options{ aBufferPoolCapacity } }
+        {
+        }
+        ~file_database()
+        {
+            if (iScrubber.joinable())
+            {
+                {
+                    std::scoped_lock lock{ iScrubMutex };
+                    iStopScrubbing = true;
+                }
+                iScrubCondition.notify_one();
+                iScrubber.join();
+            }
+            try
+            {
+                commit();
+                if (iLog)
+                    checkpoint();
+            }
+            catch (...)
+            {
+            }
+        }
+    public:
+        bool persistent() const override
+        {
+            return true;
+        }
+    public:
+        std::filesystem::path log_path() const
+        {
+            auto result = iPath;
+            result += ".wal";
+            return result;
+        }
+        std::filesystem::path slot_path() const
+        {
+            auto result = iPath;
+            result += ".slots";
+            return result;
+        }
+        std::filesystem::path map_path() const
+        {
+            auto result = iPath;
+            result += ".map";
+            return result;
+        }
+        bool compressed_pages() const
+        {
+            return iSlotFile.has_value();
+        }
+        void commit()
+        {
+            if (!iLog)
+            {
+                write_out(root());
+                return;
+            }
+            write_ahead_log::ticket_t ticket;
+            {
+                std::scoped_lock lock{ iCommitMutex };
+                auto const lsn = iLog->next_lsn();
+                log_transaction transaction;
+                std::vector<std::pair<page::pointer_type, page>> blankPages;
+                iBufferPool.collect_changes([&](page::pointer_type aAddress, page const& aBase, page& aCurrent)
+                {
+                    if (std::memcmp(&aBase, &aCurrent, sizeof(page)) == 0)
+                        return false;
+                    aCurrent.header.lsn = lsn;
+                    if (is_blank(aBase) && !iLoggedPages.contains(aAddress))
+                        blankPages.emplace_back(aAddress, aCurrent);
+                    else
+                        log_change(transaction, aAddress, aBase, aCurrent);
+                    return true;
+                });
+                if (iOptions.minimalLoggingThreshold != 0u && blankPages.size() >= iOptions.minimalLoggingThreshold)
+                {
+                    // Minimal logging for bulk loads: pages that were blank before this transaction are
+                    // made durable in place ahead of the log record. Until the record is durable they are
+                    // unreachable from the committed state, so a crash in between only leaves them orphaned.
+                    std::vector<page_write> writes;
+                    for (auto const& [address, contents] : blankPages)
+                        writes.push_back(page_write{ address, &contents });
+                    iPageIo->write_pages(writes.data(), writes.size());
+                    iPageIo->sync();
+                }
+                else
+                {
+                    static page const blank{};
+                    for (auto const& [address, contents] : blankPages)
+                        log_change(transaction, address, blank, contents);
+                }
+                transaction.add_difference(0u, iCommittedRoot, root());
+                iCommittedRoot = root();
+                if (transaction.empty())
+                    return;
+                ticket = iLog->append(lsn, transaction);
+            }
+            // committers arriving while this one waits are written and synced together
+            iLog->wait_durable(ticket);
+            iBufferPool.set_durable_lsn(iLog->durable_lsn());
+            if (iLog->size() >= iOptions.checkpointThreshold)
+                checkpoint();
+        }
+        // Write every committed page and the root page to the database file and discard the log; changes
+        // made since the last commit stay in memory, uncommitted.
+        void checkpoint()
+        {
+            if (!iLog)
+            {
+                write_out(root());
+                return;
+            }
+            std::scoped_lock lock{ iCommitMutex };
+            // a committer may still be waiting for its record; its pages must not be written ahead of it
+            iLog->wait_all_durable();
+            iBufferPool.set_durable_lsn(iLog->durable_lsn());
+            write_out(iCommittedRoot);
+            iLog->reset();
+            iLoggedPages.clear();
+        }
+        neodb::buffer_pool const& buffer_pool() const
+        {
+            return iBufferPool;
+        }
+        i_page_io& page_io() const
+        {
+            return *iPageIo;
+        }
+        void prefetch(page::pointer_type const* aAddresses, std::size_t aCount)
+        {
+            iBufferPool.prefetch(aAddresses, aCount);
+        }
+        // Read every page back from storage, bypassing the buffer pool, and return the addresses of those
+        // failing their checksum. A page is read twice before it is reported as one being written out
+        // at the same time can be seen half written.
+        std::vector<page::pointer_type> scrub()
+        {
+            std::vector<page::pointer_type> failed;
+            auto& storage = static_cast<checksummed_page_io&>(*iPageIo).next();
+            auto scratch = std::make_unique<page>();
+            for (page::pointer_type address = page::size; address < iEndOfFile && !iStopScrubbing; address += page::size)
+            {
+                bool verified = false;
+                for (int attempt = 0; attempt < 2 && !verified; ++attempt)
+                {
+                    try
+                    {
+                        storage.read_page(address, *scratch);
+                        verified = verify_page_checksum(*scratch);
+                    }
+                    catch (page_io_error const&)
+                    {
+                    }
+                }
+                if (!verified)
+                    failed.push_back(address);
+            }
+            return failed;
+        }
+        // pages the background scrubber has found failing their checksum
+        std::vector<page::pointer_type> scrub_failures() const
+        {
+            std::scoped_lock lock{ iScrubMutex };
+            return iScrubFailures;
+        }
+    public:
+        page& pin_page(page::pointer_type aAddress) override
+        {
+            return iBufferPool.pin(aAddress);
+        }
+        void unpin_page(page::pointer_type aAddress, bool aDirty) override
+        {
+            iBufferPool.unpin(aAddress, aDirty);
+        }
+        bool peek_page(page::pointer_type aAddress, page_peek& aPeek) override
+        {
+            return iBufferPool.peek(aAddress, aPeek);
+        }
+    protected:
+        page::pointer_type extend(std::uint64_t aPageCount) override
+        {
+            page::pointer_type const address = iEndOfFile.load();
+            iEndOfFile += aPageCount * page::size;
+            // with compressed pages this just leaves a hole recording the extent of the page space
+            iFile.truncate(iEndOfFile);
+            return address;
+        }
+    private:
+        static bool is_blank(page const& aPage)
+        {
+            auto const bytes = reinterpret_cast<std::uint8_t const*>(&aPage);
+            return std::all_of(bytes, bytes + sizeof(page), [](std::uint8_t aByte) { return aByte == 0u; });
+        }
+        // Must be called with iCommitMutex held.
+        void log_change(log_transaction& aTransaction, std::uint64_t aAddress, page const& aBase, page const& aCurrent)
+        {
+            if (iLoggedPages.insert(aAddress).second)
+                aTransaction.add_image(aAddress, aCurrent);
+            else
+                aTransaction.add_difference(aAddress, aBase, aCurrent);
+        }
+        static std::filesystem::path const& prepare_path(std::filesystem::path const& aDatabasePath)
+        {
+            if (!aDatabasePath.parent_path().empty() && !std::filesystem::exists(aDatabasePath.parent_path()))
+                std::filesystem::create_directories(aDatabasePath.parent_path());
+            return aDatabasePath;
+        }
+        std::unique_ptr<i_page_io> create_page_io(file_database_options const& aOptions)
+        {
+            if (aOptions.compressedPages || std::filesystem::exists(map_path()))
+            {
+                iSlotFile.emplace(slot_path());
+                iMapFile.emplace(map_path());
+                return std::make_unique<compressed_page_io>(*iSlotFile, *iMapFile, aOptions.compressionLevel);
+            }
+#ifdef NEODB_IO_URING
+            if (aOptions.asynchronousIo)
+                if (auto uring = uring_page_io::create(iFile))
+                    return uring;
+#endif
+            return std::make_unique<file_page_io>(iFile);
+        }
+        void scrub_periodically()
+        {
+            std::unique_lock lock{ iScrubMutex };
+            while (!iScrubCondition.wait_for(lock, iOptions.scrubInterval, [&]() { return iStopScrubbing.load(); }))
+            {
+                lock.unlock();
+                auto const failed = scrub();
+                lock.lock();
+                for (auto address : failed)
+                    if (std::find(iScrubFailures.begin(), iScrubFailures.end(), address) == iScrubFailures.end())
+                        iScrubFailures.push_back(address);
+            }
+        }
+        // With the log on, only what has been committed is written: aRoot is the committed root page and
+        // the buffer pool writes pages as of the last commit.
+        void write_out(root_page const& aRoot)
+        {
+            iBufferPool.flush();
+            iFile.write_at(0, &aRoot, sizeof(root_page));
+            if (compressed_pages())
+                iPageIo->sync();
+            iFile.sync();
+        }
+        // Redo committed changes that had not reached the database file: a page is brought up to date
+        // by a transaction only if the page's LSN is older than the transaction's. A page logged in full
+        // is rebuilt from blank without reading it, as what the database file holds may be torn. The
+        // root page is only ever written at a checkpoint so all of its logged changes are redone. A page
+        // that fails its checksum is restored from the log: it starts blank and must be logged in full
+        // later in the log, otherwise it cannot be recovered and bad_page_checksum is thrown.
+        void recover()
+        {
+            lsn_t currentLsn = 0;
+            std::map<std::uint64_t, bool> redo;
+            std::set<std::uint64_t> unrestored;
+            bool recovered = false;
+            iLog->replay([&](lsn_t aLsn, std::uint64_t aAddress, std::size_t aOffset, void const* aData, std::size_t aLength)
+            {
+                recovered = true;
+                if (aLsn != currentLsn)
+                {
+                    currentLsn = aLsn;
+                    redo.clear();
+                }
+                if (aAddress == 0)
+                {
+                    std::memcpy(reinterpret_cast<std::uint8_t*>(&root()) + aOffset, aData, aLength);
+                    return;
+                }
+                if (aAddress + page::size > iEndOfFile)
+                    extend((aAddress + page::size - iEndOfFile) / page::size);
+                if (aLength == 0u)
+                {
+                    iBufferPool.pin_new(aAddress);
+                    iBufferPool.unpin(aAddress, true);
+                    redo[aAddress] = true;
+                    unrestored.erase(aAddress);
+                    return;
+                }
+                page* pinned = nullptr;
+                try
+                {
+                    pinned = &iBufferPool.pin(aAddress);
+                }
+                catch (bad_page_checksum const&)
+                {
+                    pinned = &iBufferPool.pin_new(aAddress);
+                    redo[aAddress] = true;
+                    unrestored.insert(aAddress);
+                }
+                auto& target = *pinned;
+                auto decision = redo.find(aAddress);
+                if (decision == redo.end())
+                    decision = redo.emplace(aAddress, target.header.lsn < aLsn).first;
+                if (decision->second)
+                    std::memcpy(reinterpret_cast<std::uint8_t*>(&target) + aOffset, aData, aLength);
+                iBufferPool.unpin(aAddress, decision->second);
+            });
+            if (!unrestored.empty())
+                throw bad_page_checksum();
+            if (recovered)
+            {
+                write_out(root());
+                iLog->reset();
+            }
+        }
+    private:
+        std::filesystem::path const iPath;
+        file_database_options const iOptions;
+        os_file iFile;
+        std::optional<os_file> iSlotFile;
+        std::optional<os_file> iMapFile;
+        std::unique_ptr<i_page_io> iPageIo;
+        neodb::buffer_pool iBufferPool;
+        std::atomic<std::uint64_t> iEndOfFile;
+        std::optional<write_ahead_log> iLog;
+        std::mutex iCommitMutex;
+        root_page iCommittedRoot;
+        std::unordered_set<std::uint64_t> iLoggedPages; // pages logged in full since the last checkpoint
+        mutable std::mutex iScrubMutex;
+        std::condition_variable iScrubCondition;
+        std::atomic<bool> iStopScrubbing = false;
+        std::vector<page::pointer_type> iScrubFailures;
+        std::thread iScrubber;
+    };
 }
\ No newline at end of file
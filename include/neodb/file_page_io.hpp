@@ -0,0 +1,77 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <neodb/i_page_io.hpp>
+#include <neodb/os_file.hpp>
+
+namespace neodb
+{
+    // Synchronous page I/O with pread/pwrite (or their Windows equivalents).
+    class file_page_io : public i_page_io
+    {
+    public:
+        file_page_io(os_file& aFile) :
+            iFile{ aFile }
+        {
+        }
+    public:
+        void read_page(page::pointer_type aAddress, page& aPage) override
+        {
+            if (iFile.read_at(aAddress, &aPage, sizeof(page)) != sizeof(page))
+                throw page_io_error();
+        }
+        void write_page(page::pointer_type aAddress, page const& aPage) override
+        {
+            iFile.write_at(aAddress, &aPage, sizeof(page));
+        }
+        void read_pages(page_read const* aReads, std::size_t aCount) override
+        {
+            for (std::size_t index = 0; index < aCount; ++index)
+                read_page(aReads[index].address, *aReads[index].destination);
+        }
+        void write_pages(page_write const* aWrites, std::size_t aCount) override
+        {
+            for (std::size_t index = 0; index < aCount; ++index)
+                write_page(aWrites[index].address, *aWrites[index].source);
+        }
+        void sync() override
+        {
+            iFile.sync();
+        }
+    private:
+        os_file& iFile;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,282 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NEODB_HASH_INDEX_SSE2
+#include <emmintrin.h>
+#endif
+#include <neodb/index_key.hpp>
+
+namespace neodb
+{
+    inline std::uint64_t hash_key(void const* aKey, std::size_t aKeyWidth)
+    {
+        auto mix = [](std::uint64_t aValue)
+        {
+            aValue ^= aValue >> 32;
+            aValue *= 0xd6e8feb86659fd93ull;
+            aValue ^= aValue >> 32;
+            aValue *= 0xd6e8feb86659fd93ull;
+            aValue ^= aValue >> 32;
+            return aValue;
+        };
+        auto bytes = static_cast<std::uint8_t const*>(aKey);
+        std::uint64_t hash = 0x9e3779b97f4a7c15ull ^ aKeyWidth;
+        for (; aKeyWidth >= 8; aKeyWidth -= 8, bytes += 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, bytes, 8);
+            hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+            hash ^= hash >> 29;
+        }
+        if (aKeyWidth > 0)
+        {
+            std::uint64_t word = 0;
+            std::memcpy(&word, bytes, aKeyWidth);
+            hash = (hash ^ word) * 0xbf58476d1ce4e5b9ull;
+        }
+        return mix(hash);
+    }
+
+    // Memory-resident open addressing hash index over the same fixed-width keys as btree_index. Slots
+    // are arranged in groups of 16 with one control byte per slot: EMPTY, DELETED or, for an occupied
+    // slot, a 7-bit tag taken from the key's hash. A lookup probes groups linearly from the one the
+    // hash selects, matching the tag against all 16 control bytes of a group at once (SSE2 where
+    // available) and only comparing keys whose tags match, so most lookups touch one control group
+    // and one key.
+    class hash_index
+    {
+    public:
+        typedef std::uint64_t value_type;
+        static constexpr std::size_t GROUP_SIZE = 16;
+    private:
+        static constexpr std::uint8_t EMPTY = 0x80;
+        static constexpr std::uint8_t DELETED = 0xFE;
+    public:
+        hash_index(std::size_t aKeyWidth, std::size_t aExpectedSize = 0) :
+            iKeyWidth{ aKeyWidth }, iSize{ 0 }, iDeleted{ 0 }
+        {
+            if (aKeyWidth == 0)
+                throw std::invalid_argument{ "neodb::hash_index: unsupported key width" };
+            resize(capacity_for(aExpectedSize));
+        }
+        hash_index(hash_index const&) = delete;
+        hash_index& operator=(hash_index const&) = delete;
+    public:
+        std::size_t key_width() const
+        {
+            return iKeyWidth;
+        }
+        std::size_t size() const
+        {
+            std::shared_lock lock{ iMutex };
+            return iSize;
+        }
+        std::size_t capacity() const
+        {
+            std::shared_lock lock{ iMutex };
+            return iControl.size();
+        }
+    public:
+        std::optional<value_type> find(void const* aKey) const
+        {
+            std::shared_lock lock{ iMutex };
+            auto const slot = find_slot(aKey, hash_key(aKey, iKeyWidth));
+            if (slot != NO_SLOT)
+                return iValues[slot];
+            return {};
+        }
+        void insert(void const* aKey, value_type aValue)
+        {
+            std::unique_lock lock{ iMutex };
+            auto const hash = hash_key(aKey, iKeyWidth);
+            if (find_slot(aKey, hash) != NO_SLOT)
+                throw duplicate_key();
+            if ((iSize + iDeleted + 1) * 8 > iControl.size() * 7)
+                resize(iSize + 1 > iControl.size() / 2 ? iControl.size() * 2 : iControl.size());
+            place(aKey, hash, aValue);
+        }
+        bool assign(void const* aKey, value_type aValue)
+        {
+            std::unique_lock lock{ iMutex };
+            auto const slot = find_slot(aKey, hash_key(aKey, iKeyWidth));
+            if (slot == NO_SLOT)
+                return false;
+            iValues[slot] = aValue;
+            return true;
+        }
+        bool erase(void const* aKey)
+        {
+            std::unique_lock lock{ iMutex };
+            auto const slot = find_slot(aKey, hash_key(aKey, iKeyWidth));
+            if (slot == NO_SLOT)
+                return false;
+            // a group that has never been full cannot have been probed past so its slot can become empty again
+            auto const group = slot - slot % GROUP_SIZE;
+            iControl[slot] = match_empty(&iControl[group]) != 0u ? EMPTY : DELETED;
+            if (iControl[slot] == DELETED)
+                ++iDeleted;
+            --iSize;
+            return true;
+        }
+        void clear()
+        {
+            std::unique_lock lock{ iMutex };
+            std::fill(iControl.begin(), iControl.end(), EMPTY);
+            iSize = 0;
+            iDeleted = 0;
+        }
+        void reserve(std::size_t aSize)
+        {
+            std::unique_lock lock{ iMutex };
+            if (capacity_for(aSize) > iControl.size())
+                resize(capacity_for(aSize));
+        }
+    private:
+        static constexpr std::size_t NO_SLOT = ~std::size_t{};
+        static std::size_t capacity_for(std::size_t aSize)
+        {
+            std::size_t capacity = GROUP_SIZE;
+            while (capacity * 7 < aSize * 8)
+                capacity *= 2;
+            return capacity;
+        }
+        static std::uint8_t tag(std::uint64_t aHash)
+        {
+            return static_cast<std::uint8_t>(aHash & 0x7Fu);
+        }
+        std::size_t first_group(std::uint64_t aHash) const
+        {
+            return static_cast<std::size_t>(aHash >> 7) & (iControl.size() / GROUP_SIZE - 1);
+        }
+        static std::uint32_t match(std::uint8_t const* aGroup, std::uint8_t aTag)
+        {
+#ifdef NEODB_HASH_INDEX_SSE2
+            auto const control = _mm_loadu_si128(reinterpret_cast<__m128i const*>(aGroup));
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(control, _mm_set1_epi8(static_cast<char>(aTag)))));
+#else
+            std::uint32_t result = 0;
+            for (std::size_t index = 0; index < GROUP_SIZE; ++index)
+                if (aGroup[index] == aTag)
+                    result |= 1u << index;
+            return result;
+#endif
+        }
+        static std::uint32_t match_empty(std::uint8_t const* aGroup)
+        {
+            return match(aGroup, EMPTY);
+        }
+        // EMPTY and DELETED are the only control bytes with their top bit set
+        static std::uint32_t match_free(std::uint8_t const* aGroup)
+        {
+#ifdef NEODB_HASH_INDEX_SSE2
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(aGroup))));
+#else
+            std::uint32_t result = 0;
+            for (std::size_t index = 0; index < GROUP_SIZE; ++index)
+                if ((aGroup[index] & 0x80u) != 0u)
+                    result |= 1u << index;
+            return result;
+#endif
+        }
+        std::size_t find_slot(void const* aKey, std::uint64_t aHash) const
+        {
+            auto const groupMask = iControl.size() / GROUP_SIZE - 1;
+            for (std::size_t group = first_group(aHash), probes = 0; probes <= groupMask; group = (group + 1) & groupMask, ++probes)
+            {
+                auto const control = &iControl[group * GROUP_SIZE];
+                for (auto candidates = match(control, tag(aHash)); candidates != 0u; candidates &= candidates - 1u)
+                {
+                    auto const slot = group * GROUP_SIZE + std::countr_zero(candidates);
+                    if (std::memcmp(&iKeys[slot * iKeyWidth], aKey, iKeyWidth) == 0)
+                        return slot;
+                }
+                if (match_empty(control) != 0u)
+                    break;
+            }
+            return NO_SLOT;
+        }
+        void place(void const* aKey, std::uint64_t aHash, value_type aValue)
+        {
+            auto const groupMask = iControl.size() / GROUP_SIZE - 1;
+            for (std::size_t group = first_group(aHash);; group = (group + 1) & groupMask)
+            {
+                auto const free = match_free(&iControl[group * GROUP_SIZE]);
+                if (free == 0u)
+                    continue;
+                auto const slot = group * GROUP_SIZE + std::countr_zero(free);
+                if (iControl[slot] == DELETED)
+                    --iDeleted;
+                iControl[slot] = tag(aHash);
+                std::memcpy(&iKeys[slot * iKeyWidth], aKey, iKeyWidth);
+                iValues[slot] = aValue;
+                ++iSize;
+                return;
+            }
+        }
+        void resize(std::size_t aCapacity)
+        {
+            std::vector<std::uint8_t> control(aCapacity, EMPTY);
+            std::vector<std::uint8_t> keys(aCapacity * iKeyWidth);
+            std::vector<value_type> values(aCapacity);
+            control.swap(iControl);
+            keys.swap(iKeys);
+            values.swap(iValues);
+            iSize = 0;
+            iDeleted = 0;
+            for (std::size_t slot = 0; slot < control.size(); ++slot)
+                if ((control[slot] & 0x80u) == 0u)
+                    place(&keys[slot * iKeyWidth], hash_key(&keys[slot * iKeyWidth], iKeyWidth), values[slot]);
+        }
+    private:
+        std::size_t iKeyWidth;
+        std::vector<std::uint8_t> iControl;
+        std::vector<std::uint8_t> iKeys;
+        std::vector<value_type> iValues;
+        std::size_t iSize;
+        std::size_t iDeleted;
+        mutable std::shared_mutex iMutex;
+    };
+}
\ No newline at end of file
@@ -1,80 +1,164 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neodb/data_type.hpp>
-#include <neodb/i_table.hpp>
-#include <neodb/schema.hpp>
-#include <neodb/page.hpp>
-#include <neodb/i_record.hpp>
-
-namespace neodb
-{
-    class i_database
-    {
-    public:
-        typedef i_database abstract_type;
-    public:
-        virtual ~i_database() = default;
-    public:
-        virtual i_string const& name() const = 0;
-        virtual i_vector<i_ref_ptr<i_table>> const& tables() const = 0;
-        virtual void create_table(i_schema const& aSchema) = 0;
-    public:
-        virtual root_page const& root() const = 0;
-        virtual root_page& root() = 0;
-        virtual void allocate_record(record_type aRecordType, link::size_type aRecordSize, i_ref_ptr<i_record>& aNewRecord) = 0;
-        virtual void free_record(i_record& aExistingRecord) = 0;
-        // helpers
-    public:
-        ref_ptr<i_record> allocate_record(record_type aRecordType, link::size_type aRecordSize)
-        {
-            ref_ptr<i_record> newRecord;
-            allocate_record(aRecordType, aRecordSize, newRecord);
-            return newRecord;
-        }
-    };
-
-    inline void create_table(i_database& aDatabase, i_schema const& aSchema)
-    {
-        aDatabase.create_table(aSchema);
-    }
-
-    template <typename... Fields, typename... FieldSpecs>
-    inline void create_table(i_database& aDatabase, string const& aTableName, FieldSpecs&&... aFieldSpecs)
-    {
-        aDatabase.create_table(typed_schema<Fields...>{ aTableName, std::forward<FieldSpecs>(aFieldSpecs)... });
-    }
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <neodb/data_type.hpp>
+#include <neodb/table_options.hpp>
+#include <neodb/i_table.hpp>
+#include <neodb/schema.hpp>
+#include <neodb/page.hpp>
+#include <neodb/version_clock.hpp>
+#include <neodb/i_record.hpp>
+
+namespace neodb
+{
+    class i_database
+    {
+    public:
+        typedef i_database abstract_type;
+    public:
+        virtual ~i_database() = default;
+    public:
+        virtual i_string const& name() const = 0;
+        // whether the database outlives the process, so that its tables must be reachable from storage
+        virtual bool persistent() const = 0;
+        virtual i_vector<i_ref_ptr<i_table>> const& tables() const = 0;
+        virtual void create_table(i_schema const& aSchema, table_options const& aOptions) = 0;
+    public:
+        virtual root_page const& root() const = 0;
+        virtual root_page& root() = 0;
+        virtual void allocate_record(record_type aRecordType, link::size_type aRecordSize, i_ref_ptr<i_record>& aNewRecord) = 0;
+        virtual void free_record(i_record& aExistingRecord) = 0;
+        // Allocate a batch of records of one size packed into new pages, writing their addresses to
+        // aAddresses. Unlike allocate_record no record objects are created.
+        virtual void allocate_records(record_type aRecordType, link::size_type aRecordSize, std::size_t aCount, page::pointer_type* aAddresses) = 0;
+        virtual void free_record(record_type aRecordType, page::pointer_type aAddress) = 0;
+    public:
+        virtual version_clock& versions() = 0;
+        // Free every table's row versions that no snapshot can see any more; returns how many.
+        virtual std::size_t collect_garbage() = 0;
+    public:
+        virtual page& pin_page(page::pointer_type aAddress) = 0;
+        virtual void unpin_page(page::pointer_type aAddress, bool aDirty) = 0;
+        // Look at a page already in memory without pinning it, for readers that validate what they read
+        // (see page_peek); false if the page would have to be pinned to be read.
+        virtual bool peek_page(page::pointer_type aAddress, page_peek& aPeek) = 0;
+        // The contents of the allocated pages are unspecified; only their page link is cleared.
+        virtual page::pointer_type allocate_pages(std::uint64_t aPageCount) = 0;
+        virtual void free_pages(page::pointer_type aAddress, std::uint64_t aPageCount) = 0;
+        // helpers
+    public:
+        void create_table(i_schema const& aSchema)
+        {
+            create_table(aSchema, table_options{});
+        }
+        page::pointer_type allocate_page()
+        {
+            return allocate_pages(1);
+        }
+        void free_page(page::pointer_type aAddress)
+        {
+            free_pages(aAddress, 1);
+        }
+        ref_ptr<i_record> allocate_record(record_type aRecordType, link::size_type aRecordSize)
+        {
+            ref_ptr<i_record> newRecord;
+            allocate_record(aRecordType, aRecordSize, newRecord);
+            return newRecord;
+        }
+    };
+
+    class pinned_page
+    {
+    public:
+        pinned_page(i_database& aDatabase, page::pointer_type aAddress) :
+            iDatabase{ aDatabase }, iAddress{ aAddress }, iPage{ &aDatabase.pin_page(aAddress) }, iDirty{ false }
+        {
+        }
+        pinned_page(pinned_page const&) = delete;
+        pinned_page& operator=(pinned_page const&) = delete;
+        ~pinned_page()
+        {
+            iDatabase.unpin_page(iAddress, iDirty);
+        }
+    public:
+        page::pointer_type address() const
+        {
+            return iAddress;
+        }
+        void set_dirty()
+        {
+            iDirty = true;
+        }
+        page const& operator*() const
+        {
+            return *iPage;
+        }
+        page& operator*()
+        {
+            return *iPage;
+        }
+        page const* operator->() const
+        {
+            return iPage;
+        }
+        page* operator->()
+        {
+            return iPage;
+        }
+    private:
+        i_database& iDatabase;
+        page::pointer_type iAddress;
+        page* iPage;
+        bool iDirty;
+    };
+
+    inline void create_table(i_database& aDatabase, i_schema const& aSchema, table_options const& aOptions = {})
+    {
+        aDatabase.create_table(aSchema, aOptions);
+    }
+
+    template <typename... Fields, typename... FieldSpecs>
+    inline void create_table(i_database& aDatabase, string const& aTableName, FieldSpecs&&... aFieldSpecs)
+    {
+        aDatabase.create_table(typed_schema<Fields...>{ aTableName, std::forward<FieldSpecs>(aFieldSpecs)... });
+    }
+
+    template <typename... Fields, typename... FieldSpecs>
+    inline void create_table(i_database& aDatabase, table_options const& aOptions, string const& aTableName, FieldSpecs&&... aFieldSpecs)
+    {
+        aDatabase.create_table(typed_schema<Fields...>{ aTableName, std::forward<FieldSpecs>(aFieldSpecs)... }, aOptions);
+    }
 }
\ No newline at end of file
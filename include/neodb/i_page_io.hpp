@@ -0,0 +1,70 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdexcept>
+#include <neodb/page.hpp>
+
+namespace neodb
+{
+    struct page_io_error : std::runtime_error { page_io_error() : std::runtime_error{ "neodb::page_io_error" } {} };
+
+    struct page_read
+    {
+        page::pointer_type address;
+        page* destination;
+    };
+
+    struct page_write
+    {
+        page::pointer_type address;
+        page const* source;
+    };
+
+    class i_page_io
+    {
+    public:
+        typedef i_page_io abstract_type;
+    public:
+        virtual ~i_page_io() = default;
+    public:
+        virtual void read_page(page::pointer_type aAddress, page& aPage) = 0;
+        virtual void write_page(page::pointer_type aAddress, page const& aPage) = 0;
+        // Independent page transfers that a backend may have in flight together.
+        virtual void read_pages(page_read const* aReads, std::size_t aCount) = 0;
+        virtual void write_pages(page_write const* aWrites, std::size_t aCount) = 0;
+        virtual void sync() = 0;
+    };
+}
\ No newline at end of file
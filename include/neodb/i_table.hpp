@@ -1,56 +1,347 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neodb/data_type.hpp>
-#include <neodb/i_database.hpp>
-#include <neodb/i_schema.hpp>
-
-namespace neodb
-{
-    class i_database;
-
-    class i_table : public neolib::i_reference_counted
-    {
-    public:
-        typedef i_table abstract_type;
-    public:
-        virtual ~i_table() = default;
-    public:
-        virtual i_database& database() const = 0;
-        virtual i_string const& name() const = 0;
-        virtual i_schema const& schema() const = 0;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+#include <initializer_list>
+#include <neodb/data_type.hpp>
+#include <neodb/table_options.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/i_schema.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/index_key.hpp>
+#include <neodb/version_clock.hpp>
+
+namespace neodb
+{
+    struct no_primary_index : std::logic_error { no_primary_index() : std::logic_error{ "neodb::no_primary_index" } {} };
+    struct primary_index_not_persistent : std::logic_error { primary_index_not_persistent() : std::logic_error{ "neodb::primary_index_not_persistent" } {} };
+    struct unversioned_table : std::logic_error { unversioned_table() : std::logic_error{ "neodb::unversioned_table" } {} };
+    struct primary_key_changed : std::logic_error { primary_key_changed() : std::logic_error{ "neodb::primary_key_changed" } {} };
+
+    class i_database;
+
+    class i_row_encoder
+    {
+    public:
+        virtual ~i_row_encoder() = default;
+    public:
+        // encode a row into the row_layout().size() bytes at aRow
+        virtual void encode(void* aRow) const = 0;
+    };
+
+    class i_row_batch
+    {
+    public:
+        virtual ~i_row_batch() = default;
+    public:
+        virtual std::size_t size() const = 0;
+        // encode the batch's aIndex-th row into the row_layout().size() bytes at aRow
+        virtual void encode(std::size_t aIndex, void* aRow) const = 0;
+    };
+
+    class i_row_visitor
+    {
+    public:
+        virtual ~i_row_visitor() = default;
+    public:
+        virtual bool visit(page::pointer_type aRow) = 0;
+    };
+
+    class string_dictionary;
+
+    // A run of consecutive rows of some of a table's columns: each column's values are stored back to
+    // back, encoded as in a row, with a bit per row (set when null) for nullable columns. The values
+    // of a dictionary encoded column are instead little-endian 32-bit codes into its dictionary.
+    struct column_data
+    {
+        void const* values;
+        std::uint8_t const* nulls;
+        string_dictionary const* dictionary = nullptr;
+    };
+
+    struct column_chunk
+    {
+        std::size_t rows;
+        page::pointer_type const* rowAddresses;
+        column_data const* columns;
+    };
+
+    class i_column_visitor
+    {
+    public:
+        virtual ~i_column_visitor() = default;
+    public:
+        virtual bool visit(column_chunk const& aChunk) = 0;
+    };
+
+    class i_table : public neolib::i_reference_counted
+    {
+    public:
+        typedef i_table abstract_type;
+    public:
+        virtual ~i_table() = default;
+    public:
+        virtual i_database& database() const = 0;
+        virtual i_string const& name() const = 0;
+        virtual i_schema const& schema() const = 0;
+        virtual table_options const& options() const = 0;
+        virtual neodb::row_layout const& row_layout() const = 0;
+        // where the values of the table's String and Blob fields are stored
+        virtual i_value_store const& values() const = 0;
+    public:
+        // Rows are row_layout().size() bytes encoded as described by row_layout. The encoder writes the
+        // new row directly into its record; returns the row's address. The encoder stores the row's
+        // String and Blob values afresh in values() and they belong to the new row from then on (rows
+        // given as bytes have the values they refer to copied), so no two rows share a value.
+        virtual page::pointer_type insert(i_row_encoder const& aEncoder) = 0;
+        virtual void read(page::pointer_type aRow, void* aRowData) const = 0;
+        // Insert a batch of rows in one go. The batch's keys are checked first and a batch with the key
+        // of a current row or with a key twice is rejected as a whole with duplicate_key; as with
+        // insert(), a row with the key of a removed one becomes that key's newest version. The rows are
+        // then packed into new pages in batch order and an empty ordered
+        // primary key index is built bottom-up from the sorted keys instead of by repeated insertion.
+        // The rows' addresses are written to aRows unless it is null.
+        virtual void bulk_insert(i_row_batch const& aBatch, page::pointer_type* aRows = nullptr) = 0;
+        // Primary key index lookups; keys are encoded as by encode_index_key. The ordered primary key
+        // index is identified by the address of its anchor record, zero if the table has none; range
+        // scans require it.
+        virtual page::pointer_type primary_index() const = 0;
+        // Reads see the versions of rows current as of aAsOf: a snapshot's timestamp, or LATEST_VERSION
+        // for the newest versions. A row address is that of one version of the row; a version read as
+        // of LATEST_VERSION is safe from collect_garbage only while the read runs (for the whole of a
+        // scan), so a caller that goes on reading it afterwards holds a snapshot across both.
+        virtual bool find(void const* aKey, page::pointer_type& aRow, timestamp aAsOf) const = 0;
+        virtual void scan(void const* aLowKey, void const* aHighKey, i_row_visitor& aVisitor, timestamp aAsOf) const = 0;
+        // Row storage keeps multiple versions of rows. Updating a row writes a new version (the encoder
+        // must leave its key as it is) and removing one ends its newest version; the versions they
+        // supersede stay readable by older snapshots until collect_garbage frees those that every
+        // snapshot as of aHorizon or later is past. Both return false if no current row has aKey.
+        // Columnar tables are append only.
+        virtual bool update(void const* aKey, i_row_encoder const& aEncoder) = 0;
+        virtual bool remove(void const* aKey) = 0;
+        virtual std::size_t collect_garbage(timestamp aHorizon) = 0;
+        // Split the primary key range for a parallel scan into at most aParts ranges covering similar
+        // numbers of ordered index leaves: writes the (at most aParts - 1) keys dividing them to
+        // aBoundaries and returns how many there are.
+        virtual std::size_t partition(std::size_t aParts, void* aBoundaries) const = 0;
+        // Columnar access. A table with table_storage::Columns hands out its pages' column minipages in
+        // place, in insertion order, and is identified by the address of its column store's anchor
+        // record (zero for row storage). A table with row storage gathers chunks of rows in primary key
+        // order, which requires its ordered primary key index, reading rows as of aAsOf. A scan that
+        // stopped early resumes after the last row of the last chunk it visited when given that row as
+        // aAfter (zero to start at the beginning); a columnar table resumes at the next page, missing
+        // rows appended to that row's page since.
+        virtual page::pointer_type column_store() const = 0;
+        virtual void scan_columns(std::size_t const* aFields, std::size_t aFieldCount, page::pointer_type aAfter, i_column_visitor& aVisitor, timestamp aAsOf) const = 0;
+        // helpers
+    public:
+        page::pointer_type insert(void const* aRow)
+        {
+            return insert(row_copier{ *this, aRow });
+        }
+        page::pointer_type insert(std::initializer_list<data_value_type> aValues)
+        {
+            if (aValues.size() != row_layout().field_count())
+                throw field_count_mismatch();
+            return insert(value_encoder{ *this, aValues });
+        }
+        // update the row with the same key as aRow
+        bool update(void const* aRow)
+        {
+            auto const& layout = row_layout();
+            if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+                throw no_primary_index();
+            auto const& keyField = layout.field(*layout.primary_key());
+            std::vector<std::uint8_t> key(index_key_width(keyField));
+            index_key_from_row(keyField, aRow, key.data());
+            return update(key.data(), row_copier{ *this, aRow });
+        }
+        bool update(std::initializer_list<data_value_type> aValues)
+        {
+            auto const& layout = row_layout();
+            if (aValues.size() != layout.field_count())
+                throw field_count_mismatch();
+            if (!layout.primary_key())
+                throw no_primary_index();
+            return update(primary_key(*(aValues.begin() + *layout.primary_key())).data(), value_encoder{ *this, aValues });
+        }
+        bool remove(data_value_type const& aKey)
+        {
+            return remove(primary_key(aKey).data());
+        }
+        // insert aCount rows stored back to back
+        std::vector<page::pointer_type> bulk_insert(void const* aRows, std::size_t aCount)
+        {
+            struct copier : i_row_batch
+            {
+                i_table const& table;
+                std::uint8_t const* rows;
+                std::size_t count;
+                copier(i_table const& aTable, void const* aRows, std::size_t aCount) : table{ aTable }, rows{ static_cast<std::uint8_t const*>(aRows) }, count{ aCount } {}
+                std::size_t size() const override { return count; }
+                void encode(std::size_t aIndex, void* aRow) const override
+                {
+                    auto const& layout = table.row_layout();
+                    std::memcpy(aRow, rows + aIndex * layout.size(), layout.size());
+                    layout.copy_values(aRow, table.values());
+                }
+            };
+            std::vector<page::pointer_type> addresses(aCount);
+            bulk_insert(copier{ *this, aRows, aCount }, addresses.data());
+            return addresses;
+        }
+        std::vector<data_value_type> read(page::pointer_type aRow) const
+        {
+            auto const& layout = row_layout();
+            std::vector<std::uint8_t> row(layout.size());
+            read(aRow, row.data());
+            std::vector<data_value_type> result;
+            for (std::size_t field = 0; field < layout.field_count(); ++field)
+                result.push_back(layout.decode(field, row.data(), &values()));
+            return result;
+        }
+        std::vector<std::uint8_t> primary_key(data_value_type const& aValue) const
+        {
+            auto const& layout = row_layout();
+            if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+                throw no_primary_index();
+            auto const& keyField = layout.field(*layout.primary_key());
+            std::vector<std::uint8_t> key(index_key_width(keyField));
+            encode_index_key(keyField, aValue, key.data());
+            return key;
+        }
+        bool find(void const* aKey, page::pointer_type& aRow) const
+        {
+            return find(aKey, aRow, LATEST_VERSION);
+        }
+        std::optional<page::pointer_type> find(data_value_type const& aKey, timestamp aAsOf = LATEST_VERSION) const
+        {
+            page::pointer_type row;
+            if (find(primary_key(aKey).data(), row, aAsOf))
+                return row;
+            return {};
+        }
+        std::vector<std::uint8_t> partition(std::size_t aParts) const
+        {
+            auto const& layout = row_layout();
+            if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+                throw no_primary_index();
+            auto const keyWidth = index_key_width(layout.field(*layout.primary_key()));
+            std::vector<std::uint8_t> boundaries(aParts > 1 ? (aParts - 1) * keyWidth : 0u);
+            boundaries.resize(partition(aParts, boundaries.data()) * keyWidth);
+            return boundaries;
+        }
+        void scan(void const* aLowKey, void const* aHighKey, i_row_visitor& aVisitor) const
+        {
+            scan(aLowKey, aHighKey, aVisitor, LATEST_VERSION);
+        }
+        // visit rows in primary key order while aVisitor(page::pointer_type aRow) returns true
+        template <typename Visitor>
+        void scan(Visitor aVisitor, timestamp aAsOf = LATEST_VERSION) const
+        {
+            visitor_adaptor<Visitor> adaptor{ aVisitor };
+            scan(nullptr, nullptr, static_cast<i_row_visitor&>(adaptor), aAsOf);
+        }
+        template <typename Visitor> requires (!std::is_base_of_v<i_row_visitor, Visitor>)
+        void scan(void const* aLowKey, void const* aHighKey, Visitor aVisitor, timestamp aAsOf = LATEST_VERSION) const
+        {
+            visitor_adaptor<Visitor> adaptor{ aVisitor };
+            scan(aLowKey, aHighKey, static_cast<i_row_visitor&>(adaptor), aAsOf);
+        }
+        // keys given as values; pointers are encoded keys and take the overloads above, which a pointer
+        // would otherwise also reach through its conversion to bool
+        template <typename LowKey, typename HighKey, typename Visitor>
+            requires (!std::is_pointer_v<LowKey> && !std::is_pointer_v<HighKey> && !std::is_null_pointer_v<LowKey> && !std::is_null_pointer_v<HighKey> &&
+                !std::is_base_of_v<i_row_visitor, Visitor>)
+        void scan(LowKey const& aLowKey, HighKey const& aHighKey, Visitor aVisitor, timestamp aAsOf = LATEST_VERSION) const
+        {
+            visitor_adaptor<Visitor> adaptor{ aVisitor };
+            scan(primary_key(aLowKey).data(), primary_key(aHighKey).data(), static_cast<i_row_visitor&>(adaptor), aAsOf);
+        }
+        void scan_columns(std::size_t const* aFields, std::size_t aFieldCount, i_column_visitor& aVisitor) const
+        {
+            scan_columns(aFields, aFieldCount, 0u, aVisitor, LATEST_VERSION);
+        }
+        // visit chunks of the given columns while aVisitor(column_chunk const& aChunk) returns true
+        template <typename Visitor>
+        void scan_columns(std::initializer_list<std::size_t> aFields, Visitor aVisitor) const
+        {
+            struct adaptor : i_column_visitor
+            {
+                Visitor& visitor;
+                adaptor(Visitor& aVisitor) : visitor{ aVisitor } {}
+                bool visit(column_chunk const& aChunk) override { return visitor(aChunk); }
+            } columnAdaptor{ aVisitor };
+            scan_columns(aFields.begin(), aFields.size(), static_cast<i_column_visitor&>(columnAdaptor));
+        }
+    private:
+        struct row_copier : i_row_encoder
+        {
+            i_table const& table;
+            void const* row;
+            row_copier(i_table const& aTable, void const* aRow) : table{ aTable }, row{ aRow } {}
+            void encode(void* aRow) const override
+            {
+                std::memcpy(aRow, row, table.row_layout().size());
+                table.row_layout().copy_values(aRow, table.values());
+            }
+        };
+        struct value_encoder : i_row_encoder
+        {
+            i_table const& table;
+            std::initializer_list<data_value_type> values;
+            value_encoder(i_table const& aTable, std::initializer_list<data_value_type> aValues) : table{ aTable }, values( aValues ) {}
+            void encode(void* aRow) const override
+            {
+                auto const& layout = table.row_layout();
+                std::memset(aRow, 0, layout.size());
+                std::size_t field = 0;
+                for (auto const& value : values)
+                    layout.encode(field++, value, aRow, &table.values());
+            }
+        };
+        template <typename Visitor>
+        struct visitor_adaptor : i_row_visitor
+        {
+            Visitor& visitor;
+            visitor_adaptor(Visitor& aVisitor) : visitor{ aVisitor } {}
+            bool visit(page::pointer_type aRow) override { return visitor(aRow); }
+        };
+    };
 }
\ No newline at end of file
@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include <neodb/data_type.hpp>
+#include <neodb/row_layout.hpp>
+
+namespace neodb
+{
+    struct duplicate_key : std::runtime_error { duplicate_key() : std::runtime_error{ "neodb::duplicate_key" } {} };
+
+    // Index keys are fixed-width byte strings encoded so that comparing two keys with memcmp orders
+    // them as their values: integers are stored big-endian with the sign bit flipped, uuids as their
+    // canonical big-endian byte sequence and char strings zero padded to their declared length.
+    template <typename T, typename = void>
+    struct index_key_traits;
+
+    template <typename T>
+    struct index_key_traits<T, std::enable_if_t<std::is_integral_v<T>>>
+    {
+        static constexpr std::size_t width = sizeof(T);
+
+        static void encode(T aValue, std::uint8_t* aKey)
+        {
+            typedef std::make_unsigned_t<T> bits_type;
+            auto bits = static_cast<std::uint64_t>(static_cast<bits_type>(aValue));
+            if constexpr (std::is_signed_v<T>)
+                bits ^= std::uint64_t{ 1u } << (width * 8 - 1);
+            for (std::size_t index = width; index-- > 0; bits >>= 8)
+                aKey[index] = static_cast<std::uint8_t>(bits);
+        }
+    };
+
+    template <>
+    struct index_key_traits<uuid>
+    {
+        static constexpr std::size_t width = 16;
+
+        static void encode(uuid const& aValue, std::uint8_t* aKey)
+        {
+            index_key_traits<std::uint32_t>::encode(aValue.part1, aKey);
+            index_key_traits<std::uint16_t>::encode(aValue.part2, aKey + 4);
+            index_key_traits<std::uint16_t>::encode(aValue.part3, aKey + 6);
+            index_key_traits<std::uint16_t>::encode(aValue.part4, aKey + 8);
+            std::memcpy(aKey + 10, aValue.part5.data(), 6);
+        }
+    };
+
+    inline void encode_char_string_key(i_string const& aValue, std::size_t aWidth, std::uint8_t* aKey)
+    {
+        if (aValue.size() > aWidth)
+            throw field_value_too_long();
+        std::memcpy(aKey, aValue.data(), aValue.size());
+        std::memset(aKey + aValue.size(), 0, aWidth - aValue.size());
+    }
+
+    template <std::size_t N>
+    struct index_key_traits<char_string<N>>
+    {
+        static constexpr std::size_t width = N;
+
+        static void encode(i_string const& aValue, std::uint8_t* aKey)
+        {
+            encode_char_string_key(aValue, width, aKey);
+        }
+    };
+
+    // Width of the index key for a field, zero if the field's type cannot be indexed.
+    inline std::size_t index_key_width(field_layout const& aField)
+    {
+        if (aField.nullBit != NOT_NULLABLE)
+            return 0;
+        switch (aField.dataType)
+        {
+        case data_type::Int8:
+        case data_type::Int16:
+        case data_type::Int32:
+        case data_type::Int64:
+        case data_type::Uint8:
+        case data_type::Uint16:
+        case data_type::Uint32:
+        case data_type::Uint64:
+        case data_type::Uuid:
+        case data_type::CharString:
+            return aField.size;
+        default:
+            return 0;
+        }
+    }
+
+    inline bool is_indexable(field_layout const& aField)
+    {
+        return index_key_width(aField) != 0;
+    }
+
+    // Turn a key into the greatest key of the same width ordering before it; false if there is none.
+    inline bool previous_index_key(std::uint8_t* aKey, std::size_t aWidth)
+    {
+        if (std::all_of(aKey, aKey + aWidth, [](std::uint8_t aByte) { return aByte == 0u; }))
+            return false;
+        for (std::size_t index = aWidth; index-- > 0;)
+            if (aKey[index]-- != 0u)
+                break;
+        return true;
+    }
+
+    // Encode the key of a field of an encoded row.
+    inline void index_key_from_row(field_layout const& aField, void const* aRow, std::uint8_t* aKey)
+    {
+        auto const source = static_cast<std::uint8_t const*>(aRow) + aField.offset;
+        switch (aField.dataType)
+        {
+        case data_type::Int8: index_key_traits<int8_t>::encode(load_little<int8_t>(source), aKey); break;
+        case data_type::Int16: index_key_traits<int16_t>::encode(load_little<int16_t>(source), aKey); break;
+        case data_type::Int32: index_key_traits<int32_t>::encode(load_little<int32_t>(source), aKey); break;
+        case data_type::Int64: index_key_traits<int64_t>::encode(load_little<int64_t>(source), aKey); break;
+        case data_type::Uint8: index_key_traits<uint8_t>::encode(load_little<uint8_t>(source), aKey); break;
+        case data_type::Uint16: index_key_traits<uint16_t>::encode(load_little<uint16_t>(source), aKey); break;
+        case data_type::Uint32: index_key_traits<uint32_t>::encode(load_little<uint32_t>(source), aKey); break;
+        case data_type::Uint64: index_key_traits<uint64_t>::encode(load_little<uint64_t>(source), aKey); break;
+        case data_type::Uuid: index_key_traits<uuid>::encode(decode_field_value<uuid>(aField, source), aKey); break;
+        case data_type::CharString: std::memcpy(aKey, source, aField.size); break; // already zero padded
+        default: throw unsupported_field_type();
+        }
+    }
+
+    // Encode a key value for a field.
+    inline void encode_index_key(field_layout const& aField, data_value_type const& aValue, std::uint8_t* aKey)
+    {
+        std::vector<std::uint8_t> row(aField.offset + aField.size);
+        encode_field(aField, aValue, row.data());
+        index_key_from_row(aField, row.data(), aKey);
+    }
+}
\ No newline at end of file
@@ -1,57 +1,91 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neodb/database.hpp>
-
-namespace neodb
-{
-    class memory_database : public database
-    {
-    public:
-        memory_database(std::string const& aDatabaseName) :
-            database{ aDatabaseName }
-        {
-        }
-    protected:
-        page::pointer_type allocate_page() override
-        {
-            return 0;
-        }
-        void free_page(page::pointer_type aAddress) override
-        {
-        }
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <shared_mutex>
+#include <neodb/database.hpp>
+
+namespace neodb
+{
+    class memory_database : public database
+    {
+    public:
+        memory_database(std::string const& aDatabaseName) :
+            database{ aDatabaseName }
+        {
+        }
+    public:
+        bool persistent() const override
+        {
+            return false;
+        }
+    public:
+        page& pin_page(page::pointer_type aAddress) override
+        {
+            auto const index = static_cast<std::size_t>(aAddress / page::size) - 1;
+            std::shared_lock lock{ iPagesMutex };
+            if (aAddress % page::size != 0 || index >= iPages.size())
+                throw std::logic_error{ "neodb::memory_database: bad page address" };
+            return *iPages[index];
+        }
+        void unpin_page(page::pointer_type, bool) override
+        {
+        }
+        bool peek_page(page::pointer_type aAddress, page_peek& aPeek) override
+        {
+            aPeek = page_peek{ &pin_page(aAddress) };
+            return true;
+        }
+    protected:
+        page::pointer_type extend(std::uint64_t aPageCount) override
+        {
+            // address zero is the root page so the first data page is at page::size, as it is in a file
+            std::unique_lock lock{ iPagesMutex };
+            page::pointer_type const address = (iPages.size() + 1) * page::size;
+            for (std::uint64_t count = 0; count < aPageCount; ++count)
+            {
+                iPages.push_back(std::make_unique<page>());
+                iPages.back()->clear();
+            }
+            return address;
+        }
+    private:
+        // pages themselves never move; the lock only guards the vector growing under a concurrent pin
+        std::shared_mutex iPagesMutex;
+        std::vector<std::unique_ptr<page>> iPages;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,254 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+#include <neodb/os_file.hpp>
+#include <neodb/database.hpp>
+
+namespace neodb
+{
+    // Pages are handed out as references straight into a shared mapping of the database file so reads
+    // and writes never copy through a stream. The file is mapped extent by extent and an extent, once
+    // mapped, never moves, which means growing never moves a page that is already pinned. On POSIX a
+    // large range of address space is reserved up front and each extent is mapped into it; Windows
+    // cannot map a file into reserved space so each extent there is a view of its own.
+    class mmap_database : public database
+    {
+    public:
+        static constexpr std::uint64_t DEFAULT_EXTENT_SIZE = 1024 * page::size;
+        static constexpr std::uint64_t DEFAULT_RESERVATION = std::uint64_t{ 1 } << 36;
+        // Windows view offsets must be multiples of the allocation granularity
+        static constexpr std::uint64_t EXTENT_GRANULARITY = std::max<std::uint64_t>(page::size, 64 * 1024);
+    public:
+        mmap_database(std::filesystem::path const& aDatabasePath, std::uint64_t aExtentSize = DEFAULT_EXTENT_SIZE, std::uint64_t aReservation = DEFAULT_RESERVATION) :
+            database{ aDatabasePath.filename().stem().generic_string() },
+            iPath{ aDatabasePath },
+            iExtentSize{ std::max<std::uint64_t>((aExtentSize + EXTENT_GRANULARITY - 1) / EXTENT_GRANULARITY * EXTENT_GRANULARITY, EXTENT_GRANULARITY) },
+            iReservation{ (aReservation + iExtentSize - 1) / iExtentSize * iExtentSize },
+            iFile{ create_parent_directories(aDatabasePath) },
+            iBase{ nullptr },
+            iMappedSize{ 0 },
+            iEndOfData{ page::size }
+        {
+            root().clear();
+#ifdef _WIN32
+            iViews = std::make_unique<std::uint8_t*[]>(static_cast<std::size_t>(iReservation / iExtentSize));
+#else
+            void* const reservation = ::mmap(nullptr, iReservation, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (reservation == MAP_FAILED)
+                throw std::runtime_error{ "Failed to reserve address space for database '" + aDatabasePath.generic_string() + "'" };
+            iBase = static_cast<std::uint8_t*>(reservation);
+#endif
+            try
+            {
+                auto const fileSize = iFile.size();
+                bool const newDatabase = fileSize == 0;
+                auto const endOfData = std::max<std::uint64_t>((fileSize + page::size - 1) / page::size * page::size, page::size);
+                grow(endOfData);
+                iEndOfData.store(endOfData, std::memory_order_release);
+                if (newDatabase)
+                    std::memcpy(address_of(0), &root(), sizeof(root_page));
+                else
+                {
+                    std::memcpy(&root(), address_of(0), sizeof(root_page));
+                    if (root().header.magic != MAGIC)
+                        throw bad_magic();
+                    load_free_pages();
+                }
+            }
+            catch (...)
+            {
+                release();
+                throw;
+            }
+        }
+        ~mmap_database()
+        {
+            try
+            {
+                commit();
+            }
+            catch (...)
+            {
+            }
+            release();
+            try
+            {
+                // the file grows in whole extents; give back the unused tail
+                iFile.truncate(iEndOfData.load(std::memory_order_relaxed));
+            }
+            catch (...)
+            {
+            }
+        }
+    public:
+        bool persistent() const override
+        {
+            return true;
+        }
+    public:
+        void commit()
+        {
+            std::scoped_lock lock{ iMutex };
+            std::memcpy(address_of(0), &root(), sizeof(root_page));
+            auto const endOfData = iEndOfData.load(std::memory_order_relaxed);
+#ifdef _WIN32
+            for (std::uint64_t extent = 0; extent * iExtentSize < endOfData; ++extent)
+                if (!::FlushViewOfFile(iViews[static_cast<std::size_t>(extent)], static_cast<SIZE_T>(std::min(iExtentSize, endOfData - extent * iExtentSize))))
+                    throw std::runtime_error{ "Failed to commit database '" + name().to_std_string() + "'" };
+            iFile.sync();
+#else
+            if (::msync(iBase, static_cast<std::size_t>(endOfData), MS_SYNC) == -1)
+                throw std::runtime_error{ "Failed to commit database '" + name().to_std_string() + "'" };
+#endif
+        }
+        std::uint64_t mapped_size() const
+        {
+            return iMappedSize;
+        }
+    public:
+        page& pin_page(page::pointer_type aAddress) override
+        {
+            // extend() publishes the new end of data only once the extent holding it is mapped
+            if (aAddress % page::size != 0 || aAddress == 0 || aAddress >= iEndOfData.load(std::memory_order_acquire))
+                throw std::logic_error{ "neodb::mmap_database: bad page address" };
+            return *reinterpret_cast<page*>(address_of(aAddress));
+        }
+        void unpin_page(page::pointer_type, bool) override
+        {
+            // the kernel tracks dirty mapped pages; commit() flushes them
+        }
+        bool peek_page(page::pointer_type aAddress, page_peek& aPeek) override
+        {
+            aPeek = page_peek{ &pin_page(aAddress) };
+            return true;
+        }
+    protected:
+        page::pointer_type extend(std::uint64_t aPageCount) override
+        {
+            std::scoped_lock lock{ iMutex };
+            page::pointer_type const address = iEndOfData.load(std::memory_order_relaxed);
+            if (address + aPageCount * page::size > iMappedSize)
+                grow(address + aPageCount * page::size);
+            iEndOfData.store(address + aPageCount * page::size, std::memory_order_release);
+            return address;
+        }
+    private:
+        static std::filesystem::path const& create_parent_directories(std::filesystem::path const& aDatabasePath)
+        {
+            if (!std::filesystem::exists(aDatabasePath.parent_path()))
+                std::filesystem::create_directories(aDatabasePath.parent_path());
+            return aDatabasePath;
+        }
+        std::uint8_t* address_of(page::pointer_type aAddress) const
+        {
+#ifdef _WIN32
+            return iViews[static_cast<std::size_t>(aAddress / iExtentSize)] + aAddress % iExtentSize;
+#else
+            return iBase + aAddress;
+#endif
+        }
+        void grow(std::uint64_t aMinimumSize)
+        {
+            auto const newSize = (aMinimumSize + iExtentSize - 1) / iExtentSize * iExtentSize;
+            if (newSize <= iMappedSize)
+                return;
+            if (newSize > iReservation)
+                throw std::runtime_error{ "Database '" + iPath.generic_string() + "' exceeds its address space reservation" };
+            if (iFile.size() < newSize)
+                iFile.truncate(newSize);
+#ifdef _WIN32
+            HANDLE const mapping = ::CreateFileMappingW(iFile.native_handle(), nullptr, PAGE_READWRITE,
+                static_cast<DWORD>(newSize >> 32), static_cast<DWORD>(newSize), nullptr);
+            if (mapping == nullptr)
+                throw std::runtime_error{ "Failed to map database '" + iPath.generic_string() + "'" };
+            for (auto offset = iMappedSize; offset < newSize; offset += iExtentSize)
+            {
+                // a view keeps its mapping object alive after the handle is closed
+                void* const view = ::MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_WRITE,
+                    static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset), static_cast<SIZE_T>(iExtentSize));
+                if (view == nullptr)
+                {
+                    ::CloseHandle(mapping);
+                    throw std::runtime_error{ "Failed to map database '" + iPath.generic_string() + "'" };
+                }
+                iViews[static_cast<std::size_t>(offset / iExtentSize)] = static_cast<std::uint8_t*>(view);
+                iMappedSize = offset + iExtentSize;
+            }
+            ::CloseHandle(mapping);
+#else
+            void* const extent = ::mmap(iBase + iMappedSize, static_cast<std::size_t>(newSize - iMappedSize), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, iFile.native_handle(), static_cast<off_t>(iMappedSize));
+            if (extent == MAP_FAILED)
+                throw std::runtime_error{ "Failed to map database '" + iPath.generic_string() + "'" };
+            iMappedSize = newSize;
+#endif
+        }
+        void release()
+        {
+#ifdef _WIN32
+            if (iViews)
+                for (std::uint64_t extent = 0; extent * iExtentSize < iMappedSize; ++extent)
+                    ::UnmapViewOfFile(iViews[static_cast<std::size_t>(extent)]);
+            iViews.reset();
+#else
+            if (iBase != nullptr)
+                ::munmap(iBase, static_cast<std::size_t>(iReservation));
+            iBase = nullptr;
+#endif
+            iMappedSize = 0;
+        }
+    private:
+        std::filesystem::path const iPath;
+        std::uint64_t const iExtentSize;
+        std::uint64_t const iReservation;
+        std::mutex iMutex;
+        os_file iFile;
+        std::uint8_t* iBase;
+#ifdef _WIN32
+        std::unique_ptr<std::uint8_t*[]> iViews;
+#endif
+        std::uint64_t iMappedSize;
+        std::atomic<std::uint64_t> iEndOfData;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <new>
+
+namespace neodb
+{
+    struct object_pool_stats
+    {
+        std::uint64_t slabs = 0;
+        std::uint64_t allocations = 0;
+        std::uint64_t recycled = 0;
+    };
+
+    // Slab allocator for fixed-size objects of type T, intended to back a class's own operator new and
+    // operator delete. Each thread allocates from and frees to its own free list so the fast path takes
+    // no lock; slabs of SlabSize objects are only taken from the shared pool when a thread's list runs dry
+    // and a thread's free list is handed back to the shared pool when the thread exits. Slabs live until
+    // the process ends.
+    template <typename T, std::size_t SlabSize = 256>
+    class object_pool
+    {
+    private:
+        union slot
+        {
+            slot* next;
+            alignas(T) std::byte storage[sizeof(T)];
+        };
+        struct thread_cache;
+        struct shared_state
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<slot[]>> slabs;
+            slot* free = nullptr;
+            std::uint64_t slabCount = 0;
+            // counts of exited threads; live threads keep their own, summed by stats()
+            std::uint64_t allocations = 0;
+            std::uint64_t recycled = 0;
+            std::vector<thread_cache*> threads;
+        };
+        struct thread_cache
+        {
+            slot* free = nullptr;
+            // only the owning thread writes these; they are atomic so that stats() can read them
+            std::atomic<std::uint64_t> allocations = 0;
+            std::atomic<std::uint64_t> recycled = 0;
+            thread_cache()
+            {
+                auto& shared = shared_instance();
+                std::scoped_lock lock{ shared.mutex };
+                shared.threads.push_back(this);
+            }
+            ~thread_cache()
+            {
+                auto& shared = shared_instance();
+                std::scoped_lock lock{ shared.mutex };
+                shared.threads.erase(std::find(shared.threads.begin(), shared.threads.end(), this));
+                shared.allocations += allocations.load(std::memory_order_relaxed);
+                shared.recycled += recycled.load(std::memory_order_relaxed);
+                if (free == nullptr)
+                    return;
+                slot* last = free;
+                while (last->next != nullptr)
+                    last = last->next;
+                last->next = shared.free;
+                shared.free = free;
+            }
+            void count(std::atomic<std::uint64_t>& aCounter)
+            {
+                aCounter.store(aCounter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        };
+    public:
+        static void* allocate()
+        {
+            auto& cache = thread_instance();
+            cache.count(cache.allocations);
+            if (cache.free == nullptr)
+                refill(cache);
+            else
+                cache.count(cache.recycled);
+            slot* const result = cache.free;
+            cache.free = result->next;
+            return result->storage;
+        }
+        static void deallocate(void* aObject) noexcept
+        {
+            auto& cache = thread_instance();
+            slot* const freed = reinterpret_cast<slot*>(aObject);
+            freed->next = cache.free;
+            cache.free = freed;
+        }
+        static object_pool_stats stats()
+        {
+            auto& shared = shared_instance();
+            std::scoped_lock lock{ shared.mutex };
+            object_pool_stats result{ shared.slabCount, shared.allocations, shared.recycled };
+            for (auto const* cache : shared.threads)
+            {
+                result.allocations += cache->allocations.load(std::memory_order_relaxed);
+                result.recycled += cache->recycled.load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+    private:
+        static void refill(thread_cache& aCache)
+        {
+            auto& shared = shared_instance();
+            std::scoped_lock lock{ shared.mutex };
+            if (shared.free != nullptr)
+            {
+                // adopt slots released by threads that have exited
+                aCache.free = shared.free;
+                shared.free = nullptr;
+                aCache.count(aCache.recycled);
+                return;
+            }
+            shared.slabs.push_back(std::make_unique<slot[]>(SlabSize));
+            ++shared.slabCount;
+            slot* const slab = shared.slabs.back().get();
+            for (std::size_t index = 0; index < SlabSize; ++index)
+                slab[index].next = (index + 1 < SlabSize ? &slab[index + 1] : nullptr);
+            aCache.free = slab;
+        }
+        static shared_state& shared_instance()
+        {
+            static shared_state sState;
+            return sState;
+        }
+        static thread_cache& thread_instance()
+        {
+            thread_local thread_cache tCache;
+            return tCache;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,188 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+namespace neodb
+{
+    struct os_file_error : std::runtime_error { os_file_error(std::string const& aWhat) : std::runtime_error{ "neodb::os_file_error: " + aWhat } {} };
+
+    // Thin positional-I/O wrapper over a native file handle; used where std::fstream cannot help
+    // (durable sync, concurrent positional reads and writes).
+    class os_file
+    {
+    public:
+#ifdef _WIN32
+        typedef HANDLE native_handle_type;
+#else
+        typedef int native_handle_type;
+#endif
+    public:
+        os_file(std::filesystem::path const& aPath, bool aCreate = true) :
+            iPath{ aPath }
+        {
+#ifdef _WIN32
+            iHandle = ::CreateFileW(aPath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                aCreate ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (iHandle == INVALID_HANDLE_VALUE)
+                throw os_file_error{ "failed to open '" + aPath.generic_string() + "'" };
+#else
+            iHandle = ::open(aPath.c_str(), O_RDWR | (aCreate ? O_CREAT : 0), 0644);
+            if (iHandle == -1)
+                throw os_file_error{ "failed to open '" + aPath.generic_string() + "'" };
+#endif
+        }
+        os_file(os_file const&) = delete;
+        os_file& operator=(os_file const&) = delete;
+        ~os_file()
+        {
+#ifdef _WIN32
+            ::CloseHandle(iHandle);
+#else
+            ::close(iHandle);
+#endif
+        }
+    public:
+        std::filesystem::path const& path() const
+        {
+            return iPath;
+        }
+        native_handle_type native_handle() const
+        {
+            return iHandle;
+        }
+        std::uint64_t size() const
+        {
+#ifdef _WIN32
+            LARGE_INTEGER fileSize;
+            if (!::GetFileSizeEx(iHandle, &fileSize))
+                throw os_file_error{ "failed to stat '" + iPath.generic_string() + "'" };
+            return static_cast<std::uint64_t>(fileSize.QuadPart);
+#else
+            struct ::stat status;
+            if (::fstat(iHandle, &status) == -1)
+                throw os_file_error{ "failed to stat '" + iPath.generic_string() + "'" };
+            return static_cast<std::uint64_t>(status.st_size);
+#endif
+        }
+        // Returns the number of bytes read, which is only short at end of file.
+        std::size_t read_at(std::uint64_t aOffset, void* aBuffer, std::size_t aLength) const
+        {
+            std::size_t done = 0;
+            while (done < aLength)
+            {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                position.Offset = static_cast<DWORD>(aOffset + done);
+                position.OffsetHigh = static_cast<DWORD>((aOffset + done) >> 32);
+                DWORD transferred = 0;
+                if (!::ReadFile(iHandle, static_cast<char*>(aBuffer) + done, static_cast<DWORD>(aLength - done), &transferred, &position) &&
+                    ::GetLastError() != ERROR_HANDLE_EOF)
+                    throw os_file_error{ "failed to read '" + iPath.generic_string() + "'" };
+#else
+                auto const transferred = ::pread(iHandle, static_cast<char*>(aBuffer) + done, aLength - done, static_cast<off_t>(aOffset + done));
+                if (transferred == -1)
+                    throw os_file_error{ "failed to read '" + iPath.generic_string() + "'" };
+#endif
+                if (transferred == 0)
+                    break;
+                done += static_cast<std::size_t>(transferred);
+            }
+            return done;
+        }
+        void write_at(std::uint64_t aOffset, void const* aBuffer, std::size_t aLength)
+        {
+            std::size_t done = 0;
+            while (done < aLength)
+            {
+#ifdef _WIN32
+                OVERLAPPED position = {};
+                position.Offset = static_cast<DWORD>(aOffset + done);
+                position.OffsetHigh = static_cast<DWORD>((aOffset + done) >> 32);
+                DWORD transferred = 0;
+                if (!::WriteFile(iHandle, static_cast<char const*>(aBuffer) + done, static_cast<DWORD>(aLength - done), &transferred, &position))
+                    throw os_file_error{ "failed to write '" + iPath.generic_string() + "'" };
+#else
+                auto const transferred = ::pwrite(iHandle, static_cast<char const*>(aBuffer) + done, aLength - done, static_cast<off_t>(aOffset + done));
+                if (transferred == -1)
+                    throw os_file_error{ "failed to write '" + iPath.generic_string() + "'" };
+#endif
+                done += static_cast<std::size_t>(transferred);
+            }
+        }
+        void truncate(std::uint64_t aSize)
+        {
+#ifdef _WIN32
+            LARGE_INTEGER newSize;
+            newSize.QuadPart = static_cast<LONGLONG>(aSize);
+            if (!::SetFilePointerEx(iHandle, newSize, nullptr, FILE_BEGIN) || !::SetEndOfFile(iHandle))
+                throw os_file_error{ "failed to resize '" + iPath.generic_string() + "'" };
+#else
+            if (::ftruncate(iHandle, static_cast<off_t>(aSize)) == -1)
+                throw os_file_error{ "failed to resize '" + iPath.generic_string() + "'" };
+#endif
+        }
+        // Make written data durable; file metadata other than size is not forced out.
+        void sync()
+        {
+#ifdef _WIN32
+            if (!::FlushFileBuffers(iHandle))
+                throw os_file_error{ "failed to sync '" + iPath.generic_string() + "'" };
+#elif defined(__APPLE__)
+            if (::fcntl(iHandle, F_FULLFSYNC) == -1 && ::fsync(iHandle) == -1)
+                throw os_file_error{ "failed to sync '" + iPath.generic_string() + "'" };
+#else
+            if (::fdatasync(iHandle) == -1)
+                throw os_file_error{ "failed to sync '" + iPath.generic_string() + "'" };
+#endif
+        }
+    private:
+        std::filesystem::path const iPath;
+        native_handle_type iHandle;
+    };
+}
\ No newline at end of file
@@ -1,245 +1,295 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <cstdlib>
-#include <cstdint>
-#include <iostream>
-#include <boost/endian/arithmetic.hpp>
-#include <boost/endian/buffers.hpp>
-#include <boost/endian/conversion.hpp>
-
-using namespace boost::endian;
-
-namespace neodb
-{
-    template <typename Pointer = little_uint64_t>
-    struct basic_link
-    {
-        typedef Pointer pointer_type;
-        typedef pointer_type size_type;
-
-        pointer_type previous;
-        pointer_type next;
-        size_type used;
-    };
-
-    template <typename Pointer = little_uint64_t>
-    struct basic_page_header
-    {
-        typedef Pointer pointer_type;
-        typedef basic_link<pointer_type> link_type;
-
-        link_type pageLink;
-    };
-
-    template <typename Pointer = little_uint64_t>
-    struct basic_record_header
-    {
-        typedef Pointer pointer_type;
-        typedef basic_link<pointer_type> link_type;
-
-        link_type recordLink;
-    };
-    
-    std::size_t constexpr MINIMUM_RECORD_CAPACITY = 64;
-    std::size_t constexpr MAXIMUM_RECORD_CAPACITY = 8192;
-
-    inline constexpr std::size_t free_record_bucket_index(std::size_t aCapacity)
-    {
-        if (aCapacity >= MINIMUM_RECORD_CAPACITY)
-            return 1 + free_record_bucket_index(aCapacity >> 1);
-        else
-            return 0;
-    }
-
-    typedef little_uint64_t magic_t;
-    magic_t const MAGIC = 0x31307642444F454E; // NEODBv01
-
-    struct bad_magic : std::runtime_error { bad_magic() : std::runtime_error{ "neodb::bad_magic" } {} };
-
-    template <typename Pointer = little_uint64_t>
-    struct basic_root_page_header
-    {
-        typedef Pointer pointer_type;
-        typedef basic_link<pointer_type> link_type;
-
-        magic_t magic = MAGIC;
-        link_type freePages;
-        std::array<link_type, free_record_bucket_index(MAXIMUM_RECORD_CAPACITY) - free_record_bucket_index(MINIMUM_RECORD_CAPACITY) + 1> freeRecords;
-        link_type schemaRecords;
-        link_type tableRecords;
-        link_type indexRecords;
-    };
-
-    template <typename Header = basic_page_header<>, std::size_t Size = MAXIMUM_RECORD_CAPACITY * 2>
-    struct basic_page
-    {
-        static constexpr std::size_t size = Size;
-
-        typedef Header header_type;
-        typedef typename header_type::pointer_type pointer_type;
-        typedef std::array<std::uint8_t, Size - sizeof(header_type)> data_type;
-
-        header_type header;
-        data_type data;
-
-        void clear()
-        {
-            header = header_type{};
-            data = data_type{};
-        }
-        template <typename T>
-        T const* data_as() const
-        {
-            return reinterpret_cast<T const*>(&data[0]);
-        }
-        template <typename T>
-        T* data_as()
-        {
-            return reinterpret_cast<T*>(&data[0]);
-        }
-        template <typename T>
-        void emplace(T const& aData)
-        {
-            new (data_as<char>()) T{ aData };
-        }
-        template <typename T>
-        T const& as() const
-        {
-            return *reinterpret_cast<T const*>(data_as<char>());
-        }
-        template <typename T>
-        T& as()
-        {
-            return *reinterpret_cast<T const*>(data_as<char>());
-        }
-    };
-
-    using link = basic_link<>;
-    using page_header = basic_page_header<>;
-    using record_header = basic_record_header<>;
-    using page = basic_page<>;
-    using root_page = basic_page<basic_root_page_header<>>;
-
-    template <typename Char, typename CharT, typename T>
-    inline void endian_write(std::basic_ostream<Char, CharT>& aStream, T const& aEndianBuffer)
-    {
-        aStream.write(reinterpret_cast<char const*>(aEndianBuffer.data()), sizeof(aEndianBuffer));
-    }
-        
-    template <typename Char, typename CharT, typename T>
-    inline void endian_read(std::basic_istream<Char, CharT>& aStream, T& aEndianBuffer)
-    {
-        aStream.read(reinterpret_cast<char*>(aEndianBuffer.data()), sizeof(aEndianBuffer));
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_link<Pointer> const& aLink)
-    {
-        endian_write(aStream, aLink.previous);
-        endian_write(aStream, aLink.next);
-        endian_write(aStream, aLink.used);
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_page_header<Pointer> const& aHeader)
-    {
-        aStream << aHeader.pageLink;
-        aStream << aHeader.recordLink;
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_root_page_header<Pointer> const& aRootHeader)
-    {
-        endian_write(aStream, aRootHeader.magic);
-        aStream << aRootHeader.freePages;
-        for (auto const& link : aRootHeader.freeRecords)
-            aStream << link;
-        aStream << aRootHeader.schemaRecords;
-        aStream << aRootHeader.tableRecords;
-        aStream << aRootHeader.indexRecords;
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Header, std::size_t Size>
-    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_page<Header, Size> const& aPage)
-    {
-        aStream << aPage.header;
-        aStream.write(aPage.data_as<char>(), aPage.data.size());
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_link<Pointer>& aLink)
-    {
-        endian_read(aStream, aLink.previous);
-        endian_read(aStream, aLink.next);
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_page_header<Pointer>& aHeader)
-    {
-        aStream >> aHeader.pageLink;
-        aStream >> aHeader.recordLink;
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Pointer>
-    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_root_page_header<Pointer>& aRootHeader)
-    {
-        endian_read(aStream, aRootHeader.magic);
-        if (aRootHeader.magic != MAGIC)
-            throw bad_magic();
-        aStream >> aRootHeader.freePages;
-        for (auto& link : aRootHeader.freeRecords)
-            aStream >> link;
-        aStream >> aRootHeader.schemaRecords;
-        aStream >> aRootHeader.tableRecords;
-        aStream >> aRootHeader.indexRecords;
-        return aStream;
-    }
-
-    template <typename Char, typename CharT, typename Header, std::size_t Size>
-    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_page<Header, Size>& aPage)
-    {
-        aStream >> aPage.header;
-        aStream.read(aPage.data_as<char>(), aPage.data.size());
-        return aStream;
-    }
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdlib>
+#include <array>
+#include <cstdint>
+#include <atomic>
+#include <iostream>
+#include <boost/endian/arithmetic.hpp>
+#include <boost/endian/buffers.hpp>
+#include <boost/endian/conversion.hpp>
+
+using namespace boost::endian;
+
+namespace neodb
+{
+    template <typename Pointer = little_uint64_t>
+    struct basic_link
+    {
+        typedef Pointer pointer_type;
+        typedef pointer_type size_type;
+
+        pointer_type previous;
+        pointer_type next;
+        size_type used;
+    };
+
+    template <typename Pointer = little_uint64_t>
+    struct basic_page_header
+    {
+        typedef Pointer pointer_type;
+        typedef basic_link<pointer_type> link_type;
+
+        link_type pageLink;
+        pointer_type lsn;
+        little_uint32_t checksum;   // CRC32C of the rest of the page, set as it is written out
+        little_uint32_t reserved;
+    };
+
+    template <typename Pointer = little_uint64_t>
+    struct basic_record_header
+    {
+        typedef Pointer pointer_type;
+        typedef pointer_type size_type;
+        typedef basic_link<pointer_type> link_type;
+        // naturally aligned so that readers walking a version chain can load it atomically
+        typedef little_uint64_at version_type;
+
+        link_type recordLink;
+        size_type capacity;
+        // A record is one version of its contents: visible to snapshots from versionBegin up to (but
+        // not including) versionEnd, with olderVersion the address of the version it replaced, if any.
+        version_type versionBegin;
+        version_type versionEnd;
+        version_type olderVersion;
+    };
+
+    std::size_t constexpr MINIMUM_RECORD_CAPACITY = 64;
+    std::size_t constexpr MAXIMUM_RECORD_CAPACITY = 8192;
+
+    inline constexpr std::size_t free_record_bucket_index(std::size_t aCapacity)
+    {
+        if (aCapacity >= MINIMUM_RECORD_CAPACITY)
+            return 1 + free_record_bucket_index(aCapacity >> 1);
+        else
+            return 0;
+    }
+
+    // "used" value marking a record header as a free block sitting in one of the root page's freeRecords buckets
+    std::uint64_t constexpr FREE_RECORD = ~std::uint64_t{};
+
+    typedef std::uint64_t timestamp;
+    // versionEnd of a version that has not been superseded
+    timestamp constexpr NO_VERSION_END = ~timestamp{};
+
+    typedef little_uint64_t magic_t;
+    magic_t const MAGIC = 0x33307642444F454E; // NEODBv03
+
+    struct bad_magic : std::runtime_error { bad_magic() : std::runtime_error{ "neodb::bad_magic" } {} };
+
+    template <typename Pointer = little_uint64_t>
+    struct basic_root_page_header
+    {
+        typedef Pointer pointer_type;
+        typedef basic_link<pointer_type> link_type;
+
+        magic_t magic = MAGIC;
+        link_type freePages;
+        std::array<link_type, free_record_bucket_index(MAXIMUM_RECORD_CAPACITY) - free_record_bucket_index(MINIMUM_RECORD_CAPACITY) + 1> freeRecords;
+        link_type schemaRecords;
+        link_type tableRecords;
+        link_type indexRecords;
+        little_uint64_t versionClock;   // the last timestamp issued
+    };
+
+    template <typename Header = basic_page_header<>, std::size_t Size = MAXIMUM_RECORD_CAPACITY * 2>
+    struct alignas(std::uint64_t) basic_page
+    {
+        static constexpr std::size_t size = Size;
+
+        typedef Header header_type;
+        typedef typename header_type::pointer_type pointer_type;
+        typedef std::array<std::uint8_t, Size - sizeof(header_type)> data_type;
+
+        header_type header;
+        data_type data;
+
+        void clear()
+        {
+            header = header_type{};
+            data = data_type{};
+        }
+        template <typename T>
+        T const* data_as() const
+        {
+            return reinterpret_cast<T const*>(&data[0]);
+        }
+        template <typename T>
+        T* data_as()
+        {
+            return reinterpret_cast<T*>(&data[0]);
+        }
+        template <typename T>
+        void emplace(T const& aData)
+        {
+            new (data_as<char>()) T{ aData };
+        }
+        template <typename T>
+        T const& as() const
+        {
+            return *reinterpret_cast<T const*>(data_as<char>());
+        }
+        template <typename T>
+        T& as()
+        {
+            return *reinterpret_cast<T*>(data_as<char>());
+        }
+    };
+
+    using link = basic_link<>;
+    using page_header = basic_page_header<>;
+    using record_header = basic_record_header<>;
+    using page = basic_page<>;
+    using root_page = basic_page<basic_root_page_header<>>;
+
+    static_assert(sizeof(page) == page::size, "neodb::page must have no padding as it is mapped directly onto storage");
+    static_assert(sizeof(root_page) == root_page::size, "neodb::root_page must have no padding as it is mapped directly onto storage");
+    static_assert(sizeof(page_header) % alignof(record_header) == 0 && MINIMUM_RECORD_CAPACITY % alignof(record_header) == 0,
+        "neodb::record_header must be naturally aligned wherever a record starts");
+
+    // An unpinned look at a page held in memory (see i_database::peek_page). The page may be evicted
+    // and its frame reused while it is read, so what was read counts only if unchanged() is true
+    // afterwards; a null stamp means the page never moves.
+    struct page_peek
+    {
+        page const* contents = nullptr;
+        std::atomic<std::uint64_t> const* stamp = nullptr;
+        std::uint64_t seen = 0u;
+
+        bool unchanged() const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return stamp == nullptr || stamp->load(std::memory_order_relaxed) == seen;
+        }
+    };
+
+    template <typename Char, typename CharT, typename T>
+    inline void endian_write(std::basic_ostream<Char, CharT>& aStream, T const& aEndianBuffer)
+    {
+        aStream.write(reinterpret_cast<char const*>(aEndianBuffer.data()), sizeof(aEndianBuffer));
+    }
+        
+    template <typename Char, typename CharT, typename T>
+    inline void endian_read(std::basic_istream<Char, CharT>& aStream, T& aEndianBuffer)
+    {
+        aStream.read(reinterpret_cast<char*>(aEndianBuffer.data()), sizeof(aEndianBuffer));
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_link<Pointer> const& aLink)
+    {
+        endian_write(aStream, aLink.previous);
+        endian_write(aStream, aLink.next);
+        endian_write(aStream, aLink.used);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_page_header<Pointer> const& aHeader)
+    {
+        aStream << aHeader.pageLink;
+        endian_write(aStream, aHeader.lsn);
+        endian_write(aStream, aHeader.checksum);
+        endian_write(aStream, aHeader.reserved);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_root_page_header<Pointer> const& aRootHeader)
+    {
+        endian_write(aStream, aRootHeader.magic);
+        aStream << aRootHeader.freePages;
+        for (auto const& link : aRootHeader.freeRecords)
+            aStream << link;
+        aStream << aRootHeader.schemaRecords;
+        aStream << aRootHeader.tableRecords;
+        aStream << aRootHeader.indexRecords;
+        endian_write(aStream, aRootHeader.versionClock);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Header, std::size_t Size>
+    inline std::basic_ostream<Char, CharT>& operator<<(std::basic_ostream<Char, CharT>& aStream, basic_page<Header, Size> const& aPage)
+    {
+        aStream << aPage.header;
+        aStream.write(aPage.template data_as<char>(), aPage.data.size());
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_link<Pointer>& aLink)
+    {
+        endian_read(aStream, aLink.previous);
+        endian_read(aStream, aLink.next);
+        endian_read(aStream, aLink.used);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_page_header<Pointer>& aHeader)
+    {
+        aStream >> aHeader.pageLink;
+        endian_read(aStream, aHeader.lsn);
+        endian_read(aStream, aHeader.checksum);
+        endian_read(aStream, aHeader.reserved);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Pointer>
+    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_root_page_header<Pointer>& aRootHeader)
+    {
+        endian_read(aStream, aRootHeader.magic);
+        if (aRootHeader.magic != MAGIC)
+            throw bad_magic();
+        aStream >> aRootHeader.freePages;
+        for (auto& link : aRootHeader.freeRecords)
+            aStream >> link;
+        aStream >> aRootHeader.schemaRecords;
+        aStream >> aRootHeader.tableRecords;
+        aStream >> aRootHeader.indexRecords;
+        endian_read(aStream, aRootHeader.versionClock);
+        return aStream;
+    }
+
+    template <typename Char, typename CharT, typename Header, std::size_t Size>
+    inline std::basic_istream<Char, CharT>& operator>>(std::basic_istream<Char, CharT>& aStream, basic_page<Header, Size>& aPage)
+    {
+        aStream >> aPage.header;
+        aStream.read(aPage.template data_as<char>(), aPage.data.size());
+        return aStream;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,269 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <mutex>
+#include <optional>
+#include <functional>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_database.hpp>
+
+namespace neodb
+{
+    // Grants runs of physically contiguous pages. Free pages are kept as extents: the first page of
+    // each free extent carries a page link chaining it to the others (root freePages holds the head,
+    // the tail and the total number of free pages) with the extent's length in pages in "used".
+    // An in-memory index of the extents by address and by length gives best-fit allocation and
+    // coalescing of neighbours on free without walking the on-disk chain.
+    class page_allocator
+    {
+    public:
+        typedef page::pointer_type pointer_type;
+        typedef std::function<pointer_type(std::uint64_t aPageCount)> extend_function;
+    public:
+        page_allocator(i_database& aDatabase, extend_function aExtend) :
+            iDatabase{ aDatabase }, iExtend{ std::move(aExtend) }
+        {
+        }
+    public:
+        // Rebuild the in-memory index from the on-disk chain of an existing database.
+        void load()
+        {
+            std::scoped_lock lock{ iMutex };
+            iByAddress.clear();
+            iByLength.clear();
+            for (std::uint64_t address = chain().next; address != 0;)
+            {
+                pinned_page extent{ iDatabase, address };
+                std::uint64_t const length = extent->header.pageLink.used;
+                iByAddress.emplace(address, length);
+                iByLength.emplace(length, address);
+                address = extent->header.pageLink.next;
+            }
+        }
+        std::uint64_t free_page_count() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return chain().used;
+        }
+        std::size_t free_extent_count() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iByAddress.size();
+        }
+    public:
+        // Unlike pages from extend(), pages reused from a free extent are not zeroed: the free chain
+        // link is cleared but the rest holds whatever was last written, so callers must initialise
+        // every part of a page they rely on.
+        pointer_type allocate(std::uint64_t aPageCount = 1)
+        {
+            if (aPageCount == 0)
+                throw std::logic_error{ "neodb::page_allocator::allocate: zero pages" };
+            std::scoped_lock lock{ iMutex };
+            auto bestFit = iByLength.lower_bound({ aPageCount, 0 });
+            if (bestFit == iByLength.end())
+                return iExtend(aPageCount);
+            auto const [length, address] = *bestFit;
+            index_erase(address, length);
+            if (length == aPageCount)
+                unlink_extent(address);
+            else
+            {
+                auto const remainder = address + aPageCount * page::size;
+                move(address, remainder, length - aPageCount);
+                index_insert(remainder, length - aPageCount);
+            }
+            chain().used = chain().used - aPageCount;
+            return address;
+        }
+        void free(pointer_type aAddress, std::uint64_t aPageCount = 1)
+        {
+            if (aPageCount == 0)
+                return;
+            if (aAddress == 0 || aAddress % page::size != 0)
+                throw std::logic_error{ "neodb::page_allocator::free: bad page address" };
+            std::scoped_lock lock{ iMutex };
+            std::uint64_t const address = aAddress;
+            std::uint64_t const end = address + aPageCount * page::size;
+            auto next = iByAddress.lower_bound(address);
+            std::optional<std::pair<std::uint64_t, std::uint64_t>> predecessor;
+            std::optional<std::pair<std::uint64_t, std::uint64_t>> successor;
+            if (next != iByAddress.begin())
+            {
+                auto const previous = std::prev(next);
+                auto const previousEnd = previous->first + previous->second * page::size;
+                if (previousEnd > address)
+                    throw std::logic_error{ "neodb::page_allocator::free: page already free" };
+                if (previousEnd == address)
+                    predecessor = *previous;
+            }
+            if (next != iByAddress.end())
+            {
+                if (next->first < end)
+                    throw std::logic_error{ "neodb::page_allocator::free: page already free" };
+                if (next->first == end)
+                    successor = *next;
+            }
+            if (predecessor && successor)
+            {
+                index_erase(successor->first, successor->second);
+                unlink_extent(successor->first);
+                index_erase(predecessor->first, predecessor->second);
+                resize(predecessor->first, predecessor->second + aPageCount + successor->second);
+                index_insert(predecessor->first, predecessor->second + aPageCount + successor->second);
+            }
+            else if (predecessor)
+            {
+                index_erase(predecessor->first, predecessor->second);
+                resize(predecessor->first, predecessor->second + aPageCount);
+                index_insert(predecessor->first, predecessor->second + aPageCount);
+            }
+            else if (successor)
+            {
+                index_erase(successor->first, successor->second);
+                move(successor->first, address, aPageCount + successor->second);
+                index_insert(address, aPageCount + successor->second);
+            }
+            else
+            {
+                link_extent(address, aPageCount);
+                index_insert(address, aPageCount);
+            }
+            chain().used = chain().used + aPageCount;
+        }
+    private:
+        link const& chain() const
+        {
+            return iDatabase.root().header.freePages;
+        }
+        link& chain()
+        {
+            return iDatabase.root().header.freePages;
+        }
+        void index_insert(std::uint64_t aAddress, std::uint64_t aLength)
+        {
+            iByAddress.emplace(aAddress, aLength);
+            iByLength.emplace(aLength, aAddress);
+        }
+        void index_erase(std::uint64_t aAddress, std::uint64_t aLength)
+        {
+            iByAddress.erase(aAddress);
+            iByLength.erase({ aLength, aAddress });
+        }
+        void set_previous(std::uint64_t aAddress, std::uint64_t aPrevious)
+        {
+            if (aAddress == 0)
+            {
+                chain().previous = aPrevious;
+                return;
+            }
+            pinned_page extent{ iDatabase, aAddress };
+            extent->header.pageLink.previous = aPrevious;
+            extent.set_dirty();
+        }
+        void set_next(std::uint64_t aAddress, std::uint64_t aNext)
+        {
+            if (aAddress == 0)
+            {
+                chain().next = aNext;
+                return;
+            }
+            pinned_page extent{ iDatabase, aAddress };
+            extent->header.pageLink.next = aNext;
+            extent.set_dirty();
+        }
+        void link_extent(std::uint64_t aAddress, std::uint64_t aLength)
+        {
+            std::uint64_t const head = chain().next;
+            {
+                pinned_page extent{ iDatabase, aAddress };
+                extent->header.pageLink = { 0u, head, aLength };
+                extent.set_dirty();
+            }
+            set_previous(head, aAddress);
+            chain().next = aAddress;
+        }
+        void unlink_extent(std::uint64_t aAddress)
+        {
+            std::uint64_t previous;
+            std::uint64_t next;
+            {
+                pinned_page extent{ iDatabase, aAddress };
+                previous = extent->header.pageLink.previous;
+                next = extent->header.pageLink.next;
+                extent->header.pageLink = {};
+                extent.set_dirty();
+            }
+            set_next(previous, next);
+            set_previous(next, previous);
+        }
+        void resize(std::uint64_t aAddress, std::uint64_t aLength)
+        {
+            pinned_page extent{ iDatabase, aAddress };
+            extent->header.pageLink.used = aLength;
+            extent.set_dirty();
+        }
+        // Replace the extent at aFrom in the chain by one at aTo, keeping its position.
+        void move(std::uint64_t aFrom, std::uint64_t aTo, std::uint64_t aLength)
+        {
+            std::uint64_t previous;
+            std::uint64_t next;
+            {
+                pinned_page from{ iDatabase, aFrom };
+                previous = from->header.pageLink.previous;
+                next = from->header.pageLink.next;
+                from->header.pageLink = {};
+                from.set_dirty();
+            }
+            {
+                pinned_page to{ iDatabase, aTo };
+                to->header.pageLink = { previous, next, aLength };
+                to.set_dirty();
+            }
+            set_next(previous, aTo);
+            set_previous(next, aTo);
+        }
+    private:
+        mutable std::mutex iMutex;
+        i_database& iDatabase;
+        extend_function iExtend;
+        std::map<std::uint64_t, std::uint64_t> iByAddress;
+        std::set<std::pair<std::uint64_t, std::uint64_t>> iByLength;
+    };
+}
\ No newline at end of file
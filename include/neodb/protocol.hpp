@@ -0,0 +1,235 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <neodb/data_type.hpp>
+#include <neodb/table_options.hpp>
+#include <neodb/i_schema.hpp>
+#include <neodb/schema.hpp>
+#include <neodb/row_layout.hpp>
+
+namespace neodb
+{
+    typedef std::vector<std::uint8_t> message;
+
+    struct bad_message : std::runtime_error { bad_message() : std::runtime_error{ "neodb::bad_message" } {} };
+
+    // The client/server wire format. Requests and responses travel in frames of a 32-bit payload length
+    // followed by the payload, responses adding a status byte before theirs (see the server's session).
+    // A request payload is an opcode followed by its arguments; integers are little-endian and strings
+    // are prefixed with a 16-bit length. Rows travel exactly as they are stored on pages, encoded as
+    // described by the table's row_layout, so the server writes them straight from buffer pool frames
+    // and the client decodes them in place; keys are encoded as index keys (see index_key.hpp).
+    namespace protocol
+    {
+        enum class opcode : std::uint8_t
+        {
+            CreateTable     = 0x01, // table definition -> nothing
+            DescribeTable   = 0x02, // table name -> table definition
+            Insert          = 0x03, // table name, u32 count, rows -> u32 count, bitmap of rows inserted (the others had duplicate keys)
+            BulkInsert      = 0x04, // table name, u32 count, rows -> nothing; all rows or none are inserted
+            Find            = 0x05, // table name, u32 count, keys -> row batch header, bitmap of keys found, rows found
+            Scan            = 0x06, // table name, u8 scan flags, [low key], [high key], u32 row limit -> row batch header, rows
+            Commit          = 0x07, // nothing -> nothing
+            Count           = 0x08  // table name, u8 scan flags, [low key], [high key] -> u64 count
+        };
+
+        enum scan_flags : std::uint8_t
+        {
+            HasLowKey       = 0x01,
+            HasHighKey      = 0x02,
+            ExcludeLowKey   = 0x04  // resume a scan after the last row of a previous batch
+        };
+
+        enum batch_flags : std::uint8_t
+        {
+            More            = 0x01  // the scan stopped at a batch limit; rows past the last one remain
+        };
+
+        // Precedes the rows of a Find or Scan response.
+        struct row_batch_header
+        {
+            little_uint32_t rowSize;
+            little_uint32_t rowCount;
+            little_uint8_t flags;
+        };
+        static_assert(sizeof(row_batch_header) == 9);
+
+        class writer
+        {
+        public:
+            explicit writer(message& aMessage) :
+                iMessage{ aMessage }
+            {
+            }
+        public:
+            template <typename T>
+            writer& put(T aValue)
+            {
+                if constexpr (std::is_enum_v<T>)
+                    return put(static_cast<std::underlying_type_t<T>>(aValue));
+                else
+                {
+                    auto const offset = iMessage.size();
+                    iMessage.resize(offset + sizeof(T));
+                    store_little(&iMessage[offset], aValue);
+                    return *this;
+                }
+            }
+            writer& put_string(std::string_view aValue)
+            {
+                if (aValue.size() > 0xFFFFu)
+                    throw field_value_too_long();
+                put(static_cast<std::uint16_t>(aValue.size()));
+                return put_bytes(aValue.data(), aValue.size());
+            }
+            writer& put_bytes(void const* aData, std::size_t aSize)
+            {
+                auto const bytes = static_cast<std::uint8_t const*>(aData);
+                iMessage.insert(iMessage.end(), bytes, bytes + aSize);
+                return *this;
+            }
+        private:
+            message& iMessage;
+        };
+
+        // Reads a payload front to back; running off its end throws bad_message.
+        class reader
+        {
+        public:
+            reader(void const* aData, std::size_t aSize) :
+                iNext{ static_cast<std::uint8_t const*>(aData) }, iEnd{ iNext + aSize }
+            {
+            }
+            explicit reader(message const& aMessage) :
+                reader{ aMessage.data(), aMessage.size() }
+            {
+            }
+        public:
+            std::size_t remaining() const
+            {
+                return static_cast<std::size_t>(iEnd - iNext);
+            }
+            template <typename T>
+            T get()
+            {
+                if constexpr (std::is_enum_v<T>)
+                    return static_cast<T>(get<std::underlying_type_t<T>>());
+                else
+                    return load_little<T>(get_bytes(sizeof(T)));
+            }
+            std::string get_string()
+            {
+                auto const length = get<std::uint16_t>();
+                auto const bytes = get_bytes(length);
+                return std::string{ reinterpret_cast<char const*>(bytes), length };
+            }
+            // the next aSize bytes, in place
+            std::uint8_t const* get_bytes(std::size_t aSize)
+            {
+                if (aSize > remaining())
+                    throw bad_message();
+                auto const result = iNext;
+                iNext += aSize;
+                return result;
+            }
+        private:
+            std::uint8_t const* iNext;
+            std::uint8_t const* iEnd;
+        };
+
+        inline std::size_t bitmap_size(std::size_t aBits)
+        {
+            return (aBits + 7) / 8;
+        }
+
+        inline bool test_bit(std::uint8_t const* aBitmap, std::size_t aBit)
+        {
+            return (aBitmap[aBit / 8] & (1u << (aBit % 8))) != 0;
+        }
+
+        inline void set_bit(std::uint8_t* aBitmap, std::size_t aBit)
+        {
+            aBitmap[aBit / 8] |= static_cast<std::uint8_t>(1u << (aBit % 8));
+        }
+
+        inline void write_table_definition(writer& aWriter, i_schema const& aSchema, table_options const& aOptions)
+        {
+            aWriter.put_string(aSchema.name().to_std_string_view());
+            aWriter.put(aOptions.primaryIndex).put(aOptions.storage).put(static_cast<std::uint8_t>(aOptions.dictionaryEncoding));
+            aWriter.put(static_cast<std::uint16_t>(aSchema.fields().size()));
+            for (auto const& field : aSchema.fields())
+            {
+                aWriter.put_string(field->name().to_std_string_view());
+                aWriter.put(static_cast<std::uint8_t>(field->field_type()));
+                aWriter.put(field->data_type());
+                aWriter.put(static_cast<std::uint32_t>(field->layout()));
+            }
+        }
+
+        struct table_definition
+        {
+            neodb::schema schema;
+            table_options options;
+        };
+
+        inline table_definition read_table_definition(reader& aReader)
+        {
+            auto const name = aReader.get_string();
+            table_options options;
+            options.primaryIndex = aReader.get<primary_index_type>();
+            options.storage = aReader.get<table_storage>();
+            options.dictionaryEncoding = aReader.get<std::uint8_t>() != 0u;
+            std::vector<neolib::ref_ptr<i_field_spec>> fields;
+            for (auto fieldCount = aReader.get<std::uint16_t>(); fieldCount > 0; --fieldCount)
+            {
+                auto const fieldName = aReader.get_string();
+                auto const fieldType = static_cast<field_type>(aReader.get<std::uint8_t>());
+                auto const dataType = aReader.get<data_type>();
+                auto const layout = static_cast<std::size_t>(aReader.get<std::uint32_t>());
+                if (fieldType != field_type::Datum && fieldType != field_type::PrimaryKey)
+                    throw bad_message();
+                fields.push_back(neolib::make_ref<dynamic_field_spec>(string{ fieldName }, fieldType, dataType, layout));
+            }
+            return table_definition{ neodb::schema{ string{ name }, fields }, options };
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,1038 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <neodb/data_type.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/index_key.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/i_table.hpp>
+#include <neodb/column_filter.hpp>
+#include <neodb/string_dictionary.hpp>
+#include <neodb/version_clock.hpp>
+
+namespace neodb
+{
+    struct unknown_column : std::logic_error { unknown_column() : std::logic_error{ "neodb::unknown_column" } {} };
+    struct unsupported_aggregate : std::logic_error { unsupported_aggregate() : std::logic_error{ "neodb::unsupported_aggregate" } {} };
+
+    // Query operators pull batches of about this many rows from their inputs, so the cost of a virtual
+    // call and of resolving a column's type is paid once per batch rather than once per value.
+    std::size_t constexpr QUERY_BATCH_ROWS = 2048;
+
+    // One column of a batch, stored as column_data describes. The field is that of the table column
+    // scanned (only its offset is meaningless here) or, for a computed column, one of its own.
+    struct column_vector
+    {
+        field_layout field;
+        string_dictionary const* dictionary = nullptr;
+        std::vector<std::uint8_t> values;
+        std::vector<std::uint8_t> nulls;
+
+        std::size_t width() const
+        {
+            return dictionary != nullptr ? sizeof(string_dictionary::code_type) : field.size;
+        }
+        bool nullable() const
+        {
+            return field.nullBit != NOT_NULLABLE;
+        }
+        std::size_t rows() const
+        {
+            return values.size() / width();
+        }
+        void resize(std::size_t aRows)
+        {
+            values.resize(aRows * width());
+            if (nullable())
+                nulls.resize((aRows + 7) / 8);
+        }
+        bool null(std::size_t aRow) const
+        {
+            return nullable() && ((nulls[aRow / 8] >> (aRow % 8)) & 1u) != 0u;
+        }
+        void set_null(std::size_t aRow, bool aNull)
+        {
+            auto const mask = static_cast<std::uint8_t>(1u << (aRow % 8));
+            nulls[aRow / 8] = aNull ? nulls[aRow / 8] | mask : nulls[aRow / 8] & ~mask;
+        }
+        std::uint8_t const* value(std::size_t aRow) const
+        {
+            return values.data() + aRow * width();
+        }
+        column_data data() const
+        {
+            return column_data{ values.data(), nullable() ? nulls.data() : nullptr, dictionary };
+        }
+        // the value of a row, a dictionary code decoded to its string
+        data_value_type decode(std::size_t aRow) const
+        {
+            return visit_data_type(field.dataType, [&](auto aType) -> data_value_type
+            {
+                typedef typename decltype(aType)::type value_type;
+                if (null(aRow))
+                    return data_value_type{ std::in_place_type<optional<value_type>> };
+                auto const source = dictionary != nullptr ? dictionary->value(load_little<string_dictionary::code_type>(value(aRow))) : value(aRow);
+                if (!nullable())
+                    return data_value_type{ std::in_place_type<value_type>, decode_field_value<value_type>(field, source) };
+                return data_value_type{ std::in_place_type<optional<value_type>>, decode_field_value<value_type>(field, source) };
+            });
+        }
+        // append rows [aFirst, aFirst + aCount) of a column of the same shape
+        void append(column_data const& aSource, std::size_t aFirst, std::size_t aCount)
+        {
+            auto const first = rows();
+            resize(first + aCount);
+            std::memcpy(values.data() + first * width(), static_cast<std::uint8_t const*>(aSource.values) + aFirst * width(), aCount * width());
+            if (nullable())
+                for (std::size_t row = 0; row < aCount; ++row)
+                    set_null(first + row, aSource.nulls != nullptr && ((aSource.nulls[(aFirst + row) / 8] >> ((aFirst + row) % 8)) & 1u) != 0u);
+        }
+        // append the rows of a column of the same shape with the given indices, in their order
+        void gather(column_data const& aSource, std::uint32_t const* aRows, std::size_t aCount)
+        {
+            auto const first = rows();
+            resize(first + aCount);
+            auto const source = static_cast<std::uint8_t const*>(aSource.values);
+            auto const destination = values.data() + first * width();
+            switch (width())
+            {
+            case 1: gather_values<1>(source, aRows, aCount, destination); break;
+            case 2: gather_values<2>(source, aRows, aCount, destination); break;
+            case 4: gather_values<4>(source, aRows, aCount, destination); break;
+            case 8: gather_values<8>(source, aRows, aCount, destination); break;
+            case 16: gather_values<16>(source, aRows, aCount, destination); break;
+            default:
+                for (std::size_t row = 0; row < aCount; ++row)
+                    std::memcpy(destination + row * width(), source + aRows[row] * width(), width());
+                break;
+            }
+            if (nullable())
+                for (std::size_t row = 0; row < aCount; ++row)
+                    set_null(first + row, aSource.nulls != nullptr && ((aSource.nulls[aRows[row] / 8] >> (aRows[row] % 8)) & 1u) != 0u);
+        }
+    private:
+        template <std::size_t Width>
+        static void gather_values(std::uint8_t const* aSource, std::uint32_t const* aRows, std::size_t aCount, std::uint8_t* aDestination)
+        {
+            for (std::size_t row = 0; row < aCount; ++row)
+                std::memcpy(aDestination + row * Width, aSource + aRows[row] * Width, Width);
+        }
+    };
+
+    struct column_description
+    {
+        std::string name;
+        field_layout field;
+    };
+
+    // a field for a computed column
+    inline field_layout computed_field(data_type aType)
+    {
+        return field_layout{ aType, 0u, field_size(aType, 0u), is_nullable(aType) ? 0u : NOT_NULLABLE };
+    }
+
+    struct column_batch
+    {
+        std::size_t rows = 0u;
+        std::vector<column_vector> columns;
+
+        // empty the batch, giving it columns of the given shape
+        void reset(std::vector<column_description> const& aColumns)
+        {
+            rows = 0u;
+            columns.resize(aColumns.size());
+            for (std::size_t column = 0; column < aColumns.size(); ++column)
+                reset_column(column, aColumns[column].field, nullptr);
+        }
+        void reset(column_batch const& aShape)
+        {
+            rows = 0u;
+            columns.resize(aShape.columns.size());
+            for (std::size_t column = 0; column < aShape.columns.size(); ++column)
+                reset_column(column, aShape.columns[column].field, aShape.columns[column].dictionary);
+        }
+        data_value_type value(std::size_t aRow, std::size_t aColumn) const
+        {
+            return columns[aColumn].decode(aRow);
+        }
+    private:
+        void reset_column(std::size_t aColumn, field_layout const& aField, string_dictionary const* aDictionary)
+        {
+            auto& column = columns[aColumn];
+            column.field = aField;
+            column.dictionary = aDictionary;
+            column.values.clear();
+            column.nulls.clear();
+        }
+    };
+
+    // A query is a pipeline of operators, each pulling column batches from its input. Operators that
+    // need their whole input (aggregation, sorting) consume it on their first pull.
+    class i_query_operator
+    {
+    public:
+        virtual ~i_query_operator() = default;
+    public:
+        // the columns of the batches produced
+        virtual std::vector<column_description> const& columns() const = 0;
+        // Fill aBatch with the next rows, at least one; false once there are no more.
+        virtual bool next(column_batch& aBatch) = 0;
+    };
+
+    inline std::size_t column_index(std::vector<column_description> const& aColumns, std::string_view aName)
+    {
+        for (std::size_t column = 0; column < aColumns.size(); ++column)
+            if (aColumns[column].name == aName)
+                return column;
+        throw unknown_column();
+    }
+
+    // Reads some of a table's columns (all of them if none are named) as of a snapshot held for the
+    // scan's lifetime, a batch of whole scan_columns chunks at a time. Columns holding their values
+    // out of line (String, Blob) cannot be scanned.
+    class table_scan : public i_query_operator
+    {
+    public:
+        table_scan(i_table const& aTable, std::vector<std::string> const& aColumns = {}) :
+            iTable{ aTable }, iSnapshot{ aTable.database().versions() }
+        {
+            std::vector<column_description> fields;
+            for (auto const& field : aTable.schema().fields())
+                fields.push_back(column_description{ field->name().to_std_string(), aTable.row_layout().field(fields.size()) });
+            for (std::size_t column = 0; column < (aColumns.empty() ? fields.size() : aColumns.size()); ++column)
+            {
+                auto const field = aColumns.empty() ? column : column_index(fields, aColumns[column]);
+                if (!is_fixed_width(fields[field].field.dataType))
+                    throw unsupported_field_type();
+                iFields.push_back(field);
+                iColumns.push_back(fields[field]);
+            }
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iColumns;
+        }
+        bool next(column_batch& aBatch) override
+        {
+            aBatch.reset(iColumns);
+            if (iExhausted)
+                return false;
+            struct appender : i_column_visitor
+            {
+                column_batch& batch;
+                page::pointer_type& last;
+                appender(column_batch& aBatch, page::pointer_type& aLast) : batch{ aBatch }, last{ aLast } {}
+                bool visit(column_chunk const& aChunk) override
+                {
+                    for (std::size_t column = 0; column < batch.columns.size(); ++column)
+                    {
+                        batch.columns[column].dictionary = aChunk.columns[column].dictionary;
+                        batch.columns[column].append(aChunk.columns[column], 0u, aChunk.rows);
+                    }
+                    batch.rows += aChunk.rows;
+                    last = aChunk.rowAddresses[aChunk.rows - 1u];
+                    return batch.rows < QUERY_BATCH_ROWS;
+                }
+            } chunkAppender{ aBatch, iLast };
+            iTable.scan_columns(iFields.data(), iFields.size(), iLast, chunkAppender, iSnapshot.as_of());
+            iExhausted = aBatch.rows < QUERY_BATCH_ROWS;
+            return aBatch.rows != 0u;
+        }
+    private:
+        i_table const& iTable;
+        snapshot iSnapshot;
+        std::vector<std::size_t> iFields;
+        std::vector<column_description> iColumns;
+        page::pointer_type iLast = 0u;
+        bool iExhausted = false;
+    };
+
+    // a comparison of a column with a constant, as column_predicate makes
+    struct query_condition
+    {
+        std::string column;
+        compare_op op;
+        data_value_type value;
+    };
+
+    // Passes on the rows meeting all of its conditions. Each condition is evaluated over a whole batch
+    // into a selection bitmap and the selected rows are then gathered column by column; a batch whose
+    // rows are all selected is passed on as it is.
+    class filter : public i_query_operator
+    {
+    private:
+        struct bound_condition
+        {
+            std::size_t column;
+            compare_op op;
+            data_value_type value;
+            string_dictionary const* dictionary = nullptr;
+            std::optional<column_predicate> predicate;
+        };
+    public:
+        filter(std::unique_ptr<i_query_operator> aInput, std::vector<query_condition> aConditions) :
+            iInput{ std::move(aInput) }
+        {
+            for (auto& condition : aConditions)
+                iConditions.push_back(bound_condition{ column_index(iInput->columns(), condition.column), condition.op, std::move(condition.value), nullptr, std::nullopt });
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iInput->columns();
+        }
+        bool next(column_batch& aBatch) override
+        {
+            while (iInput->next(iInputBatch))
+            {
+                for (std::size_t condition = 0; condition < iConditions.size(); ++condition)
+                {
+                    auto const& column = iInputBatch.columns[iConditions[condition].column];
+                    predicate(iConditions[condition], column).evaluate(column.data(), iInputBatch.rows, condition == 0u ? iSelection : iConditionSelection);
+                    if (condition != 0u)
+                        iSelection &= iConditionSelection;
+                }
+                auto const selected = iConditions.empty() ? iInputBatch.rows : iSelection.count();
+                if (selected == 0u)
+                    continue;
+                if (selected == iInputBatch.rows)
+                {
+                    std::swap(aBatch, iInputBatch);
+                    return true;
+                }
+                iRows.clear();
+                for (std::size_t word = 0; word < (iInputBatch.rows + 63) / 64; ++word)
+                    for (auto bits = iSelection.data()[word]; bits != 0u; bits &= bits - 1u)
+                        iRows.push_back(static_cast<std::uint32_t>(word * 64 + static_cast<std::size_t>(std::countr_zero(bits))));
+                aBatch.reset(iInputBatch);
+                for (std::size_t column = 0; column < aBatch.columns.size(); ++column)
+                    aBatch.columns[column].gather(iInputBatch.columns[column].data(), iRows.data(), iRows.size());
+                aBatch.rows = iRows.size();
+                return true;
+            }
+            return false;
+        }
+    private:
+        // a predicate on a dictionary encoded column compares codes so waits until the dictionary is known
+        static column_predicate const& predicate(bound_condition& aCondition, column_vector const& aColumn)
+        {
+            if (!aCondition.predicate || aCondition.dictionary != aColumn.dictionary)
+            {
+                if (aColumn.dictionary != nullptr)
+                    aCondition.predicate.emplace(*aColumn.dictionary, aColumn.field, aCondition.op, aCondition.value);
+                else
+                    aCondition.predicate.emplace(aColumn.field, aCondition.op, aCondition.value);
+                aCondition.dictionary = aColumn.dictionary;
+            }
+            return *aCondition.predicate;
+        }
+    private:
+        std::unique_ptr<i_query_operator> iInput;
+        std::vector<bound_condition> iConditions;
+        column_batch iInputBatch;
+        selection_bitmap iSelection;
+        selection_bitmap iConditionSelection;
+        std::vector<std::uint32_t> iRows;
+    };
+
+    // Passes on some of its input's columns, in the given order, handing over their values rather
+    // than copying them.
+    class project : public i_query_operator
+    {
+    public:
+        project(std::unique_ptr<i_query_operator> aInput, std::vector<std::string> const& aColumns) :
+            iInput{ std::move(aInput) }
+        {
+            for (auto const& name : aColumns)
+            {
+                iSources.push_back(column_index(iInput->columns(), name));
+                iColumns.push_back(iInput->columns()[iSources.back()]);
+            }
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iColumns;
+        }
+        bool next(column_batch& aBatch) override
+        {
+            if (!iInput->next(iInputBatch))
+                return false;
+            aBatch.rows = iInputBatch.rows;
+            aBatch.columns.resize(iSources.size());
+            for (std::size_t column = 0; column < iSources.size(); ++column)
+            {
+                auto const earlier = std::find(iSources.begin(), iSources.begin() + column, iSources[column]);
+                if (earlier == iSources.begin() + column)
+                    std::swap(aBatch.columns[column], iInputBatch.columns[iSources[column]]);
+                else
+                    aBatch.columns[column] = aBatch.columns[earlier - iSources.begin()];
+            }
+            return true;
+        }
+    private:
+        std::unique_ptr<i_query_operator> iInput;
+        std::vector<std::size_t> iSources;
+        std::vector<column_description> iColumns;
+        column_batch iInputBatch;
+    };
+
+    enum class aggregate_function : std::uint32_t
+    {
+        Count,
+        Sum,
+        Min,
+        Max,
+        Average
+    };
+
+    // An aggregate of a column's non-null values, named aName in the output; a Count without a column
+    // counts rows.
+    struct query_aggregate
+    {
+        aggregate_function function;
+        std::string column;
+        std::string name;
+    };
+
+    // Groups its input by the values of some columns, a null being a value of its own, and outputs a
+    // row per group holding those columns followed by the aggregates. Each row's grouping values are
+    // hashed once to find its group; every aggregate then runs over the batch as a loop specialised
+    // for its column's type. Without grouping columns there is exactly one group, even for no input.
+    // Counts are Uint64; sums are Int64, Uint64 or Double as their column is signed, unsigned or
+    // floating point (integer sums wrap around); averages are Double; minimums and maximums are of
+    // their column's type. All but counts are null for a group without values.
+    class hash_aggregate : public i_query_operator
+    {
+    private:
+        static constexpr std::uint32_t NO_GROUP = ~std::uint32_t{};
+        struct accumulator
+        {
+            aggregate_function function;
+            std::optional<std::size_t> column;
+            std::vector<std::uint64_t> values; // per group, the running result's bits
+            std::vector<std::uint64_t> counts; // per group, the values seen
+        };
+    public:
+        hash_aggregate(std::unique_ptr<i_query_operator> aInput, std::vector<std::string> const& aGroupBy, std::vector<query_aggregate> const& aAggregates) :
+            iInput{ std::move(aInput) }
+        {
+            auto const& input = iInput->columns();
+            for (auto const& name : aGroupBy)
+            {
+                iGroupColumns.push_back(column_index(input, name));
+                iColumns.push_back(input[iGroupColumns.back()]);
+            }
+            for (auto const& aggregate : aAggregates)
+            {
+                accumulator newAccumulator{ aggregate.function, std::nullopt, {}, {} };
+                if (!aggregate.column.empty())
+                    newAccumulator.column = column_index(input, aggregate.column);
+                else if (aggregate.function != aggregate_function::Count)
+                    throw unknown_column();
+                iColumns.push_back(column_description{ aggregate.name, computed_field(result_type(aggregate.function,
+                    newAccumulator.column ? input[*newAccumulator.column].field.dataType : data_type::Uint64)) });
+                iAccumulators.push_back(std::move(newAccumulator));
+            }
+            if (iGroupColumns.empty())
+                add_group();
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iColumns;
+        }
+        bool next(column_batch& aBatch) override
+        {
+            if (!iConsumed)
+            {
+                while (iInput->next(iInputBatch))
+                {
+                    assign_groups();
+                    for (auto& accumulator : iAccumulators)
+                        accumulate(accumulator);
+                }
+                iConsumed = true;
+            }
+            aBatch.reset(iColumns);
+            if (iEmitted == iGroupCount)
+                return false;
+            auto const count = std::min(QUERY_BATCH_ROWS, iGroupCount - iEmitted);
+            std::size_t keyOffset = 0;
+            for (std::size_t group = 0; group < iGroupColumns.size(); ++group)
+            {
+                auto& column = aBatch.columns[group];
+                column.dictionary = iGroupDictionaries[group];
+                column.resize(count);
+                for (std::size_t row = 0; row < count; ++row)
+                {
+                    auto const key = &iGroupKeys[(iEmitted + row) * iKeyWidth + keyOffset];
+                    if (column.nullable())
+                        column.set_null(row, key[0] != 0u);
+                    std::memcpy(column.values.data() + row * column.width(), key + (column.nullable() ? 1 : 0), column.width());
+                }
+                keyOffset += (column.nullable() ? 1 : 0) + column.width();
+            }
+            for (std::size_t aggregate = 0; aggregate < iAccumulators.size(); ++aggregate)
+            {
+                auto const& accumulator = iAccumulators[aggregate];
+                auto& column = aBatch.columns[iGroupColumns.size() + aggregate];
+                column.resize(count);
+                for (std::size_t row = 0; row < count; ++row)
+                {
+                    auto const group = iEmitted + row;
+                    std::uint64_t bits = 0u;
+                    if (accumulator.function == aggregate_function::Count)
+                        bits = accumulator.counts[group];
+                    else if (accumulator.counts[group] == 0u)
+                        column.set_null(row, true);
+                    else
+                    {
+                        column.set_null(row, false);
+                        bits = accumulator.values[group];
+                        if (accumulator.function == aggregate_function::Average)
+                            bits = detail::kernel_bits(detail::kernel_value<double>(bits) / static_cast<double>(accumulator.counts[group]));
+                    }
+                    std::uint8_t encoded[sizeof(bits)];
+                    store_little(encoded, bits);
+                    std::memcpy(column.values.data() + row * column.width(), encoded, column.width());
+                }
+            }
+            aBatch.rows = count;
+            iEmitted += count;
+            return true;
+        }
+    private:
+        static data_type result_type(aggregate_function aFunction, data_type aColumnType)
+        {
+            if (aFunction == aggregate_function::Count)
+                return data_type::Uint64;
+            return detail::visit_filter_type(aColumnType, [&](auto aValueType, auto aKernelType) -> data_type
+            {
+                typedef typename decltype(aValueType)::type value_type;
+                typedef typename decltype(aKernelType)::type kernel_type;
+                if constexpr (std::is_void_v<kernel_type>)
+                    throw unsupported_aggregate();
+                else
+                {
+                    if (aFunction == aggregate_function::Min || aFunction == aggregate_function::Max)
+                        return nullable(aColumnType);
+                    if constexpr (std::is_same_v<value_type, bool> || std::is_same_v<value_type, time>)
+                        throw unsupported_aggregate();
+                    if (aFunction == aggregate_function::Average || std::is_floating_point_v<kernel_type>)
+                        return data_type::NullableDouble;
+                    return std::is_signed_v<kernel_type> ? data_type::NullableInt64 : data_type::NullableUint64;
+                }
+            });
+        }
+        void add_group(std::uint8_t const* aKey = nullptr)
+        {
+            if (aKey != nullptr)
+                iGroupKeys.insert(iGroupKeys.end(), aKey, aKey + iKeyWidth);
+            ++iGroupCount;
+            for (auto& accumulator : iAccumulators)
+            {
+                accumulator.values.push_back(0u);
+                accumulator.counts.push_back(0u);
+            }
+        }
+        void assign_groups()
+        {
+            iGroupOfRow.assign(iInputBatch.rows, 0u);
+            if (iGroupColumns.empty())
+                return;
+            if (iGroupDictionaries.empty())
+            {
+                // the key layout depends on which columns are dictionary encoded
+                for (auto group : iGroupColumns)
+                {
+                    auto const& column = iInputBatch.columns[group];
+                    iGroupDictionaries.push_back(column.dictionary);
+                    iKeyWidth += (column.nullable() ? 1 : 0) + column.width();
+                }
+                iKey.resize(iKeyWidth);
+            }
+            if (iKeyWidth <= sizeof(std::uint64_t))
+            {
+                narrow_keys();
+                for (std::size_t row = 0; row < iInputBatch.rows; ++row)
+                    iGroupOfRow[row] = find_group(iNarrowKeys[row]);
+                return;
+            }
+            for (std::size_t row = 0; row < iInputBatch.rows; ++row)
+            {
+                auto key = iKey.data();
+                for (auto group : iGroupColumns)
+                {
+                    auto const& column = iInputBatch.columns[group];
+                    bool const null = column.null(row);
+                    if (column.nullable())
+                        *key++ = null ? 1 : 0;
+                    if (null)
+                        std::memset(key, 0, column.width());
+                    else
+                        std::memcpy(key, column.value(row), column.width());
+                    key += column.width();
+                }
+                auto const [existing, added] = iGroups.try_emplace(iKey, static_cast<std::uint32_t>(iGroupCount));
+                if (added)
+                    add_group(reinterpret_cast<std::uint8_t const*>(iKey.data()));
+                iGroupOfRow[row] = existing->second;
+            }
+        }
+        // Keys of up to eight bytes (say a dictionary code or an integer) are built a column at a time
+        // in the bytes of a 64-bit word and looked up in an open addressing table of their own.
+        void narrow_keys()
+        {
+            iNarrowKeys.assign(iInputBatch.rows, 0u);
+            std::size_t offset = 0;
+            for (auto group : iGroupColumns)
+            {
+                auto const& column = iInputBatch.columns[group];
+                if (column.nullable())
+                {
+                    for (std::size_t row = 0; row < iInputBatch.rows; ++row)
+                        reinterpret_cast<std::uint8_t*>(&iNarrowKeys[row])[offset] = column.null(row) ? 1u : 0u;
+                    ++offset;
+                }
+                switch (column.width())
+                {
+                case 1: narrow_values<1>(column, offset); break;
+                case 2: narrow_values<2>(column, offset); break;
+                case 4: narrow_values<4>(column, offset); break;
+                case 8: narrow_values<8>(column, offset); break;
+                default:
+                    for (std::size_t row = 0; row < iInputBatch.rows; ++row)
+                        if (!column.null(row))
+                            std::memcpy(reinterpret_cast<std::uint8_t*>(&iNarrowKeys[row]) + offset, column.value(row), column.width());
+                    break;
+                }
+                offset += column.width();
+            }
+        }
+        template <std::size_t Width>
+        void narrow_values(column_vector const& aColumn, std::size_t aOffset)
+        {
+            auto const values = aColumn.values.data();
+            auto const keys = reinterpret_cast<std::uint8_t*>(iNarrowKeys.data());
+            bool const nullable = aColumn.nullable();
+            for (std::size_t row = 0; row < iInputBatch.rows; ++row)
+                if (!nullable || !aColumn.null(row))
+                    std::memcpy(keys + row * sizeof(std::uint64_t) + aOffset, values + row * Width, Width);
+        }
+        std::uint32_t find_group(std::uint64_t aKey)
+        {
+            if ((iGroupCount + 1) * 2 > iSlotGroups.size())
+                grow_slots();
+            auto const mask = iSlotGroups.size() - 1u;
+            for (auto slot = slot_of(aKey) & mask;; slot = (slot + 1u) & mask)
+            {
+                if (iSlotGroups[slot] == NO_GROUP)
+                {
+                    iSlotKeys[slot] = aKey;
+                    iSlotGroups[slot] = static_cast<std::uint32_t>(iGroupCount);
+                    add_group(reinterpret_cast<std::uint8_t const*>(&aKey));
+                    return iSlotGroups[slot];
+                }
+                if (iSlotKeys[slot] == aKey)
+                    return iSlotGroups[slot];
+            }
+        }
+        static std::size_t slot_of(std::uint64_t aKey)
+        {
+            auto const hash = aKey * 0x9E3779B97F4A7C15ull;
+            return static_cast<std::size_t>(hash ^ (hash >> 32));
+        }
+        void grow_slots()
+        {
+            std::vector<std::uint64_t> keys(std::max<std::size_t>(iSlotGroups.size() * 2u, 1024u));
+            std::vector<std::uint32_t> groups(keys.size(), NO_GROUP);
+            auto const mask = keys.size() - 1u;
+            for (std::size_t slot = 0; slot < iSlotGroups.size(); ++slot)
+                if (iSlotGroups[slot] != NO_GROUP)
+                {
+                    auto newSlot = slot_of(iSlotKeys[slot]) & mask;
+                    while (groups[newSlot] != NO_GROUP)
+                        newSlot = (newSlot + 1u) & mask;
+                    keys[newSlot] = iSlotKeys[slot];
+                    groups[newSlot] = iSlotGroups[slot];
+                }
+            iSlotKeys.swap(keys);
+            iSlotGroups.swap(groups);
+        }
+        void accumulate(accumulator& aAccumulator)
+        {
+            if (!aAccumulator.column)
+            {
+                for (auto group : iGroupOfRow)
+                    ++aAccumulator.counts[group];
+                return;
+            }
+            auto const& column = iInputBatch.columns[*aAccumulator.column];
+            detail::visit_filter_type(column.field.dataType, [&](auto, auto aKernelType)
+            {
+                typedef typename decltype(aKernelType)::type kernel_type;
+                if constexpr (!std::is_void_v<kernel_type>)
+                    accumulate<kernel_type>(aAccumulator, column);
+            });
+        }
+        template <typename K>
+        void accumulate(accumulator& aAccumulator, column_vector const& aColumn)
+        {
+            auto const values = aColumn.values.data();
+            auto const nulls = aColumn.nullable() ? aColumn.nulls.data() : nullptr;
+            auto const groups = iGroupOfRow.data();
+            auto const rows = iInputBatch.rows;
+            auto const results = aAccumulator.values.data();
+            auto const counts = aAccumulator.counts.data();
+            auto each = [&](auto aUpdate)
+            {
+                for (std::size_t row = 0; row < rows; ++row)
+                    if (nulls == nullptr || ((nulls[row / 8] >> (row % 8)) & 1u) == 0u)
+                        aUpdate(groups[row], load_little<K>(values + row * sizeof(K)));
+            };
+            switch (aAccumulator.function)
+            {
+            case aggregate_function::Count:
+                each([&](std::uint32_t aGroup, K) { ++counts[aGroup]; });
+                break;
+            case aggregate_function::Sum:
+                if constexpr (std::is_floating_point_v<K>)
+                    each([&](std::uint32_t aGroup, K aValue) { ++counts[aGroup]; results[aGroup] = detail::kernel_bits(detail::kernel_value<double>(results[aGroup]) + aValue); });
+                else if constexpr (std::is_signed_v<K>)
+                    each([&](std::uint32_t aGroup, K aValue) { ++counts[aGroup]; results[aGroup] += static_cast<std::uint64_t>(static_cast<std::int64_t>(aValue)); });
+                else
+                    each([&](std::uint32_t aGroup, K aValue) { ++counts[aGroup]; results[aGroup] += aValue; });
+                break;
+            case aggregate_function::Average:
+                each([&](std::uint32_t aGroup, K aValue) { ++counts[aGroup]; results[aGroup] = detail::kernel_bits(detail::kernel_value<double>(results[aGroup]) + static_cast<double>(aValue)); });
+                break;
+            case aggregate_function::Min:
+                each([&](std::uint32_t aGroup, K aValue) { if (counts[aGroup]++ == 0u || aValue < detail::kernel_value<K>(results[aGroup])) results[aGroup] = detail::kernel_bits(aValue); });
+                break;
+            case aggregate_function::Max:
+                each([&](std::uint32_t aGroup, K aValue) { if (counts[aGroup]++ == 0u || aValue > detail::kernel_value<K>(results[aGroup])) results[aGroup] = detail::kernel_bits(aValue); });
+                break;
+            }
+        }
+    private:
+        std::unique_ptr<i_query_operator> iInput;
+        std::vector<std::size_t> iGroupColumns;
+        std::vector<accumulator> iAccumulators;
+        std::vector<column_description> iColumns;
+        column_batch iInputBatch;
+        std::vector<string_dictionary const*> iGroupDictionaries;
+        std::size_t iKeyWidth = 0u;
+        std::string iKey;
+        std::unordered_map<std::string, std::uint32_t> iGroups;
+        std::vector<std::uint64_t> iNarrowKeys;
+        std::vector<std::uint64_t> iSlotKeys;
+        std::vector<std::uint32_t> iSlotGroups;
+        std::vector<std::uint8_t> iGroupKeys; // iKeyWidth bytes per group
+        std::vector<std::uint32_t> iGroupOfRow;
+        std::size_t iGroupCount = 0u;
+        std::size_t iEmitted = 0u;
+        bool iConsumed = false;
+    };
+
+    namespace detail
+    {
+        // An encoded field value in a form that memcmp orders as the values: integers, times and uuids
+        // as index keys, floating point values as their bit patterns with the sign bit set and
+        // negatives inverted, and strings as their zero padded characters.
+        template <typename T>
+        inline void encode_order_key(field_layout const& aField, std::uint8_t const* aSource, std::uint8_t* aKey)
+        {
+            if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>)
+                *aKey = *aSource;
+            else if constexpr (std::is_integral_v<T>)
+                index_key_traits<T>::encode(load_little<T>(aSource), aKey);
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                typedef std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t> bits_type;
+                auto const sign = static_cast<bits_type>(bits_type{ 1u } << (sizeof(T) * 8 - 1));
+                auto const bits = load_little<bits_type>(aSource);
+                index_key_traits<bits_type>::encode((bits & sign) != 0u ? static_cast<bits_type>(~bits) : static_cast<bits_type>(bits | sign), aKey);
+            }
+            else if constexpr (std::is_same_v<T, time>)
+                index_key_traits<std::int64_t>::encode(load_little<std::int64_t>(aSource), aKey);
+            else if constexpr (std::is_same_v<T, uuid>)
+                index_key_traits<uuid>::encode(decode_field_value<uuid>(aField, aSource), aKey);
+            else if constexpr (std::is_same_v<T, c_string>)
+                std::memcpy(aKey, aSource, aField.size);
+            else if constexpr (std::is_same_v<T, vc_string>)
+                std::memcpy(aKey, aSource + 2, aField.size - 2);
+            else
+                throw unsupported_field_type();
+        }
+
+        inline std::size_t order_key_width(field_layout const& aField)
+        {
+            return non_nullable(aField.dataType) == data_type::VarcharString ? aField.size - 2 : aField.size;
+        }
+    }
+
+    struct sort_key
+    {
+        std::string column;
+        bool descending = false;
+    };
+
+    // Sorts its whole input, stably, nulls before values. Each row's sort columns are encoded once into
+    // a byte string that memcmp orders as the rows should be (a null flag and the value's order key per
+    // column, inverted if descending) so comparisons never look at the values' types.
+    class order_by : public i_query_operator
+    {
+    public:
+        order_by(std::unique_ptr<i_query_operator> aInput, std::vector<sort_key> const& aKeys) :
+            iInput{ std::move(aInput) }
+        {
+            for (auto const& key : aKeys)
+            {
+                auto const column = column_index(iInput->columns(), key.column);
+                auto const& field = iInput->columns()[column].field;
+                if (!is_fixed_width(field.dataType))
+                    throw unsupported_field_type();
+                iKeys.push_back(bound_key{ column, key.descending, iKeyWidth });
+                iKeyWidth += 1 + detail::order_key_width(field);
+            }
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iInput->columns();
+        }
+        bool next(column_batch& aBatch) override
+        {
+            if (!iSorted)
+            {
+                sort();
+                iSorted = true;
+            }
+            if (iEmitted == iOrder.size())
+                return false;
+            auto const count = std::min(QUERY_BATCH_ROWS, iOrder.size() - iEmitted);
+            aBatch.reset(iRows);
+            for (std::size_t column = 0; column < aBatch.columns.size(); ++column)
+                aBatch.columns[column].gather(iRows.columns[column].data(), &iOrder[iEmitted], count);
+            aBatch.rows = count;
+            iEmitted += count;
+            return true;
+        }
+    private:
+        struct bound_key
+        {
+            std::size_t column;
+            bool descending;
+            std::size_t offset;
+        };
+        void sort()
+        {
+            column_batch batch;
+            while (iInput->next(batch))
+            {
+                if (iRows.columns.empty())
+                    iRows.reset(batch);
+                for (std::size_t column = 0; column < batch.columns.size(); ++column)
+                    iRows.columns[column].append(batch.columns[column].data(), 0u, batch.rows);
+                iRows.rows += batch.rows;
+            }
+            std::vector<std::uint8_t> keys(iRows.rows * iKeyWidth);
+            for (auto const& key : iKeys)
+                encode_keys(iRows.columns[key.column], key, keys.data());
+            iOrder.resize(iRows.rows);
+            std::iota(iOrder.begin(), iOrder.end(), 0u);
+            std::stable_sort(iOrder.begin(), iOrder.end(), [&](std::uint32_t aLeft, std::uint32_t aRight)
+            {
+                return std::memcmp(&keys[aLeft * iKeyWidth], &keys[aRight * iKeyWidth], iKeyWidth) < 0;
+            });
+        }
+        void encode_keys(column_vector const& aColumn, bound_key const& aKey, std::uint8_t* aKeys) const
+        {
+            auto const width = detail::order_key_width(aColumn.field);
+            visit_data_type(aColumn.field.dataType, [&](auto aType)
+            {
+                typedef typename decltype(aType)::type value_type;
+                // a dictionary's values are encoded once each rather than once per row
+                std::vector<std::uint8_t> codeKeys;
+                if (aColumn.dictionary != nullptr)
+                {
+                    codeKeys.resize(aColumn.dictionary->size() * width);
+                    for (std::size_t code = 0; code < aColumn.dictionary->size(); ++code)
+                        detail::encode_order_key<value_type>(aColumn.field, aColumn.dictionary->value(static_cast<string_dictionary::code_type>(code)), &codeKeys[code * width]);
+                }
+                for (std::size_t row = 0; row < iRows.rows; ++row)
+                {
+                    auto const key = aKeys + row * iKeyWidth + aKey.offset;
+                    bool const null = aColumn.null(row);
+                    key[0] = null ? 0u : 1u;
+                    if (null)
+                        std::memset(key + 1, 0, width);
+                    else if (aColumn.dictionary != nullptr)
+                        std::memcpy(key + 1, &codeKeys[load_little<string_dictionary::code_type>(aColumn.value(row)) * width], width);
+                    else
+                        detail::encode_order_key<value_type>(aColumn.field, aColumn.value(row), key + 1);
+                    if (aKey.descending)
+                        for (std::size_t byte = 0; byte <= width; ++byte)
+                            key[byte] = static_cast<std::uint8_t>(~key[byte]);
+                }
+            });
+        }
+    private:
+        std::unique_ptr<i_query_operator> iInput;
+        std::vector<bound_key> iKeys;
+        std::size_t iKeyWidth = 0u;
+        column_batch iRows;
+        std::vector<std::uint32_t> iOrder;
+        std::size_t iEmitted = 0u;
+        bool iSorted = false;
+    };
+
+    // Passes on aCount rows after skipping aOffset, then stops pulling from its input.
+    class limit : public i_query_operator
+    {
+    public:
+        limit(std::unique_ptr<i_query_operator> aInput, std::size_t aCount, std::size_t aOffset = 0u) :
+            iInput{ std::move(aInput) }, iRemaining{ aCount }, iSkip{ aOffset }
+        {
+        }
+    public:
+        std::vector<column_description> const& columns() const override
+        {
+            return iInput->columns();
+        }
+        bool next(column_batch& aBatch) override
+        {
+            while (iRemaining != 0u && iInput->next(iInputBatch))
+            {
+                auto const skipped = std::min(iSkip, iInputBatch.rows);
+                iSkip -= skipped;
+                auto const taken = std::min(iInputBatch.rows - skipped, iRemaining);
+                if (taken == 0u)
+                    continue;
+                iRemaining -= taken;
+                if (taken == iInputBatch.rows)
+                    std::swap(aBatch, iInputBatch);
+                else
+                {
+                    aBatch.reset(iInputBatch);
+                    for (std::size_t column = 0; column < aBatch.columns.size(); ++column)
+                        aBatch.columns[column].append(iInputBatch.columns[column].data(), skipped, taken);
+                    aBatch.rows = taken;
+                }
+                return true;
+            }
+            return false;
+        }
+    private:
+        std::unique_ptr<i_query_operator> iInput;
+        std::size_t iRemaining;
+        std::size_t iSkip;
+        column_batch iInputBatch;
+    };
+
+    // Builds a pipeline over a table a stage at a time, e.g.
+    //     query{ orders }.filter({ { "Quantity", compare_op::Greater, 10 } }).aggregate({ "Company" }, { { aggregate_function::Sum, "Quantity", "Total" } }).rows()
+    class query
+    {
+    public:
+        query(i_table const& aTable, std::vector<std::string> const& aColumns = {}) :
+            iPipeline{ std::make_unique<table_scan>(aTable, aColumns) }
+        {
+        }
+    public:
+        query& filter(std::vector<query_condition> aConditions)
+        {
+            iPipeline = std::make_unique<neodb::filter>(std::move(iPipeline), std::move(aConditions));
+            return *this;
+        }
+        query& project(std::vector<std::string> const& aColumns)
+        {
+            iPipeline = std::make_unique<neodb::project>(std::move(iPipeline), aColumns);
+            return *this;
+        }
+        query& aggregate(std::vector<std::string> const& aGroupBy, std::vector<query_aggregate> const& aAggregates)
+        {
+            iPipeline = std::make_unique<hash_aggregate>(std::move(iPipeline), aGroupBy, aAggregates);
+            return *this;
+        }
+        query& order_by(std::vector<sort_key> const& aKeys)
+        {
+            iPipeline = std::make_unique<neodb::order_by>(std::move(iPipeline), aKeys);
+            return *this;
+        }
+        query& limit(std::size_t aCount, std::size_t aOffset = 0u)
+        {
+            iPipeline = std::make_unique<neodb::limit>(std::move(iPipeline), aCount, aOffset);
+            return *this;
+        }
+    public:
+        i_query_operator& pipeline()
+        {
+            return *iPipeline;
+        }
+        // run the pipeline to completion, decoding its rows
+        std::vector<std::vector<data_value_type>> rows()
+        {
+            std::vector<std::vector<data_value_type>> result;
+            column_batch batch;
+            while (iPipeline->next(batch))
+                for (std::size_t row = 0; row < batch.rows; ++row)
+                {
+                    auto& values = result.emplace_back();
+                    for (std::size_t column = 0; column < batch.columns.size(); ++column)
+                        values.push_back(batch.value(row, column));
+                }
+            return result;
+        }
+    private:
+        std::unique_ptr<i_query_operator> iPipeline;
+    };
+}
\ No newline at end of file
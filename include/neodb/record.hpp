@@ -1,74 +1,224 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neodb/i_database.hpp>
-#include <neodb/i_record.hpp>
-
-namespace neodb
-{
-    class record : public neolib::reference_counted<i_record>
-    {
-    public:
-        record(i_database& aDatabase, record_type aRecordType, link::size_type aRecordSize) :
-            iDatabase{ aDatabase }, iType{ aRecordType }, iSize{ aRecordSize }
-        {
-        }
-    public:
-        i_database& database() const
-        {
-            return iDatabase;
-        }
-        record_type type() const
-        {
-            return iType;
-        }
-        link::size_type size() const
-        {
-            return iSize;
-        }
-    public:
-        void write(void const* aData, std::size_t aDataLength) override
-        {
-        }
-        void read(void* aData, std::size_t aDataLength) override
-        {
-        }
-    private:
-        i_database& iDatabase;
-        record_type iType;
-        link::size_type iSize;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <neodb/i_database.hpp>
+#include <neodb/i_record.hpp>
+#include <neodb/object_pool.hpp>
+
+namespace neodb
+{
+    struct record_overflow : std::runtime_error { record_overflow() : std::runtime_error{ "neodb::record_overflow" } {} };
+
+    class record;
+
+    inline record_header& record_header_at(page& aPage, page::pointer_type aRecordAddress)
+    {
+        return *reinterpret_cast<record_header*>(&aPage.data[aRecordAddress % page::size - sizeof(page_header)]);
+    }
+
+    inline std::uint8_t* record_payload(page& aPage, page::pointer_type aRecordAddress)
+    {
+        return &aPage.data[aRecordAddress % page::size - sizeof(page_header) + sizeof(record_header)];
+    }
+
+    // A published version's end and older version links change under readers walking its chain so
+    // they are read and written atomically.
+    static_assert(sizeof(record_header::version_type) == sizeof(std::uint64_t) && alignof(record_header::version_type) >= std::atomic_ref<std::uint64_t>::required_alignment,
+        "neodb::record_header version fields must be atomically accessible");
+
+    inline std::uint64_t load_version_field(record_header::version_type const& aField)
+    {
+        auto& field = const_cast<std::uint64_t&>(reinterpret_cast<std::uint64_t const&>(aField));
+        return little_to_native(std::atomic_ref<std::uint64_t>{ field }.load(std::memory_order_acquire));
+    }
+
+    inline void store_version_field(record_header::version_type& aField, std::uint64_t aValue)
+    {
+        auto& field = reinterpret_cast<std::uint64_t&>(aField);
+        std::atomic_ref<std::uint64_t>{ field }.store(native_to_little(aValue), std::memory_order_release);
+    }
+
+    // Records currently alive for a database, threaded through the records themselves so tracking
+    // a record costs no allocation.
+    class active_record_list
+    {
+        friend class record;
+    public:
+        active_record_list() :
+            iHead{ nullptr }, iSize{ 0 }
+        {
+        }
+        active_record_list(active_record_list const&) = delete;
+        active_record_list& operator=(active_record_list const&) = delete;
+    public:
+        std::size_t size() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iSize;
+        }
+    private:
+        inline void insert(record& aRecord);
+        inline void erase(record& aRecord);
+    private:
+        mutable std::mutex iMutex;
+        record* iHead;
+        std::size_t iSize;
+    };
+
+    class record : public neolib::reference_counted<i_record>
+    {
+        friend class active_record_list;
+    public:
+        typedef object_pool<record> pool;
+    public:
+        record(i_database& aDatabase, active_record_list& aActiveRecords, record_type aRecordType, link::size_type aRecordSize, page::pointer_type aAddress) :
+            iDatabase{ aDatabase }, iActiveRecords{ aActiveRecords }, iType{ aRecordType }, iSize{ aRecordSize }, iAddress{ aAddress }, iPosition{ 0u },
+            iPreviousActive{ nullptr }, iNextActive{ nullptr }
+        {
+            iActiveRecords.insert(*this);
+        }
+        ~record()
+        {
+            iActiveRecords.erase(*this);
+        }
+    public:
+        static void* operator new(std::size_t aSize)
+        {
+            if (aSize != sizeof(record))
+                return ::operator new(aSize);
+            return pool::allocate();
+        }
+        static void operator delete(void* aObject, std::size_t aSize)
+        {
+            if (aSize != sizeof(record))
+                ::operator delete(aObject);
+            else
+                pool::deallocate(aObject);
+        }
+    public:
+        i_database& database() const
+        {
+            return iDatabase;
+        }
+        record_type type() const
+        {
+            return iType;
+        }
+        link::size_type size() const
+        {
+            return iSize;
+        }
+        page::pointer_type address() const override
+        {
+            return iAddress;
+        }
+    public:
+        void seek(link::size_type aPosition) override
+        {
+            iPosition = aPosition;
+        }
+        void write(void const* aData, std::size_t aDataLength) override
+        {
+            pinned_page recordPage{ iDatabase, page_address() };
+            auto& header = record_header_of(*recordPage);
+            if (iPosition + aDataLength + sizeof(record_header) > header.capacity)
+                throw record_overflow();
+            std::memcpy(payload(*recordPage) + iPosition, aData, aDataLength);
+            iPosition = iPosition + aDataLength;
+            if (header.recordLink.used < iPosition)
+                header.recordLink.used = iPosition;
+            recordPage.set_dirty();
+        }
+        void read(void* aData, std::size_t aDataLength) override
+        {
+            pinned_page recordPage{ iDatabase, page_address() };
+            auto const& header = record_header_of(*recordPage);
+            if (iPosition + aDataLength > header.recordLink.used)
+                throw record_overflow();
+            std::memcpy(aData, payload(*recordPage) + iPosition, aDataLength);
+            iPosition = iPosition + aDataLength;
+        }
+    private:
+        page::pointer_type page_address() const
+        {
+            return iAddress - iAddress % page::size;
+        }
+        record_header& record_header_of(page& aPage) const
+        {
+            return record_header_at(aPage, iAddress);
+        }
+        std::uint8_t* payload(page& aPage) const
+        {
+            return record_payload(aPage, iAddress);
+        }
+    private:
+        i_database& iDatabase;
+        active_record_list& iActiveRecords;
+        record_type iType;
+        link::size_type iSize;
+        page::pointer_type iAddress;
+        link::size_type iPosition;
+        record* iPreviousActive;
+        record* iNextActive;
+    };
+
+    inline void active_record_list::insert(record& aRecord)
+    {
+        std::scoped_lock lock{ iMutex };
+        aRecord.iNextActive = iHead;
+        if (iHead != nullptr)
+            iHead->iPreviousActive = &aRecord;
+        iHead = &aRecord;
+        ++iSize;
+    }
+
+    inline void active_record_list::erase(record& aRecord)
+    {
+        std::scoped_lock lock{ iMutex };
+        if (aRecord.iPreviousActive != nullptr)
+            aRecord.iPreviousActive->iNextActive = aRecord.iNextActive;
+        else
+            iHead = aRecord.iNextActive;
+        if (aRecord.iNextActive != nullptr)
+            aRecord.iNextActive->iPreviousActive = aRecord.iPreviousActive;
+        aRecord.iPreviousActive = nullptr;
+        aRecord.iNextActive = nullptr;
+        --iSize;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,320 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_record.hpp>
+#include <neodb/i_database.hpp>
+
+namespace neodb
+{
+    struct record_too_large : std::runtime_error { record_too_large() : std::runtime_error{ "neodb::record_too_large" } {} };
+
+    // Segregated-fit allocator for records within pages. Record blocks are powers of two between
+    // MINIMUM_RECORD_CAPACITY and MAXIMUM_RECORD_CAPACITY; free blocks of each size are chained
+    // through their record headers from the root page's freeRecords buckets. Blocks are split and
+    // coalesced buddy-wise within a page (a block's buddy is at its offset XOR its capacity) and a
+    // page whose blocks are all free is handed back to the page allocator. A page's header "used"
+    // field counts the bytes of its blocks that are allocated.
+    class record_allocator
+    {
+    public:
+        typedef page::pointer_type pointer_type;
+        static constexpr std::size_t BUCKET_COUNT = std::tuple_size_v<decltype(root_page::header_type::freeRecords)>;
+        static constexpr std::size_t PAGE_DATA_SIZE = std::tuple_size_v<page::data_type>;
+    public:
+        record_allocator(i_database& aDatabase) :
+            iDatabase{ aDatabase }
+        {
+        }
+    public:
+        static constexpr std::size_t capacity_for(std::size_t aRecordSize)
+        {
+            std::size_t capacity = MINIMUM_RECORD_CAPACITY;
+            while (capacity < aRecordSize + sizeof(record_header))
+                capacity <<= 1;
+            return capacity;
+        }
+        static constexpr std::size_t bucket_index(std::size_t aCapacity)
+        {
+            return free_record_bucket_index(aCapacity) - free_record_bucket_index(MINIMUM_RECORD_CAPACITY);
+        }
+        static pointer_type page_address(std::uint64_t aRecordAddress)
+        {
+            return aRecordAddress - aRecordAddress % page::size;
+        }
+    public:
+        pointer_type allocate(record_type aRecordType, std::size_t aRecordSize)
+        {
+            std::size_t const capacity = capacity_for(aRecordSize);
+            if (capacity > MAXIMUM_RECORD_CAPACITY)
+                throw record_too_large();
+            std::scoped_lock lock{ iMutex };
+            std::size_t bucket = bucket_index(capacity);
+            while (bucket < BUCKET_COUNT && buckets()[bucket].next == 0)
+                ++bucket;
+            if (bucket == BUCKET_COUNT)
+            {
+                carve(iDatabase.allocate_page());
+                bucket = bucket_index(MAXIMUM_RECORD_CAPACITY);
+            }
+            std::uint64_t const address = buckets()[bucket].next;
+            unlink(buckets()[bucket], address);
+            pinned_page recordPage{ iDatabase, page_address(address) };
+            // split down to the requested size, returning the upper halves to their buckets
+            for (std::size_t blockCapacity = MINIMUM_RECORD_CAPACITY << bucket; blockCapacity > capacity;)
+            {
+                blockCapacity >>= 1;
+                header(*recordPage, address + blockCapacity).capacity = blockCapacity;
+                push(buckets()[bucket_index(blockCapacity)], address + blockCapacity, FREE_RECORD);
+            }
+            header(*recordPage, address).capacity = capacity;
+            push(list(aRecordType), address, 0u);
+            recordPage->header.pageLink.used = recordPage->header.pageLink.used + capacity;
+            recordPage.set_dirty();
+            return address;
+        }
+        // Allocate aCount records of one size packed into freshly carved pages, rather than taken from
+        // the free buckets, so that a batch fills whole pages in address order; what is left of the last
+        // page's blocks goes to the buckets. The addresses are written to aAddresses in that order.
+        void allocate_packed(record_type aRecordType, std::size_t aRecordSize, std::size_t aCount, pointer_type* aAddresses)
+        {
+            std::size_t const capacity = capacity_for(aRecordSize);
+            if (capacity > MAXIMUM_RECORD_CAPACITY)
+                throw record_too_large();
+            std::scoped_lock lock{ iMutex };
+            for (std::size_t allocated = 0; allocated < aCount;)
+            {
+                auto const pageAddress = iDatabase.allocate_page();
+                pinned_page newPage{ iDatabase, pageAddress };
+                newPage->header.pageLink = {};
+                for_each_carved_block(pageAddress, [&](std::uint64_t aBlock, std::size_t aCapacity)
+                {
+                    std::size_t offset = 0;
+                    for (; aCapacity >= capacity && offset < aCapacity && allocated < aCount; offset += capacity)
+                    {
+                        header(*newPage, aBlock + offset).capacity = capacity;
+                        push(list(aRecordType), aBlock + offset, 0u);
+                        aAddresses[allocated++] = aBlock + offset;
+                        newPage->header.pageLink.used = newPage->header.pageLink.used + capacity;
+                    }
+                    // the rest of the block is freed as the largest buddy-aligned blocks it divides into
+                    while (offset < aCapacity)
+                    {
+                        std::size_t piece = MINIMUM_RECORD_CAPACITY;
+                        while (offset % (piece << 1) == 0 && offset + (piece << 1) <= aCapacity)
+                            piece <<= 1;
+                        header(*newPage, aBlock + offset).capacity = piece;
+                        push(buckets()[bucket_index(piece)], aBlock + offset, FREE_RECORD);
+                        offset += piece;
+                    }
+                });
+                newPage.set_dirty();
+            }
+        }
+        void free(record_type aRecordType, pointer_type aAddress)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto const pageAddress = page_address(aAddress);
+            pinned_page recordPage{ iDatabase, pageAddress };
+            recordPage.set_dirty();
+            std::uint64_t address = aAddress;
+            std::size_t capacity = header(*recordPage, address).capacity;
+            if (header(*recordPage, address).recordLink.used == FREE_RECORD)
+                throw std::logic_error{ "neodb::record_allocator::free: record already free" };
+            unlink(list(aRecordType), address);
+            recordPage->header.pageLink.used = recordPage->header.pageLink.used - capacity;
+            while (capacity < MAXIMUM_RECORD_CAPACITY)
+            {
+                std::size_t const offset = data_offset(address);
+                std::size_t const buddyOffset = offset ^ capacity;
+                if (buddyOffset + capacity > PAGE_DATA_SIZE)
+                    break;
+                std::uint64_t const buddy = pageAddress + sizeof(page_header) + buddyOffset;
+                if (!is_free_block(*recordPage, buddy, capacity))
+                    break;
+                unlink(buckets()[bucket_index(capacity)], buddy);
+                address = std::min(address, buddy);
+                capacity <<= 1;
+            }
+            header(*recordPage, address).capacity = capacity;
+            push(buckets()[bucket_index(capacity)], address, FREE_RECORD);
+            if (recordPage->header.pageLink.used == 0u)
+            {
+                // every block has coalesced back to the page's initial carving; release the page
+                for_each_carved_block(pageAddress, [&](std::uint64_t aBlock, std::size_t aCapacity)
+                {
+                    unlink(buckets()[bucket_index(aCapacity)], aBlock);
+                });
+                recordPage->header.pageLink = {};
+                iDatabase.free_page(pageAddress);
+            }
+        }
+    private:
+        template <typename Visitor>
+        static void for_each_carved_block(pointer_type aPageAddress, Visitor aVisitor)
+        {
+            std::size_t offset = 0;
+            for (std::size_t capacity = MAXIMUM_RECORD_CAPACITY; capacity >= MINIMUM_RECORD_CAPACITY; capacity >>= 1)
+                if (offset + capacity <= PAGE_DATA_SIZE)
+                {
+                    aVisitor(aPageAddress + sizeof(page_header) + offset, capacity);
+                    offset += capacity;
+                }
+        }
+        void carve(pointer_type aPageAddress)
+        {
+            {
+                pinned_page newPage{ iDatabase, aPageAddress };
+                newPage->header.pageLink = {};
+                newPage.set_dirty();
+                for_each_carved_block(aPageAddress, [&](std::uint64_t aBlock, std::size_t aCapacity)
+                {
+                    header(*newPage, aBlock).capacity = aCapacity;
+                });
+            }
+            for_each_carved_block(aPageAddress, [&](std::uint64_t aBlock, std::size_t aCapacity)
+            {
+                push(buckets()[bucket_index(aCapacity)], aBlock, FREE_RECORD);
+            });
+        }
+        static std::size_t data_offset(std::uint64_t aRecordAddress)
+        {
+            return static_cast<std::size_t>(aRecordAddress % page::size) - sizeof(page_header);
+        }
+        static record_header& header(page& aPage, std::uint64_t aRecordAddress)
+        {
+            return *reinterpret_cast<record_header*>(&aPage.data[data_offset(aRecordAddress)]);
+        }
+        // A buddy position may lie inside an allocated record's payload so the header found there is only
+        // trusted if it is also threaded into its bucket list.
+        bool is_free_block(page& aPage, std::uint64_t aAddress, std::size_t aCapacity)
+        {
+            auto const& candidate = header(aPage, aAddress);
+            if (candidate.recordLink.used != FREE_RECORD || candidate.capacity != aCapacity)
+                return false;
+            std::uint64_t const previous = candidate.recordLink.previous;
+            if (previous == 0)
+                return buckets()[bucket_index(aCapacity)].next == aAddress;
+            if (previous % page::size < sizeof(page_header) || previous % page::size + sizeof(record_header) > page::size)
+                return false;
+            pinned_page previousPage{ iDatabase, page_address(previous) };
+            return header(*previousPage, previous).recordLink.next == aAddress;
+        }
+        std::array<link, BUCKET_COUNT>& buckets()
+        {
+            return iDatabase.root().header.freeRecords;
+        }
+        link& list(record_type aRecordType)
+        {
+            switch (aRecordType)
+            {
+            case record_type::Schema:
+                return iDatabase.root().header.schemaRecords;
+            case record_type::Table:
+                return iDatabase.root().header.tableRecords;
+            case record_type::Index:
+                return iDatabase.root().header.indexRecords;
+            default:
+                throw std::logic_error{ "neodb::record_allocator: bad record type" };
+            }
+        }
+        // Record lists are doubly linked through record headers: the list's "next" is its head, "previous"
+        // its tail and "used" its length. Records on a free bucket list have "used" set to FREE_RECORD.
+        void push(link& aList, std::uint64_t aAddress, std::uint64_t aUsed)
+        {
+            std::uint64_t const head = aList.next;
+            {
+                pinned_page recordPage{ iDatabase, page_address(aAddress) };
+                auto& recordHeader = header(*recordPage, aAddress);
+                recordHeader.recordLink.previous = 0u;
+                recordHeader.recordLink.next = head;
+                recordHeader.recordLink.used = aUsed;
+                // a new record is the only version of its contents and is visible to every snapshot
+                recordHeader.versionBegin = 0u;
+                recordHeader.versionEnd = NO_VERSION_END;
+                recordHeader.olderVersion = 0u;
+                recordPage.set_dirty();
+            }
+            if (head != 0)
+            {
+                pinned_page headPage{ iDatabase, page_address(head) };
+                header(*headPage, head).recordLink.previous = aAddress;
+                headPage.set_dirty();
+            }
+            else
+                aList.previous = aAddress;
+            aList.next = aAddress;
+            aList.used = aList.used + 1u;
+        }
+        void unlink(link& aList, std::uint64_t aAddress)
+        {
+            std::uint64_t previous;
+            std::uint64_t next;
+            {
+                pinned_page recordPage{ iDatabase, page_address(aAddress) };
+                auto& recordHeader = header(*recordPage, aAddress);
+                previous = recordHeader.recordLink.previous;
+                next = recordHeader.recordLink.next;
+                recordHeader.recordLink.previous = 0u;
+                recordHeader.recordLink.next = 0u;
+                recordPage.set_dirty();
+            }
+            if (previous != 0)
+            {
+                pinned_page previousPage{ iDatabase, page_address(previous) };
+                header(*previousPage, previous).recordLink.next = next;
+                previousPage.set_dirty();
+            }
+            else
+                aList.next = next;
+            if (next != 0)
+            {
+                pinned_page nextPage{ iDatabase, page_address(next) };
+                header(*nextPage, next).recordLink.previous = previous;
+                nextPage.set_dirty();
+            }
+            else
+                aList.previous = previous;
+            aList.used = aList.used - 1u;
+        }
+    private:
+        std::mutex iMutex;
+        i_database& iDatabase;
+    };
+}
\ No newline at end of file
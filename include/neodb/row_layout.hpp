@@ -0,0 +1,817 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include <optional>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <string_view>
+#include <chrono>
+#include <stdexcept>
+#include <type_traits>
+#include <neodb/data_type.hpp>
+#include <neodb/i_schema.hpp>
+
+namespace neodb
+{
+    struct unsupported_field_type : std::logic_error { unsupported_field_type() : std::logic_error{ "neodb::unsupported_field_type" } {} };
+    struct field_type_mismatch : std::logic_error { field_type_mismatch() : std::logic_error{ "neodb::field_type_mismatch" } {} };
+    struct field_count_mismatch : std::logic_error { field_count_mismatch() : std::logic_error{ "neodb::field_count_mismatch" } {} };
+    struct field_value_too_long : std::runtime_error { field_value_too_long() : std::runtime_error{ "neodb::field_value_too_long" } {} };
+
+    inline constexpr bool is_nullable(data_type aType)
+    {
+        return aType >= data_type::NullableBool;
+    }
+
+    inline constexpr data_type non_nullable(data_type aType)
+    {
+        switch (aType)
+        {
+        case data_type::NullableBool: return data_type::Bool;
+        case data_type::NullableInt8: return data_type::Int8;
+        case data_type::NullableInt16: return data_type::Int16;
+        case data_type::NullableInt32: return data_type::Int32;
+        case data_type::NullableInt64: return data_type::Int64;
+        case data_type::NullableUint8: return data_type::Uint8;
+        case data_type::NullableUint16: return data_type::Uint16;
+        case data_type::NullableUint32: return data_type::Uint32;
+        case data_type::NullableUint64: return data_type::Uint64;
+        case data_type::NullableFloat: return data_type::Float;
+        case data_type::NullableDouble: return data_type::Double;
+        case data_type::NullableChar: return data_type::Char;
+        case data_type::NullableString: return data_type::String;
+        case data_type::NullableCharString: return data_type::CharString;
+        case data_type::NullableVarcharString: return data_type::VarcharString;
+        case data_type::NullableUuid: return data_type::Uuid;
+        case data_type::NullableTime: return data_type::Time;
+        case data_type::NullableBlob: return data_type::Blob;
+        default: return aType;
+        }
+    }
+
+    inline constexpr data_type nullable(data_type aType)
+    {
+        switch (aType)
+        {
+        case data_type::Bool: return data_type::NullableBool;
+        case data_type::Int8: return data_type::NullableInt8;
+        case data_type::Int16: return data_type::NullableInt16;
+        case data_type::Int32: return data_type::NullableInt32;
+        case data_type::Int64: return data_type::NullableInt64;
+        case data_type::Uint8: return data_type::NullableUint8;
+        case data_type::Uint16: return data_type::NullableUint16;
+        case data_type::Uint32: return data_type::NullableUint32;
+        case data_type::Uint64: return data_type::NullableUint64;
+        case data_type::Float: return data_type::NullableFloat;
+        case data_type::Double: return data_type::NullableDouble;
+        case data_type::Char: return data_type::NullableChar;
+        case data_type::String: return data_type::NullableString;
+        case data_type::CharString: return data_type::NullableCharString;
+        case data_type::VarcharString: return data_type::NullableVarcharString;
+        case data_type::Uuid: return data_type::NullableUuid;
+        case data_type::Time: return data_type::NullableTime;
+        case data_type::Blob: return data_type::NullableBlob;
+        default: return aType;
+        }
+    }
+
+    inline constexpr bool is_fixed_width(data_type aType)
+    {
+        switch (non_nullable(aType))
+        {
+        case data_type::String:
+        case data_type::Blob:
+            return false;
+        default:
+            return true;
+        }
+    }
+
+    // Bytes a field occupies within a row. CharString fields are zero padded to their layout length,
+    // VarcharString fields are prefixed with a 16-bit length and String and Blob fields reserve room
+    // for a reference (record address and length) to out-of-line storage.
+    inline constexpr std::size_t field_size(data_type aType, std::size_t aLayout)
+    {
+        switch (non_nullable(aType))
+        {
+        case data_type::Bool:
+        case data_type::Int8:
+        case data_type::Uint8:
+        case data_type::Char:
+            return 1;
+        case data_type::Int16:
+        case data_type::Uint16:
+            return 2;
+        case data_type::Int32:
+        case data_type::Uint32:
+        case data_type::Float:
+            return 4;
+        case data_type::Int64:
+        case data_type::Uint64:
+        case data_type::Double:
+        case data_type::Time:
+            return 8;
+        case data_type::Uuid:
+            return 16;
+        case data_type::CharString:
+            return aLayout;
+        case data_type::VarcharString:
+            return 2 + aLayout;
+        case data_type::String:
+        case data_type::Blob:
+            return 16;
+        default:
+            throw unsupported_field_type();
+        }
+    }
+
+    inline constexpr std::size_t field_alignment(data_type aType)
+    {
+        switch (non_nullable(aType))
+        {
+        case data_type::Int16:
+        case data_type::Uint16:
+        case data_type::VarcharString:
+            return 2;
+        case data_type::Int32:
+        case data_type::Uint32:
+        case data_type::Float:
+            return 4;
+        case data_type::Int64:
+        case data_type::Uint64:
+        case data_type::Double:
+        case data_type::Time:
+        case data_type::String:
+        case data_type::Blob:
+            return 8;
+        default:
+            return 1;
+        }
+    }
+
+    // Storage for the values of String and Blob fields, which rows hold out of line: the field holds
+    // a reference to the record storing its value (see value_reference). A store is a view of its
+    // database's records so it is used through const references, as the database is.
+    class i_value_store
+    {
+    public:
+        virtual ~i_value_store() = default;
+    public:
+        // store a value in a record of its own, returning the record's address
+        virtual std::uint64_t store_value(void const* aData, std::size_t aLength) const = 0;
+        virtual void load_value(std::uint64_t aAddress, void* aData, std::size_t aLength) const = 0;
+        virtual void free_value(std::uint64_t aAddress) const = 0;
+    };
+
+    std::size_t constexpr NOT_NULLABLE = ~std::size_t{};
+
+    struct field_shape
+    {
+        neodb::data_type dataType;
+        std::size_t layout;
+    };
+
+    struct field_layout
+    {
+        neodb::data_type dataType;
+        std::size_t offset;
+        std::size_t size;
+        std::size_t nullBit; // bit within the row's null bitmap, NOT_NULLABLE if the field cannot be null
+    };
+
+    // Rows start with a null bitmap (one bit per nullable field, set when the field is null) followed
+    // by the fields in declaration order, each aligned to its natural alignment (relative to the start
+    // of the row); the row size is padded to a multiple of its most strictly aligned field. Returns
+    // the row size.
+    inline constexpr std::size_t lay_out_row(field_shape const* aFields, std::size_t aFieldCount, field_layout* aLayouts)
+    {
+        std::size_t nullableCount = 0;
+        for (std::size_t index = 0; index < aFieldCount; ++index)
+            if (is_nullable(aFields[index].dataType))
+                ++nullableCount;
+        std::size_t offset = (nullableCount + 7) / 8;
+        std::size_t rowAlignment = 1;
+        std::size_t nullBit = 0;
+        for (std::size_t index = 0; index < aFieldCount; ++index)
+        {
+            auto const alignment = field_alignment(aFields[index].dataType);
+            offset = (offset + alignment - 1) / alignment * alignment;
+            aLayouts[index] = field_layout{
+                aFields[index].dataType,
+                offset,
+                field_size(aFields[index].dataType, aFields[index].layout),
+                is_nullable(aFields[index].dataType) ? nullBit++ : NOT_NULLABLE };
+            offset += aLayouts[index].size;
+            rowAlignment = std::max(rowAlignment, alignment);
+        }
+        return (offset + rowAlignment - 1) / rowAlignment * rowAlignment;
+    }
+
+    namespace detail
+    {
+        template <typename T> struct little_endian { typedef T type; };
+        template <> struct little_endian<bool> { typedef std::uint8_t type; };
+        template <> struct little_endian<int16_t> { typedef little_int16_t type; };
+        template <> struct little_endian<int32_t> { typedef little_int32_t type; };
+        template <> struct little_endian<int64_t> { typedef little_int64_t type; };
+        template <> struct little_endian<uint16_t> { typedef little_uint16_t type; };
+        template <> struct little_endian<uint32_t> { typedef little_uint32_t type; };
+        template <> struct little_endian<uint64_t> { typedef little_uint64_t type; };
+        template <> struct little_endian<float> { typedef little_float32_t type; };
+        template <> struct little_endian<double> { typedef little_float64_t type; };
+
+        template <typename T> struct is_optional : std::false_type {};
+        template <typename T> struct is_optional<optional<T>> : std::true_type { typedef T value_type; };
+    }
+
+    template <typename T>
+    inline void store_little(void* aDestination, T aValue)
+    {
+        typename detail::little_endian<T>::type const value{ aValue };
+        std::memcpy(aDestination, &value, sizeof(value));
+    }
+
+    template <typename T>
+    inline T load_little(void const* aSource)
+    {
+        typename detail::little_endian<T>::type value;
+        std::memcpy(&value, aSource, sizeof(value));
+        return static_cast<T>(value);
+    }
+
+    // Calls aVisitor with std::type_identity of the C++ type holding values of the given data type.
+    template <typename Visitor>
+    inline decltype(auto) visit_data_type(data_type aType, Visitor&& aVisitor)
+    {
+        switch (non_nullable(aType))
+        {
+        case data_type::Bool: return aVisitor(std::type_identity<bool>{});
+        case data_type::Int8: return aVisitor(std::type_identity<int8_t>{});
+        case data_type::Int16: return aVisitor(std::type_identity<int16_t>{});
+        case data_type::Int32: return aVisitor(std::type_identity<int32_t>{});
+        case data_type::Int64: return aVisitor(std::type_identity<int64_t>{});
+        case data_type::Uint8: return aVisitor(std::type_identity<uint8_t>{});
+        case data_type::Uint16: return aVisitor(std::type_identity<uint16_t>{});
+        case data_type::Uint32: return aVisitor(std::type_identity<uint32_t>{});
+        case data_type::Uint64: return aVisitor(std::type_identity<uint64_t>{});
+        case data_type::Float: return aVisitor(std::type_identity<float>{});
+        case data_type::Double: return aVisitor(std::type_identity<double>{});
+        case data_type::Char: return aVisitor(std::type_identity<char>{});
+        case data_type::String: return aVisitor(std::type_identity<string>{});
+        case data_type::CharString: return aVisitor(std::type_identity<c_string>{});
+        case data_type::VarcharString: return aVisitor(std::type_identity<vc_string>{});
+        case data_type::Uuid: return aVisitor(std::type_identity<uuid>{});
+        case data_type::Time: return aVisitor(std::type_identity<time>{});
+        case data_type::Blob: return aVisitor(std::type_identity<blob>{});
+        default: throw unsupported_field_type();
+        }
+    }
+
+    inline bool is_null(field_layout const& aField, void const* aRow)
+    {
+        if (aField.nullBit == NOT_NULLABLE)
+            return false;
+        return (static_cast<std::uint8_t const*>(aRow)[aField.nullBit / 8] & (1u << (aField.nullBit % 8))) != 0u;
+    }
+
+    // Time is stored as int64 nanoseconds since the epoch: exact for system_clock on every
+    // supported standard library and representable from 1678 to 2262.
+    inline std::int64_t to_stored_time(time aValue)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(aValue.time_since_epoch()).count();
+    }
+
+    inline time from_stored_time(std::int64_t aValue)
+    {
+        return time{ std::chrono::duration_cast<time::duration>(std::chrono::nanoseconds{ aValue }) };
+    }
+
+    inline void set_null(field_layout const& aField, void* aRow, bool aNull)
+    {
+        auto& bits = static_cast<std::uint8_t*>(aRow)[aField.nullBit / 8];
+        if (aNull)
+            bits |= static_cast<std::uint8_t>(1u << (aField.nullBit % 8));
+        else
+            bits &= static_cast<std::uint8_t>(~(1u << (aField.nullBit % 8)));
+    }
+
+    // A String or Blob field's reference to its value: the address of the record storing it (zero for
+    // an empty value) followed by the value's length.
+    struct value_reference
+    {
+        std::uint64_t address;
+        std::uint64_t length;
+    };
+
+    inline value_reference load_value_reference(std::uint8_t const* aSource)
+    {
+        return value_reference{ load_little<std::uint64_t>(aSource), load_little<std::uint64_t>(aSource + 8) };
+    }
+
+    inline void store_value_reference(std::uint8_t* aDestination, value_reference const& aReference)
+    {
+        store_little<std::uint64_t>(aDestination, aReference.address);
+        store_little<std::uint64_t>(aDestination + 8, aReference.length);
+    }
+
+    inline void store_out_of_line(void const* aData, std::size_t aLength, std::uint8_t* aDestination, i_value_store const* aValues)
+    {
+        if (aValues == nullptr)
+            throw unsupported_field_type();
+        store_value_reference(aDestination, value_reference{ aLength != 0u ? aValues->store_value(aData, aLength) : 0u, aLength });
+    }
+
+    // Values of String and Blob fields are written to and read from aValues, without which they
+    // cannot be encoded or decoded.
+    template <typename T>
+    inline void encode_field_value(field_layout const& aField, T const& aValue, std::uint8_t* aDestination, i_value_store const* aValues = nullptr)
+    {
+        if constexpr (std::is_arithmetic_v<T>)
+            store_little(aDestination, aValue);
+        else if constexpr (std::is_same_v<T, uuid>)
+        {
+            static_assert(sizeof(uuid) == 16);
+            std::memcpy(aDestination, &aValue, sizeof(uuid));
+        }
+        else if constexpr (std::is_same_v<T, time>)
+            store_little<int64_t>(aDestination, to_stored_time(aValue));
+        else if constexpr (std::is_same_v<T, blob>)
+            store_out_of_line(aValue.data(), aValue.size(), aDestination, aValues);
+        else if constexpr (std::is_base_of_v<i_string, T>)
+        {
+            if (non_nullable(aField.dataType) == data_type::String)
+            {
+                store_out_of_line(aValue.data(), aValue.size(), aDestination, aValues);
+                return;
+            }
+            if (non_nullable(aField.dataType) != data_type::CharString && non_nullable(aField.dataType) != data_type::VarcharString)
+                throw unsupported_field_type();
+            bool const varchar = non_nullable(aField.dataType) == data_type::VarcharString;
+            std::size_t const capacity = varchar ? aField.size - 2 : aField.size;
+            if (aValue.size() > capacity)
+                throw field_value_too_long();
+            if (varchar)
+            {
+                store_little<uint16_t>(aDestination, static_cast<uint16_t>(aValue.size()));
+                aDestination += 2;
+            }
+            std::memcpy(aDestination, aValue.data(), aValue.size());
+            std::memset(aDestination + aValue.size(), 0, capacity - aValue.size());
+        }
+        else
+            throw unsupported_field_type();
+    }
+
+    template <typename T>
+    inline T decode_field_value(field_layout const& aField, std::uint8_t const* aSource, i_value_store const* aValues = nullptr)
+    {
+        if constexpr (std::is_arithmetic_v<T>)
+            return load_little<T>(aSource);
+        else if constexpr (std::is_same_v<T, uuid>)
+        {
+            uuid result;
+            std::memcpy(&result, aSource, sizeof(uuid));
+            return result;
+        }
+        else if constexpr (std::is_same_v<T, time>)
+            return from_stored_time(load_little<int64_t>(aSource));
+        else if constexpr (std::is_same_v<T, c_string>)
+            return T{ std::string{ reinterpret_cast<char const*>(aSource), ::strnlen(reinterpret_cast<char const*>(aSource), aField.size) } };
+        else if constexpr (std::is_same_v<T, vc_string>)
+            return T{ std::string{ reinterpret_cast<char const*>(aSource + 2), std::min<std::size_t>(load_little<uint16_t>(aSource), aField.size - 2) } };
+        else if constexpr (std::is_same_v<T, string> || std::is_same_v<T, blob>)
+        {
+            if (aValues == nullptr)
+                throw unsupported_field_type();
+            auto const reference = load_value_reference(aSource);
+            std::vector<std::uint8_t> value(static_cast<std::size_t>(reference.length));
+            if (!value.empty())
+                aValues->load_value(reference.address, value.data(), value.size());
+            if constexpr (std::is_same_v<T, string>)
+                return T{ std::string{ value.begin(), value.end() } };
+            else
+                return T{ value.begin(), value.end() };
+        }
+        else
+            throw unsupported_field_type();
+    }
+
+    // Encode a value into its field of a row. A plain String value is accepted for CharString and
+    // VarcharString fields; an empty optional marks a nullable field null.
+    inline void encode_field(field_layout const& aField, data_value_type const& aValue, void* aRow, i_value_store const* aValues = nullptr)
+    {
+        auto const destination = static_cast<std::uint8_t*>(aRow) + aField.offset;
+        std::visit([&](auto const& aAlternative)
+        {
+            typedef std::decay_t<decltype(aAlternative)> alternative_type;
+            auto encode = [&](auto const& aFieldValue)
+            {
+                typedef std::decay_t<decltype(aFieldValue)> value_type;
+                bool const compatible = as_data_type_v<value_type> == non_nullable(aField.dataType) ||
+                    (std::is_same_v<value_type, string> &&
+                        (non_nullable(aField.dataType) == data_type::CharString || non_nullable(aField.dataType) == data_type::VarcharString));
+                if (!compatible)
+                    throw field_type_mismatch();
+                encode_field_value(aField, aFieldValue, destination, aValues);
+            };
+            if constexpr (detail::is_optional<alternative_type>::value)
+            {
+                if (aField.nullBit == NOT_NULLABLE)
+                    throw field_type_mismatch();
+                set_null(aField, aRow, !aAlternative);
+                if (aAlternative)
+                    encode(*aAlternative);
+                else
+                    std::memset(destination, 0, aField.size);
+            }
+            else
+            {
+                if (aField.nullBit != NOT_NULLABLE)
+                    set_null(aField, aRow, false);
+                encode(aAlternative);
+            }
+        }, aValue);
+    }
+
+    inline data_value_type decode_field(field_layout const& aField, void const* aRow, i_value_store const* aValues = nullptr)
+    {
+        auto const source = static_cast<std::uint8_t const*>(aRow) + aField.offset;
+        return visit_data_type(aField.dataType, [&](auto aType) -> data_value_type
+        {
+            typedef typename decltype(aType)::type value_type;
+            if (aField.nullBit == NOT_NULLABLE)
+                return data_value_type{ std::in_place_type<value_type>, decode_field_value<value_type>(aField, source, aValues) };
+            if (is_null(aField, aRow))
+                return data_value_type{ std::in_place_type<optional<value_type>> };
+            return data_value_type{ std::in_place_type<optional<value_type>>, decode_field_value<value_type>(aField, source, aValues) };
+        });
+    }
+
+    // The physical layout of a table's rows, derived from its schema.
+    class row_layout
+    {
+    public:
+        row_layout(i_schema const& aSchema) :
+            iSize{ 0 }, iNullBitmapSize{ 0 }, iFixedWidth{ true }
+        {
+            std::vector<field_shape> shapes;
+            for (auto const& field : aSchema.fields())
+            {
+                shapes.push_back(field_shape{ field->data_type(), field->layout() });
+                if (field->field_type() == field_type::PrimaryKey && !iPrimaryKey)
+                    iPrimaryKey = shapes.size() - 1;
+                if (!is_fixed_width(field->data_type()))
+                    iFixedWidth = false;
+                if (is_nullable(field->data_type()))
+                    ++iNullBitmapSize;
+            }
+            iNullBitmapSize = (iNullBitmapSize + 7) / 8;
+            iFields.resize(shapes.size());
+            iSize = lay_out_row(shapes.data(), shapes.size(), iFields.data());
+        }
+    public:
+        std::size_t size() const
+        {
+            return iSize;
+        }
+        std::size_t null_bitmap_size() const
+        {
+            return iNullBitmapSize;
+        }
+        // false if any field holds its value out of line (String, Blob)
+        bool fixed_width() const
+        {
+            return iFixedWidth;
+        }
+        std::size_t field_count() const
+        {
+            return iFields.size();
+        }
+        field_layout const& field(std::size_t aIndex) const
+        {
+            return iFields.at(aIndex);
+        }
+        std::optional<std::size_t> const& primary_key() const
+        {
+            return iPrimaryKey;
+        }
+    public:
+        bool is_null(std::size_t aField, void const* aRow) const
+        {
+            return neodb::is_null(field(aField), aRow);
+        }
+        void encode(std::size_t aField, data_value_type const& aValue, void* aRow, i_value_store const* aValues = nullptr) const
+        {
+            encode_field(field(aField), aValue, aRow, aValues);
+        }
+        data_value_type decode(std::size_t aField, void const* aRow, i_value_store const* aValues = nullptr) const
+        {
+            return decode_field(field(aField), aRow, aValues);
+        }
+        // Give a copy of an encoded row copies of the String and Blob values it refers to, stored in
+        // aValues; if that fails the row is left referring to none.
+        void copy_values(void* aRow, i_value_store const& aValues) const
+        {
+            if (iFixedWidth)
+                return;
+            auto const row = static_cast<std::uint8_t*>(aRow);
+            std::vector<std::pair<std::size_t, value_reference>> copies;
+            try
+            {
+                for (auto const& field : iFields)
+                {
+                    if (is_fixed_width(field.dataType))
+                        continue;
+                    auto const reference = load_value_reference(row + field.offset);
+                    if (reference.address == 0u)
+                        continue;
+                    std::vector<std::uint8_t> value(static_cast<std::size_t>(reference.length));
+                    aValues.load_value(reference.address, value.data(), value.size());
+                    copies.emplace_back(field.offset, value_reference{ aValues.store_value(value.data(), value.size()), reference.length });
+                }
+            }
+            catch (...)
+            {
+                for (auto const& copy : copies)
+                    aValues.free_value(copy.second.address);
+                for (auto const& field : iFields)
+                    if (!is_fixed_width(field.dataType))
+                        store_value_reference(row + field.offset, value_reference{ 0u, 0u });
+                throw;
+            }
+            for (auto const& copy : copies)
+                store_value_reference(row + copy.first, copy.second);
+        }
+        // free the out-of-line values of a row (null and empty ones refer to no record)
+        void free_values(void const* aRow, i_value_store const& aValues) const
+        {
+            if (iFixedWidth)
+                return;
+            for (auto const& field : iFields)
+            {
+                if (is_fixed_width(field.dataType))
+                    continue;
+                auto const reference = load_value_reference(static_cast<std::uint8_t const*>(aRow) + field.offset);
+                if (reference.address != 0u)
+                    aValues.free_value(reference.address);
+            }
+        }
+    private:
+        std::size_t iSize;
+        std::size_t iNullBitmapSize;
+        bool iFixedWidth;
+        std::vector<field_layout> iFields;
+        std::optional<std::size_t> iPrimaryKey;
+    };
+
+    template <typename T> struct field_value { typedef T type; };
+    template <typename T> struct field_value<primary_key<T>> { typedef T type; };
+    template <typename T> struct field_value<foreign_key<T>> { typedef T type; };
+    template <typename T>
+    using field_value_t = typename field_value<T>::type;
+
+    // Encoding of a fixed-width field of a compile-time schema; decoding yields a view of the field,
+    // string_view for character strings, without copying.
+    template <typename T, typename = void>
+    struct field_codec;
+
+    template <typename T>
+    struct field_codec<T, std::enable_if_t<std::is_arithmetic_v<T>>>
+    {
+        typedef T param_type;
+        typedef T view_type;
+        static void encode(std::uint8_t* aDestination, T aValue)
+        {
+            store_little(aDestination, aValue);
+        }
+        static T decode(std::uint8_t const* aSource)
+        {
+            return load_little<T>(aSource);
+        }
+    };
+
+    template <std::size_t N>
+    struct field_codec<char_string<N>>
+    {
+        typedef std::string_view param_type;
+        typedef std::string_view view_type;
+        static void encode(std::uint8_t* aDestination, std::string_view aValue)
+        {
+            if (aValue.size() > N)
+                throw field_value_too_long();
+            std::memcpy(aDestination, aValue.data(), aValue.size());
+            std::memset(aDestination + aValue.size(), 0, N - aValue.size());
+        }
+        static std::string_view decode(std::uint8_t const* aSource)
+        {
+            auto const chars = reinterpret_cast<char const*>(aSource);
+            return std::string_view{ chars, ::strnlen(chars, N) };
+        }
+    };
+
+    template <std::size_t N>
+    struct field_codec<varchar_string<N>>
+    {
+        typedef std::string_view param_type;
+        typedef std::string_view view_type;
+        static void encode(std::uint8_t* aDestination, std::string_view aValue)
+        {
+            if (aValue.size() > N)
+                throw field_value_too_long();
+            store_little<uint16_t>(aDestination, static_cast<uint16_t>(aValue.size()));
+            std::memcpy(aDestination + 2, aValue.data(), aValue.size());
+            std::memset(aDestination + 2 + aValue.size(), 0, N - aValue.size());
+        }
+        static std::string_view decode(std::uint8_t const* aSource)
+        {
+            return std::string_view{ reinterpret_cast<char const*>(aSource + 2), std::min<std::size_t>(load_little<uint16_t>(aSource), N) };
+        }
+    };
+
+    template <>
+    struct field_codec<uuid>
+    {
+        typedef uuid const& param_type;
+        typedef uuid view_type;
+        static void encode(std::uint8_t* aDestination, uuid const& aValue)
+        {
+            std::memcpy(aDestination, &aValue, sizeof(uuid));
+        }
+        static uuid decode(std::uint8_t const* aSource)
+        {
+            uuid result;
+            std::memcpy(&result, aSource, sizeof(uuid));
+            return result;
+        }
+    };
+
+    template <>
+    struct field_codec<time>
+    {
+        typedef time param_type;
+        typedef time view_type;
+        static void encode(std::uint8_t* aDestination, time aValue)
+        {
+            store_little<int64_t>(aDestination, to_stored_time(aValue));
+        }
+        static time decode(std::uint8_t const* aSource)
+        {
+            return from_stored_time(load_little<int64_t>(aSource));
+        }
+    };
+
+    // nullable fields; the null bit itself is maintained by typed_row_layout
+    template <typename T>
+    struct field_codec<optional<T>>
+    {
+        typedef std::optional<typename field_codec<T>::view_type> param_type;
+        typedef std::optional<typename field_codec<T>::view_type> view_type;
+        static void encode(std::uint8_t* aDestination, typename field_codec<T>::param_type aValue)
+        {
+            field_codec<T>::encode(aDestination, aValue);
+        }
+        static typename field_codec<T>::view_type decode(std::uint8_t const* aSource)
+        {
+            return field_codec<T>::decode(aSource);
+        }
+    };
+
+    // out-of-line fields have no in-row value to view
+    template <typename T>
+    struct field_codec<T, std::enable_if_t<std::is_same_v<T, string> || std::is_same_v<T, blob>>>
+    {
+        typedef T const& param_type;
+        typedef void const* view_type;
+    };
+
+    template <std::size_t FieldCount>
+    struct computed_row_layout
+    {
+        std::array<field_layout, FieldCount> fields = {};
+        std::size_t size = 0;
+    };
+
+    template <std::size_t FieldCount>
+    inline constexpr computed_row_layout<FieldCount> compute_row_layout(std::array<field_shape, FieldCount> const& aShapes)
+    {
+        computed_row_layout<FieldCount> result;
+        result.size = lay_out_row(aShapes.data(), FieldCount, result.fields.data());
+        return result;
+    }
+
+    // The row layout of a compile-time schema: the same layout row_layout computes at run time for
+    // it, but evaluated by the compiler so that field access is a fixed offset and no variant is
+    // involved in encoding or decoding a row.
+    template <typename... Fields>
+    class typed_row_layout
+    {
+    public:
+        typedef std::tuple<field_value_t<Fields>...> field_types;
+        template <std::size_t Index>
+        using field_type = std::tuple_element_t<Index, field_types>;
+        template <std::size_t Index>
+        using param_type = typename field_codec<field_type<Index>>::param_type;
+        template <std::size_t Index>
+        using view_type = typename field_codec<field_type<Index>>::view_type;
+        static constexpr std::size_t field_count = sizeof...(Fields);
+        static constexpr std::array<field_shape, field_count> shapes = { field_shape{ as_data_type_v<field_value_t<Fields>>, layout_v<field_value_t<Fields>> }... };
+    private:
+        static constexpr computed_row_layout<field_count> computed = compute_row_layout(shapes);
+    public:
+        static constexpr std::array<field_layout, field_count> fields = computed.fields;
+        static constexpr std::size_t size = computed.size;
+        static constexpr std::size_t null_bitmap_size = ((is_nullable(as_data_type_v<field_value_t<Fields>>) ? 1 : 0) + ... + 7) / 8;
+        static constexpr bool fixed_width = (is_fixed_width(as_data_type_v<field_value_t<Fields>>) && ...);
+    public:
+        template <std::size_t Index>
+        static view_type<Index> get(void const* aRow)
+        {
+            constexpr field_layout field = fields[Index];
+            static_assert(is_fixed_width(field.dataType), "neodb::typed_row_layout: field is stored out of line");
+            auto const source = static_cast<std::uint8_t const*>(aRow) + field.offset;
+            if constexpr (field.nullBit != NOT_NULLABLE)
+            {
+                if (is_null(field, aRow))
+                    return {};
+            }
+            return field_codec<field_type<Index>>::decode(source);
+        }
+        template <std::size_t Index>
+        static void set(void* aRow, param_type<Index> aValue)
+        {
+            constexpr field_layout field = fields[Index];
+            static_assert(is_fixed_width(field.dataType), "neodb::typed_row_layout: field is stored out of line");
+            auto const destination = static_cast<std::uint8_t*>(aRow) + field.offset;
+            if constexpr (field.nullBit != NOT_NULLABLE)
+            {
+                set_null(field, aRow, !aValue);
+                if (aValue)
+                    field_codec<field_type<Index>>::encode(destination, *aValue);
+                else
+                    std::memset(destination, 0, field.size);
+            }
+            else
+                field_codec<field_type<Index>>::encode(destination, aValue);
+        }
+        // encode a whole row into size bytes at aRow
+        static void encode(void* aRow, typename field_codec<field_value_t<Fields>>::param_type... aValues)
+        {
+            static_assert(fixed_width, "neodb::typed_row_layout: out-of-line fields cannot be encoded in place");
+            std::memset(aRow, 0, size);
+            encode(std::index_sequence_for<Fields...>{}, aRow, aValues...);
+        }
+        static std::tuple<typename field_codec<field_value_t<Fields>>::view_type...> decode(void const* aRow)
+        {
+            return decode(std::index_sequence_for<Fields...>{}, aRow);
+        }
+    private:
+        template <std::size_t... Indices, typename... Values>
+        static void encode(std::index_sequence<Indices...>, void* aRow, Values const&... aValues)
+        {
+            (set<Indices>(aRow, aValues), ...);
+        }
+        template <std::size_t... Indices>
+        static std::tuple<typename field_codec<field_value_t<Fields>>::view_type...> decode(std::index_sequence<Indices...>, void const* aRow)
+        {
+            return { get<Indices>(aRow)... };
+        }
+    };
+}
\ No newline at end of file
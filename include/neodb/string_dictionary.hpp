@@ -0,0 +1,273 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <shared_mutex>
+#include <mutex>
+#include <stdexcept>
+#include <neodb/page.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/record.hpp>
+#include <neodb/row_layout.hpp>
+
+namespace neodb
+{
+    struct bad_dictionary : std::runtime_error { bad_dictionary() : std::runtime_error{ "neodb::bad_dictionary" } {} };
+
+    // Distinct values of a CharString or VarcharString column, each numbered by a 32-bit code in order
+    // of first appearance. A value is held in its encoded field form (zero padded) so equal strings
+    // have equal bytes. Entries are appended to a chain of records behind an anchor record and the
+    // whole dictionary is loaded into memory when opened.
+    class string_dictionary
+    {
+    public:
+        typedef std::uint32_t code_type;
+        typedef page::pointer_type pointer_type;
+    private:
+        static constexpr std::uint64_t ANCHOR_MAGIC = 0x31304349444F454E; // NEODIC01
+        static constexpr std::size_t BLOCK_SIZE = MAXIMUM_RECORD_CAPACITY - sizeof(record_header);
+        static constexpr std::size_t ENTRIES_PER_CHUNK = 1024;
+        struct anchor
+        {
+            little_uint64_t magic;
+            little_uint64_t first;
+            little_uint64_t last;
+            little_uint64_t count;
+            little_uint64_t width;
+        };
+        struct block_header
+        {
+            little_uint64_t next;
+            little_uint64_t count;
+        };
+    public:
+        // create an empty dictionary for a field
+        string_dictionary(i_database& aDatabase, field_layout const& aField) :
+            iDatabase{ aDatabase }, iWidth{ aField.size }, iFirst{ 0u }, iLast{ 0u }, iCount{ 0u }
+        {
+            check_field(aField);
+            iAnchor = iDatabase.allocate_record(record_type::Table, sizeof(anchor))->address();
+            store_anchor();
+        }
+        // open an existing dictionary
+        string_dictionary(i_database& aDatabase, field_layout const& aField, pointer_type aAnchor) :
+            iDatabase{ aDatabase }, iWidth{ aField.size }, iAnchor{ aAnchor }, iCount{ 0u }
+        {
+            check_field(aField);
+            pointer_type next;
+            {
+                pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+                auto const& existing = *reinterpret_cast<anchor const*>(record_payload(*anchorPage, iAnchor));
+                if (existing.magic != ANCHOR_MAGIC || existing.width != iWidth)
+                    throw bad_dictionary();
+                iFirst = existing.first;
+                iLast = existing.last;
+                next = iFirst;
+            }
+            while (next != 0u)
+            {
+                pinned_page blockPage{ iDatabase, next - next % page::size };
+                auto const block = record_payload(*blockPage, next);
+                auto const& header = *reinterpret_cast<block_header const*>(block);
+                for (std::size_t entry = 0; entry < header.count; ++entry)
+                    add(block + sizeof(block_header) + entry * iWidth);
+                next = header.next;
+            }
+        }
+    public:
+        pointer_type anchor_address() const
+        {
+            return iAnchor;
+        }
+        // bytes per entry, the width of the field's encoded form
+        std::size_t width() const
+        {
+            return iWidth;
+        }
+        std::size_t size() const
+        {
+            std::shared_lock lock{ iMutex };
+            return iCount;
+        }
+        // the code of an encoded field value, if present
+        std::optional<code_type> find(void const* aValue) const
+        {
+            std::shared_lock lock{ iMutex };
+            auto const existing = iCodes.find(key(aValue));
+            if (existing == iCodes.end())
+                return {};
+            return existing->second;
+        }
+        // the code of a string, if present; encoded as for aField
+        std::optional<code_type> find(field_layout const& aField, data_value_type const& aValue) const
+        {
+            std::vector<std::uint8_t> row(aField.offset + aField.size + (aField.nullBit != NOT_NULLABLE ? aField.nullBit / 8 + 1 : 0));
+            encode_field(aField, aValue, row.data());
+            if (is_null(aField, row.data()))
+                return {};
+            return find(row.data() + aField.offset);
+        }
+        // the encoded field value of a code; stays valid for the dictionary's lifetime
+        std::uint8_t const* value(code_type aCode) const
+        {
+            std::shared_lock lock{ iMutex };
+            if (aCode >= iCount)
+                throw bad_dictionary();
+            return entry(aCode);
+        }
+        std::string_view string(code_type aCode) const
+        {
+            auto const encoded = value(aCode);
+            if (iVarchar)
+                return std::string_view{ reinterpret_cast<char const*>(encoded + 2), std::min<std::size_t>(load_little<std::uint16_t>(encoded), iWidth - 2) };
+            return std::string_view{ reinterpret_cast<char const*>(encoded), ::strnlen(reinterpret_cast<char const*>(encoded), iWidth) };
+        }
+        // the code of an encoded field value, adding it if new
+        code_type intern(void const* aValue)
+        {
+            {
+                std::shared_lock lock{ iMutex };
+                auto const existing = iCodes.find(key(aValue));
+                if (existing != iCodes.end())
+                    return existing->second;
+            }
+            std::unique_lock lock{ iMutex };
+            auto const existing = iCodes.find(key(aValue));
+            if (existing != iCodes.end())
+                return existing->second;
+            if (iCount == std::numeric_limits<code_type>::max())
+                throw bad_dictionary();
+            persist(aValue);
+            auto const code = add(aValue);
+            store_anchor();
+            return code;
+        }
+    private:
+        void check_field(field_layout const& aField)
+        {
+            auto const type = non_nullable(aField.dataType);
+            if (type != data_type::CharString && type != data_type::VarcharString)
+                throw unsupported_field_type();
+            if (entries_per_block() == 0u)
+                throw bad_dictionary();
+            iVarchar = type == data_type::VarcharString;
+        }
+        std::size_t entries_per_block() const
+        {
+            return (BLOCK_SIZE - sizeof(block_header)) / iWidth;
+        }
+        std::string_view key(void const* aValue) const
+        {
+            return std::string_view{ static_cast<char const*>(aValue), iWidth };
+        }
+        std::uint8_t const* entry(code_type aCode) const
+        {
+            return iChunks[aCode / ENTRIES_PER_CHUNK].get() + (aCode % ENTRIES_PER_CHUNK) * iWidth;
+        }
+        code_type add(void const* aValue)
+        {
+            auto const code = static_cast<code_type>(iCount);
+            if (code % ENTRIES_PER_CHUNK == 0u)
+                iChunks.push_back(std::make_unique<std::uint8_t[]>(ENTRIES_PER_CHUNK * iWidth));
+            auto const stored = iChunks.back().get() + (code % ENTRIES_PER_CHUNK) * iWidth;
+            std::memcpy(stored, aValue, iWidth);
+            iCodes.emplace(key(stored), code);
+            ++iCount;
+            return code;
+        }
+        void persist(void const* aValue)
+        {
+            bool full = iLast == 0u;
+            if (!full)
+            {
+                pinned_page lastPage{ iDatabase, iLast - iLast % page::size };
+                full = reinterpret_cast<block_header const*>(record_payload(*lastPage, iLast))->count == entries_per_block();
+            }
+            if (full)
+            {
+                auto const newBlock = iDatabase.allocate_record(record_type::Table, BLOCK_SIZE)->address();
+                {
+                    pinned_page newPage{ iDatabase, newBlock - newBlock % page::size };
+                    *reinterpret_cast<block_header*>(record_payload(*newPage, newBlock)) = block_header{ 0u, 0u };
+                    newPage.set_dirty();
+                }
+                if (iLast != 0u)
+                {
+                    pinned_page lastPage{ iDatabase, iLast - iLast % page::size };
+                    reinterpret_cast<block_header*>(record_payload(*lastPage, iLast))->next = newBlock;
+                    lastPage.set_dirty();
+                }
+                else
+                    iFirst = newBlock;
+                iLast = newBlock;
+            }
+            {
+                pinned_page lastPage{ iDatabase, iLast - iLast % page::size };
+                auto const block = record_payload(*lastPage, iLast);
+                auto& header = *reinterpret_cast<block_header*>(block);
+                std::memcpy(block + sizeof(block_header) + header.count * iWidth, aValue, iWidth);
+                header.count = header.count + 1u;
+                lastPage.set_dirty();
+            }
+        }
+        void store_anchor()
+        {
+            pinned_page anchorPage{ iDatabase, iAnchor - iAnchor % page::size };
+            *reinterpret_cast<anchor*>(record_payload(*anchorPage, iAnchor)) = anchor{ ANCHOR_MAGIC, iFirst, iLast, iCount, iWidth };
+            anchorPage.set_dirty();
+        }
+    private:
+        i_database& iDatabase;
+        std::size_t iWidth;
+        bool iVarchar;
+        pointer_type iAnchor;
+        pointer_type iFirst;
+        pointer_type iLast;
+        std::size_t iCount;
+        std::vector<std::unique_ptr<std::uint8_t[]>> iChunks;
+        std::unordered_map<std::string_view, code_type> iCodes;
+        mutable std::shared_mutex iMutex;
+    };
+}
\ No newline at end of file
@@ -1,73 +1,708 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neolib/core/reference_counted.hpp>
-#include <neodb/i_table.hpp>
-#include <neodb/schema.hpp>
-
-namespace neodb
-{
-    class table : public neolib::reference_counted<i_table>
-    {
-    public:
-        table(i_database& aDatabase, i_schema const& aSchema) :
-            iDatabase{ aDatabase },
-            iSchema{ aSchema }
-        {
-        }
-        table(i_table const& aOther) : 
-            iDatabase{ aOther.database() },
-            iSchema{ aOther.schema() }
-        {
-        }
-    public:
-        i_database& database() const override
-        {
-            return iDatabase;
-        }
-        i_string const& name() const override
-        {
-            return iSchema.name();
-        }
-        i_schema const& schema() const override
-        {
-            return iSchema;
-        }
-    private:
-        i_database& iDatabase;
-        neodb::schema iSchema;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <shared_mutex>
+#include <neolib/core/reference_counted.hpp>
+#include <neodb/i_table.hpp>
+#include <neodb/schema.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/index_key.hpp>
+#include <neodb/record.hpp>
+#include <neodb/btree_index.hpp>
+#include <neodb/hash_index.hpp>
+#include <neodb/column_store.hpp>
+#include <neodb/value_store.hpp>
+
+namespace neodb
+{
+    // Rows are Table records. A table whose primary key is of an indexable type (integer, uuid or
+    // char_string<N>) gets a B+tree and/or hash index on it when created, as its options request.
+    // The hash index is memory-resident: a table opened from an existing one rebuilds it from the
+    // B+tree, so hash-only tables only suit databases that do not outlive the table object.
+    // Tables with columnar storage keep their rows in a column_store instead of Table records.
+    // The primary key indexes map each key to the newest version of its row; older versions hang off
+    // it newest first through their record headers' olderVersion links. Each version owns the records
+    // holding its String and Blob values and they are freed along with it.
+    class table : public neolib::reference_counted<i_table>
+    {
+    public:
+        table(i_database& aDatabase, i_schema const& aSchema, table_options const& aOptions = {}) :
+            iDatabase{ aDatabase },
+            iSchema{ aSchema },
+            iOptions{ aOptions },
+            iRowLayout{ iSchema },
+            iValues{ aDatabase }
+        {
+            if (iOptions.storage == table_storage::Columns)
+                iColumns.emplace(iDatabase, iRowLayout, iOptions.dictionaryEncoding);
+            if (!iRowLayout.primary_key() || !is_indexable(primary_key_field()))
+                return;
+            if (iOptions.primaryIndex & primary_index_type::Ordered)
+                iPrimaryIndex.emplace(iDatabase, index_key_width(primary_key_field()));
+            if (iOptions.primaryIndex & primary_index_type::Hashed)
+                iHashIndex.emplace(index_key_width(primary_key_field()));
+        }
+        table(i_table const& aOther) : 
+            iDatabase{ aOther.database() },
+            iSchema{ aOther.schema() },
+            iOptions{ aOther.options() },
+            iRowLayout{ iSchema },
+            iValues{ iDatabase },
+            iSweepAll{ aOther.primary_index() != 0u }
+        {
+            if (aOther.column_store() != 0u)
+                iColumns.emplace(iDatabase, iRowLayout, aOther.column_store());
+            if (aOther.primary_index() != 0u)
+                iPrimaryIndex.emplace(iDatabase, aOther.primary_index());
+            if (iRowLayout.primary_key() && is_indexable(primary_key_field()) && (iOptions.primaryIndex & primary_index_type::Hashed))
+            {
+                if (!iPrimaryIndex)
+                    throw no_primary_index();
+                iHashIndex.emplace(iPrimaryIndex->key_width(), static_cast<std::size_t>(iPrimaryIndex->size()));
+                iPrimaryIndex->scan(nullptr, nullptr, [&](std::uint8_t const* aKey, btree_index::value_type aRow)
+                {
+                    iHashIndex->insert(aKey, aRow);
+                    return true;
+                });
+            }
+        }
+    public:
+        i_database& database() const override
+        {
+            return iDatabase;
+        }
+        i_string const& name() const override
+        {
+            return iSchema.name();
+        }
+        i_schema const& schema() const override
+        {
+            return iSchema;
+        }
+        table_options const& options() const override
+        {
+            return iOptions;
+        }
+        neodb::row_layout const& row_layout() const override
+        {
+            return iRowLayout;
+        }
+        i_value_store const& values() const override
+        {
+            return iValues;
+        }
+    public:
+        using i_table::insert;
+        page::pointer_type insert(i_row_encoder const& aEncoder) override
+        {
+            if (iColumns)
+                return insert_columns(aEncoder);
+            // shared with other row inserts; excludes a batch between its key checks and its index inserts
+            std::shared_lock lock{ iAppendMutex };
+            versioned_write write{ iDatabase.versions() };
+            auto rowRecord = iDatabase.allocate_record(record_type::Table, iRowLayout.size());
+            auto const address = rowRecord->address();
+            try
+            {
+                std::vector<std::uint8_t> key;
+                {
+                    pinned_page rowPage{ iDatabase, address - address % page::size };
+                    auto const row = record_payload(*rowPage, address);
+                    clear_references(row);
+                    aEncoder.encode(row);
+                    record_header_at(*rowPage, address).recordLink.used = iRowLayout.size();
+                    record_header_at(*rowPage, address).versionBegin = write.stamp();
+                    rowPage.set_dirty();
+                    key = row_key(row);
+                }
+                try
+                {
+                    index_row(key, address);
+                }
+                catch (duplicate_key const&)
+                {
+                    if (!reinsert(key, address))
+                        throw;
+                }
+            }
+            catch (...)
+            {
+                free_values(address);
+                iDatabase.free_record(*rowRecord);
+                throw;
+            }
+            return address;
+        }
+        using i_table::bulk_insert;
+        void bulk_insert(i_row_batch const& aBatch, page::pointer_type* aRows) override
+        {
+            std::size_t const count = aBatch.size();
+            std::size_t const rowSize = iRowLayout.size();
+            std::vector<std::uint8_t> rows(count * rowSize);
+            std::vector<page::pointer_type> addresses(count);
+            // exclusive of row inserts, other batches and columnar inserts so the up-front key checks still hold
+            std::unique_lock lock{ iAppendMutex, std::defer_lock };
+            batch_keys keys;
+            try
+            {
+                for (std::size_t index = 0; index < count; ++index)
+                    aBatch.encode(index, &rows[index * rowSize]);
+                lock.lock();
+                keys = sorted_keys(rows.data(), count);
+            }
+            catch (...)
+            {
+                for (std::size_t index = 0; index < count; ++index)
+                    iRowLayout.free_values(&rows[index * rowSize], iValues);
+                throw;
+            }
+            versioned_write write{ iDatabase.versions() };
+            if (iColumns)
+                iColumns->append(rows.data(), count, addresses.data());
+            else if (count != 0)
+            {
+                iDatabase.allocate_records(record_type::Table, rowSize, count, addresses.data());
+                for (std::size_t index = 0; index < count;)
+                {
+                    auto const pageAddress = addresses[index] - addresses[index] % page::size;
+                    pinned_page rowPage{ iDatabase, pageAddress };
+                    for (; index < count && addresses[index] - addresses[index] % page::size == pageAddress; ++index)
+                    {
+                        std::memcpy(record_payload(*rowPage, addresses[index]), &rows[index * rowSize], rowSize);
+                        record_header_at(*rowPage, addresses[index]).recordLink.used = rowSize;
+                        record_header_at(*rowPage, addresses[index]).versionBegin = write.stamp();
+                    }
+                    rowPage.set_dirty();
+                }
+            }
+            if (!keys.order.empty())
+            {
+                std::vector<btree_index::value_type> values(count);
+                for (std::size_t index = 0; index < count; ++index)
+                    values[index] = addresses[keys.order[index]];
+                bool const loaded = iPrimaryIndex && iPrimaryIndex->size() == 0u;
+                if (loaded)
+                    iPrimaryIndex->bulk_load(keys.keys.data(), values.data(), count);
+                if (iHashIndex)
+                    iHashIndex->reserve(iHashIndex->size() + count);
+                for (std::size_t index = 0; index < count; ++index)
+                {
+                    auto const key = &keys.keys[index * keys.width];
+                    // as with insert(), a row with the key of a removed one becomes the key's newest version
+                    if (keys.removed[index] && reinsert(std::vector<std::uint8_t>(key, key + keys.width), values[index]))
+                        continue;
+                    if (iPrimaryIndex && !loaded)
+                        iPrimaryIndex->insert(key, values[index]);
+                    if (iHashIndex)
+                        iHashIndex->insert(key, values[index]);
+                }
+            }
+            if (aRows != nullptr)
+                std::copy(addresses.begin(), addresses.end(), aRows);
+        }
+        using i_table::read;
+        void read(page::pointer_type aRow, void* aRowData) const override
+        {
+            if (iColumns)
+            {
+                iColumns->read(aRow, aRowData);
+                return;
+            }
+            pinned_page rowPage{ iDatabase, aRow - aRow % page::size };
+            std::memcpy(aRowData, record_payload(*rowPage, aRow), iRowLayout.size());
+        }
+        page::pointer_type primary_index() const override
+        {
+            return iPrimaryIndex ? iPrimaryIndex->anchor_address() : page::pointer_type{ 0u };
+        }
+        using i_table::find;
+        bool find(void const* aKey, page::pointer_type& aRow, timestamp aAsOf) const override
+        {
+            if (!iPrimaryIndex && !iHashIndex)
+                throw no_primary_index();
+            auto const reading = latest_snapshot(aAsOf);
+            auto const newest = newest_version(aKey);
+            if (!newest)
+                return false;
+            auto const version = iColumns ? *newest : visible_row(aKey, *newest, aAsOf);
+            if (version == 0u)
+                return false;
+            aRow = version;
+            return true;
+        }
+        using i_table::scan;
+        void scan(void const* aLowKey, void const* aHighKey, i_row_visitor& aVisitor, timestamp aAsOf) const override
+        {
+            if (!iPrimaryIndex)
+                throw no_primary_index();
+            auto const reading = latest_snapshot(aAsOf);
+            iPrimaryIndex->scan(aLowKey, aHighKey, [&](std::uint8_t const* aKey, btree_index::value_type aRow)
+            {
+                if (iColumns)
+                    return aVisitor.visit(aRow);
+                auto const version = visible_row(aKey, aRow, aAsOf);
+                return version == 0u || aVisitor.visit(version);
+            });
+        }
+        using i_table::update;
+        bool update(void const* aKey, i_row_encoder const& aEncoder) override
+        {
+            if (iColumns)
+                throw unversioned_table();
+            if (!iPrimaryIndex && !iHashIndex)
+                throw no_primary_index();
+            std::scoped_lock lock{ iVersionMutex };
+            auto const newest = newest_version(aKey);
+            if (!newest || version_field(*newest, &record_header::versionEnd) != NO_VERSION_END)
+                return false;
+            versioned_write write{ iDatabase.versions() };
+            auto rowRecord = iDatabase.allocate_record(record_type::Table, iRowLayout.size());
+            auto const address = rowRecord->address();
+            std::vector<std::uint8_t> key;
+            try
+            {
+                pinned_page rowPage{ iDatabase, address - address % page::size };
+                auto const row = record_payload(*rowPage, address);
+                clear_references(row);
+                aEncoder.encode(row);
+                auto& header = record_header_at(*rowPage, address);
+                header.recordLink.used = iRowLayout.size();
+                header.versionBegin = write.stamp();
+                header.olderVersion = *newest;
+                rowPage.set_dirty();
+                key = row_key(row);
+                if (std::memcmp(key.data(), aKey, key.size()) != 0)
+                    throw primary_key_changed();
+            }
+            catch (...)
+            {
+                free_values(address);
+                iDatabase.free_record(*rowRecord);
+                throw;
+            }
+            // the new version is published before the old one ends so a key always has a current version
+            replace_version(key, address);
+            set_version_field(*newest, &record_header::versionEnd, write.stamp());
+            iSuperseded.insert(std::move(key));
+            return true;
+        }
+        using i_table::remove;
+        bool remove(void const* aKey) override
+        {
+            if (iColumns)
+                throw unversioned_table();
+            if (!iPrimaryIndex && !iHashIndex)
+                throw no_primary_index();
+            std::scoped_lock lock{ iVersionMutex };
+            auto const newest = newest_version(aKey);
+            if (!newest || version_field(*newest, &record_header::versionEnd) != NO_VERSION_END)
+                return false;
+            versioned_write write{ iDatabase.versions() };
+            set_version_field(*newest, &record_header::versionEnd, write.stamp());
+            auto const key = static_cast<std::uint8_t const*>(aKey);
+            iSuperseded.emplace(key, key + index_key_width(primary_key_field()));
+            return true;
+        }
+        // A removed row's newest version stays behind as its key's tombstone; only the versions before
+        // it are freed.
+        std::size_t collect_garbage(timestamp aHorizon) override
+        {
+            if (iColumns || (!iPrimaryIndex && !iHashIndex))
+                return 0u;
+            std::set<std::vector<std::uint8_t>> keys;
+            {
+                std::scoped_lock lock{ iVersionMutex };
+                if (iSweepAll)
+                {
+                    // an opened table does not know which of its keys have older versions
+                    iPrimaryIndex->scan(nullptr, nullptr, [&](std::uint8_t const* aKey, btree_index::value_type aRow)
+                    {
+                        if (version_field(aRow, &record_header::olderVersion) != 0u)
+                            iSuperseded.emplace(aKey, aKey + iPrimaryIndex->key_width());
+                        return true;
+                    });
+                    iSweepAll = false;
+                }
+                keys.swap(iSuperseded);
+            }
+            std::size_t collected = 0;
+            for (auto const& key : keys)
+            {
+                std::scoped_lock lock{ iVersionMutex };
+                auto const newest = newest_version(key.data());
+                if (!newest)
+                    continue;
+                // the newest version begun by the horizon is the oldest that any snapshot can still see
+                auto oldestVisible = *newest;
+                while (oldestVisible != 0u && version_field(oldestVisible, &record_header::versionBegin) > aHorizon)
+                    oldestVisible = version_field(oldestVisible, &record_header::olderVersion);
+                if (oldestVisible != *newest)
+                    iSuperseded.insert(key);
+                if (oldestVisible == 0u)
+                    continue;
+                auto dead = version_field(oldestVisible, &record_header::olderVersion);
+                if (dead != 0u)
+                    set_version_field(oldestVisible, &record_header::olderVersion, 0u);
+                for (; dead != 0u; ++collected)
+                {
+                    auto const older = version_field(dead, &record_header::olderVersion);
+                    free_values(dead);
+                    iDatabase.free_record(record_type::Table, dead);
+                    dead = older;
+                }
+            }
+            return collected;
+        }
+        using i_table::partition;
+        std::size_t partition(std::size_t aParts, void* aBoundaries) const override
+        {
+            if (!iPrimaryIndex)
+                throw no_primary_index();
+            auto const boundaries = iPrimaryIndex->partition(aParts);
+            std::copy(boundaries.begin(), boundaries.end(), static_cast<std::uint8_t*>(aBoundaries));
+            return boundaries.size() / iPrimaryIndex->key_width();
+        }
+        page::pointer_type column_store() const override
+        {
+            return iColumns ? iColumns->anchor_address() : page::pointer_type{ 0u };
+        }
+        using i_table::scan_columns;
+        void scan_columns(std::size_t const* aFields, std::size_t aFieldCount, page::pointer_type aAfter, i_column_visitor& aVisitor, timestamp aAsOf) const override
+        {
+            if (iColumns)
+                scan_column_pages(aFields, aFieldCount, aAfter, aVisitor);
+            else
+                gather_columns(aFields, aFieldCount, aAfter, aVisitor, aAsOf);
+        }
+    public:
+        btree_index const* primary_key_index() const
+        {
+            return iPrimaryIndex ? &*iPrimaryIndex : nullptr;
+        }
+        hash_index const* primary_key_hash_index() const
+        {
+            return iHashIndex ? &*iHashIndex : nullptr;
+        }
+    private:
+        field_layout const& primary_key_field() const
+        {
+            return iRowLayout.field(*iRowLayout.primary_key());
+        }
+        std::vector<std::uint8_t> row_key(void const* aRow) const
+        {
+            std::vector<std::uint8_t> key;
+            if (iPrimaryIndex || iHashIndex)
+            {
+                key.resize(index_key_width(primary_key_field()));
+                index_key_from_row(primary_key_field(), aRow, key.data());
+            }
+            return key;
+        }
+        void index_row(std::vector<std::uint8_t> const& aKey, page::pointer_type aRow)
+        {
+            if (iPrimaryIndex)
+                iPrimaryIndex->insert(aKey.data(), aRow);
+            if (iHashIndex)
+                iHashIndex->insert(aKey.data(), aRow);
+        }
+        std::optional<page::pointer_type> newest_version(void const* aKey) const
+        {
+            auto const row = iHashIndex ? iHashIndex->find(aKey) : iPrimaryIndex->find(aKey);
+            if (row)
+                return static_cast<page::pointer_type>(*row);
+            return {};
+        }
+        void replace_version(std::vector<std::uint8_t> const& aKey, page::pointer_type aRow)
+        {
+            if (iPrimaryIndex)
+                iPrimaryIndex->assign(aKey.data(), aRow);
+            if (iHashIndex)
+                iHashIndex->assign(aKey.data(), aRow);
+        }
+        // a row inserted with the key of a removed one becomes the key's newest version
+        bool reinsert(std::vector<std::uint8_t> const& aKey, page::pointer_type aRow)
+        {
+            std::scoped_lock lock{ iVersionMutex };
+            auto const newest = newest_version(aKey.data());
+            if (!newest || version_field(*newest, &record_header::versionEnd) == NO_VERSION_END)
+                return false;
+            set_version_field(aRow, &record_header::olderVersion, *newest);
+            replace_version(aKey, aRow);
+            iSuperseded.insert(aKey);
+            return true;
+        }
+        // A read as of a snapshot is covered by it; one as of LATEST_VERSION holds a snapshot of its own
+        // while it runs so that garbage collection leaves the versions it comes across alone.
+        std::unique_ptr<snapshot> latest_snapshot(timestamp aAsOf) const
+        {
+            if (aAsOf != LATEST_VERSION || iColumns)
+                return nullptr;
+            return std::make_unique<snapshot>(iDatabase.versions());
+        }
+        // The version of aKey's row current as of aAsOf, starting from aNewest, the newest version when the
+        // key was looked up; zero if there is none. As of LATEST_VERSION that version may have been
+        // superseded rather than removed since, so the key is looked up again until its newest is seen.
+        page::pointer_type visible_row(void const* aKey, page::pointer_type aNewest, timestamp aAsOf) const
+        {
+            for (std::optional<page::pointer_type> newest = aNewest; newest;)
+            {
+                auto const version = visible_version(*newest, aAsOf);
+                if (version != 0u || aAsOf != LATEST_VERSION)
+                    return version;
+                auto const current = newest_version(aKey);
+                if (current == newest)
+                    break;
+                newest = current;
+            }
+            return 0u;
+        }
+        // Walk a key's versions from the newest to the one current as of aAsOf, zero if there is none.
+        // Versions end when the next one begins so the walk stops at the first that began by aAsOf.
+        page::pointer_type visible_version(page::pointer_type aVersion, timestamp aAsOf) const
+        {
+            while (aVersion != 0u)
+            {
+                pinned_page versionPage{ iDatabase, aVersion - aVersion % page::size };
+                auto const& header = record_header_at(*versionPage, aVersion);
+                if (load_version_field(header.versionBegin) <= aAsOf)
+                    return aAsOf < load_version_field(header.versionEnd) ? aVersion : page::pointer_type{ 0u };
+                aVersion = load_version_field(header.olderVersion);
+            }
+            return 0u;
+        }
+        std::uint64_t version_field(page::pointer_type aVersion, record_header::version_type record_header::* aField) const
+        {
+            pinned_page versionPage{ iDatabase, aVersion - aVersion % page::size };
+            return load_version_field(record_header_at(*versionPage, aVersion).*aField);
+        }
+        void set_version_field(page::pointer_type aVersion, record_header::version_type record_header::* aField, std::uint64_t aValue)
+        {
+            pinned_page versionPage{ iDatabase, aVersion - aVersion % page::size };
+            store_version_field(record_header_at(*versionPage, aVersion).*aField, aValue);
+            versionPage.set_dirty();
+        }
+        // A new row's record is not zeroed so its String and Blob references are cleared before it is
+        // encoded; an encoder that fails part way then leaves only references to values it stored.
+        void clear_references(std::uint8_t* aRow) const
+        {
+            if (iRowLayout.fixed_width())
+                return;
+            for (std::size_t index = 0; index < iRowLayout.field_count(); ++index)
+                if (!is_fixed_width(iRowLayout.field(index).dataType))
+                    store_value_reference(aRow + iRowLayout.field(index).offset, value_reference{ 0u, 0u });
+        }
+        // free the values a row version owns
+        void free_values(page::pointer_type aRow)
+        {
+            if (iRowLayout.fixed_width())
+                return;
+            pinned_page rowPage{ iDatabase, aRow - aRow % page::size };
+            iRowLayout.free_values(record_payload(*rowPage, aRow), iValues);
+        }
+        struct batch_keys
+        {
+            std::size_t width;
+            std::vector<std::uint8_t> keys; // in key order
+            std::vector<std::size_t> order; // the batch row of each key
+            std::vector<bool> removed;      // the key is indexed but its row has been removed
+        };
+        // Extract and sort the primary keys of a batch of rows, throwing duplicate_key if any is repeated
+        // or belongs to a current row. Empty if the table has no primary key index.
+        batch_keys sorted_keys(std::uint8_t const* aRows, std::size_t aCount) const
+        {
+            batch_keys result{ iPrimaryIndex || iHashIndex ? index_key_width(primary_key_field()) : 0u, {}, {}, {} };
+            if (result.width == 0u)
+                return result;
+            std::vector<std::uint8_t> unsorted(aCount * result.width);
+            for (std::size_t index = 0; index < aCount; ++index)
+                index_key_from_row(primary_key_field(), aRows + index * iRowLayout.size(), &unsorted[index * result.width]);
+            result.order.resize(aCount);
+            for (std::size_t index = 0; index < aCount; ++index)
+                result.order[index] = index;
+            auto const key = [&](std::size_t aIndex) { return &unsorted[aIndex * result.width]; };
+            std::sort(result.order.begin(), result.order.end(), [&](std::size_t aLeft, std::size_t aRight)
+            {
+                return std::memcmp(key(aLeft), key(aRight), result.width) < 0;
+            });
+            result.keys.resize(aCount * result.width);
+            for (std::size_t index = 0; index < aCount; ++index)
+            {
+                std::memcpy(&result.keys[index * result.width], key(result.order[index]), result.width);
+                if (index != 0 && std::memcmp(&result.keys[(index - 1) * result.width], &result.keys[index * result.width], result.width) == 0)
+                    throw duplicate_key();
+            }
+            result.removed.resize(aCount);
+            bool const indexed = iHashIndex ? iHashIndex->size() != 0u : iPrimaryIndex->size() != 0u;
+            for (std::size_t index = 0; indexed && index < aCount; ++index)
+            {
+                auto const existing = iHashIndex ? iHashIndex->find(&result.keys[index * result.width]) : iPrimaryIndex->find(&result.keys[index * result.width]);
+                if (!existing)
+                    continue;
+                if (iColumns || version_field(static_cast<page::pointer_type>(*existing), &record_header::versionEnd) == NO_VERSION_END)
+                    throw duplicate_key();
+                result.removed[index] = true;
+            }
+            return result;
+        }
+        page::pointer_type insert_columns(i_row_encoder const& aEncoder)
+        {
+            // serialised so that a row whose key is rejected is still the last one appended
+            std::unique_lock lock{ iAppendMutex };
+            std::vector<std::uint8_t> row(iRowLayout.size());
+            aEncoder.encode(row.data());
+            auto const key = row_key(row.data());
+            auto const address = iColumns->append(row.data());
+            try
+            {
+                index_row(key, address);
+            }
+            catch (...)
+            {
+                iColumns->remove_last(address);
+                iRowLayout.free_values(row.data(), iValues);
+                throw;
+            }
+            return address;
+        }
+        void scan_column_pages(std::size_t const* aFields, std::size_t aFieldCount, page::pointer_type aAfter, i_column_visitor& aVisitor) const
+        {
+            auto const& pageLayout = iColumns->page_layout();
+            std::vector<page::pointer_type> addresses(pageLayout.capacity());
+            std::vector<column_data> columns(aFieldCount);
+            auto const chain = iColumns->pages();
+            auto pageAddress = chain.first;
+            if (aAfter != 0u)
+                pageAddress = aAfter - aAfter % page::size != chain.last ?
+                    static_cast<page::pointer_type>(pinned_page{ iDatabase, aAfter - aAfter % page::size }->header.pageLink.next) : page::pointer_type{ 0u };
+            while (pageAddress != 0u)
+            {
+                pinned_page columnPage{ iDatabase, pageAddress };
+                bool const lastPage = pageAddress == chain.last;
+                column_chunk const chunk{ lastPage ? chain.lastRows : static_cast<std::size_t>(columnPage->header.pageLink.used), addresses.data(), columns.data() };
+                for (std::size_t slot = 0; slot < chunk.rows; ++slot)
+                    addresses[slot] = pageAddress + slot;
+                for (std::size_t column = 0; column < aFieldCount; ++column)
+                {
+                    auto const nulls = pageLayout.nulls_offset(aFields[column]);
+                    columns[column] = column_data{ &columnPage->data[pageLayout.values_offset(aFields[column])],
+                        nulls != column_page_layout::NO_NULLS ? &columnPage->data[nulls] : nullptr, iColumns->dictionary(aFields[column]) };
+                }
+                if (chunk.rows != 0u && !aVisitor.visit(chunk))
+                    return;
+                pageAddress = lastPage ? page::pointer_type{ 0u } : static_cast<page::pointer_type>(columnPage->header.pageLink.next);
+            }
+        }
+        void gather_columns(std::size_t const* aFields, std::size_t aFieldCount, page::pointer_type aAfter, i_column_visitor& aVisitor, timestamp aAsOf) const
+        {
+            if (!iPrimaryIndex)
+                throw no_primary_index();
+            auto const reading = latest_snapshot(aAsOf);
+            // a version that was visible as of aAsOf outlives the snapshot, and its key never changes
+            std::vector<std::uint8_t> afterKey;
+            if (aAfter != 0u)
+            {
+                pinned_page rowPage{ iDatabase, aAfter - aAfter % page::size };
+                afterKey = row_key(record_payload(*rowPage, aAfter));
+            }
+            std::size_t constexpr CHUNK_ROWS = 1024;
+            std::vector<page::pointer_type> addresses(CHUNK_ROWS);
+            std::vector<std::vector<std::uint8_t>> values(aFieldCount);
+            std::vector<std::vector<std::uint8_t>> nulls(aFieldCount);
+            std::vector<column_data> columns(aFieldCount);
+            for (std::size_t column = 0; column < aFieldCount; ++column)
+            {
+                auto const& field = iRowLayout.field(aFields[column]);
+                values[column].resize(CHUNK_ROWS * field.size);
+                if (field.nullBit != NOT_NULLABLE)
+                    nulls[column].resize(CHUNK_ROWS / 8);
+                columns[column] = column_data{ values[column].data(), field.nullBit != NOT_NULLABLE ? nulls[column].data() : nullptr };
+            }
+            column_chunk chunk{ 0u, addresses.data(), columns.data() };
+            bool more = true;
+            iPrimaryIndex->scan(afterKey.empty() ? nullptr : afterKey.data(), nullptr, [&](std::uint8_t const* aKey, btree_index::value_type aNewest)
+            {
+                if (!afterKey.empty() && std::memcmp(aKey, afterKey.data(), afterKey.size()) == 0)
+                    return more;
+                auto const version = visible_row(aKey, aNewest, aAsOf);
+                if (version == 0u)
+                    return more;
+                pinned_page rowPage{ iDatabase, version - version % page::size };
+                auto const row = record_payload(*rowPage, version);
+                auto const slot = chunk.rows;
+                addresses[slot] = version;
+                for (std::size_t column = 0; column < aFieldCount; ++column)
+                {
+                    auto const& field = iRowLayout.field(aFields[column]);
+                    std::memcpy(&values[column][slot * field.size], row + field.offset, field.size);
+                    if (field.nullBit != NOT_NULLABLE)
+                    {
+                        auto const mask = static_cast<std::uint8_t>(1u << (slot % 8));
+                        auto& bits = nulls[column][slot / 8];
+                        bits = is_null(field, row) ? bits | mask : bits & ~mask;
+                    }
+                }
+                if (++chunk.rows == CHUNK_ROWS)
+                {
+                    more = aVisitor.visit(chunk);
+                    chunk.rows = 0u;
+                }
+                return more;
+            });
+            if (more && chunk.rows != 0u)
+                aVisitor.visit(chunk);
+        }
+    private:
+        i_database& iDatabase;
+        neodb::schema iSchema;
+        table_options iOptions;
+        neodb::row_layout iRowLayout;
+        neodb::value_store iValues;
+        std::optional<btree_index> iPrimaryIndex;
+        std::optional<hash_index> iHashIndex;
+        std::optional<neodb::column_store> iColumns;
+        std::shared_mutex iAppendMutex;
+        std::mutex iVersionMutex;
+        std::set<std::vector<std::uint8_t>> iSuperseded;    // keys with versions that may become garbage
+        bool iSweepAll = false;
+    };
 }
\ No newline at end of file
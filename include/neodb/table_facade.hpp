@@ -1,52 +1,379 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <neodb/i_table.hpp>
-
-namespace neodb
-{
-    template <typename... Fields>
-    class table_facade
-    {
-    public:
-        table_facade(i_table& aTable) :
-            iTable{ aTable }
-        {
-        }
-    private:
-        i_table& iTable;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <tuple>
+#include <vector>
+#include <neodb/i_table.hpp>
+#include <neodb/row_layout.hpp>
+#include <neodb/index_key.hpp>
+#include <neodb/record.hpp>
+
+namespace neodb
+{
+    struct columnar_table : std::logic_error { columnar_table() : std::logic_error{ "neodb::columnar_table" } {} };
+
+    template <typename T> struct is_primary_key : std::false_type {};
+    template <typename T> struct is_primary_key<primary_key<T>> : std::true_type {};
+
+    template <typename... Fields>
+    inline constexpr std::size_t primary_key_index_of()
+    {
+        constexpr std::array<bool, sizeof...(Fields)> isPrimaryKey = { is_primary_key<Fields>::value... };
+        for (std::size_t index = 0; index < isPrimaryKey.size(); ++index)
+            if (isPrimaryKey[index])
+                return index;
+        return sizeof...(Fields);
+    }
+
+    // Typed access to a table whose schema is typed_schema<Fields...>. Rows are read in place from
+    // their pinned pages: a row view's get<I>() decodes one field at its compile-time offset and
+    // character strings come back as string_views of the page, valid while the row stays pinned
+    // (until its cursor moves on or its pinned_row is destroyed). Cursors and pinned rows hold a
+    // snapshot for their lifetime so that garbage collection never frees a version they are reading;
+    // a cursor sees the rows as of its creation while find() sees the newest version of a row.
+    // insert() encodes the fields straight into the new row's record.
+    template <typename... Fields>
+    class table_facade
+    {
+    public:
+        typedef typed_row_layout<Fields...> layout_type;
+        static constexpr std::size_t primary_key_index = primary_key_index_of<Fields...>();
+    public:
+        class row_view
+        {
+        public:
+            row_view() :
+                iAddress{ 0u }, iData{ nullptr }
+            {
+            }
+            row_view(page::pointer_type aAddress, std::uint8_t const* aData) :
+                iAddress{ aAddress }, iData{ aData }
+            {
+            }
+        public:
+            page::pointer_type address() const
+            {
+                return iAddress;
+            }
+            void const* data() const
+            {
+                return iData;
+            }
+            template <std::size_t Index>
+            typename layout_type::template view_type<Index> get() const
+            {
+                return layout_type::template get<Index>(iData);
+            }
+            auto decode() const
+            {
+                return layout_type::decode(iData);
+            }
+        private:
+            page::pointer_type iAddress;
+            std::uint8_t const* iData;
+        };
+
+        class pinned_row
+        {
+        public:
+            pinned_row(i_database& aDatabase, page::pointer_type aAddress) :
+                pinned_row{ aDatabase, aAddress, std::make_unique<snapshot>(aDatabase.versions()) }
+            {
+            }
+            // aSnapshot was taken before the row was found
+            pinned_row(i_database& aDatabase, page::pointer_type aAddress, std::unique_ptr<snapshot> aSnapshot) :
+                iSnapshot{ std::move(aSnapshot) },
+                iPage{ aDatabase, aAddress - aAddress % page::size },
+                iView{ aAddress, record_payload(*iPage, aAddress) }
+            {
+            }
+        public:
+            row_view const& view() const
+            {
+                return iView;
+            }
+            page::pointer_type address() const
+            {
+                return iView.address();
+            }
+            template <std::size_t Index>
+            typename layout_type::template view_type<Index> get() const
+            {
+                return iView.template get<Index>();
+            }
+        private:
+            std::unique_ptr<snapshot> iSnapshot;
+            pinned_page iPage;
+            row_view iView;
+        };
+
+        // Rows in primary key order. Row addresses are taken from the ordered primary key index a
+        // batch at a time; the page holding the current row stays pinned and is only re-pinned when
+        // the next row lives on another page.
+        class cursor
+        {
+        public:
+            static constexpr std::size_t BATCH_SIZE = 256;
+        public:
+            class iterator
+            {
+            public:
+                iterator() :
+                    iCursor{ nullptr }
+                {
+                }
+                iterator(cursor& aCursor) :
+                    iCursor{ aCursor.next() ? &aCursor : nullptr }
+                {
+                }
+            public:
+                row_view const& operator*() const
+                {
+                    return iCursor->current();
+                }
+                row_view const* operator->() const
+                {
+                    return &iCursor->current();
+                }
+                iterator& operator++()
+                {
+                    if (!iCursor->next())
+                        iCursor = nullptr;
+                    return *this;
+                }
+                bool operator==(iterator const& aOther) const
+                {
+                    return iCursor == aOther.iCursor;
+                }
+                bool operator!=(iterator const& aOther) const
+                {
+                    return !(*this == aOther);
+                }
+            private:
+                cursor* iCursor;
+            };
+        public:
+            cursor(i_table& aTable, std::vector<std::uint8_t> aLowKey = {}, std::vector<std::uint8_t> aHighKey = {}) :
+                iTable{ aTable }, iSnapshot{ aTable.database().versions() }, iLowKey{ std::move(aLowKey) }, iHighKey{ std::move(aHighKey) }, iPosition{ 0 }, iExhausted{ false }, iLastRow{ 0u }
+            {
+            }
+            cursor(cursor const&) = delete;
+            cursor& operator=(cursor const&) = delete;
+        public:
+            iterator begin()
+            {
+                return iterator{ *this };
+            }
+            iterator end()
+            {
+                return iterator{};
+            }
+            row_view const& current() const
+            {
+                return iCurrent;
+            }
+            bool next()
+            {
+                if (iPosition == iBatch.size())
+                {
+                    fill();
+                    if (iBatch.empty())
+                    {
+                        iPage.reset();
+                        return false;
+                    }
+                }
+                auto const address = iBatch[iPosition++];
+                auto const pageAddress = address - address % page::size;
+                if (!iPage || iPage->address() != pageAddress)
+                {
+                    iPage.reset();
+                    iPage.emplace(iTable.database(), pageAddress);
+                }
+                iCurrent = row_view{ address, record_payload(**iPage, address) };
+                return true;
+            }
+        private:
+            void fill()
+            {
+                iBatch.clear();
+                iPosition = 0;
+                if (iExhausted)
+                    return;
+                bool const resuming = iLastRow != 0u;
+                void const* const low = resuming ? iResumeKey.data() : iLowKey.empty() ? nullptr : iLowKey.data();
+                void const* const high = iHighKey.empty() ? nullptr : iHighKey.data();
+                struct collector : i_row_visitor
+                {
+                    std::vector<page::pointer_type>& batch;
+                    page::pointer_type skip;
+                    collector(std::vector<page::pointer_type>& aBatch, page::pointer_type aSkip) : batch{ aBatch }, skip{ aSkip } {}
+                    bool visit(page::pointer_type aRow) override
+                    {
+                        // the first row at the resume key is the last row of the previous batch
+                        if (skip != 0u)
+                        {
+                            bool const skipped = aRow == skip;
+                            skip = 0u;
+                            if (skipped)
+                                return true;
+                        }
+                        batch.push_back(aRow);
+                        return batch.size() < BATCH_SIZE;
+                    }
+                } visitor{ iBatch, resuming ? iLastRow : page::pointer_type{ 0u } };
+                iTable.scan(low, high, visitor, iSnapshot.as_of());
+                if (iBatch.size() < BATCH_SIZE)
+                    iExhausted = true;
+                if (!iBatch.empty() && !iExhausted)
+                {
+                    // resume after the last row of this batch by its key
+                    iLastRow = iBatch.back();
+                    auto const& keyField = iTable.row_layout().field(primary_key_index);
+                    iResumeKey.resize(index_key_width(keyField));
+                    pinned_page lastPage{ iTable.database(), iLastRow - iLastRow % page::size };
+                    index_key_from_row(keyField, record_payload(*lastPage, iLastRow), iResumeKey.data());
+                }
+            }
+        private:
+            i_table& iTable;
+            snapshot iSnapshot;
+            std::vector<std::uint8_t> iLowKey;
+            std::vector<std::uint8_t> iHighKey;
+            std::vector<std::uint8_t> iResumeKey;
+            std::vector<page::pointer_type> iBatch;
+            std::size_t iPosition;
+            bool iExhausted;
+            page::pointer_type iLastRow;
+            std::optional<pinned_page> iPage;
+            row_view iCurrent;
+        };
+    public:
+        table_facade(i_table& aTable) :
+            iTable{ aTable }
+        {
+            if (iTable.options().storage != table_storage::Rows)
+                throw columnar_table();
+            auto const& layout = iTable.row_layout();
+            bool matches = layout.size() == layout_type::size && layout.field_count() == layout_type::field_count;
+            for (std::size_t index = 0; matches && index < layout_type::field_count; ++index)
+                matches = layout.field(index).dataType == layout_type::fields[index].dataType &&
+                    layout.field(index).offset == layout_type::fields[index].offset &&
+                    layout.field(index).size == layout_type::fields[index].size &&
+                    layout.field(index).nullBit == layout_type::fields[index].nullBit;
+            if (!matches)
+                throw field_type_mismatch();
+        }
+    public:
+        i_table& table() const
+        {
+            return iTable;
+        }
+        page::pointer_type insert(typename field_codec<field_value_t<Fields>>::param_type... aValues)
+        {
+            auto encode = [&](void* aRow) { layout_type::encode(aRow, aValues...); };
+            return iTable.insert(encoder<decltype(encode)>{ encode });
+        }
+        // Bulk insert a range of tuples of field values (such as those returned by row_view::decode());
+        // returns the rows' addresses in range order.
+        template <typename Range>
+        std::vector<page::pointer_type> bulk_insert(Range const& aRows)
+        {
+            std::vector<std::add_pointer_t<std::ranges::range_value_t<Range> const>> rows;
+            for (auto const& row : aRows)
+                rows.push_back(&row);
+            struct batch : i_row_batch
+            {
+                decltype(rows) const& values;
+                batch(decltype(rows) const& aValues) : values{ aValues } {}
+                std::size_t size() const override { return values.size(); }
+                void encode(std::size_t aIndex, void* aRow) const override
+                {
+                    std::apply([&](auto const&... aValues) { layout_type::encode(aRow, aValues...); }, *values[aIndex]);
+                }
+            };
+            std::vector<page::pointer_type> addresses(rows.size());
+            iTable.bulk_insert(batch{ rows }, addresses.data());
+            return addresses;
+        }
+        std::optional<pinned_row> find(typename layout_type::template param_type<primary_key_index> aKey) const
+        {
+            auto const key = encode_key(aKey);
+            auto current = std::make_unique<snapshot>(iTable.database().versions());
+            page::pointer_type row;
+            if (!iTable.find(key.data(), row, LATEST_VERSION))
+                return std::nullopt;
+            return std::optional<pinned_row>{ std::in_place, iTable.database(), row, std::move(current) };
+        }
+        pinned_row read(page::pointer_type aRow) const
+        {
+            return pinned_row{ iTable.database(), aRow };
+        }
+        cursor rows() const
+        {
+            return cursor{ iTable };
+        }
+        cursor rows(typename layout_type::template param_type<primary_key_index> aLowKey, typename layout_type::template param_type<primary_key_index> aHighKey) const
+        {
+            return cursor{ iTable, encode_key(aLowKey), encode_key(aHighKey) };
+        }
+    private:
+        template <typename Encode>
+        struct encoder : i_row_encoder
+        {
+            Encode& function;
+            encoder(Encode& aFunction) : function{ aFunction } {}
+            void encode(void* aRow) const override { function(aRow); }
+        };
+        static std::vector<std::uint8_t> encode_key(typename layout_type::template param_type<primary_key_index> aKey)
+        {
+            static_assert(primary_key_index < layout_type::field_count, "neodb::table_facade: schema has no primary key");
+            constexpr field_layout keyField = layout_type::fields[primary_key_index];
+            std::array<std::uint8_t, keyField.offset + keyField.size> row = {};
+            layout_type::template set<primary_key_index>(row.data(), aKey);
+            std::vector<std::uint8_t> key(index_key_width(keyField));
+            index_key_from_row(keyField, row.data(), key.data());
+            return key;
+        }
+    private:
+        i_table& iTable;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace neodb
+{
+    enum class primary_index_type : std::uint32_t
+    {
+        Ordered             = 0x00000001,   // persistent B+tree; point lookups and range scans
+        Hashed              = 0x00000002,   // memory-resident hash table; point lookups only
+        OrderedAndHashed    = Ordered | Hashed
+    };
+
+    inline constexpr bool operator&(primary_index_type aLhs, primary_index_type aRhs)
+    {
+        return (static_cast<std::uint32_t>(aLhs) & static_cast<std::uint32_t>(aRhs)) != 0u;
+    }
+
+    enum class table_storage : std::uint32_t
+    {
+        Rows                = 0x00000001,   // one record per row
+        Columns             = 0x00000002    // PAX pages: each page holds its rows column by column
+    };
+
+    struct table_options
+    {
+        primary_index_type primaryIndex = primary_index_type::Ordered;
+        table_storage storage = table_storage::Rows;
+        // columnar storage only: CharString and VarcharString columns hold codes into per-column dictionaries
+        bool dictionaryEncoding = false;
+    };
+}
\ No newline at end of file
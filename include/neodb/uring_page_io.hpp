@@ -0,0 +1,261 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#ifdef NEODB_IO_URING
+
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <neodb/file_page_io.hpp>
+
+namespace neodb
+{
+    // Page I/O through a Linux io_uring: a batch of page reads or writes is queued as one set of
+    // submission entries and handed to the kernel with a single io_uring_enter, so independent page
+    // transfers are in flight together. The ring is driven with raw system calls; create() returns
+    // nothing when the kernel (or a sandbox) refuses io_uring_setup so the caller can fall back to
+    // file_page_io.
+    class uring_page_io : public file_page_io
+    {
+    public:
+        static constexpr unsigned QUEUE_DEPTH = 64;
+    public:
+        static std::unique_ptr<uring_page_io> create(os_file& aFile)
+        {
+            std::unique_ptr<uring_page_io> result{ new uring_page_io{ aFile } };
+            if (result->iRing == -1)
+                result.reset();
+            return result;
+        }
+        uring_page_io(uring_page_io const&) = delete;
+        uring_page_io& operator=(uring_page_io const&) = delete;
+        ~uring_page_io()
+        {
+            release();
+        }
+    public:
+        void read_page(page::pointer_type aAddress, page& aPage) override
+        {
+            page_read const read{ aAddress, &aPage };
+            read_pages(&read, 1);
+        }
+        void write_page(page::pointer_type aAddress, page const& aPage) override
+        {
+            page_write const write{ aAddress, &aPage };
+            write_pages(&write, 1);
+        }
+        void read_pages(page_read const* aReads, std::size_t aCount) override
+        {
+            transfer(aCount, [&](std::size_t aIndex, io_uring_sqe& aEntry)
+            {
+                aEntry.opcode = IORING_OP_READ;
+                aEntry.off = aReads[aIndex].address;
+                aEntry.addr = reinterpret_cast<std::uint64_t>(aReads[aIndex].destination);
+            });
+        }
+        void write_pages(page_write const* aWrites, std::size_t aCount) override
+        {
+            transfer(aCount, [&](std::size_t aIndex, io_uring_sqe& aEntry)
+            {
+                aEntry.opcode = IORING_OP_WRITE;
+                aEntry.off = aWrites[aIndex].address;
+                aEntry.addr = reinterpret_cast<std::uint64_t>(aWrites[aIndex].source);
+            });
+        }
+    private:
+        uring_page_io(os_file& aFile) :
+            file_page_io{ aFile },
+            iFile{ aFile }
+        {
+            io_uring_params parameters = {};
+            iRing = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &parameters));
+            if (iRing == -1)
+                return;
+            if (!supports_read_write())
+            {
+                ::close(iRing);
+                iRing = -1;
+                return;
+            }
+            iSqRingSize = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+            iCqRingSize = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+            bool const singleMapping = (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (singleMapping)
+                iSqRingSize = iCqRingSize = std::max(iSqRingSize, iCqRingSize);
+            iSqRing = map(iSqRingSize, IORING_OFF_SQ_RING);
+            iCqRing = singleMapping ? iSqRing : map(iCqRingSize, IORING_OFF_CQ_RING);
+            iSqesSize = parameters.sq_entries * sizeof(io_uring_sqe);
+            iSqes = map(iSqesSize, IORING_OFF_SQES);
+            if (iSqRing == nullptr || iCqRing == nullptr || iSqes == nullptr)
+            {
+                release();
+                return;
+            }
+            auto* const sq = static_cast<std::uint8_t*>(iSqRing);
+            auto* const cq = static_cast<std::uint8_t*>(iCqRing);
+            iSqTail = reinterpret_cast<unsigned*>(sq + parameters.sq_off.tail);
+            iSqMask = *reinterpret_cast<unsigned*>(sq + parameters.sq_off.ring_mask);
+            iSqArray = reinterpret_cast<unsigned*>(sq + parameters.sq_off.array);
+            iCqHead = reinterpret_cast<unsigned*>(cq + parameters.cq_off.head);
+            iCqTail = reinterpret_cast<unsigned*>(cq + parameters.cq_off.tail);
+            iCqMask = *reinterpret_cast<unsigned*>(cq + parameters.cq_off.ring_mask);
+            iCqes = reinterpret_cast<io_uring_cqe*>(cq + parameters.cq_off.cqes);
+            iDepth = std::min<unsigned>(parameters.sq_entries, QUEUE_DEPTH);
+        }
+        // IORING_OP_READ and IORING_OP_WRITE arrived in 5.6, with the opcode probe; an older kernel fails
+        // the probe and a newer one reports which opcodes it supports.
+        bool supports_read_write() const
+        {
+            std::vector<std::uint8_t> buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+            auto* const probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+            if (::syscall(__NR_io_uring_register, iRing, IORING_REGISTER_PROBE, probe, 256) < 0)
+                return false;
+            auto const supported = [&](unsigned aOpcode)
+            {
+                return aOpcode <= probe->last_op && (probe->ops[aOpcode].flags & IO_URING_OP_SUPPORTED) != 0;
+            };
+            return supported(IORING_OP_READ) && supported(IORING_OP_WRITE);
+        }
+        void release()
+        {
+            if (iSqes != nullptr)
+                ::munmap(iSqes, iSqesSize);
+            if (iCqRing != nullptr && iCqRing != iSqRing)
+                ::munmap(iCqRing, iCqRingSize);
+            if (iSqRing != nullptr)
+                ::munmap(iSqRing, iSqRingSize);
+            if (iRing != -1)
+                ::close(iRing);
+            iSqes = iCqRing = iSqRing = nullptr;
+            iRing = -1;
+        }
+        void* map(std::size_t aSize, std::uint64_t aOffset)
+        {
+            void* const result = ::mmap(nullptr, aSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iRing, static_cast<off_t>(aOffset));
+            return result == MAP_FAILED ? nullptr : result;
+        }
+        template <typename Prepare>
+        void transfer(std::size_t aCount, Prepare aPrepare)
+        {
+            std::scoped_lock lock{ iMutex };
+            for (std::size_t first = 0; first < aCount; first += iDepth)
+            {
+                unsigned const batch = static_cast<unsigned>(std::min<std::size_t>(aCount - first, iDepth));
+                unsigned tail = std::atomic_ref<unsigned>{ *iSqTail }.load(std::memory_order_relaxed);
+                for (unsigned index = 0; index < batch; ++index, ++tail)
+                {
+                    auto const slot = tail & iSqMask;
+                    auto& entry = static_cast<io_uring_sqe*>(iSqes)[slot];
+                    std::memset(&entry, 0, sizeof(entry));
+                    entry.fd = iFile.native_handle();
+                    entry.len = sizeof(page);
+                    entry.user_data = first + index;
+                    aPrepare(first + index, entry);
+                    iSqArray[slot] = slot;
+                }
+                std::atomic_ref<unsigned>{ *iSqTail }.store(tail, std::memory_order_release);
+                bool failed = false;
+                unsigned submitted = 0;
+                while (submitted < batch)
+                {
+                    auto const result = ::syscall(__NR_io_uring_enter, iRing, batch - submitted, batch, IORING_ENTER_GETEVENTS, nullptr, 0);
+                    if (result < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        // take back the entries the kernel has not consumed so no later batch submits them
+                        std::atomic_ref<unsigned>{ *iSqTail }.store(tail - (batch - submitted), std::memory_order_release);
+                        failed = true;
+                        break;
+                    }
+                    submitted += static_cast<unsigned>(result);
+                }
+                // entries in flight refer to the caller's pages so they must complete before returning or throwing
+                reap(submitted, failed);
+                if (failed)
+                    throw page_io_error();
+            }
+        }
+        void reap(unsigned aCount, bool& aFailed)
+        {
+            for (unsigned completed = 0; completed < aCount;)
+            {
+                unsigned head = std::atomic_ref<unsigned>{ *iCqHead }.load(std::memory_order_relaxed);
+                unsigned const available = std::atomic_ref<unsigned>{ *iCqTail }.load(std::memory_order_acquire);
+                if (head == available)
+                {
+                    if (::syscall(__NR_io_uring_enter, iRing, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                    {
+                        aFailed = true;
+                        std::this_thread::yield();
+                    }
+                    continue;
+                }
+                for (; head != available; ++head, ++completed)
+                    if (iCqes[head & iCqMask].res != static_cast<std::int32_t>(sizeof(page)))
+                        aFailed = true;
+                std::atomic_ref<unsigned>{ *iCqHead }.store(head, std::memory_order_release);
+            }
+        }
+    private:
+        std::mutex iMutex;
+        os_file& iFile;
+        int iRing = -1;
+        void* iSqRing = nullptr;
+        void* iCqRing = nullptr;
+        void* iSqes = nullptr;
+        std::size_t iSqRingSize = 0;
+        std::size_t iCqRingSize = 0;
+        std::size_t iSqesSize = 0;
+        unsigned* iSqTail = nullptr;
+        unsigned iSqMask = 0;
+        unsigned* iSqArray = nullptr;
+        unsigned* iCqHead = nullptr;
+        unsigned* iCqTail = nullptr;
+        unsigned iCqMask = 0;
+        io_uring_cqe* iCqes = nullptr;
+        unsigned iDepth = QUEUE_DEPTH;
+    };
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <neodb/page.hpp>
+#include <neodb/i_database.hpp>
+#include <neodb/record.hpp>
+#include <neodb/row_layout.hpp>
+
+namespace neodb
+{
+    // The out-of-line values of a table's String and Blob fields, each stored in a Table record of its
+    // own and so at most MAXIMUM_RECORD_CAPACITY less a record header long. A value belongs to the one
+    // row version that refers to it and is freed with that version.
+    class value_store : public i_value_store
+    {
+    public:
+        value_store(i_database& aDatabase) :
+            iDatabase{ aDatabase }
+        {
+        }
+    public:
+        std::uint64_t store_value(void const* aData, std::size_t aLength) const override
+        {
+            auto const address = iDatabase.allocate_record(record_type::Table, static_cast<link::size_type>(aLength))->address();
+            pinned_page valuePage{ iDatabase, address - address % page::size };
+            std::memcpy(record_payload(*valuePage, address), aData, aLength);
+            record_header_at(*valuePage, address).recordLink.used = aLength;
+            valuePage.set_dirty();
+            return address;
+        }
+        void load_value(std::uint64_t aAddress, void* aData, std::size_t aLength) const override
+        {
+            pinned_page valuePage{ iDatabase, aAddress - aAddress % page::size };
+            std::memcpy(aData, record_payload(*valuePage, aAddress), aLength);
+        }
+        void free_value(std::uint64_t aAddress) const override
+        {
+            iDatabase.free_record(record_type::Table, aAddress);
+        }
+    private:
+        i_database& iDatabase;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <set>
+#include <mutex>
+#include <neodb/page.hpp>
+
+namespace neodb
+{
+    // snapshot timestamp seeing the newest version of everything, including writes still in progress
+    timestamp constexpr LATEST_VERSION = NO_VERSION_END - 1u;
+
+    // Issues the timestamps that versions are stamped with and that snapshots read as of. Each write
+    // takes the next timestamp; a snapshot sees every write before the oldest one still in progress,
+    // so it never sees part of a write. The clock itself lives in the root page so timestamps keep
+    // increasing across sessions.
+    class version_clock
+    {
+    public:
+        version_clock(little_uint64_t& aClock) :
+            iClock{ aClock }
+        {
+        }
+        version_clock(version_clock const&) = delete;
+        version_clock& operator=(version_clock const&) = delete;
+    public:
+        timestamp latest() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iClock;
+        }
+        timestamp begin_write()
+        {
+            std::scoped_lock lock{ iMutex };
+            iClock = iClock + 1u;
+            iWrites.insert(iClock);
+            return iClock;
+        }
+        void end_write(timestamp aWrite)
+        {
+            std::scoped_lock lock{ iMutex };
+            iWrites.erase(aWrite);
+        }
+        timestamp acquire_snapshot()
+        {
+            std::scoped_lock lock{ iMutex };
+            auto const result = visible();
+            iSnapshots.insert(result);
+            return result;
+        }
+        void release_snapshot(timestamp aSnapshot)
+        {
+            std::scoped_lock lock{ iMutex };
+            auto const existing = iSnapshots.find(aSnapshot);
+            if (existing != iSnapshots.end())
+                iSnapshots.erase(existing);
+        }
+        // No snapshot, current or future, reads as of a timestamp before the horizon: versions
+        // superseded at or before it can be collected.
+        timestamp horizon() const
+        {
+            std::scoped_lock lock{ iMutex };
+            auto const result = visible();
+            return iSnapshots.empty() ? result : std::min(result, *iSnapshots.begin());
+        }
+    private:
+        timestamp visible() const
+        {
+            return iWrites.empty() ? static_cast<timestamp>(iClock) : *iWrites.begin() - 1u;
+        }
+    private:
+        mutable std::mutex iMutex;
+        little_uint64_t& iClock;
+        std::set<timestamp> iWrites;
+        std::multiset<timestamp> iSnapshots;
+    };
+
+    // A read transaction: the versions it reads stay put until it is released.
+    class snapshot
+    {
+    public:
+        snapshot(version_clock& aClock) :
+            iClock{ aClock }, iTimestamp{ aClock.acquire_snapshot() }
+        {
+        }
+        snapshot(snapshot const&) = delete;
+        snapshot& operator=(snapshot const&) = delete;
+        ~snapshot()
+        {
+            iClock.release_snapshot(iTimestamp);
+        }
+    public:
+        timestamp as_of() const
+        {
+            return iTimestamp;
+        }
+    private:
+        version_clock& iClock;
+        timestamp iTimestamp;
+    };
+
+    // Stamps the versions a write creates; the write stays in progress until this is destroyed.
+    class versioned_write
+    {
+    public:
+        versioned_write(version_clock& aClock) :
+            iClock{ aClock }, iTimestamp{ aClock.begin_write() }
+        {
+        }
+        versioned_write(versioned_write const&) = delete;
+        versioned_write& operator=(versioned_write const&) = delete;
+        ~versioned_write()
+        {
+            iClock.end_write(iTimestamp);
+        }
+    public:
+        timestamp stamp() const
+        {
+            return iTimestamp;
+        }
+    private:
+        version_clock& iClock;
+        timestamp iTimestamp;
+    };
+}
\ No newline at end of file
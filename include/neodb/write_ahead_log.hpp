@@ -0,0 +1,370 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <boost/endian/buffers.hpp>
+#include <neodb/page.hpp>
+#include <neodb/os_file.hpp>
+
+namespace neodb
+{
+    struct bad_log : std::runtime_error { bad_log() : std::runtime_error{ "neodb::bad_log" } {} };
+
+    typedef std::uint64_t lsn_t;
+
+    // The byte ranges of pages changed by one commit. The root page is logged as address zero.
+    class log_transaction
+    {
+    public:
+        log_transaction() :
+            iChangeCount{ 0 }
+        {
+        }
+    public:
+        bool empty() const
+        {
+            return iChangeCount == 0;
+        }
+        std::uint32_t change_count() const
+        {
+            return iChangeCount;
+        }
+        std::vector<std::uint8_t> const& changes() const
+        {
+            return iChanges;
+        }
+        void add(std::uint64_t aPageAddress, std::size_t aOffset, void const* aData, std::size_t aLength)
+        {
+            little_uint64_buf_t const address{ aPageAddress };
+            little_uint16_buf_t const offset{ static_cast<std::uint16_t>(aOffset) };
+            little_uint16_buf_t const length{ static_cast<std::uint16_t>(aLength) };
+            append(address.data(), sizeof(address));
+            append(offset.data(), sizeof(offset));
+            append(length.data(), sizeof(length));
+            if (aLength != 0u)
+                append(aData, aLength);
+            ++iChangeCount;
+        }
+        // Log the whole of aCurrent: a change of zero length that tells recovery to start the page from
+        // blank, followed by the page's difference from a blank page. Recovery then never has to read
+        // the page from the database file, where a torn write may have left it half old, half new.
+        template <typename Page>
+        void add_image(std::uint64_t aPageAddress, Page const& aCurrent)
+        {
+            static Page const blank{};
+            add(aPageAddress, 0u, nullptr, 0u);
+            add_difference(aPageAddress, blank, aCurrent);
+        }
+        // Log the parts of aCurrent that differ from aBase, at CHUNK granularity with nearby runs merged.
+        template <typename Page>
+        void add_difference(std::uint64_t aPageAddress, Page const& aBase, Page const& aCurrent)
+        {
+            static constexpr std::size_t CHUNK = 32;
+            auto const* const base = reinterpret_cast<std::uint8_t const*>(&aBase);
+            auto const* const current = reinterpret_cast<std::uint8_t const*>(&aCurrent);
+            std::size_t runStart = 0;
+            std::size_t runEnd = 0;
+            bool inRun = false;
+            for (std::size_t chunk = 0; chunk < sizeof(Page); chunk += CHUNK)
+            {
+                auto const chunkEnd = std::min(chunk + CHUNK, sizeof(Page));
+                if (std::memcmp(base + chunk, current + chunk, chunkEnd - chunk) == 0)
+                {
+                    if (inRun && chunk - runEnd >= CHUNK)
+                    {
+                        add(aPageAddress, runStart, current + runStart, runEnd - runStart);
+                        inRun = false;
+                    }
+                    continue;
+                }
+                if (!inRun)
+                    runStart = chunk;
+                inRun = true;
+                runEnd = chunkEnd;
+            }
+            if (inRun)
+                add(aPageAddress, runStart, current + runStart, runEnd - runStart);
+        }
+    private:
+        void append(void const* aData, std::size_t aLength)
+        {
+            auto const* const bytes = static_cast<std::uint8_t const*>(aData);
+            iChanges.insert(iChanges.end(), bytes, bytes + aLength);
+        }
+    private:
+        std::vector<std::uint8_t> iChanges;
+        std::uint32_t iChangeCount;
+    };
+
+    // Redo log for a file_database. Committers append a transaction and then wait for it to become
+    // durable; a single flusher thread writes out everything appended since its last sync and then
+    // syncs once, so every committer that arrived while the previous sync was in progress shares the
+    // next one (group commit).
+    //
+    // Log file: header { magic, first lsn } followed by transactions
+    //     { body length (u32), lsn (u64), change count (u32), changes..., checksum (u64) }
+    // where each change is { page address (u64), offset (u16), length (u16), bytes }; a change of zero
+    // length blanks the page. A transaction that is cut short or fails its checksum marks the end of
+    // the log.
+    class write_ahead_log
+    {
+    public:
+        static constexpr std::uint64_t LOG_MAGIC = 0x4C415742444F454E; // NEODBWAL
+        static constexpr std::size_t HEADER_SIZE = 16;
+    public:
+        typedef std::uint64_t ticket_t;
+    public:
+        write_ahead_log(std::filesystem::path const& aLogPath) :
+            iFile{ aLogPath },
+            iNextLsn{ 1 },
+            iAppended{ 0 },
+            iDurable{ 0 },
+            iEnd{ 0 },
+            iStopping{ false }
+        {
+            if (iFile.size() < HEADER_SIZE)
+                write_header();
+            else
+            {
+                little_uint64_buf_t header[2];
+                iFile.read_at(0, header, sizeof(header));
+                if (header[0].value() != LOG_MAGIC)
+                    throw bad_log();
+                iNextLsn = header[1].value();
+            }
+            // anything after the last complete transaction is a torn write and will be overwritten
+            iEnd = replay([&](lsn_t aLsn, std::uint64_t, std::size_t, void const*, std::size_t)
+            {
+                iNextLsn = std::max(iNextLsn, aLsn + 1);
+            });
+            iAppendedLsn = iNextLsn - 1;
+            iDurableLsn = iAppendedLsn;
+            iFlusher = std::thread{ [this]() { flush_loop(); } };
+        }
+        ~write_ahead_log()
+        {
+            {
+                std::scoped_lock lock{ iMutex };
+                iStopping = true;
+            }
+            iWork.notify_one();
+            iFlusher.join();
+        }
+    public:
+        std::uint64_t size() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iEnd + iAppended - iDurable;
+        }
+        lsn_t next_lsn()
+        {
+            std::scoped_lock lock{ iMutex };
+            return iNextLsn++;
+        }
+        // The LSN of the last transaction known to be durable; pages stamped with a later one must not
+        // reach the database file yet.
+        lsn_t durable_lsn() const
+        {
+            std::scoped_lock lock{ iMutex };
+            return iDurableLsn;
+        }
+        // Queue a transaction; LSNs must be appended in the order next_lsn() handed them out.
+        ticket_t append(lsn_t aLsn, log_transaction const& aTransaction)
+        {
+            little_uint32_buf_t const bodyLength{ static_cast<std::uint32_t>(sizeof(little_uint64_buf_t) + sizeof(little_uint32_buf_t) + aTransaction.changes().size()) };
+            little_uint64_buf_t const lsn{ aLsn };
+            little_uint32_buf_t const changeCount{ aTransaction.change_count() };
+            std::scoped_lock lock{ iMutex };
+            auto const start = iPending.size();
+            append_bytes(bodyLength.data(), sizeof(bodyLength));
+            append_bytes(lsn.data(), sizeof(lsn));
+            append_bytes(changeCount.data(), sizeof(changeCount));
+            append_bytes(aTransaction.changes().data(), aTransaction.changes().size());
+            little_uint64_buf_t const checksum{ fnv1a(&iPending[start], iPending.size() - start) };
+            append_bytes(checksum.data(), sizeof(checksum));
+            iAppended += iPending.size() - start;
+            iAppendedLsn = aLsn;
+            iWork.notify_one();
+            return iAppended;
+        }
+        void wait_durable(ticket_t aTicket)
+        {
+            std::unique_lock lock{ iMutex };
+            iDurableChanged.wait(lock, [&]() { return iDurable >= aTicket || iFailed; });
+            if (iDurable < aTicket)
+                throw os_file_error{ "failed to write log '" + iFile.path().generic_string() + "'" };
+        }
+        // Wait until everything appended so far is durable.
+        void wait_all_durable()
+        {
+            std::unique_lock lock{ iMutex };
+            iDurableChanged.wait(lock, [&]() { return iDurable >= iAppended || iFailed; });
+            if (iDurable < iAppended)
+                throw os_file_error{ "failed to write log '" + iFile.path().generic_string() + "'" };
+        }
+        // Discard the log once every page it covers is safely in the database file.
+        void reset()
+        {
+            std::unique_lock lock{ iMutex };
+            iDurableChanged.wait(lock, [&]() { return iDurable >= iAppended || iFailed; });
+            // records that never became durable were never checkpointed either, so the log must stay
+            if (iDurable < iAppended)
+                throw os_file_error{ "failed to write log '" + iFile.path().generic_string() + "'" };
+            iFile.truncate(0);
+            write_header();
+            iEnd = HEADER_SIZE;
+        }
+        // Visit every change of every complete transaction, in log order; returns where the valid log ends.
+        template <typename Visitor>
+        std::uint64_t replay(Visitor aVisitor) const
+        {
+            std::vector<std::uint8_t> log(static_cast<std::size_t>(iFile.size()));
+            log.resize(iFile.read_at(0, log.data(), log.size()));
+            std::size_t position = HEADER_SIZE;
+            while (position + sizeof(little_uint32_buf_t) <= log.size())
+            {
+                auto const bodyLength = read<little_uint32_buf_t>(log, position);
+                std::size_t const end = position + sizeof(little_uint32_buf_t) + bodyLength + sizeof(little_uint64_buf_t);
+                if (bodyLength < sizeof(little_uint64_buf_t) + sizeof(little_uint32_buf_t) || end > log.size())
+                    break;
+                auto const checksum = read<little_uint64_buf_t>(log, end - sizeof(little_uint64_buf_t));
+                if (checksum != fnv1a(&log[position], end - position - sizeof(little_uint64_buf_t)))
+                    break;
+                std::size_t cursor = position + sizeof(little_uint32_buf_t);
+                lsn_t const lsn = read<little_uint64_buf_t>(log, cursor);
+                cursor += sizeof(little_uint64_buf_t);
+                auto const changeCount = read<little_uint32_buf_t>(log, cursor);
+                cursor += sizeof(little_uint32_buf_t);
+                for (std::uint32_t change = 0; change < changeCount; ++change)
+                {
+                    auto const address = read<little_uint64_buf_t>(log, cursor);
+                    auto const offset = read<little_uint16_buf_t>(log, cursor + 8);
+                    auto const length = read<little_uint16_buf_t>(log, cursor + 10);
+                    cursor += 12;
+                    aVisitor(lsn, address, offset, &log[cursor], length);
+                    cursor += length;
+                }
+                position = end;
+            }
+            return std::max<std::uint64_t>(position, HEADER_SIZE);
+        }
+    private:
+        template <typename Buffer>
+        static auto read(std::vector<std::uint8_t> const& aLog, std::size_t aPosition)
+        {
+            Buffer value;
+            std::memcpy(value.data(), &aLog[aPosition], sizeof(value));
+            return value.value();
+        }
+        static std::uint64_t fnv1a(void const* aData, std::size_t aLength)
+        {
+            auto const* bytes = static_cast<std::uint8_t const*>(aData);
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            for (std::size_t index = 0; index < aLength; ++index)
+                hash = (hash ^ bytes[index]) * 0x100000001b3ull;
+            return hash;
+        }
+        void append_bytes(void const* aData, std::size_t aLength)
+        {
+            auto const* const bytes = static_cast<std::uint8_t const*>(aData);
+            iPending.insert(iPending.end(), bytes, bytes + aLength);
+        }
+        void write_header()
+        {
+            little_uint64_buf_t const header[2] = { little_uint64_buf_t{ LOG_MAGIC }, little_uint64_buf_t{ iNextLsn } };
+            iFile.write_at(0, header, sizeof(header));
+            iFile.sync();
+        }
+        void flush_loop()
+        {
+            std::unique_lock lock{ iMutex };
+            for (;;)
+            {
+                iWork.wait(lock, [&]() { return iStopping || !iPending.empty(); });
+                if (iPending.empty())
+                    return;
+                std::swap(iPending, iWriting);
+                auto const target = iAppended;
+                auto const targetLsn = iAppendedLsn;
+                auto const offset = iEnd;
+                lock.unlock();
+                bool written = true;
+                try
+                {
+                    iFile.write_at(offset, iWriting.data(), iWriting.size());
+                    iFile.sync();
+                }
+                catch (...)
+                {
+                    written = false;
+                }
+                lock.lock();
+                if (written)
+                {
+                    iEnd += iWriting.size();
+                    iDurable = target;
+                    iDurableLsn = targetLsn;
+                }
+                else
+                    iFailed = true;
+                iWriting.clear();
+                iDurableChanged.notify_all();
+            }
+        }
+    private:
+        mutable std::mutex iMutex;
+        std::condition_variable iWork;
+        std::condition_variable iDurableChanged;
+        os_file iFile;
+        lsn_t iNextLsn;
+        std::vector<std::uint8_t> iPending;
+        std::vector<std::uint8_t> iWriting;
+        ticket_t iAppended;
+        ticket_t iDurable;
+        lsn_t iAppendedLsn;
+        lsn_t iDurableLsn;
+        std::uint64_t iEnd;
+        bool iStopping;
+        bool iFailed = false;
+        std::thread iFlusher;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <neodb/file_database.hpp>
+#include <neodb/protocol.hpp>
+#include <worker_pool.hpp>
+#include <session.hpp>
+
+namespace neodb
+{
+    struct unknown_table : std::runtime_error { unknown_table() : std::runtime_error{ "neodb::unknown_table" } {} };
+    struct table_exists : std::runtime_error { table_exists() : std::runtime_error{ "neodb::table_exists" } {} };
+
+    // Executes protocol requests against a database. The rows of a Find or Scan response are not copied:
+    // the reply references them in the buffer pool frames holding them, which stay pinned until the
+    // response has been written (rows are never changed in place once inserted). A response pins at most
+    // MAXIMUM_PINNED_PAGES pages, a scan stopping early, with batch_flags::More set, when it would need
+    // more; rows of tables with columnar storage have to be gathered so they are copied instead.
+    class database_service
+    {
+    public:
+        static constexpr std::size_t MAXIMUM_BATCH_ROWS = 65536;
+        static constexpr std::size_t MAXIMUM_PINNED_PAGES = 64;
+    public:
+        database_service(std::filesystem::path const& aDatabasePath, std::size_t aBufferPoolPages, worker_pool& aWorkers, std::size_t aMorselsPerWorker);
+    public:
+        reply handle(message const& aRequest);
+    private:
+        class row_sender
+        {
+        public:
+            row_sender(database_service& aService, i_table const& aTable, reply& aReply);
+        public:
+            // false if the row's page cannot be pinned without exceeding MAXIMUM_PINNED_PAGES
+            bool send(page::pointer_type aRow);
+        private:
+            database_service& iService;
+            i_table const& iTable;
+            reply& iReply;
+            std::size_t const iRowSize;
+            std::map<page::pointer_type, std::shared_ptr<pinned_page>> iPins;
+        };
+    private:
+        reply create_table(protocol::reader& aRequest);
+        reply describe_table(protocol::reader& aRequest);
+        reply insert(protocol::reader& aRequest);
+        reply bulk_insert(protocol::reader& aRequest);
+        reply find(protocol::reader& aRequest);
+        reply scan(protocol::reader& aRequest);
+        reply commit();
+        reply count(protocol::reader& aRequest);
+        i_table& table(std::string const& aName);
+        static std::uint8_t const* rows(protocol::reader& aRequest, i_table const& aTable, std::uint32_t& aCount);
+    private:
+        file_database iDatabase;
+        worker_pool& iWorkers;
+        std::size_t const iMorselsPerWorker;
+        std::shared_mutex iTablesMutex;
+        std::unordered_map<std::string, i_table*> iTables;
+    };
+}
\ No newline at end of file
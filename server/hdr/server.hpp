@@ -1,52 +1,86 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#pragma once
-
-#include <filesystem>
-#include <neolib/file/json.hpp>
-
-namespace neodb
-{
-    class server
-    {
-    public:
-        server(std::filesystem::path const& aConfigFile = "/etc/opt/neodb/server.rjson");
-    private:
-        neolib::rjson iConfig;
-        std::filesystem::path iDbRoot;
-        std::string iHostIp;
-        unsigned short iHostPort;
-    };
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <neolib/file/json.hpp>
+#include <worker_pool.hpp>
+#include <session.hpp>
+#include <database_service.hpp>
+
+namespace neodb
+{
+    // Listens on host_ip:host_port. Connections are spread round robin over one io_context per I/O
+    // thread (io_threads, zero for one per core), each run by a single thread, so a session's socket
+    // I/O never migrates between cores; requests are executed on a separate worker pool
+    // (worker_threads, worker_queue_limit) so that slow requests never hold up socket I/O. Requests are
+    // served from the database in db_root by default, which splits scans into up to morsels_per_worker
+    // morsels per worker thread.
+    class server
+    {
+    public:
+        server(std::filesystem::path const& aConfigFile = "/etc/opt/neodb/server.rjson");
+        ~server();
+    public:
+        boost::asio::ip::tcp::endpoint local_endpoint() const;
+        void set_request_handler(request_handler aHandler);
+        // serve until stop() is called or the process is sent SIGINT or SIGTERM
+        void run();
+        void stop();
+    private:
+        void accept();
+    private:
+        neolib::rjson iConfig;
+        std::filesystem::path iDbRoot;
+        std::string iHostIp;
+        unsigned short iHostPort;
+        std::size_t iBufferPoolPages;
+        std::size_t iPipelineLimit;
+        worker_pool iWorkers;
+        // destroyed after the I/O contexts as replies not yet written keep pages of it pinned
+        database_service iService;
+        std::vector<std::unique_ptr<boost::asio::io_context>> iIoContexts;
+        std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> iWork;
+        boost::asio::ip::tcp::acceptor iAcceptor;
+        boost::asio::signal_set iSignals;
+        std::size_t iNextContext;
+        request_handler iHandler;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <neodb/protocol.hpp>
+#include <worker_pool.hpp>
+
+namespace neodb
+{
+    enum class response_status : std::uint8_t
+    {
+        Ok      = 0x00,
+        Busy    = 0x01, // the worker pool's queue was full; the request was not executed
+        Error   = 0x02  // the request failed; the payload holds the reason as text
+    };
+
+    // A response payload as a list of byte ranges, sent with one gathered write. Bytes added with copy()
+    // are owned by the reply; bytes added with reference() are sent from where they are, so they must
+    // stay valid and unchanged until the reply is destroyed, which whatever is passed to hold() (a
+    // pinned page, say) ensures. Adjacent ranges are merged.
+    class reply
+    {
+    public:
+        reply() = default;
+        reply(message aPayload);
+        reply(reply&&) = default;
+        reply& operator=(reply&&) = default;
+    public:
+        std::size_t size() const;
+        std::vector<boost::asio::const_buffer> const& buffers() const;
+        void copy(void const* aData, std::size_t aSize);
+        void reference(void const* aData, std::size_t aSize);
+        void hold(std::shared_ptr<void> aResource);
+    private:
+        static constexpr std::size_t BLOCK_CAPACITY = 4096;
+    private:
+        std::deque<message> iBlocks;
+        std::vector<boost::asio::const_buffer> iBuffers;
+        std::vector<std::shared_ptr<void>> iHeld;
+        std::size_t iSize = 0u;
+    };
+
+    // Handles one request on a worker thread, returning the response payload.
+    typedef std::function<reply(message const& aRequest)> request_handler;
+
+    // One client connection. Requests are frames of a 32-bit little-endian payload length followed by
+    // the payload; responses add a status byte between the length and the payload. A client may send
+    // requests without waiting for responses: each request read is handed to the worker pool and the
+    // next is read at once, up to a limit of requests in flight, and responses are written back in
+    // request order, as many as are ready per write; a client that shuts down its sending side still gets
+    // the responses to the requests it sent. All of a session's handlers run on its socket's
+    // io_context, which only one thread runs, so the session needs no locking of its own.
+    class session : public std::enable_shared_from_this<session>
+    {
+    public:
+        static constexpr std::size_t MAXIMUM_REQUEST_SIZE = 64 * 1024 * 1024;
+    public:
+        session(boost::asio::ip::tcp::socket aSocket, worker_pool& aWorkers, request_handler const& aHandler, std::size_t aPipelineLimit);
+    public:
+        void start();
+    private:
+        void read_header();
+        void read_payload();
+        void dispatch(message aRequest);
+        void complete(std::uint64_t aSequence, response_status aStatus, reply aResponse);
+        void write();
+        void end_of_requests(boost::system::error_code const& aError);
+        void close();
+        std::size_t in_flight() const;
+    private:
+        struct response
+        {
+            std::array<std::uint8_t, 5> header;
+            reply payload;
+        };
+    private:
+        boost::asio::ip::tcp::socket iSocket;
+        worker_pool& iWorkers;
+        request_handler const& iHandler;
+        std::size_t const iPipelineLimit;
+        std::array<std::uint8_t, 4> iHeader;
+        message iRequest;
+        std::uint64_t iNextRequest;
+        std::uint64_t iNextResponse;
+        std::map<std::uint64_t, response> iReady;
+        std::deque<response> iWriting;
+        bool iReadPaused;
+        bool iDraining;
+        bool iClosed;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace neodb
+{
+    // A work-stealing thread pool. Each worker has its own deque: tasks a worker creates go on the back
+    // of its own deque and it takes them back from there, while tasks posted from outside the pool are
+    // dealt round robin over the deques; a worker whose deque is empty steals from the front of the
+    // others' before going to sleep. Each deque has its own lock so workers never contend on a global
+    // one. Posted work is refused rather than queued without limit so that an overloaded server answers
+    // "busy" promptly instead of letting every queued request's latency grow.
+    class worker_pool
+    {
+    public:
+        typedef std::function<void()> task;
+    public:
+        worker_pool(std::size_t aThreads, std::size_t aQueueLimit);
+        ~worker_pool();
+    public:
+        std::size_t thread_count() const;
+        // queue a task unless the queue limit is reached or the pool is stopping
+        bool try_post(task aTask);
+        // Call aMorsel(0) to aMorsel(aCount - 1), in parallel, returning once all the calls have returned
+        // (rethrowing the first exception thrown by any of them). The calling thread works through the
+        // morsels too, so a task may call this; idle workers join in by stealing helper tasks from it.
+        void parallel_for(std::size_t aCount, std::function<void(std::size_t)> const& aMorsel);
+        // finish the tasks already queued then join the threads
+        void stop();
+    private:
+        struct alignas(64) worker_queue
+        {
+            std::mutex mutex;
+            std::deque<task> tasks;
+        };
+    private:
+        void push(task aTask);
+        bool try_take(std::size_t aWorker, task& aTask);
+        void work(std::size_t aWorker);
+    private:
+        std::size_t const iQueueLimit;
+        std::vector<std::unique_ptr<worker_queue>> iQueues;
+        std::atomic<std::size_t> iQueued;
+        std::atomic<std::size_t> iNextQueue;
+        std::atomic<std::size_t> iSleeping;
+        std::atomic<bool> iStopping;
+        std::mutex iIdleMutex;
+        std::condition_variable iIdle;
+        std::vector<std::thread> iThreads;
+    };
+}
\ No newline at end of file
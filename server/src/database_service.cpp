@@ -0,0 +1,323 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <atomic>
+#include <mutex>
+#include <database_service.hpp>
+
+namespace neodb
+{
+    database_service::database_service(std::filesystem::path const& aDatabasePath, std::size_t aBufferPoolPages, worker_pool& aWorkers, std::size_t aMorselsPerWorker) :
+        iDatabase{ aDatabasePath, aBufferPoolPages },
+        iWorkers{ aWorkers },
+        iMorselsPerWorker{ std::max<std::size_t>(aMorselsPerWorker, 1u) }
+    {
+        for (auto const& existing : iDatabase.tables())
+            iTables.emplace(existing->name().to_std_string(), &*existing);
+    }
+
+    reply database_service::handle(message const& aRequest)
+    {
+        protocol::reader request{ aRequest };
+        switch (request.get<protocol::opcode>())
+        {
+        case protocol::opcode::CreateTable:
+            return create_table(request);
+        case protocol::opcode::DescribeTable:
+            return describe_table(request);
+        case protocol::opcode::Insert:
+            return insert(request);
+        case protocol::opcode::BulkInsert:
+            return bulk_insert(request);
+        case protocol::opcode::Find:
+            return find(request);
+        case protocol::opcode::Scan:
+            return scan(request);
+        case protocol::opcode::Commit:
+            return commit();
+        case protocol::opcode::Count:
+            return count(request);
+        default:
+            throw bad_message();
+        }
+    }
+
+    database_service::row_sender::row_sender(database_service& aService, i_table const& aTable, reply& aReply) :
+        iService{ aService }, iTable{ aTable }, iReply{ aReply }, iRowSize{ aTable.row_layout().size() }
+    {
+    }
+
+    bool database_service::row_sender::send(page::pointer_type aRow)
+    {
+        if (iTable.options().storage == table_storage::Columns)
+        {
+            std::vector<std::uint8_t> row(iRowSize);
+            iTable.read(aRow, row.data());
+            iReply.copy(row.data(), row.size());
+            return true;
+        }
+        auto const pageAddress = aRow - aRow % page::size;
+        auto pin = iPins.find(pageAddress);
+        if (pin == iPins.end())
+        {
+            if (iPins.size() == MAXIMUM_PINNED_PAGES)
+                return false;
+            pin = iPins.emplace(pageAddress, std::make_shared<pinned_page>(iService.iDatabase, pageAddress)).first;
+            iReply.hold(pin->second);
+        }
+        iReply.reference(record_payload(**pin->second, aRow), iRowSize);
+        return true;
+    }
+
+    reply database_service::create_table(protocol::reader& aRequest)
+    {
+        auto const definition = protocol::read_table_definition(aRequest);
+        std::unique_lock lock{ iTablesMutex };
+        auto const name = definition.schema.name().to_std_string();
+        if (iTables.find(name) != iTables.end())
+            throw table_exists();
+        iDatabase.create_table(definition.schema, definition.options);
+        iTables.emplace(name, &*iDatabase.tables().back());
+        return {};
+    }
+
+    reply database_service::describe_table(protocol::reader& aRequest)
+    {
+        auto const& existing = table(aRequest.get_string());
+        message result;
+        protocol::writer writer{ result };
+        protocol::write_table_definition(writer, existing.schema(), existing.options());
+        return reply{ std::move(result) };
+    }
+
+    reply database_service::insert(protocol::reader& aRequest)
+    {
+        auto& target = table(aRequest.get_string());
+        std::uint32_t count;
+        auto const data = rows(aRequest, target, count);
+        auto const rowSize = target.row_layout().size();
+        message result;
+        protocol::writer{ result }.put(count);
+        result.resize(result.size() + protocol::bitmap_size(count));
+        auto const inserted = &result[sizeof(std::uint32_t)];
+        for (std::uint32_t index = 0; index < count; ++index)
+        {
+            try
+            {
+                target.insert(data + index * rowSize);
+                protocol::set_bit(inserted, index);
+            }
+            catch (duplicate_key const&)
+            {
+            }
+        }
+        return reply{ std::move(result) };
+    }
+
+    reply database_service::bulk_insert(protocol::reader& aRequest)
+    {
+        auto& target = table(aRequest.get_string());
+        std::uint32_t count;
+        auto const data = rows(aRequest, target, count);
+        target.bulk_insert(data, count);
+        return {};
+    }
+
+    reply database_service::find(protocol::reader& aRequest)
+    {
+        auto const& target = table(aRequest.get_string());
+        auto const& layout = target.row_layout();
+        if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+            throw no_primary_index();
+        auto const keyWidth = index_key_width(layout.field(*layout.primary_key()));
+        auto const count = aRequest.get<std::uint32_t>();
+        if (count > MAXIMUM_BATCH_ROWS || aRequest.remaining() != static_cast<std::size_t>(count) * keyWidth)
+            throw bad_message();
+        auto const keys = aRequest.get_bytes(aRequest.remaining());
+        // the header and bitmap are filled in once the rows following them are known
+        reply result;
+        auto const header = std::make_shared<protocol::row_batch_header>();
+        auto const found = std::make_shared<message>(protocol::bitmap_size(count));
+        result.reference(header.get(), sizeof(*header));
+        result.reference(found->data(), found->size());
+        result.hold(header);
+        result.hold(found);
+        // The versions referenced in place stay put until the reply has been sent. Rows are found as
+        // their newest versions, not as of the snapshot, which leaves out writes acknowledged while an
+        // older one is still in progress; a lookup sees every insert acknowledged before it.
+        auto const current = std::make_shared<snapshot>(iDatabase.versions());
+        result.hold(current);
+        row_sender sender{ *this, target, result };
+        std::uint32_t rowCount = 0u;
+        for (std::uint32_t index = 0; index < count; ++index)
+        {
+            page::pointer_type row;
+            if (!target.find(keys + index * keyWidth, row, LATEST_VERSION))
+                continue;
+            if (!sender.send(row))
+            {
+                // out of pins: copy the row instead
+                std::vector<std::uint8_t> copy(layout.size());
+                target.read(row, copy.data());
+                result.copy(copy.data(), copy.size());
+            }
+            protocol::set_bit(found->data(), index);
+            ++rowCount;
+        }
+        header->rowSize = static_cast<std::uint32_t>(layout.size());
+        header->rowCount = rowCount;
+        header->flags = 0u;
+        return result;
+    }
+
+    reply database_service::scan(protocol::reader& aRequest)
+    {
+        auto const& target = table(aRequest.get_string());
+        auto const& layout = target.row_layout();
+        if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+            throw no_primary_index();
+        auto const& keyField = layout.field(*layout.primary_key());
+        auto const keyWidth = index_key_width(keyField);
+        auto const flags = aRequest.get<std::uint8_t>();
+        auto const lowKey = (flags & protocol::HasLowKey) ? aRequest.get_bytes(keyWidth) : nullptr;
+        auto const highKey = (flags & protocol::HasHighKey) ? aRequest.get_bytes(keyWidth) : nullptr;
+        auto limit = static_cast<std::size_t>(aRequest.get<std::uint32_t>());
+        if (limit == 0u || limit > MAXIMUM_BATCH_ROWS)
+            limit = MAXIMUM_BATCH_ROWS;
+        reply result;
+        auto const header = std::make_shared<protocol::row_batch_header>();
+        result.reference(header.get(), sizeof(*header));
+        result.hold(header);
+        // the versions referenced in place stay put until the reply has been sent
+        auto const current = std::make_shared<snapshot>(iDatabase.versions());
+        result.hold(current);
+        row_sender sender{ *this, target, result };
+        std::uint32_t rowCount = 0u;
+        bool more = false;
+        bool first = true;
+        std::vector<std::uint8_t> rowKey(keyWidth);
+        target.scan(lowKey, highKey, [&](page::pointer_type aRow)
+        {
+            if (first && lowKey && (flags & protocol::ExcludeLowKey))
+            {
+                first = false;
+                std::vector<std::uint8_t> row(layout.size());
+                target.read(aRow, row.data());
+                index_key_from_row(keyField, row.data(), rowKey.data());
+                if (std::memcmp(rowKey.data(), lowKey, keyWidth) == 0)
+                    return true;
+            }
+            first = false;
+            if (rowCount == limit || !sender.send(aRow))
+            {
+                more = true;
+                return false;
+            }
+            ++rowCount;
+            return true;
+        }, current->as_of());
+        header->rowSize = static_cast<std::uint32_t>(layout.size());
+        header->rowCount = rowCount;
+        header->flags = more ? std::uint8_t{ protocol::More } : std::uint8_t{ 0u };
+        return result;
+    }
+
+    reply database_service::commit()
+    {
+        iDatabase.collect_garbage();
+        iDatabase.commit();
+        return {};
+    }
+
+    reply database_service::count(protocol::reader& aRequest)
+    {
+        auto const& target = table(aRequest.get_string());
+        auto const& layout = target.row_layout();
+        if (!layout.primary_key() || !is_indexable(layout.field(*layout.primary_key())))
+            throw no_primary_index();
+        auto const keyWidth = index_key_width(layout.field(*layout.primary_key()));
+        auto const flags = aRequest.get<std::uint8_t>();
+        auto const lowKey = (flags & protocol::HasLowKey) ? aRequest.get_bytes(keyWidth) : nullptr;
+        auto const highKey = (flags & protocol::HasHighKey) ? aRequest.get_bytes(keyWidth) : nullptr;
+        // morsel i covers [bounds[i], bounds[i + 1]), the first and last bounds being the requested ones
+        std::vector<std::vector<std::uint8_t>> bounds{ {} };
+        if (lowKey)
+            bounds.back().assign(lowKey, lowKey + keyWidth);
+        auto const boundaries = target.partition(iWorkers.thread_count() * iMorselsPerWorker);
+        for (std::size_t offset = 0; offset < boundaries.size(); offset += keyWidth)
+        {
+            auto const boundary = &boundaries[offset];
+            if ((!lowKey || std::memcmp(boundary, lowKey, keyWidth) > 0) && (!highKey || std::memcmp(boundary, highKey, keyWidth) <= 0))
+                bounds.emplace_back(boundary, boundary + keyWidth);
+        }
+        // every morsel counts the same snapshot of the table
+        snapshot current{ iDatabase.versions() };
+        std::atomic<std::uint64_t> total = 0u;
+        iWorkers.parallel_for(bounds.size(), [&](std::size_t aMorsel)
+        {
+            auto const low = bounds[aMorsel].empty() ? nullptr : bounds[aMorsel].data();
+            std::vector<std::uint8_t> high;
+            if (aMorsel + 1 < bounds.size())
+            {
+                high = bounds[aMorsel + 1];
+                previous_index_key(high.data(), keyWidth);
+            }
+            else if (highKey)
+                high.assign(highKey, highKey + keyWidth);
+            std::uint64_t rows = 0u;
+            target.scan(low, high.empty() ? nullptr : high.data(), [&](page::pointer_type) { ++rows; return true; }, current.as_of());
+            total += rows;
+        });
+        message result;
+        protocol::writer{ result }.put(total.load());
+        return reply{ std::move(result) };
+    }
+
+    i_table& database_service::table(std::string const& aName)
+    {
+        std::shared_lock lock{ iTablesMutex };
+        auto existing = iTables.find(aName);
+        if (existing == iTables.end())
+            throw unknown_table();
+        return *existing->second;
+    }
+
+    std::uint8_t const* database_service::rows(protocol::reader& aRequest, i_table const& aTable, std::uint32_t& aCount)
+    {
+        aCount = aRequest.get<std::uint32_t>();
+        if (aCount > MAXIMUM_BATCH_ROWS || aRequest.remaining() != static_cast<std::size_t>(aCount) * aTable.row_layout().size())
+            throw bad_message();
+        return aRequest.get_bytes(aRequest.remaining());
+    }
+}
\ No newline at end of file
@@ -1,47 +1,139 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#include <tuple>
-#include <server.hpp>
-
-namespace neodb
-{
-    server::server(std::filesystem::path const& aConfigFile) : 
-        iConfig{ aConfigFile.generic_string() },
-        iDbRoot{ iConfig.at("db_root").as<neolib::rjson_string>().to_std_string() },
-        iHostIp{ iConfig.at("host_ip").as<neolib::rjson_string>().to_std_string() },
-        iHostPort{ static_cast<unsigned short>(iConfig.at("host_port").as<int32_t>()) }
-    {
-    }
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <tuple>
+#include <algorithm>
+#include <server.hpp>
+
+namespace neodb
+{
+    namespace
+    {
+        std::size_t thread_count(std::int32_t aConfigured)
+        {
+            return aConfigured > 0 ? static_cast<std::size_t>(aConfigured) : std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::vector<std::unique_ptr<boost::asio::io_context>> create_io_contexts(std::size_t aCount)
+        {
+            std::vector<std::unique_ptr<boost::asio::io_context>> result;
+            for (std::size_t index = 0; index < aCount; ++index)
+                result.push_back(std::make_unique<boost::asio::io_context>(1));
+            return result;
+        }
+    }
+
+    server::server(std::filesystem::path const& aConfigFile) : 
+        iConfig{ aConfigFile.generic_string() },
+        iDbRoot{ iConfig.at("db_root").as<neolib::rjson_string>().to_std_string() },
+        iHostIp{ iConfig.at("host_ip").as<neolib::rjson_string>().to_std_string() },
+        iHostPort{ static_cast<unsigned short>(iConfig.at("host_port").as<int32_t>()) },
+        iBufferPoolPages{ static_cast<std::size_t>(iConfig.at("buffer_pool_pages").as<int32_t>()) },
+        iPipelineLimit{ static_cast<std::size_t>(iConfig.at("pipeline_limit").as<int32_t>()) },
+        iWorkers{ thread_count(iConfig.at("worker_threads").as<int32_t>()), static_cast<std::size_t>(iConfig.at("worker_queue_limit").as<int32_t>()) },
+        iService{ iDbRoot / "neodb.db", iBufferPoolPages, iWorkers, static_cast<std::size_t>(iConfig.at("morsels_per_worker").as<int32_t>()) },
+        iIoContexts{ create_io_contexts(thread_count(iConfig.at("io_threads").as<int32_t>())) },
+        iAcceptor{ *iIoContexts[0] },
+        iSignals{ *iIoContexts[0], SIGINT, SIGTERM },
+        iNextContext{ 0u },
+        iHandler{ [this](message const& aRequest) { return iService.handle(aRequest); } }
+    {
+        for (auto& context : iIoContexts)
+            iWork.push_back(boost::asio::make_work_guard(*context));
+        boost::asio::ip::tcp::endpoint const endpoint{ boost::asio::ip::make_address(iHostIp), iHostPort };
+        iAcceptor.open(endpoint.protocol());
+        iAcceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address{ true });
+        iAcceptor.bind(endpoint);
+        iAcceptor.listen(boost::asio::socket_base::max_listen_connections);
+        iSignals.async_wait([this](boost::system::error_code const& aError, int)
+        {
+            if (!aError)
+                stop();
+        });
+        accept();
+    }
+
+    server::~server()
+    {
+        stop();
+        iWorkers.stop();
+    }
+
+    boost::asio::ip::tcp::endpoint server::local_endpoint() const
+    {
+        return iAcceptor.local_endpoint();
+    }
+
+    void server::set_request_handler(request_handler aHandler)
+    {
+        iHandler = std::move(aHandler);
+    }
+
+    void server::run()
+    {
+        std::vector<std::thread> ioThreads;
+        for (std::size_t index = 1; index < iIoContexts.size(); ++index)
+            ioThreads.emplace_back([&context = *iIoContexts[index]]() { context.run(); });
+        iIoContexts[0]->run();
+        for (auto& thread : ioThreads)
+            thread.join();
+    }
+
+    void server::stop()
+    {
+        boost::asio::post(iAcceptor.get_executor(), [this]()
+        {
+            boost::system::error_code ignored;
+            iAcceptor.close(ignored);
+            iSignals.cancel(ignored);
+        });
+        iWork.clear();
+        for (auto& context : iIoContexts)
+            context->stop();
+    }
+
+    void server::accept()
+    {
+        auto& context = *iIoContexts[iNextContext];
+        iNextContext = (iNextContext + 1) % iIoContexts.size();
+        iAcceptor.async_accept(context, [this](boost::system::error_code const& aError, boost::asio::ip::tcp::socket aSocket)
+        {
+            if (aError == boost::asio::error::operation_aborted)
+                return;
+            if (!aError)
+                std::make_shared<session>(std::move(aSocket), iWorkers, iHandler, iPipelineLimit)->start();
+            accept();
+        });
+    }
 }
\ No newline at end of file
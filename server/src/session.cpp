@@ -0,0 +1,277 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string>
+#include <session.hpp>
+
+namespace neodb
+{
+    namespace
+    {
+        std::uint32_t load_length(std::uint8_t const* aBytes)
+        {
+            return static_cast<std::uint32_t>(aBytes[0]) | static_cast<std::uint32_t>(aBytes[1]) << 8 |
+                static_cast<std::uint32_t>(aBytes[2]) << 16 | static_cast<std::uint32_t>(aBytes[3]) << 24;
+        }
+
+        void store_length(std::uint8_t* aBytes, std::uint32_t aLength)
+        {
+            for (std::size_t index = 0; index < 4; ++index)
+                aBytes[index] = static_cast<std::uint8_t>(aLength >> (index * 8));
+        }
+    }
+
+    reply::reply(message aPayload)
+    {
+        if (!aPayload.empty())
+        {
+            iSize = aPayload.size();
+            iBuffers.push_back(boost::asio::buffer(aPayload));
+            iBlocks.push_back(std::move(aPayload));
+        }
+    }
+
+    std::size_t reply::size() const
+    {
+        return iSize;
+    }
+
+    std::vector<boost::asio::const_buffer> const& reply::buffers() const
+    {
+        return iBuffers;
+    }
+
+    void reply::copy(void const* aData, std::size_t aSize)
+    {
+        if (aSize == 0u)
+            return;
+        // append to the last block while it has room so that its bytes never move
+        bool const extendLast = !iBlocks.empty() && !iBuffers.empty() &&
+            static_cast<std::uint8_t const*>(iBuffers.back().data()) + iBuffers.back().size() == iBlocks.back().data() + iBlocks.back().size() &&
+            iBlocks.back().capacity() - iBlocks.back().size() >= aSize;
+        if (!extendLast)
+        {
+            iBlocks.emplace_back().reserve(std::max(aSize, BLOCK_CAPACITY));
+            iBuffers.emplace_back(iBlocks.back().data(), 0u);
+        }
+        auto& block = iBlocks.back();
+        auto const bytes = static_cast<std::uint8_t const*>(aData);
+        block.insert(block.end(), bytes, bytes + aSize);
+        iBuffers.back() = boost::asio::const_buffer{ iBuffers.back().data(), iBuffers.back().size() + aSize };
+        iSize += aSize;
+    }
+
+    void reply::reference(void const* aData, std::size_t aSize)
+    {
+        if (aSize == 0u)
+            return;
+        if (!iBuffers.empty() && static_cast<std::uint8_t const*>(iBuffers.back().data()) + iBuffers.back().size() == aData)
+            iBuffers.back() = boost::asio::const_buffer{ iBuffers.back().data(), iBuffers.back().size() + aSize };
+        else
+            iBuffers.emplace_back(aData, aSize);
+        iSize += aSize;
+    }
+
+    void reply::hold(std::shared_ptr<void> aResource)
+    {
+        iHeld.push_back(std::move(aResource));
+    }
+
+    session::session(boost::asio::ip::tcp::socket aSocket, worker_pool& aWorkers, request_handler const& aHandler, std::size_t aPipelineLimit) :
+        iSocket{ std::move(aSocket) },
+        iWorkers{ aWorkers },
+        iHandler{ aHandler },
+        iPipelineLimit{ std::max<std::size_t>(aPipelineLimit, 1u) },
+        iHeader{},
+        iNextRequest{ 0u },
+        iNextResponse{ 0u },
+        iReadPaused{ false },
+        iDraining{ false },
+        iClosed{ false }
+    {
+    }
+
+    void session::start()
+    {
+        boost::system::error_code ignored;
+        iSocket.set_option(boost::asio::ip::tcp::no_delay{ true }, ignored);
+        read_header();
+    }
+
+    void session::read_header()
+    {
+        if (in_flight() >= iPipelineLimit)
+        {
+            // resumed once a response has been written
+            iReadPaused = true;
+            return;
+        }
+        boost::asio::async_read(iSocket, boost::asio::buffer(iHeader),
+            [self = shared_from_this()](boost::system::error_code const& aError, std::size_t)
+            {
+                if (aError)
+                    self->end_of_requests(aError);
+                else
+                    self->read_payload();
+            });
+    }
+
+    void session::read_payload()
+    {
+        auto const length = load_length(iHeader.data());
+        if (length > MAXIMUM_REQUEST_SIZE)
+        {
+            close();
+            return;
+        }
+        iRequest.resize(length);
+        boost::asio::async_read(iSocket, boost::asio::buffer(iRequest),
+            [self = shared_from_this()](boost::system::error_code const& aError, std::size_t)
+            {
+                if (aError)
+                {
+                    self->close();
+                    return;
+                }
+                self->dispatch(std::move(self->iRequest));
+                self->read_header();
+            });
+    }
+
+    void session::dispatch(message aRequest)
+    {
+        auto const sequence = iNextRequest++;
+        auto executed = iWorkers.try_post([self = shared_from_this(), sequence, request = std::move(aRequest)]()
+        {
+            response_status status = response_status::Ok;
+            reply result;
+            try
+            {
+                result = self->iHandler(request);
+            }
+            catch (std::exception const& e)
+            {
+                status = response_status::Error;
+                std::string const reason = e.what();
+                result = reply{ message{ reason.begin(), reason.end() } };
+            }
+            catch (...)
+            {
+                status = response_status::Error;
+            }
+            boost::asio::post(self->iSocket.get_executor(), [self, sequence, status, result = std::move(result)]() mutable
+            {
+                self->complete(sequence, status, std::move(result));
+            });
+        });
+        if (!executed)
+            complete(sequence, response_status::Busy, {});
+    }
+
+    void session::complete(std::uint64_t aSequence, response_status aStatus, reply aResponse)
+    {
+        if (iClosed)
+            return;
+        auto& ready = iReady[aSequence];
+        store_length(ready.header.data(), static_cast<std::uint32_t>(aResponse.size()));
+        ready.header[4] = static_cast<std::uint8_t>(aStatus);
+        ready.payload = std::move(aResponse);
+        if (iWriting.empty())
+            write();
+    }
+
+    void session::write()
+    {
+        // gather every response that is next in request order into one write
+        for (auto next = iReady.find(iNextResponse + iWriting.size()); next != iReady.end(); next = iReady.find(iNextResponse + iWriting.size()))
+        {
+            iWriting.push_back(std::move(next->second));
+            iReady.erase(next);
+        }
+        if (iWriting.empty())
+            return;
+        std::vector<boost::asio::const_buffer> buffers;
+        for (auto const& response : iWriting)
+        {
+            buffers.push_back(boost::asio::buffer(response.header));
+            buffers.insert(buffers.end(), response.payload.buffers().begin(), response.payload.buffers().end());
+        }
+        boost::asio::async_write(iSocket, buffers,
+            [self = shared_from_this()](boost::system::error_code const& aError, std::size_t)
+            {
+                if (aError)
+                {
+                    self->close();
+                    return;
+                }
+                self->iNextResponse += self->iWriting.size();
+                self->iWriting.clear();
+                if (self->iDraining && self->in_flight() == 0)
+                {
+                    self->close();
+                    return;
+                }
+                if (self->iReadPaused && self->in_flight() < self->iPipelineLimit)
+                {
+                    self->iReadPaused = false;
+                    self->read_header();
+                }
+                self->write();
+            });
+    }
+
+    void session::end_of_requests(boost::system::error_code const& aError)
+    {
+        if (aError != boost::asio::error::eof || in_flight() == 0)
+            close();
+        else
+            iDraining = true;
+    }
+
+    void session::close()
+    {
+        if (iClosed)
+            return;
+        iClosed = true;
+        boost::system::error_code ignored;
+        iSocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+        iSocket.close(ignored);
+        iReady.clear();
+    }
+
+    std::size_t session::in_flight() const
+    {
+        return static_cast<std::size_t>(iNextRequest - iNextResponse);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,219 @@
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <exception>
+#include <worker_pool.hpp>
+
+namespace neodb
+{
+    namespace
+    {
+        struct current_worker
+        {
+            worker_pool const* pool = nullptr;
+            std::size_t index = 0u;
+        };
+
+        thread_local current_worker tCurrentWorker;
+    }
+
+    worker_pool::worker_pool(std::size_t aThreads, std::size_t aQueueLimit) :
+        iQueueLimit{ std::max<std::size_t>(aQueueLimit, 1u) }, iQueued{ 0u }, iNextQueue{ 0u }, iSleeping{ 0u }, iStopping{ false }
+    {
+        if (aThreads == 0)
+            aThreads = std::max(1u, std::thread::hardware_concurrency());
+        for (std::size_t index = 0; index < aThreads; ++index)
+            iQueues.push_back(std::make_unique<worker_queue>());
+        for (std::size_t index = 0; index < aThreads; ++index)
+            iThreads.emplace_back([this, index]() { work(index); });
+    }
+
+    worker_pool::~worker_pool()
+    {
+        stop();
+    }
+
+    std::size_t worker_pool::thread_count() const
+    {
+        return iThreads.size();
+    }
+
+    bool worker_pool::try_post(task aTask)
+    {
+        if (iStopping)
+            return false;
+        if (iQueued.fetch_add(1u) >= iQueueLimit)
+        {
+            iQueued.fetch_sub(1u);
+            return false;
+        }
+        push(std::move(aTask));
+        return true;
+    }
+
+    void worker_pool::parallel_for(std::size_t aCount, std::function<void(std::size_t)> const& aMorsel)
+    {
+        struct state
+        {
+            std::function<void(std::size_t)> const* morsel;
+            std::size_t count;
+            std::atomic<std::size_t> next{ 0u };
+            std::atomic<std::size_t> finished{ 0u };
+            std::mutex mutex;
+            std::condition_variable done;
+            std::exception_ptr error;
+        };
+        auto const shared = std::make_shared<state>();
+        shared->morsel = &aMorsel;
+        shared->count = aCount;
+        // Helpers claim morsels until none are left, so a helper that only runs after the last has been
+        // claimed returns at once, without touching aMorsel, which may be gone by then.
+        auto const run = [](state& aState)
+        {
+            for (auto index = aState.next++; index < aState.count; index = aState.next++)
+            {
+                try
+                {
+                    (*aState.morsel)(index);
+                }
+                catch (...)
+                {
+                    std::scoped_lock lock{ aState.mutex };
+                    if (!aState.error)
+                        aState.error = std::current_exception();
+                }
+                if (++aState.finished == aState.count)
+                {
+                    std::scoped_lock lock{ aState.mutex };
+                    aState.done.notify_all();
+                }
+            }
+        };
+        auto const helpers = std::min(aCount, thread_count()) - (aCount != 0u ? 1u : 0u);
+        for (std::size_t helper = 0; helper < helpers; ++helper)
+        {
+            iQueued.fetch_add(1u);
+            push([shared, run]() { run(*shared); });
+        }
+        run(*shared);
+        std::unique_lock lock{ shared->mutex };
+        shared->done.wait(lock, [&]() { return shared->finished == shared->count; });
+        if (shared->error)
+            std::rethrow_exception(shared->error);
+    }
+
+    void worker_pool::stop()
+    {
+        if (iStopping.exchange(true))
+            return;
+        {
+            std::scoped_lock lock{ iIdleMutex };
+        }
+        iIdle.notify_all();
+        for (auto& thread : iThreads)
+            thread.join();
+    }
+
+    // the caller has counted the task in iQueued
+    void worker_pool::push(task aTask)
+    {
+        auto const queue = tCurrentWorker.pool == this ? tCurrentWorker.index : iNextQueue++ % iQueues.size();
+        {
+            std::scoped_lock lock{ iQueues[queue]->mutex };
+            iQueues[queue]->tasks.push_back(std::move(aTask));
+        }
+        if (iSleeping != 0u)
+        {
+            {
+                std::scoped_lock lock{ iIdleMutex };
+            }
+            iIdle.notify_one();
+        }
+    }
+
+    bool worker_pool::try_take(std::size_t aWorker, task& aTask)
+    {
+        {
+            auto& own = *iQueues[aWorker];
+            std::scoped_lock lock{ own.mutex };
+            if (!own.tasks.empty())
+            {
+                aTask = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                iQueued.fetch_sub(1u);
+                return true;
+            }
+        }
+        for (std::size_t offset = 1; offset < iQueues.size(); ++offset)
+        {
+            auto& victim = *iQueues[(aWorker + offset) % iQueues.size()];
+            std::unique_lock lock{ victim.mutex, std::try_to_lock };
+            if (lock.owns_lock() && !victim.tasks.empty())
+            {
+                aTask = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                iQueued.fetch_sub(1u);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_pool::work(std::size_t aWorker)
+    {
+        tCurrentWorker = current_worker{ this, aWorker };
+        for (;;)
+        {
+            task next;
+            if (try_take(aWorker, next))
+            {
+                next();
+                continue;
+            }
+            if (iQueued != 0u)
+            {
+                // queued but not found: pushed a moment ago or its deque was locked
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock lock{ iIdleMutex };
+            ++iSleeping;
+            iIdle.wait(lock, [this]() { return iStopping || iQueued != 0u; });
+            --iSleeping;
+            if (iStopping && iQueued == 0u)
+                return;
+        }
+    }
+}
\ No newline at end of file
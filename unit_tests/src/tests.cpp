@@ -1,94 +1,2230 @@
-/*
- *  Copyright (c) 2021 Leigh Johnston.
- *
- *  All rights reserved.
- *
- *  Redistribution and use in source and binary forms, with or without
- *  modification, are permitted provided that the following conditions are
- *  met:
- *
- *     * Redistributions of source code must retain the above copyright
- *       notice, this list of conditions and the following disclaimer.
- *
- *     * Redistributions in binary form must reproduce the above copyright
- *       notice, this list of conditions and the following disclaimer in the
- *       documentation and/or other materials provided with the distribution.
- *
- *     * Neither the name of Leigh Johnston nor the names of any
- *       other contributors to this software may be used to endorse or
- *       promote products derived from this software without specific prior
- *       written permission.
- *
- *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
- *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
- *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
- *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
- *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
- *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
- *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
- *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
- *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
- *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
- *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
- // todo: use gtest
-#include <neodb/file_database.hpp>
-#include <neodb/memory_database.hpp>
-
-using namespace neodb;
-
-void test_file_database()
-{
-    std::filesystem::remove("/tmp/accounts.db");
-    {
-        file_database database{ "/tmp/accounts.db" };
-
-        create_table<primary_key<char_string<255>>>(
-            database,
-            "Companies"_s,
-            "Company Name"_s);
-
-        typedef int32_t currency;
-
-        create_table<primary_key<int32_t>, foreign_key<char_string<255>>, currency>(
-            database,
-            "Invoices"_s,
-            "Invoice Number"_s,
-            as_foreign_key<char_string<255>>{ "Company Name"_s, "Companies"_s, "Company Name"_s },
-            "Total"_s);
-    } 
-    {
-        file_database database{ "/tmp/accounts.db" };
-    }
-}
-
-void test_memory_database()
-{
-    memory_database database{ "Players" };
-
-    typedef int64_t score;
-
-    create_table<primary_key<string>, score>(
-        database,
-        "High Scores"_s,
-        "Player Name"_s,
-        "Score"_s);
-}
-
-int main()
-{
-    try
-    {
-        test_file_database();
-        test_memory_database();
-    }
-    catch (std::exception& e)
-    {
-        std::cerr << "Error: " << e.what() << std::endl;
-    }
-    catch (...)
-    {
-        std::cerr << "Error: unknown error" << std::endl;
-    }
+/*
+ *  Copyright (c) 2021 Leigh Johnston.
+ *
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ *     * Neither the name of Leigh Johnston nor the names of any
+ *       other contributors to this software may be used to endorse or
+ *       promote products derived from this software without specific prior
+ *       written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ *  IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ *  THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ *  PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ *  CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ *  EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ *  PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *  PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *  LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *  NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *  SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+ // todo: use gtest
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <neodb/file_database.hpp>
+#include <neodb/memory_database.hpp>
+#include <neodb/mmap_database.hpp>
+#include <neodb/btree_index.hpp>
+#include <neodb/index_key.hpp>
+#include <neodb/hash_index.hpp>
+#include <neodb/table_facade.hpp>
+#include <neodb/column_filter.hpp>
+#include <neodb/query.hpp>
+#include <neodb/table.hpp>
+#include <neodb/delimited_import.hpp>
+#include <neodb/protocol.hpp>
+#include <future>
+#include <session.hpp>
+#include <worker_pool.hpp>
+#include <database_service.hpp>
+#include <client.hpp>
+
+using namespace neodb;
+
+void test_check(bool aCondition, std::string const& aWhat)
+{
+    if (!aCondition)
+        throw std::runtime_error{ "test failed: " + aWhat };
+}
+
+class test_page_io : public i_page_io
+{
+public:
+    void read_page(page::pointer_type aAddress, page& aPage) override
+    {
+        ++reads;
+        aPage = pages.at(aAddress);
+    }
+    void write_page(page::pointer_type aAddress, page const& aPage) override
+    {
+        if (failWrites)
+            throw page_io_error();
+        ++writes;
+        pages[aAddress] = aPage;
+    }
+    void read_pages(page_read const* aReads, std::size_t aCount) override
+    {
+        ++batches;
+        for (std::size_t index = 0; index < aCount; ++index)
+            read_page(aReads[index].address, *aReads[index].destination);
+    }
+    void write_pages(page_write const* aWrites, std::size_t aCount) override
+    {
+        ++batches;
+        for (std::size_t index = 0; index < aCount; ++index)
+            write_page(aWrites[index].address, *aWrites[index].source);
+    }
+    void sync() override
+    {
+    }
+public:
+    std::map<std::uint64_t, page> pages;
+    std::size_t reads = 0;
+    std::size_t writes = 0;
+    std::size_t batches = 0;
+    bool failWrites = false;
+};
+
+void test_buffer_pool()
+{
+    test_page_io io;
+    buffer_pool pool{ io, 4 };
+    for (std::uint64_t address = page::size; address <= page::size * 8; address += page::size)
+    {
+        auto& newPage = pool.pin_new(address);
+        newPage.data[0] = static_cast<std::uint8_t>(address / page::size);
+        pool.unpin(address, true);
+    }
+    test_check(pool.stats().evictions == 4, "buffer pool evicts beyond capacity");
+    test_check(io.writes == 4, "buffer pool writes back dirty victims");
+    auto& first = pool.pin(page::size);
+    test_check(first.data[0] == 1, "buffer pool reads back evicted page");
+    pool.unpin(page::size, false);
+    pool.pin(page::size);
+    pool.unpin(page::size, false);
+    test_check(pool.stats().hits == 1 && pool.stats().misses == 1, "buffer pool hit/miss counters");
+    auto const batchesBeforeFlush = io.batches;
+    pool.flush();
+    test_check(io.pages.size() == 8, "buffer pool flush");
+    test_check(io.batches == batchesBeforeFlush + 1, "buffer pool flush is batched");
+    page::pointer_type const prefetch[] = { page::size * 5, page::size * 6, page::size * 7, page::size * 5 };
+    auto const readsBeforePrefetch = io.reads;
+    pool.prefetch(prefetch, std::size(prefetch));
+    test_check(io.reads - readsBeforePrefetch <= 3, "buffer pool prefetch reads each page once");
+    auto const readsAfterPrefetch = io.reads;
+    test_check(pool.pin(page::size * 6).data[0] == 6, "buffer pool prefetched page contents");
+    pool.unpin(page::size * 6, false);
+    test_check(io.reads == readsAfterPrefetch, "buffer pool prefetched page is resident");
+    auto const pinsBeforePeek = pool.stats().hits + pool.stats().misses;
+    page_peek peek;
+    bool const peeked = pool.peek(page::size * 6, peek) && peek.contents->data[0] == 6 && peek.unchanged();
+    test_check(peeked && pool.stats().hits + pool.stats().misses == pinsBeforePeek, "buffer pool peeks at a resident page without pinning it");
+    for (std::uint64_t address = page::size * 9; address <= page::size * 16; address += page::size)
+    {
+        pool.pin_new(address);
+        pool.unpin(address, true);
+    }
+    page_peek evicted;
+    test_check(!peek.unchanged() && !pool.peek(page::size * 6, evicted), "buffer pool peek fails once its frame is reused");
+    buffer_pool logged{ io, 2 };
+    for (std::uint64_t address = page::size; address <= page::size * 2; address += page::size)
+    {
+        logged.pin_new(address).header.lsn = 5u;
+        logged.unpin(address, true);
+    }
+    auto const writesBeforeLimit = io.writes;
+    bool exhausted = false;
+    try
+    {
+        logged.pin(page::size * 3);
+    }
+    catch (buffer_pool_exhausted const&)
+    {
+        exhausted = true;
+    }
+    test_check(exhausted && io.writes == writesBeforeLimit, "pages ahead of the durable log are not written back");
+    logged.set_durable_lsn(5u);
+    logged.pin(page::size * 3);
+    logged.unpin(page::size * 3, false);
+    test_check(io.writes == writesBeforeLimit + 1, "pages are written back once the log is durable");
+    buffer_pool interrupted{ io, 4 };
+    interrupted.pin(page::size);
+    interrupted.unpin(page::size, false);
+    for (std::uint64_t address = page::size * 20; address < page::size * 23; address += page::size)
+    {
+        interrupted.pin_new(address);
+        interrupted.unpin(address, true);
+    }
+    io.failWrites = true;
+    page::pointer_type const interruptedPrefetch[] = { page::size * 5, page::size * 6 };
+    bool prefetchFailed = false;
+    try
+    {
+        // the first page takes the clean frame, the second must write back a dirty one and fails
+        interrupted.prefetch(interruptedPrefetch, std::size(interruptedPrefetch));
+    }
+    catch (page_io_error const&)
+    {
+        prefetchFailed = true;
+    }
+    io.failWrites = false;
+    test_check(prefetchFailed && interrupted.pin(page::size * 5).data[0] == 5, "failed prefetch leaves no stale frame behind");
+    interrupted.unpin(page::size * 5, false);
+}
+
+void test_page_allocator()
+{
+    std::filesystem::remove("/tmp/pages.db");
+    {
+        file_database database{ "/tmp/pages.db", 8 };
+        auto const run = database.allocate_pages(16);
+        test_check(run == page::size, "first run follows root page");
+        auto const single = database.allocate_page();
+        test_check(single == run + 16 * page::size, "allocation extends storage");
+        database.free_pages(run + 4 * page::size, 4);
+        database.free_pages(run + 12 * page::size, 4);
+        database.free_pages(run + 8 * page::size, 4);
+        test_check(database.page_allocator().free_extent_count() == 1, "adjacent free extents coalesce");
+        test_check(database.page_allocator().free_page_count() == 12, "free page count");
+    }
+    {
+        file_database database{ "/tmp/pages.db", 8 };
+        test_check(database.page_allocator().free_extent_count() == 1, "free extents persist");
+        auto const reused = database.allocate_pages(3);
+        test_check(reused == 5 * page::size, "best fit reuses free extent from its start");
+        test_check(database.allocate_pages(9) == 8 * page::size, "remainder of extent is contiguous");
+        test_check(database.page_allocator().free_page_count() == 0, "free extent consumed");
+        database.free_page(reused + page::size);
+        database.free_page(reused);
+        test_check(database.page_allocator().free_extent_count() == 1, "successor coalesces on free");
+        auto const relinked = database.allocate_pages(2);
+        pinned_page allocated{ database, relinked };
+        test_check(relinked == reused && allocated->header.pageLink.used == 0u && allocated->header.pageLink.next == 0u, "reused extent is unlinked from the free chain");
+    }
+}
+
+void test_record_allocator()
+{
+    memory_database database{ "Records" };
+    std::vector<ref_ptr<i_record>> records;
+    for (std::size_t size = 1; size < 4000; size += 97)
+        records.push_back(database.allocate_record(record_type::Table, size));
+    test_check(records[0]->address() % page::size == sizeof(page_header), "small record split from the start of a fresh page");
+    for (auto& r : records)
+        r->write(r->address());
+    for (auto& r : records)
+    {
+        std::uint64_t value = 0;
+        r->seek(0);
+        r->read(&value, sizeof(value));
+        test_check(value == r->address(), "record round trip");
+    }
+    for (std::size_t index = 0; index < records.size(); index += 2)
+        database.free_record(*records[index]);
+    for (std::size_t index = 1; index < records.size(); index += 2)
+        database.free_record(*records[index]);
+    auto const& root = database.root().header;
+    test_check(root.tableRecords.next == 0 && root.tableRecords.used == 0, "table record list empty");
+    for (auto const& bucket : root.freeRecords)
+        test_check(bucket.next == 0 && bucket.used == 0, "empty pages leave no free record blocks");
+    test_check(database.page_allocator().free_extent_count() != 0, "empty pages are released");
+
+    std::filesystem::remove("/tmp/records.db");
+    std::uint64_t first;
+    {
+        file_database fileDatabase{ "/tmp/records.db" };
+        first = fileDatabase.allocate_record(record_type::Table, 10)->address();
+        fileDatabase.allocate_record(record_type::Table, 10);
+    }
+    {
+        file_database fileDatabase{ "/tmp/records.db" };
+        test_check(fileDatabase.root().header.tableRecords.used == 2, "record list persists");
+        auto const reused = fileDatabase.allocate_record(record_type::Index, 10)->address();
+        test_check(reused / page::size == first / page::size, "free record buckets persist");
+    }
+}
+
+void test_record_pool()
+{
+    memory_database database{ "Sessions" };
+    auto const before = record::pool::stats();
+    std::size_t const batch = 1000;
+    for (std::size_t round = 0; round < 100; ++round)
+    {
+        std::vector<ref_ptr<i_record>> sessions;
+        for (std::size_t index = 0; index < batch; ++index)
+            sessions.push_back(database.allocate_record(record_type::Table, 32));
+        test_check(database.active_records().size() == batch, "active records tracked");
+        for (auto& session : sessions)
+            database.free_record(*session);
+    }
+    auto const after = record::pool::stats();
+    test_check(database.active_records().size() == 0, "released records leave active list");
+    test_check(after.allocations - before.allocations == 100 * batch, "every record comes from the pool");
+    test_check(after.slabs - before.slabs <= (batch + 255) / 256, "slabs only for peak live records");
+    std::vector<std::thread> threads;
+    for (std::size_t thread = 0; thread < 4; ++thread)
+        threads.emplace_back([&]()
+        {
+            for (std::size_t round = 0; round < 100; ++round)
+            {
+                std::vector<ref_ptr<i_record>> sessions;
+                for (std::size_t index = 0; index < batch; ++index)
+                    sessions.push_back(database.allocate_record(record_type::Table, 32));
+                for (auto& session : sessions)
+                    database.free_record(*session);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+    test_check(record::pool::stats().allocations - after.allocations == 4 * 100 * batch, "counts of exited threads are kept");
+}
+
+void test_write_ahead_log()
+{
+    std::filesystem::remove("/tmp/ledger.db");
+    std::filesystem::remove("/tmp/ledger.db.wal");
+    std::filesystem::remove("/tmp/ledger_crashed.db");
+    std::filesystem::remove("/tmp/ledger_crashed.db.wal");
+    std::uint64_t address;
+    {
+        file_database database{ "/tmp/ledger.db" };
+        auto entry = database.allocate_record(record_type::Table, 16);
+        entry->write(std::uint64_t{ 0x1234567890abcdef });
+        address = entry->address();
+        database.commit();
+        test_check(database.buffer_pool().stats().writeBacks == 0, "commit does not force pages to the database file");
+        // simulate a crash: take the files as they are after the commit returns
+        std::filesystem::copy_file("/tmp/ledger.db", "/tmp/ledger_crashed.db");
+        std::filesystem::copy_file(database.log_path(), "/tmp/ledger_crashed.db.wal");
+    }
+    {
+        file_database database{ "/tmp/ledger_crashed.db" };
+        test_check(database.root().header.tableRecords.used == 1, "root page recovered from log");
+        pinned_page recordPage{ database, address - address % page::size };
+        std::uint64_t value;
+        std::memcpy(&value, &recordPage->data[address % page::size - sizeof(page_header) + sizeof(record_header)], sizeof(value));
+        test_check(value == 0x1234567890abcdef, "record recovered from log");
+        test_check(recordPage->header.lsn != 0u, "recovered page carries its LSN");
+    }
+    test_check(std::filesystem::file_size("/tmp/ledger_crashed.db.wal") == write_ahead_log::HEADER_SIZE, "log discarded after recovery");
+
+    // a checkpoint writes what was committed, also of a page pinned across the commit, and nothing since
+    for (auto const* file : { "/tmp/ledger.db", "/tmp/ledger.db.wal", "/tmp/ledger_crashed.db", "/tmp/ledger_crashed.db.wal" })
+        std::filesystem::remove(file);
+    {
+        file_database database{ "/tmp/ledger.db" };
+        auto entry = database.allocate_record(record_type::Table, 16);
+        address = entry->address();
+        pinned_page held{ database, address - address % page::size };
+        entry->write(std::uint64_t{ 1 });
+        database.commit();
+        entry->write(std::uint64_t{ 2 });
+        auto const uncommitted = database.allocate_record(record_type::Table, 16);
+        database.checkpoint();
+        std::filesystem::copy_file("/tmp/ledger.db", "/tmp/ledger_crashed.db");
+        std::filesystem::copy_file(database.log_path(), "/tmp/ledger_crashed.db.wal");
+    }
+    {
+        file_database database{ "/tmp/ledger_crashed.db" };
+        pinned_page recordPage{ database, address - address % page::size };
+        std::uint64_t value;
+        std::memcpy(&value, &recordPage->data[address % page::size - sizeof(page_header) + sizeof(record_header)], sizeof(value));
+        test_check(value == 1u && database.root().header.tableRecords.used == 1, "checkpoint leaves out changes made since the last commit");
+    }
+
+    for (auto const* file : { "/tmp/ledger.db", "/tmp/ledger.db.wal", "/tmp/ledger_crashed.db", "/tmp/ledger_crashed.db.wal" })
+        std::filesystem::remove(file);
+    page::pointer_type torn;
+    {
+        file_database database{ "/tmp/ledger.db" };
+        torn = database.allocate_page();
+        {
+            pinned_page ledger{ database, torn };
+            std::memset(ledger->data.data(), 1, ledger->data.size());
+            ledger.set_dirty();
+        }
+        database.commit();
+        database.checkpoint();
+        pinned_page ledger{ database, torn };
+        std::memset(ledger->data.data(), 2, ledger->data.size());
+        ledger.set_dirty();
+        database.commit();
+        std::filesystem::copy_file("/tmp/ledger.db", "/tmp/ledger_crashed.db");
+        std::filesystem::copy_file(database.log_path(), "/tmp/ledger_crashed.db.wal");
+        // simulate a crash part way through writing the page out: only its first sector, holding the
+        // header and the new LSN, reaches the file
+        std::fstream file{ "/tmp/ledger_crashed.db", std::ios::in | std::ios::out | std::ios::binary };
+        file.seekp(static_cast<std::streamoff>(torn));
+        file.write(reinterpret_cast<char const*>(&*ledger), 4096);
+    }
+    {
+        file_database database{ "/tmp/ledger_crashed.db" };
+        pinned_page ledger{ database, torn };
+        test_check(std::all_of(ledger->data.begin(), ledger->data.end(), [](std::uint8_t aByte) { return aByte == 2u; }), "torn page rebuilt from the log");
+    }
+
+    // a torn page the log does not cover cannot be recovered
+    {
+        std::fstream file{ "/tmp/ledger_crashed.db", std::ios::in | std::ios::out | std::ios::binary };
+        file.seekp(static_cast<std::streamoff>(torn + 4096));
+        file.write(std::string(4096, '\x03').data(), 4096);
+    }
+    bool unrecoverable = false;
+    try
+    {
+        file_database database{ "/tmp/ledger_crashed.db" };
+        pinned_page ledger{ database, torn };
+    }
+    catch (bad_page_checksum const&)
+    {
+        unrecoverable = true;
+    }
+    test_check(unrecoverable, "torn page outside the log fails its checksum");
+
+    // recovery redoing more pages than the buffer pool holds
+    for (auto const* file : { "/tmp/ledger.db", "/tmp/ledger.db.wal", "/tmp/ledger_crashed.db", "/tmp/ledger_crashed.db.wal" })
+        std::filesystem::remove(file);
+    std::vector<page::pointer_type> ledgers;
+    {
+        file_database database{ "/tmp/ledger.db", file_database_options{ 32 } };
+        for (std::uint8_t index = 0; index < 20; ++index)
+        {
+            ledgers.push_back(database.allocate_page());
+            pinned_page ledger{ database, ledgers.back() };
+            std::memset(ledger->data.data(), index + 1, ledger->data.size());
+            ledger.set_dirty();
+        }
+        database.commit();
+        std::filesystem::copy_file("/tmp/ledger.db", "/tmp/ledger_crashed.db");
+        std::filesystem::copy_file(database.log_path(), "/tmp/ledger_crashed.db.wal");
+    }
+    {
+        file_database database{ "/tmp/ledger_crashed.db", file_database_options{ 8 } };
+        bool intact = true;
+        for (std::size_t index = 0; index < ledgers.size(); ++index)
+            intact = intact && pinned_page{ database, ledgers[index] }->data[100] == index + 1;
+        test_check(intact, "recovery writes back pages to make room in a small buffer pool");
+    }
+}
+
+void test_btree_index()
+{
+    memory_database database{ "Index" };
+    btree_index index{ database, index_key_traits<int32_t>::width, 4 };
+    std::vector<int32_t> keys;
+    for (int32_t key = -500; key < 500; ++key)
+        keys.push_back(key * 7 % 1000);
+    std::uint8_t key[4];
+    for (auto k : keys)
+    {
+        index_key_traits<int32_t>::encode(k, key);
+        index.insert(key, static_cast<std::uint64_t>(k + 1000));
+    }
+    test_check(index.size() == keys.size(), "btree index counts entries");
+    test_check(index.height() > 3, "btree index grows in height");
+    bool found = true;
+    for (auto k : keys)
+    {
+        index_key_traits<int32_t>::encode(k, key);
+        auto const value = index.find(key);
+        found = found && value && *value == static_cast<std::uint64_t>(k + 1000);
+    }
+    test_check(found, "btree index point lookups");
+    index_key_traits<int32_t>::encode(12345, key);
+    test_check(!index.find(key), "btree index missing key");
+    index_key_traits<int32_t>::encode(keys[0], key);
+    bool duplicateRejected = false;
+    try
+    {
+        index.insert(key, 0u);
+    }
+    catch (duplicate_key const&)
+    {
+        duplicateRejected = true;
+    }
+    test_check(duplicateRejected, "btree index rejects duplicate keys");
+    std::uint8_t low[4];
+    std::uint8_t high[4];
+    index_key_traits<int32_t>::encode(-10, low);
+    index_key_traits<int32_t>::encode(10, high);
+    std::vector<std::int64_t> range;
+    index.scan(low, high, [&](std::uint8_t const*, std::uint64_t aValue) { range.push_back(static_cast<std::int64_t>(aValue) - 1000); return true; });
+    std::vector<std::int64_t> expected;
+    for (auto k : keys)
+        if (k >= -10 && k <= 10)
+            expected.push_back(k);
+    std::sort(expected.begin(), expected.end());
+    test_check(range == expected, "btree index range scan");
+    std::size_t scanned = 0;
+    index.scan(nullptr, nullptr, [&](std::uint8_t const*, std::uint64_t) { ++scanned; return true; });
+    test_check(scanned == keys.size(), "btree index full scan");
+    auto const boundaries = index.partition(8);
+    std::size_t const parts = boundaries.size() / 4 + 1;
+    bool ordered = parts > 1 && parts <= 8;
+    for (std::size_t part = 1; ordered && part + 1 < parts; ++part)
+        ordered = std::memcmp(&boundaries[(part - 1) * 4], &boundaries[part * 4], 4) < 0;
+    test_check(ordered, "btree index partition boundaries");
+    std::size_t morselRows = 0;
+    for (std::size_t part = 0; part < parts; ++part)
+    {
+        std::uint8_t last[4];
+        if (part + 1 < parts)
+        {
+            std::memcpy(last, &boundaries[part * 4], 4);
+            previous_index_key(last, 4);
+        }
+        index.scan(part == 0 ? nullptr : &boundaries[(part - 1) * 4], part + 1 < parts ? last : nullptr,
+            [&](std::uint8_t const*, std::uint64_t) { ++morselRows; return true; });
+    }
+    test_check(morselRows == keys.size(), "btree index partition covers every entry once");
+    std::uint8_t carry[2] = { 0x01, 0x00 };
+    std::uint8_t zero[2] = { 0x00, 0x00 };
+    test_check(previous_index_key(carry, 2) && carry[0] == 0x00 && carry[1] == 0xFF && !previous_index_key(zero, 2), "previous index key");
+    btree_index reopened{ database, index.anchor_address() };
+    index_key_traits<int32_t>::encode(-499, key);
+    test_check(reopened.size() == keys.size() && reopened.find(key), "btree index reopens from its anchor");
+    auto const anchor = [&]()
+    {
+        pinned_page anchorPage{ database, index.anchor_address() - index.anchor_address() % page::size };
+        auto const payload = record_payload(*anchorPage, index.anchor_address());
+        return std::vector<std::uint8_t>(payload, payload + 6 * sizeof(std::uint64_t));
+    };
+    auto const anchorBefore = anchor();
+    auto const heightBefore = index.height();
+    index_key_traits<int32_t>::encode(5000, key);
+    index.insert(key, 0u);
+    if (index.height() == heightBefore)
+        test_check(anchor() == anchorBefore, "btree index insert leaves its anchor alone");
+    test_check(btree_index{ database, index.anchor_address() }.size() == keys.size() + 1, "btree index recounts entries on reopen");
+}
+
+void test_btree_index_readers()
+{
+    std::filesystem::remove("/tmp/index.db");
+    // few enough frames that readers keep finding the frames of the nodes they read reused
+    file_database_options options;
+    options.bufferPoolCapacity = 32;
+    options.writeAheadLog = false;
+    file_database database{ "/tmp/index.db", options };
+    btree_index index{ database, index_key_traits<uint64_t>::width, 16 };
+    std::uint64_t const keyCount = 20000;
+    std::vector<std::uint64_t> keys;
+    for (std::uint64_t k = 0; k < keyCount; ++k)
+        keys.push_back(k * 7919 % keyCount * 2);
+    std::atomic<std::size_t> inserted = 0u;
+    std::atomic<bool> consistent = true;
+    std::vector<std::thread> readers;
+    for (std::uint64_t reader = 0; reader < 4; ++reader)
+        readers.emplace_back([&, reader]()
+        {
+            std::uint8_t key[8];
+            for (std::uint64_t step = reader; inserted.load() < keyCount; step += 7)
+            {
+                auto const published = inserted.load();
+                if (published == 0u)
+                    continue;
+                auto const k = keys[step * 104729 % published];
+                index_key_traits<uint64_t>::encode(k, key);
+                auto const value = index.find(key);
+                index_key_traits<uint64_t>::encode(k + 1, key);
+                if (!value || *value != k + 1 || index.find(key))
+                    consistent = false;
+            }
+        });
+    std::uint8_t key[8];
+    for (auto k : keys)
+    {
+        index_key_traits<uint64_t>::encode(k, key);
+        index.insert(key, k + 1);
+        ++inserted;
+    }
+    for (auto& reader : readers)
+        reader.join();
+    test_check(consistent, "btree index readers see every key inserted before them and no others");
+    test_check(database.buffer_pool().stats().evictions > 0u, "btree index readers run while frames are reused");
+    std::uint64_t expected = 0u;
+    bool ordered = true;
+    index.scan(nullptr, nullptr, [&](std::uint8_t const*, std::uint64_t aValue)
+    {
+        ordered = ordered && aValue == expected + 1;
+        expected += 2;
+        return true;
+    });
+    test_check(ordered && expected == keyCount * 2, "btree index scan after concurrent inserts");
+    index_key_traits<uint64_t>::encode(keys[0], key);
+    index.find(key);
+    auto const pinsBefore = database.buffer_pool().stats().hits + database.buffer_pool().stats().misses;
+    index.find(key);
+    test_check(database.buffer_pool().stats().hits + database.buffer_pool().stats().misses == pinsBefore, "btree index lookups through resident nodes pin no pages");
+}
+
+void test_hash_index()
+{
+    hash_index index{ index_key_traits<uint64_t>::width };
+    std::uint8_t key[8];
+    for (std::uint64_t k = 0; k < 10000; ++k)
+    {
+        index_key_traits<uint64_t>::encode(k * 2654435761u, key);
+        index.insert(key, k);
+    }
+    test_check(index.size() == 10000 && index.capacity() * 7 >= index.size() * 8, "hash index grows within its load factor");
+    bool found = true;
+    for (std::uint64_t k = 0; k < 10000; ++k)
+    {
+        index_key_traits<uint64_t>::encode(k * 2654435761u, key);
+        auto const value = index.find(key);
+        found = found && value && *value == k;
+    }
+    test_check(found, "hash index point lookups");
+    for (std::uint64_t k = 0; k < 10000; k += 2)
+    {
+        index_key_traits<uint64_t>::encode(k * 2654435761u, key);
+        index.erase(key);
+    }
+    index_key_traits<uint64_t>::encode(std::uint64_t{ 2 } * 2654435761u, key);
+    bool const erasedGone = !index.find(key);
+    index_key_traits<uint64_t>::encode(std::uint64_t{ 3 } * 2654435761u, key);
+    test_check(index.size() == 5000 && erasedGone && index.find(key) == 3u, "hash index erase");
+    bool duplicateRejected = false;
+    try
+    {
+        index.insert(key, 0u);
+    }
+    catch (duplicate_key const&)
+    {
+        duplicateRejected = true;
+    }
+    test_check(duplicateRejected, "hash index rejects duplicate keys");
+}
+
+void test_table_rows()
+{
+    memory_database database{ "Stock" };
+
+    typedef char_string<16> description;
+    typedef optional<int32_t> quantity;
+
+    create_table<primary_key<uint64_t>, description, quantity>(
+        database,
+        "Parts"_s,
+        "Part Number"_s,
+        "Description"_s,
+        "Quantity"_s);
+
+    auto& parts = database.tables()[0];
+    test_check(parts->primary_index() != 0u, "create_table indexes the primary key");
+    test_check(parts->row_layout().size() == 40, "row layout size");
+    for (std::uint64_t partNumber = 1000; partNumber > 0; --partNumber)
+        parts->insert({ partNumber, c_string{ "part " + std::to_string(partNumber) }, partNumber % 2 ? quantity{ static_cast<int32_t>(partNumber) } : quantity{} });
+    auto const row = parts->find(std::uint64_t{ 42 });
+    test_check(row.has_value(), "table primary key lookup");
+    auto const values = parts->read(*row);
+    test_check(std::get<c_string>(values[1]).to_std_string() == "part 42", "table row char string field");
+    test_check(!std::get<optional<int32_t>>(values[2]), "table row null field");
+    test_check(*std::get<optional<int32_t>>(parts->read(*parts->find(std::uint64_t{ 43 }))[2]) == 43, "table row nullable field");
+    std::vector<std::uint64_t> partNumbers;
+    parts->scan(std::uint64_t{ 100 }, std::uint64_t{ 199 }, [&](page::pointer_type aRow)
+    {
+        partNumbers.push_back(std::get<std::uint64_t>(parts->read(aRow)[0]));
+        return true;
+    });
+    test_check(partNumbers.size() == 100 && partNumbers.front() == 100 && partNumbers.back() == 199, "table primary key range scan");
+
+    typedef char_string<32> session_id;
+    typedef int64_t expiry;
+
+    create_table<primary_key<session_id>, expiry>(
+        database,
+        table_options{ primary_index_type::Hashed },
+        "Sessions"_s,
+        "Session"_s,
+        "Expiry"_s);
+
+    auto& sessions = database.tables()[1];
+    test_check(sessions->primary_index() == 0u, "hash-only table has no ordered index");
+    for (int64_t session = 0; session < 100; ++session)
+        sessions->insert({ c_string{ "session-" + std::to_string(session) }, session * 60 });
+    auto const session = sessions->find(c_string{ "session-7" });
+    test_check(session && std::get<int64_t>(sessions->read(*session)[1]) == 420, "hash index table lookup");
+    test_check(!sessions->find(c_string{ "session-100" }), "hash index table missing key");
+
+    std::filesystem::remove("/tmp/sessions.db");
+    std::filesystem::remove("/tmp/sessions.db.wal");
+    file_database sessionDatabase{ "/tmp/sessions.db" };
+    bool rejected = false;
+    try
+    {
+        create_table<primary_key<session_id>, expiry>(
+            sessionDatabase,
+            table_options{ primary_index_type::Hashed },
+            "Sessions"_s,
+            "Session"_s,
+            "Expiry"_s);
+    }
+    catch (primary_index_not_persistent const&)
+    {
+        rejected = true;
+    }
+    test_check(rejected && sessionDatabase.tables().empty(), "hash-only table rejected by a persistent database");
+}
+
+void test_mvcc()
+{
+    memory_database database{ "Bank" };
+
+    typedef int64_t balance;
+
+    create_table<primary_key<uint64_t>, balance>(
+        database,
+        table_options{ primary_index_type::OrderedAndHashed },
+        "Accounts"_s,
+        "Account"_s,
+        "Balance"_s);
+
+    auto& accounts = database.tables()[0];
+    auto const balance_of = [&](std::optional<page::pointer_type> aRow)
+    {
+        return std::get<int64_t>(accounts->read(*aRow)[1]);
+    };
+    for (std::uint64_t account = 1; account <= 100; ++account)
+        accounts->insert({ account, static_cast<int64_t>(account) });
+    {
+        snapshot before{ database.versions() };
+        for (std::uint64_t account = 1; account <= 50; ++account)
+            test_check(accounts->update({ account, static_cast<int64_t>(account * 10) }), "update row");
+        test_check(accounts->remove(std::uint64_t{ 60 }), "remove row");
+        test_check(!accounts->remove(std::uint64_t{ 60 }), "removed row cannot be removed again");
+        test_check(!accounts->update({ std::uint64_t{ 60 }, int64_t{ 0 } }), "removed row cannot be updated");
+        test_check(!accounts->update({ std::uint64_t{ 101 }, int64_t{ 0 } }), "missing row cannot be updated");
+        test_check(balance_of(accounts->find(std::uint64_t{ 7 })) == 70, "read sees the newest version");
+        test_check(balance_of(accounts->find(std::uint64_t{ 7 }, before.as_of())) == 7, "snapshot sees the version current when it was taken");
+        test_check(!accounts->find(std::uint64_t{ 60 }), "removed row not found");
+        test_check(accounts->find(std::uint64_t{ 60 }, before.as_of()).has_value(), "snapshot still sees removed row");
+        std::size_t rows = 0;
+        int64_t total = 0;
+        accounts->scan([&](page::pointer_type aRow) { ++rows; total += std::get<int64_t>(accounts->read(aRow)[1]); return true; }, before.as_of());
+        test_check(rows == 100 && total == 5050, "snapshot scan sees a consistent table");
+        rows = 0;
+        accounts->scan([&](page::pointer_type) { ++rows; return true; });
+        test_check(rows == 99, "scan skips removed row");
+        test_check(database.collect_garbage() == 0u, "versions a snapshot can see are not collected");
+    }
+    test_check(database.collect_garbage() == 50u, "superseded versions collected once no snapshot can see them");
+    test_check(balance_of(accounts->find(std::uint64_t{ 7 })) == 70, "newest version survives garbage collection");
+    accounts->insert({ std::uint64_t{ 60 }, int64_t{ 600 } });
+    test_check(balance_of(accounts->find(std::uint64_t{ 60 })) == 600, "removed key can be inserted again");
+    bool threw = false;
+    try
+    {
+        accounts->insert({ std::uint64_t{ 60 }, int64_t{ 0 } });
+    }
+    catch (duplicate_key const&)
+    {
+        threw = true;
+    }
+    test_check(threw, "reinserted key is a duplicate");
+    test_check(database.collect_garbage() == 1u, "removed version collected after its key is reinserted");
+
+    auto const& layout = accounts->row_layout();
+    std::vector<std::uint8_t> batch(2 * layout.size());
+    layout.encode(0, std::uint64_t{ 70 }, &batch[0]);
+    layout.encode(1, int64_t{ 700 }, &batch[0]);
+    layout.encode(0, std::uint64_t{ 101 }, &batch[layout.size()]);
+    layout.encode(1, int64_t{ 101 }, &batch[layout.size()]);
+    test_check(accounts->remove(std::uint64_t{ 70 }), "remove row before batch");
+    accounts->bulk_insert(batch.data(), 2);
+    test_check(balance_of(accounts->find(std::uint64_t{ 70 })) == 700 && balance_of(accounts->find(std::uint64_t{ 101 })) == 101, "batch reinserts a removed key");
+    threw = false;
+    try
+    {
+        accounts->bulk_insert(batch.data(), 2);
+    }
+    catch (duplicate_key const&)
+    {
+        threw = true;
+    }
+    test_check(threw, "batch with the key of a current row rejected");
+    test_check(database.collect_garbage() == 1u, "version superseded by a batch collected");
+
+    table_facade<primary_key<uint64_t>, balance> facade{ *accounts };
+    auto cursor = facade.rows();
+    auto const pinned = facade.find(1u);
+    for (std::uint64_t account = 1; account <= 100; ++account)
+        accounts->update({ account, int64_t{ -1 } });
+    test_check(database.collect_garbage() == 0u, "versions an open cursor or pinned row can see are not collected");
+    int64_t total = 0;
+    for (auto const& row : cursor)
+        total += row.get<1>();
+    int64_t expected = 0;
+    for (int64_t account = 1; account <= 101; ++account)
+        expected += account <= 50 ? account * 10 : account == 60 || account == 70 ? account * 10 : account;
+    test_check(total == expected && pinned->get<1>() == 10, "cursor reads the rows as of its creation");
+    {
+        // an older write still in progress holds snapshots back but not lookups
+        versioned_write inProgress{ database.versions() };
+        accounts->update({ std::uint64_t{ 2 }, int64_t{ 20 } });
+        test_check(facade.find(2u)->get<1>() == 20, "find sees a row written while an older write is in progress");
+    }
+}
+
+void test_mvcc_readers()
+{
+    memory_database database{ "Bank" };
+
+    typedef int64_t balance;
+
+    create_table<primary_key<uint64_t>, balance>(
+        database,
+        "Accounts"_s,
+        "Account"_s,
+        "Balance"_s);
+
+    // readers without a snapshot of their own race updates whose old versions are collected and reused
+    auto& accounts = database.tables()[0];
+    for (std::uint64_t account = 1; account <= 8; ++account)
+        accounts->insert({ account, int64_t{ 0 } });
+    std::atomic<bool> stop = false;
+    std::atomic<bool> consistent = true;
+    std::vector<std::thread> threads;
+    threads.emplace_back([&]()
+    {
+        while (!stop)
+            database.collect_garbage();
+    });
+    for (std::uint64_t reader = 0; reader < 2; ++reader)
+        threads.emplace_back([&, reader]()
+        {
+            for (std::uint64_t step = reader; !stop; ++step)
+            {
+                // a version freed and reused for another key would turn up out of order
+                std::uint64_t expected = 1u;
+                accounts->scan([&](page::pointer_type aRow)
+                {
+                    if (std::get<std::uint64_t>(accounts->read(aRow)[0]) != expected++)
+                        consistent = false;
+                    return true;
+                });
+                if (expected != 9u || !accounts->find(step % 8 + 1))
+                    consistent = false;
+            }
+        });
+    for (int64_t round = 1; round <= 5000; ++round)
+        for (std::uint64_t account = 1; account <= 8; ++account)
+            accounts->update({ account, round });
+    stop = true;
+    for (auto& thread : threads)
+        thread.join();
+    test_check(consistent, "rows read without a snapshot are not collected under the reader");
+}
+
+void test_column_store()
+{
+    memory_database database{ "Stock" };
+
+    typedef char_string<16> description;
+    typedef optional<int32_t> quantity;
+
+    create_table<primary_key<uint64_t>, description, quantity>(
+        database,
+        table_options{ primary_index_type::Ordered, table_storage::Columns },
+        "Parts"_s,
+        "Part Number"_s,
+        "Description"_s,
+        "Quantity"_s);
+    create_table<primary_key<uint64_t>, description, quantity>(
+        database,
+        "Parts (rows)"_s,
+        "Part Number"_s,
+        "Description"_s,
+        "Quantity"_s);
+
+    auto& parts = database.tables()[0];
+    auto& rowParts = database.tables()[1];
+    test_check(parts->column_store() != 0u && rowParts->column_store() == 0u, "column store anchor");
+    column_page_layout const pageLayout{ parts->row_layout() };
+    test_check(pageLayout.capacity() > 500 && pageLayout.nulls_offset(0) == column_page_layout::NO_NULLS && pageLayout.nulls_offset(2) != column_page_layout::NO_NULLS, "column page layout");
+    std::uint64_t const partCount = pageLayout.capacity() * 3 + 7;
+    for (std::uint64_t partNumber = partCount; partNumber > 0; --partNumber)
+    {
+        auto const q = partNumber % 3 ? quantity{ static_cast<int32_t>(partNumber) } : quantity{};
+        parts->insert({ partNumber, c_string{ "part " + std::to_string(partNumber) }, q });
+        rowParts->insert({ partNumber, c_string{ "part " + std::to_string(partNumber) }, q });
+    }
+    auto const values = parts->read(*parts->find(std::uint64_t{ 43 }));
+    test_check(std::get<c_string>(values[1]).to_std_string() == "part 43" && *std::get<optional<int32_t>>(values[2]) == 43, "columnar row read");
+    test_check(!std::get<optional<int32_t>>(parts->read(*parts->find(std::uint64_t{ 42 }))[2]), "columnar row null field");
+    bool duplicateRejected = false;
+    try
+    {
+        parts->insert({ std::uint64_t{ 1 }, c_string{ "duplicate" }, quantity{} });
+    }
+    catch (duplicate_key const&)
+    {
+        duplicateRejected = true;
+    }
+    test_check(duplicateRejected, "columnar table rejects duplicate key");
+    auto sum_quantities = [](i_table const& aTable, std::size_t& aChunks)
+    {
+        std::int64_t total = 0;
+        std::uint64_t rows = 0;
+        aChunks = 0;
+        aTable.scan_columns({ 2 }, [&](column_chunk const& aChunk)
+        {
+            auto const quantities = static_cast<std::uint8_t const*>(aChunk.columns[0].values);
+            for (std::size_t row = 0; row < aChunk.rows; ++row)
+                if ((aChunk.columns[0].nulls[row / 8] & (1u << (row % 8))) == 0u)
+                    total += load_little<std::int32_t>(quantities + row * 4);
+            rows += aChunk.rows;
+            ++aChunks;
+            return true;
+        });
+        return std::make_pair(total, rows);
+    };
+    std::int64_t expected = 0;
+    for (std::uint64_t partNumber = 1; partNumber <= partCount; ++partNumber)
+        if (partNumber % 3)
+            expected += static_cast<std::int64_t>(partNumber);
+    std::size_t chunks;
+    test_check(sum_quantities(*parts, chunks) == std::make_pair(expected, partCount) && chunks == 4, "columnar scan visits each page's column once");
+    test_check(sum_quantities(*rowParts, chunks) == std::make_pair(expected, partCount), "row storage gathers columns");
+    std::uint64_t const appendCount = pageLayout.capacity() * 2;
+    std::thread appender{ [&]()
+    {
+        for (std::uint64_t partNumber = partCount + 1; partNumber <= partCount + appendCount; ++partNumber)
+            parts->insert({ partNumber, c_string{ "part " + std::to_string(partNumber) }, quantity{ 1 } });
+    } };
+    bool consistent = true;
+    std::uint64_t previousRows = partCount;
+    for (int scan = 0; scan < 50; ++scan)
+    {
+        auto const [total, rows] = sum_quantities(*parts, chunks);
+        consistent = consistent && rows >= previousRows && rows <= partCount + appendCount && total == expected + static_cast<std::int64_t>(rows - partCount);
+        previousRows = rows;
+    }
+    appender.join();
+    test_check(consistent && sum_quantities(*parts, chunks).second == partCount + appendCount, "columnar scan concurrent with appends");
+    bool facadeRejected = false;
+    try
+    {
+        table_facade<primary_key<uint64_t>, description, quantity> facade{ *parts };
+    }
+    catch (columnar_table const&)
+    {
+        facadeRejected = true;
+    }
+    test_check(facadeRejected, "table_facade rejects columnar tables");
+}
+
+template <typename T>
+void test_column_filter_type(data_type aType, T aLow, T aHigh, std::uint64_t aSeed)
+{
+    std::size_t const rows = 1000;
+    field_layout const field{ aType, 0u, sizeof(T), 0u };
+    std::vector<std::uint8_t> values(rows * sizeof(T));
+    std::vector<std::uint8_t> nulls((rows + 7) / 8);
+    std::vector<T> native(rows);
+    std::uint64_t state = aSeed;
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        native[row] = static_cast<T>(aLow + static_cast<T>((state >> 33) % static_cast<std::uint64_t>(aHigh - aLow + 1)));
+        store_little(&values[row * sizeof(T)], native[row]);
+        if (row % 7 == 3)
+            nulls[row / 8] |= static_cast<std::uint8_t>(1u << (row % 8));
+    }
+    column_data const column{ values.data(), nulls.data() };
+    T const pivot = static_cast<T>(aLow + (aHigh - aLow) / 2);
+    auto check = [&](column_predicate const& aPredicate, auto aReference, std::string const& aTest)
+    {
+        for (auto level : { simd_level::Scalar, simd_level::Sse42, simd_level::Avx2 })
+        {
+            selection_bitmap selection;
+            aPredicate.evaluate(column, rows, selection, level);
+            bool correct = true;
+            for (std::size_t row = 0; row < rows; ++row)
+                correct = correct && selection.test(row) == (row % 7 != 3 && aReference(native[row]));
+            test_check(correct, aTest);
+        }
+    };
+    check(column_predicate{ field, compare_op::Equal, pivot }, [&](T v) { return v == pivot; }, "column filter equal");
+    check(column_predicate{ field, compare_op::NotEqual, pivot }, [&](T v) { return v != pivot; }, "column filter not equal");
+    check(column_predicate{ field, compare_op::Less, pivot }, [&](T v) { return v < pivot; }, "column filter less");
+    check(column_predicate{ field, compare_op::LessEqual, pivot }, [&](T v) { return v <= pivot; }, "column filter less or equal");
+    check(column_predicate{ field, compare_op::Greater, pivot }, [&](T v) { return v > pivot; }, "column filter greater");
+    check(column_predicate{ field, compare_op::GreaterEqual, pivot }, [&](T v) { return v >= pivot; }, "column filter greater or equal");
+    check(column_predicate{ field, compare_op::Less, aLow }, [&](T v) { return v < aLow; }, "column filter less than minimum");
+    check(column_predicate{ field, aLow, pivot }, [&](T v) { return v >= aLow && v <= pivot; }, "column filter range");
+    check(column_predicate{ field, std::vector<data_value_type>{ aLow, pivot, aHigh } }, [&](T v) { return v == aLow || v == pivot || v == aHigh; }, "column filter in list");
+}
+
+void test_column_filter()
+{
+    test_column_filter_type<int8_t>(data_type::Int8, -100, 100, 1);
+    test_column_filter_type<uint8_t>(data_type::Uint8, 0, 255, 2);
+    test_column_filter_type<int16_t>(data_type::Int16, -30000, 30000, 3);
+    test_column_filter_type<uint16_t>(data_type::Uint16, 100, 65535, 4);
+    test_column_filter_type<int32_t>(data_type::Int32, -1000, 1000, 5);
+    test_column_filter_type<uint32_t>(data_type::Uint32, 0x7FFFFF00u, 0x800000FFu, 6);
+    test_column_filter_type<int64_t>(data_type::Int64, -5000, 5000, 7);
+    test_column_filter_type<uint64_t>(data_type::Uint64, 0x7FFFFFFFFFFFFF00ull, 0x80000000000000FFull, 8);
+    test_column_filter_type<float>(data_type::Float, -50, 50, 9);
+    test_column_filter_type<double>(data_type::Double, -50, 50, 10);
+
+    field_layout const quantity{ data_type::NullableInt32, 0u, 4u, 0u };
+    std::vector<data_value_type> many;
+    for (int32_t value = 0; value < 40; value += 2)
+        many.push_back(value);
+    std::vector<std::uint8_t> values(100 * 4);
+    for (int32_t row = 0; row < 100; ++row)
+        store_little(&values[row * 4], row);
+    selection_bitmap selection;
+    column_predicate{ quantity, many }.evaluate(column_data{ values.data(), nullptr }, 100, selection);
+    test_check(selection.count() == 20 && selection.test(38) && !selection.test(39) && !selection.test(40), "column filter long in list");
+    column_predicate{ quantity, compare_op::GreaterEqual, optional<int32_t>{ 90 } }.evaluate(column_data{ values.data(), nullptr }, 100, selection);
+    test_check(selection.count() == 10, "column filter optional constant");
+    bool rejected = false;
+    try
+    {
+        column_predicate{ quantity, compare_op::Equal, int64_t{ 1 } };
+    }
+    catch (field_type_mismatch const&)
+    {
+        rejected = true;
+    }
+    test_check(rejected, "column filter constant type mismatch");
+}
+
+void test_string_dictionary()
+{
+    memory_database database{ "Sales" };
+
+    typedef char_string<64> company;
+    typedef optional<varchar_string<16>> country;
+
+    create_table<primary_key<uint64_t>, company, country>(
+        database,
+        table_options{ primary_index_type::Ordered, table_storage::Columns, true },
+        "Orders"_s,
+        "Order Number"_s,
+        "Company"_s,
+        "Country"_s);
+
+    auto& orders = database.tables()[0];
+    char const* const companies[] = { "Acme Corporation", "Globex", "Initech", "Umbrella" };
+    char const* const countries[] = { "GB", "FR", "DE" };
+    std::uint64_t const orderCount = 3000;
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+        orders->insert({ order, c_string{ companies[order % 4] }, order % 5 == 0 ? data_value_type{ optional<vc_string>{} } : data_value_type{ optional<vc_string>{ vc_string{ countries[order % 3] } } } });
+    column_page_layout const plainLayout{ orders->row_layout() };
+    column_store const store{ orders->database(), orders->row_layout(), orders->column_store() };
+    test_check(store.dictionary(0) == nullptr && store.dictionary(1) != nullptr && store.dictionary(2) != nullptr, "dictionary encoded string columns");
+    test_check(store.dictionary(1)->size() == 4 && store.dictionary(2)->size() == 3, "dictionary holds distinct values");
+    test_check(store.page_layout().capacity() > plainLayout.capacity() * 4, "dictionary codes shrink rows");
+    auto const values = orders->read(*orders->find(std::uint64_t{ 7 }));
+    test_check(std::get<c_string>(values[1]).to_std_string() == "Umbrella" && std::get<optional<vc_string>>(values[2])->to_std_string() == "FR", "dictionary encoded row read");
+    test_check(!std::get<optional<vc_string>>(orders->read(*orders->find(std::uint64_t{ 10 }))[2]), "dictionary encoded null field");
+    std::size_t globex = 0;
+    std::size_t notGb = 0;
+    std::map<std::string, std::size_t> perCountry;
+    orders->scan_columns({ 1, 2 }, [&](column_chunk const& aChunk)
+    {
+        auto const& companyColumn = aChunk.columns[0];
+        auto const& countryColumn = aChunk.columns[1];
+        selection_bitmap selection;
+        column_predicate{ *companyColumn.dictionary, orders->row_layout().field(1), compare_op::Equal, c_string{ "Globex" } }.evaluate(companyColumn, aChunk.rows, selection);
+        globex += selection.count();
+        column_predicate{ *countryColumn.dictionary, orders->row_layout().field(2), compare_op::NotEqual, optional<vc_string>{ vc_string{ "GB" } } }.evaluate(countryColumn, aChunk.rows, selection);
+        notGb += selection.count();
+        std::vector<std::size_t> counts(countryColumn.dictionary->size());
+        for (std::size_t row = 0; row < aChunk.rows; ++row)
+            if ((countryColumn.nulls[row / 8] & (1u << (row % 8))) == 0u)
+                ++counts[load_little<std::uint32_t>(static_cast<std::uint8_t const*>(countryColumn.values) + row * 4)];
+        for (std::uint32_t code = 0; code < counts.size(); ++code)
+            perCountry[std::string{ countryColumn.dictionary->string(code) }] += counts[code];
+        return true;
+    });
+    std::size_t expectedNotGb = 0;
+    std::size_t expectedFr = 0;
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+    {
+        expectedNotGb += order % 5 != 0 && order % 3 != 0;
+        expectedFr += order % 5 != 0 && order % 3 == 1;
+    }
+    test_check(globex == orderCount / 4, "equality predicate on dictionary codes");
+    test_check(notGb == expectedNotGb, "inequality predicate on dictionary codes");
+    test_check(perCountry.size() == 3 && perCountry["FR"] == expectedFr, "group by dictionary codes");
+    std::size_t absent = 1;
+    orders->scan_columns({ 1 }, [&](column_chunk const& aChunk)
+    {
+        selection_bitmap selection;
+        column_predicate{ *aChunk.columns[0].dictionary, orders->row_layout().field(1), compare_op::Equal, c_string{ "Hooli" } }.evaluate(aChunk.columns[0], aChunk.rows, selection);
+        absent = selection.count();
+        return false;
+    });
+    test_check(absent == 0, "equality predicate on value missing from dictionary");
+    neodb::table reopened{ static_cast<i_table const&>(*orders) };
+    test_check(std::get<c_string>(reopened.read(*reopened.find(std::uint64_t{ 2998 }))[1]).to_std_string() == "Initech", "dictionary reopened with table");
+    reopened.insert({ std::uint64_t{ orderCount }, c_string{ "Hooli" }, optional<vc_string>{ vc_string{ "US" } } });
+    test_check(std::get<c_string>(reopened.read(*reopened.find(orderCount))[1]).to_std_string() == "Hooli", "reopened dictionary grows");
+}
+
+void test_typed_row_layout()
+{
+    typedef char_string<16> description;
+    typedef optional<int32_t> quantity;
+    typedef typed_schema<primary_key<uint64_t>, description, quantity, bool> part_schema;
+    typedef part_schema::row_layout_type part_layout;
+
+    static_assert(part_layout::fields[0].offset == 8 && part_layout::fields[1].offset == 16 && part_layout::fields[2].offset == 32 && part_layout::fields[3].offset == 36);
+    static_assert(part_layout::fields[2].nullBit == 0 && part_layout::null_bitmap_size == 1);
+    static_assert(part_schema::row_size == 40);
+
+    part_schema schema{ "Parts"_s, "Part Number"_s, "Description"_s, "Quantity"_s, "Obsolete"_s };
+    row_layout const runtimeLayout{ schema };
+    bool same = runtimeLayout.size() == part_layout::size;
+    for (std::size_t index = 0; index < part_layout::field_count; ++index)
+        same = same && runtimeLayout.field(index).offset == part_layout::fields[index].offset &&
+            runtimeLayout.field(index).nullBit == part_layout::fields[index].nullBit;
+    test_check(same, "typed row layout matches run time row layout");
+
+    std::array<std::uint8_t, part_layout::size> row;
+    part_layout::encode(row.data(), 42u, "widget", std::nullopt, true);
+    test_check(part_layout::get<0>(row.data()) == 42u && part_layout::get<1>(row.data()) == "widget", "typed row field access");
+    test_check(!part_layout::get<2>(row.data()) && part_layout::get<3>(row.data()), "typed row null field");
+    part_layout::set<2>(row.data(), 7);
+    auto const [partNumber, name, count, obsolete] = part_layout::decode(row.data());
+    test_check(partNumber == 42u && name == "widget" && count == 7 && obsolete, "typed row decode");
+    test_check(std::get<c_string>(runtimeLayout.decode(1, row.data())).to_std_string() == "widget", "typed row readable through run time layout");
+
+    std::array<std::uint8_t, 8> timeField;
+    neodb::time const now{ std::chrono::system_clock::now() };
+    field_codec<neodb::time>::encode(timeField.data(), now);
+    test_check(field_codec<neodb::time>::decode(timeField.data()) == now, "neodb::time field keeps full clock resolution");
+
+    memory_database database{ "Parts" };
+    database.create_table(schema);
+    auto& parts = database.tables()[0];
+    parts->insert(row.data());
+    test_check(parts->find(std::uint64_t{ 42 }).has_value(), "typed row indexed on insert");
+}
+
+void test_table_facade()
+{
+    memory_database database{ "Inventory" };
+
+    typedef char_string<24> description;
+    typedef optional<int32_t> quantity;
+
+    create_table<primary_key<int32_t>, description, quantity>(
+        database,
+        "Parts"_s,
+        "Part Number"_s,
+        "Description"_s,
+        "Quantity"_s);
+
+    table_facade<primary_key<int32_t>, description, quantity> parts{ *database.tables()[0] };
+    for (int32_t partNumber = 999; partNumber >= 0; --partNumber)
+    {
+        auto const name = "part " + std::to_string(partNumber);
+        parts.insert(partNumber, name, partNumber % 3 ? std::optional<int32_t>{ partNumber * 10 } : std::nullopt);
+    }
+    auto const part = parts.find(124);
+    test_check(part && part->get<0>() == 124 && part->get<1>() == "part 124" && part->get<2>() == 1240, "table facade find");
+    test_check(!parts.find(1000), "table facade missing key");
+    test_check(std::get<c_string>(database.tables()[0]->read(part->address())[1]).to_std_string() == "part 124", "table facade rows readable generically");
+    int32_t expected = 0;
+    bool ordered = true;
+    std::size_t nulls = 0;
+    for (auto const& row : parts.rows())
+    {
+        ordered = ordered && row.get<0>() == expected++;
+        if (!row.get<2>())
+            ++nulls;
+    }
+    test_check(ordered && expected == 1000 && nulls == 334, "table facade cursor visits rows in key order");
+    std::size_t count = 0;
+    for (auto const& row : parts.rows(250, 749))
+        count += row.get<0>() >= 250 && row.get<0>() <= 749 ? 1 : 0;
+    test_check(count == 500, "table facade range cursor");
+    bool mismatchDetected = false;
+    try
+    {
+        table_facade<primary_key<int64_t>, description, quantity> wrong{ *database.tables()[0] };
+    }
+    catch (field_type_mismatch const&)
+    {
+        mismatchDetected = true;
+    }
+    test_check(mismatchDetected, "table facade checks the table's layout");
+}
+
+void test_query_operators()
+{
+    memory_database database{ "Sales" };
+
+    typedef char_string<16> company;
+    typedef optional<int32_t> quantity;
+    typedef optional<varchar_string<8>> country;
+    typedef optional<vc_string> country_value;
+
+    create_table<primary_key<uint64_t>, company, quantity, double>(
+        database,
+        table_options{ primary_index_type::Ordered },
+        "Orders"_s,
+        "Order Number"_s,
+        "Company"_s,
+        "Quantity"_s,
+        "Price"_s);
+    create_table<primary_key<uint64_t>, company, country>(
+        database,
+        table_options{ primary_index_type::Ordered, table_storage::Columns, true },
+        "Shipments"_s,
+        "Order Number"_s,
+        "Company"_s,
+        "Country"_s);
+
+    auto& orders = database.tables()[0];
+    auto& shipments = database.tables()[1];
+    char const* const companies[] = { "Acme", "Globex", "Initech", "Umbrella" };
+    char const* const countries[] = { "GB", "FR", "DE" };
+    std::uint64_t const orderCount = 10000;
+    auto const quantity_of = [](std::uint64_t aOrder) { return aOrder % 10 == 0 ? std::optional<int32_t>{} : static_cast<int32_t>(aOrder % 97); };
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+    {
+        auto const orderQuantity = quantity_of(order);
+        orders->insert({ order, c_string{ companies[order % 4] }, orderQuantity ? quantity{ *orderQuantity } : quantity{}, static_cast<double>(order % 13) * 0.5 });
+        shipments->insert({ order, c_string{ companies[order % 4] }, order % 5 == 0 ? data_value_type{ country_value{} } : data_value_type{ country_value{ vc_string{ countries[order % 3] } } } });
+    }
+
+    auto const all = query{ *orders }.rows();
+    bool inOrder = all.size() == orderCount;
+    for (std::uint64_t order = 0; inOrder && order < orderCount; ++order)
+        inOrder = std::get<uint64_t>(all[order][0]) == order && std::get<c_string>(all[order][1]).to_std_string() == companies[order % 4];
+    test_check(inOrder, "table scan reads every row in key order");
+
+    auto const large = query{ *orders, { "Quantity", "Order Number" } }.filter({ { "Quantity", compare_op::Greater, quantity{ 90 } } }).rows();
+    std::size_t expectedLarge = 0;
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+        expectedLarge += quantity_of(order) && *quantity_of(order) > 90;
+    test_check(large.size() == expectedLarge && *std::get<quantity>(large[0][0]) == 91 && std::get<uint64_t>(large[0][1]) == 91, "filter selects matching rows");
+
+    struct totals { std::uint64_t rows = 0; std::uint64_t counted = 0; int64_t sum = 0; int32_t low = 1000; int32_t high = -1; double price = 0.0; };
+    std::map<std::string, totals> expected;
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+    {
+        auto& total = expected[companies[order % 4]];
+        ++total.rows;
+        total.price += static_cast<double>(order % 13) * 0.5;
+        if (auto const orderQuantity = quantity_of(order))
+        {
+            ++total.counted;
+            total.sum += *orderQuantity;
+            total.low = std::min(total.low, *orderQuantity);
+            total.high = std::max(total.high, *orderQuantity);
+        }
+    }
+    auto const grouped = query{ *orders }.aggregate({ "Company" }, {
+        { aggregate_function::Count, "", "Orders" },
+        { aggregate_function::Count, "Quantity", "Counted" },
+        { aggregate_function::Sum, "Quantity", "Total" },
+        { aggregate_function::Min, "Quantity", "Smallest" },
+        { aggregate_function::Max, "Quantity", "Largest" },
+        { aggregate_function::Average, "Price", "Average Price" } }).order_by({ { "Company" } }).rows();
+    bool aggregated = grouped.size() == 4;
+    for (std::size_t group = 0; aggregated && group < grouped.size(); ++group)
+    {
+        auto const& row = grouped[group];
+        auto const& total = expected[companies[group]];
+        aggregated = std::get<c_string>(row[0]).to_std_string() == companies[group] &&
+            std::get<uint64_t>(row[1]) == total.rows &&
+            std::get<uint64_t>(row[2]) == total.counted &&
+            *std::get<optional<int64_t>>(row[3]) == total.sum &&
+            *std::get<quantity>(row[4]) == total.low &&
+            *std::get<quantity>(row[5]) == total.high &&
+            std::abs(*std::get<optional<double>>(row[6]) - total.price / static_cast<double>(total.rows)) < 1e-9;
+    }
+    test_check(aggregated, "hash aggregate groups and aggregates");
+    auto const overall = query{ *orders }.filter({ { "Order Number", compare_op::Less, uint64_t{ 0 } } }).aggregate({}, { { aggregate_function::Count, "", "Orders" }, { aggregate_function::Sum, "Quantity", "Total" } }).rows();
+    test_check(overall.size() == 1 && std::get<uint64_t>(overall[0][0]) == 0u && !std::get<optional<int64_t>>(overall[0][1]), "aggregate without groups has one row");
+
+    auto const top = query{ *orders }.order_by({ { "Quantity", true }, { "Order Number" } }).limit(5, 3).project({ "Order Number", "Quantity" }).rows();
+    std::vector<std::uint64_t> expectedOrder;
+    for (std::uint64_t order = 0; order < orderCount; ++order)
+        expectedOrder.push_back(order);
+    std::stable_sort(expectedOrder.begin(), expectedOrder.end(), [&](std::uint64_t aLeft, std::uint64_t aRight)
+    {
+        return quantity_of(aLeft).value_or(-1) > quantity_of(aRight).value_or(-1);
+    });
+    bool sorted = top.size() == 5;
+    for (std::size_t row = 0; sorted && row < top.size(); ++row)
+        sorted = std::get<uint64_t>(top[row][0]) == expectedOrder[row + 3] && *std::get<quantity>(top[row][1]) == *quantity_of(expectedOrder[row + 3]);
+    test_check(sorted, "order by, limit and project");
+    auto const nullsFirst = query{ *orders, { "Quantity" } }.order_by({ { "Quantity" } }).limit(1).rows();
+    test_check(nullsFirst.size() == 1 && !std::get<quantity>(nullsFirst[0][0]), "nulls sort first");
+
+    auto const byCountry = query{ *shipments }.filter({ { "Company", compare_op::Equal, c_string{ "Globex" } } }).aggregate({ "Country" }, { { aggregate_function::Count, "", "Shipments" } }).order_by({ { "Country", true } }).rows();
+    std::map<std::string, std::uint64_t> expectedCountries;
+    for (std::uint64_t order = 1; order < orderCount; order += 4)
+        ++expectedCountries[order % 5 == 0 ? "" : countries[order % 3]];
+    test_check(byCountry.size() == 4 &&
+        std::get<country_value>(byCountry[0][0])->to_std_string() == "GB" && std::get<uint64_t>(byCountry[0][1]) == expectedCountries["GB"] &&
+        std::get<country_value>(byCountry[2][0])->to_std_string() == "DE" &&
+        !std::get<country_value>(byCountry[3][0]) && std::get<uint64_t>(byCountry[3][1]) == expectedCountries[""], "dictionary encoded columns filter, group and sort");
+
+    table_scan scan{ *orders, { "Order Number" } };
+    column_batch batch;
+    test_check(scan.next(batch) && batch.rows == QUERY_BATCH_ROWS, "table scan batch");
+    std::size_t scanned = batch.rows;
+    test_check(orders->remove(uint64_t{ orderCount - 1 }) && orders->update({ uint64_t{ orderCount - 2 }, c_string{ "Globex" }, quantity{}, 1.0 }), "change rows during scan");
+    orders->insert({ orderCount, c_string{ "Acme" }, quantity{ 1 }, 1.0 });
+    while (scan.next(batch))
+        scanned += batch.rows;
+    test_check(scanned == orderCount, "table scan reads as of its snapshot");
+    test_check(query{ *orders }.rows().size() == orderCount, "new scan sees changes");
+}
+
+void test_bulk_insert()
+{
+    memory_database database{ "Sales" };
+
+    typedef char_string<16> customer;
+    typedef optional<int32_t> quantity;
+
+    create_table<primary_key<uint64_t>, customer, quantity>(
+        database,
+        table_options{ primary_index_type::OrderedAndHashed },
+        "Orders"_s,
+        "Order Number"_s,
+        "Customer"_s,
+        "Quantity"_s);
+    create_table<primary_key<uint64_t>, customer, quantity>(
+        database,
+        table_options{ primary_index_type::Ordered, table_storage::Columns },
+        "Orders (columns)"_s,
+        "Order Number"_s,
+        "Customer"_s,
+        "Quantity"_s);
+
+    auto& orders = *database.tables()[0];
+    auto& columnOrders = *database.tables()[1];
+    auto const& layout = orders.row_layout();
+    auto encode_rows = [&](std::vector<std::uint64_t> const& aKeys)
+    {
+        std::vector<std::uint8_t> rows(aKeys.size() * layout.size());
+        for (std::size_t index = 0; index < aKeys.size(); ++index)
+        {
+            auto const row = &rows[index * layout.size()];
+            layout.encode(0, aKeys[index], row);
+            layout.encode(1, c_string{ "customer " + std::to_string(aKeys[index] % 100) }, row);
+            layout.encode(2, aKeys[index] % 5 ? quantity{ static_cast<int32_t>(aKeys[index]) } : quantity{}, row);
+        }
+        return rows;
+    };
+    std::vector<std::uint64_t> keys;
+    for (std::uint64_t key = 1; key <= 20000; ++key)
+        keys.push_back(key * 2);
+    std::uint64_t state = 7;
+    for (std::size_t index = keys.size() - 1; index > 0; --index)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        std::swap(keys[index], keys[static_cast<std::size_t>(state >> 33) % (index + 1)]);
+    }
+    auto const rows = encode_rows(keys);
+    auto const addresses = orders.bulk_insert(rows.data(), keys.size());
+    std::set<page::pointer_type> pages;
+    for (auto address : addresses)
+        pages.insert(address - address % page::size);
+    auto const perPage = (page::size - sizeof(page_header)) / record_allocator::capacity_for(layout.size());
+    test_check(pages.size() == (keys.size() + perPage - 1) / perPage, "bulk inserted rows fill whole pages");
+    auto const& index = *static_cast<neodb::table&>(orders).primary_key_index();
+    test_check(index.size() == keys.size() && index.height() == 2, "primary key index built bottom-up");
+    std::uint64_t expected = 2;
+    bool ordered = true;
+    orders.scan([&](page::pointer_type aRow)
+    {
+        ordered = ordered && std::get<std::uint64_t>(orders.read(aRow)[0]) == expected;
+        expected += 2;
+        return ordered;
+    });
+    test_check(ordered && expected == 40002, "bulk loaded index scans in key order");
+    auto const order = orders.read(*orders.find(std::uint64_t{ 1234 }));
+    test_check(std::get<c_string>(order[1]).to_std_string() == "customer 34" && *std::get<optional<int32_t>>(order[2]) == 1234, "bulk inserted row found");
+
+    auto const tableRecords = database.root().header.tableRecords.used;
+    bool duplicateRejected = false;
+    try
+    {
+        orders.bulk_insert(encode_rows({ 1, 3, 1000, 5 }).data(), 4);
+    }
+    catch (duplicate_key const&)
+    {
+        duplicateRejected = true;
+    }
+    test_check(duplicateRejected && database.root().header.tableRecords.used == tableRecords && !orders.find(std::uint64_t{ 1 }), "batch with an existing key rejected whole");
+    duplicateRejected = false;
+    try
+    {
+        orders.bulk_insert(encode_rows({ 1, 3, 1 }).data(), 3);
+    }
+    catch (duplicate_key const&)
+    {
+        duplicateRejected = true;
+    }
+    test_check(duplicateRejected && !orders.find(std::uint64_t{ 3 }), "batch repeating a key rejected whole");
+    orders.bulk_insert(encode_rows({ 40001, 1, 20001 }).data(), 3);
+    test_check(index.size() == keys.size() + 3 && orders.find(std::uint64_t{ 20001 }) && orders.find(std::uint64_t{ 40001 }), "batch added to a populated index");
+
+    // row inserts racing batches over the same keys: each batch is indexed whole or not at all
+    std::vector<bool> batchInserted(100);
+    std::thread batcher{ [&]()
+    {
+        for (std::uint64_t batch = 0; batch < 100; ++batch)
+        {
+            std::vector<std::uint64_t> batchKeys;
+            for (std::uint64_t key = 0; key < 10; ++key)
+                batchKeys.push_back(100001 + batch * 10 + key);
+            try
+            {
+                orders.bulk_insert(encode_rows(batchKeys).data(), batchKeys.size());
+                batchInserted[batch] = true;
+            }
+            catch (duplicate_key const&)
+            {
+            }
+        }
+    } };
+    std::size_t rowsInserted = 0;
+    for (std::uint64_t key = 101000; key > 100000; --key)
+    {
+        try
+        {
+            orders.insert({ key, c_string{ "single" }, quantity{} });
+            ++rowsInserted;
+        }
+        catch (duplicate_key const&)
+        {
+        }
+    }
+    batcher.join();
+    bool whole = true;
+    std::size_t batchesInserted = 0;
+    for (std::uint64_t batch = 0; batch < 100; ++batch)
+    {
+        batchesInserted += batchInserted[batch] ? 1 : 0;
+        for (std::uint64_t key = 0; key < 10; ++key)
+        {
+            auto const row = orders.find(std::uint64_t{ 100001 + batch * 10 + key });
+            whole = whole && row && (std::get<c_string>(orders.read(*row)[1]).to_std_string() == "single") != batchInserted[batch];
+        }
+    }
+    test_check(whole && rowsInserted + batchesInserted * 10 == 1000 && index.size() == keys.size() + 3 + 1000, "row inserts and batches sharing keys");
+
+    auto const columnAddresses = columnOrders.bulk_insert(rows.data(), keys.size());
+    std::uint64_t columnRows = 0;
+    std::size_t chunks = 0;
+    columnOrders.scan_columns({ 0 }, [&](column_chunk const& aChunk)
+    {
+        columnRows += aChunk.rows;
+        ++chunks;
+        return true;
+    });
+    column_page_layout const pageLayout{ columnOrders.row_layout() };
+    test_check(columnRows == keys.size() && chunks == (keys.size() + pageLayout.capacity() - 1) / pageLayout.capacity(), "bulk inserted columnar rows fill whole pages");
+    test_check(*columnOrders.find(std::uint64_t{ 1234 }) == columnAddresses[std::find(keys.begin(), keys.end(), 1234u) - keys.begin()], "bulk inserted columnar row found");
+
+    create_table<primary_key<int32_t>, customer, quantity>(
+        database,
+        "Returns"_s,
+        "Return Number"_s,
+        "Customer"_s,
+        "Quantity"_s);
+    table_facade<primary_key<int32_t>, customer, quantity> returns{ *database.tables()[2] };
+    std::vector<std::tuple<int32_t, std::string, std::optional<int32_t>>> returned;
+    for (int32_t returnNumber = 500; returnNumber > 0; --returnNumber)
+        returned.emplace_back(returnNumber, "customer " + std::to_string(returnNumber % 10), returnNumber % 2 ? std::optional<int32_t>{ returnNumber } : std::nullopt);
+    auto const returnAddresses = returns.bulk_insert(returned);
+    auto const found = returns.find(17);
+    test_check(returnAddresses.size() == 500 && found && found->address() == returnAddresses[483] && found->get<1>() == "customer 7" && found->get<2>() == 17, "table facade bulk insert");
+
+    for (auto const* file : { "/tmp/sales.db", "/tmp/sales.db.wal" })
+        std::filesystem::remove(file);
+    {
+        file_database salesDatabase{ "/tmp/sales.db" };
+        create_table<primary_key<uint64_t>, customer, quantity>(
+            salesDatabase,
+            "Orders"_s,
+            "Order Number"_s,
+            "Customer"_s,
+            "Quantity"_s);
+        salesDatabase.commit();
+        auto const logged = std::filesystem::file_size("/tmp/sales.db.wal");
+        salesDatabase.tables()[0]->bulk_insert(rows.data(), keys.size());
+        salesDatabase.commit();
+        test_check(std::filesystem::file_size("/tmp/sales.db.wal") - logged < rows.size() / 4, "bulk load minimally logged");
+    }
+}
+
+void test_delimited_import()
+{
+    std::vector<std::uint32_t> separators;
+    std::string const sample = "alpha,\"beta\ngamma\",,delta\n0123456789,abcdefghijklmnopqrstuvwxyz,\"\"\"\"\n";
+    for (auto level : { simd_level::Scalar, simd_level::Sse42, simd_level::Avx2 })
+    {
+        if ((level == simd_level::Sse42 && !detected_cpu_features().sse42) || (level == simd_level::Avx2 && !detected_cpu_features().avx2))
+            continue;
+        neodb::detail::find_separators(sample.data(), sample.size(), ',', '"', separators, level);
+        std::size_t expected = 0;
+        for (auto character : sample)
+            expected += character == ',' || character == '\n' || character == '"' ? 1 : 0;
+        test_check(separators.size() == expected && std::all_of(separators.begin(), separators.end(), [&](std::uint32_t aOffset)
+            { return sample[aOffset] == ',' || sample[aOffset] == '\n' || sample[aOffset] == '"'; }), "delimited import separator scan");
+    }
+
+    memory_database database{ "Imports" };
+
+    typedef char_string<24> product;
+    typedef optional<double> price;
+
+    create_table<primary_key<uint32_t>, product, price, optional<int16_t>>(
+        database,
+        "Products"_s,
+        "Product Id"_s,
+        "Name"_s,
+        "Price"_s,
+        "Stock"_s);
+    auto& products = *database.tables()[0];
+    std::string csv = "Product Id,Name,Price,Stock\r\n";
+    for (std::uint32_t id = 1; id <= 5000; ++id)
+    {
+        std::string name = "product " + std::to_string(id);
+        if (id % 7 == 0)
+            name = "\"widget, \"\"" + std::to_string(id) + "\"\"\nmk2\"";
+        csv += std::to_string(id) + "," + name + "," + (id % 5 ? std::to_string(id) + ".25" : "") + "," + (id % 3 ? std::to_string(id % 1000) : "") + (id % 2 ? "\r\n" : "\n");
+        if (id % 1000 == 0)
+            csv += "\n";
+    }
+    {
+        std::istringstream input{ csv };
+        delimited_import_options options;
+        options.header = true;
+        options.threads = 3;
+        options.chunkSize = 300;
+        test_check(import_delimited(products, input, options) == 5000u, "delimited import row count");
+    }
+    auto const row = products.read(*products.find(std::uint32_t{ 14 }));
+    test_check(std::get<c_string>(row[1]).to_std_string() == "widget, \"14\"\nmk2" && *std::get<optional<double>>(row[2]) == 14.25 && *std::get<optional<int16_t>>(row[3]) == 14, "delimited import quoted field");
+    auto const nullRow = products.read(*products.find(std::uint32_t{ 15 }));
+    test_check(std::get<c_string>(nullRow[1]).to_std_string() == "product 15" && !std::get<optional<double>>(nullRow[2]) && !std::get<optional<int16_t>>(nullRow[3]), "delimited import null fields");
+    auto const lastRow = products.read(*products.find(std::uint32_t{ 5000 }));
+    test_check(std::get<c_string>(lastRow[1]).to_std_string() == "product 5000" && *std::get<optional<int16_t>>(lastRow[3]) == 0, "delimited import last row");
+
+    create_table<primary_key<uint32_t>, product, price, optional<int16_t>>(
+        database,
+        "Products (TSV)"_s,
+        "Product Id"_s,
+        "Name"_s,
+        "Price"_s,
+        "Stock"_s);
+    auto& tsvProducts = *database.tables()[1];
+    {
+        std::istringstream input{ "1\t\"quoted\"\t1.5\t3\n2\tplain\t\t\n3\tlast\t2\t-4" };
+        delimited_import_options options;
+        options.delimiter = '\t';
+        options.quoted = false;
+        test_check(import_delimited(tsvProducts, input, options) == 3u, "tsv import row count");
+    }
+    test_check(std::get<c_string>(tsvProducts.read(*tsvProducts.find(std::uint32_t{ 1 }))[1]).to_std_string() == "\"quoted\"" &&
+        *std::get<optional<int16_t>>(tsvProducts.read(*tsvProducts.find(std::uint32_t{ 3 }))[3]) == -4, "tsv import leaves quotes alone");
+    auto rejects = [&](std::string const& aText)
+    {
+        std::istringstream input{ aText };
+        try
+        {
+            import_delimited(tsvProducts, input);
+        }
+        catch (bad_import_record const&)
+        {
+            return true;
+        }
+        return false;
+    };
+    test_check(rejects("10,a,1.0,2,3\n") && rejects("11,a\n") && rejects("x12,a,,\n") && rejects("13,\"a,,\n") && rejects("14,abcdefghijklmnopqrstuvwxyz,,\n"),
+        "delimited import rejects malformed records");
+}
+
+void test_protocol()
+{
+    typed_schema<primary_key<uint64_t>, char_string<16>, optional<int32_t>> const accounts{ "Accounts"_s, "Account Id"_s, "Holder"_s, "Balance"_s };
+    table_options options;
+    options.primaryIndex = primary_index_type::OrderedAndHashed;
+    message request;
+    protocol::writer writer{ request };
+    writer.put(protocol::opcode::CreateTable);
+    protocol::write_table_definition(writer, accounts, options);
+    protocol::reader reader{ request };
+    test_check(reader.get<protocol::opcode>() == protocol::opcode::CreateTable, "protocol opcode");
+    auto const definition = protocol::read_table_definition(reader);
+    test_check(reader.remaining() == 0u, "protocol table definition size");
+    test_check(definition.schema.name() == "Accounts"_s && definition.schema.fields().size() == 3u &&
+        definition.options.primaryIndex == primary_index_type::OrderedAndHashed && definition.options.storage == table_storage::Rows, "protocol table definition");
+    neodb::row_layout const sent{ accounts };
+    neodb::row_layout const received{ definition.schema };
+    test_check(received.size() == sent.size() && received.primary_key() == sent.primary_key(), "protocol row layout");
+    for (std::size_t field = 0; field < sent.field_count(); ++field)
+        test_check(received.field(field).offset == sent.field(field).offset && received.field(field).dataType == sent.field(field).dataType &&
+            received.field(field).nullBit == sent.field(field).nullBit, "protocol field layout");
+
+    // rows travel as encoded on pages, so a received row decodes in place
+    std::vector<std::uint8_t> row(sent.size());
+    sent.encode(0, uint64_t{ 42u }, row.data());
+    sent.encode(1, "Ada"_s, row.data());
+    sent.encode(2, optional<int32_t>{}, row.data());
+    message response;
+    protocol::row_batch_header header;
+    header.rowSize = static_cast<std::uint32_t>(row.size());
+    header.rowCount = 1u;
+    header.flags = protocol::More;
+    protocol::writer{ response }.put_bytes(&header, sizeof(header)).put_bytes(row.data(), row.size());
+    test_check(response.size() == 9u + row.size() && response[0] == row.size() && response[4] == 1u && response[8] == protocol::More, "protocol row batch header");
+    auto const receivedRow = protocol::reader{ response }.get_bytes(response.size()) + sizeof(protocol::row_batch_header);
+    test_check(std::get<uint64_t>(received.decode(0, receivedRow)) == 42u && std::get<c_string>(received.decode(1, receivedRow)) == "Ada"_s &&
+        received.is_null(2, receivedRow), "protocol row decode");
+
+    bool threw = false;
+    try
+    {
+        protocol::reader truncated{ request.data(), request.size() - 1u };
+        truncated.get<protocol::opcode>();
+        protocol::read_table_definition(truncated);
+    }
+    catch (bad_message const&)
+    {
+        threw = true;
+    }
+    test_check(threw, "protocol truncated message");
+}
+
+// A server session on one end of a loopback connection, run by a thread of its own; the test drives
+// the other end with blocking reads and writes.
+class test_session_server
+{
+public:
+    test_session_server(worker_pool& aWorkers, request_handler aHandler, std::size_t aPipelineLimit) :
+        iHandler{ std::move(aHandler) },
+        iWork{ boost::asio::make_work_guard(iIoContext) },
+        iAcceptor{ iIoContext, boost::asio::ip::tcp::endpoint{ boost::asio::ip::address_v4::loopback(), 0 } },
+        iClient{ iClientContext }
+    {
+        iClient.connect(iAcceptor.local_endpoint());
+        std::make_shared<session>(iAcceptor.accept(), aWorkers, iHandler, aPipelineLimit)->start();
+        iThread = std::thread{ [this]() { iIoContext.run(); } };
+    }
+    ~test_session_server()
+    {
+        iWork.reset();
+        boost::system::error_code ignored;
+        iClient.close(ignored);
+        iThread.join();
+    }
+public:
+    void send(message const& aRequest)
+    {
+        std::array<std::uint8_t, 4> header;
+        for (std::size_t index = 0; index < 4; ++index)
+            header[index] = static_cast<std::uint8_t>(aRequest.size() >> (index * 8));
+        boost::asio::write(iClient, std::array<boost::asio::const_buffer, 2>{ boost::asio::buffer(header), boost::asio::buffer(aRequest) });
+    }
+    std::pair<response_status, message> receive()
+    {
+        std::array<std::uint8_t, 5> header;
+        boost::asio::read(iClient, boost::asio::buffer(header));
+        message payload(static_cast<std::size_t>(header[0]) | static_cast<std::size_t>(header[1]) << 8 |
+            static_cast<std::size_t>(header[2]) << 16 | static_cast<std::size_t>(header[3]) << 24);
+        boost::asio::read(iClient, boost::asio::buffer(payload));
+        return { static_cast<response_status>(header[4]), std::move(payload) };
+    }
+    void shutdown_sending()
+    {
+        iClient.shutdown(boost::asio::ip::tcp::socket::shutdown_send);
+    }
+    bool closed_by_server()
+    {
+        std::uint8_t byte;
+        boost::system::error_code error;
+        boost::asio::read(iClient, boost::asio::buffer(&byte, 1), error);
+        return error == boost::asio::error::eof;
+    }
+private:
+    request_handler iHandler;
+    boost::asio::io_context iIoContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> iWork;
+    boost::asio::ip::tcp::acceptor iAcceptor;
+    boost::asio::io_context iClientContext;
+    boost::asio::ip::tcp::socket iClient;
+    std::thread iThread;
+};
+
+void test_session()
+{
+    {
+        // the first requests take the longest so the workers finish them last
+        worker_pool workers{ 4, 64 };
+        test_session_server server{ workers, [](message const& aRequest)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ aRequest[0] });
+            if (aRequest[1] == 5)
+                throw std::runtime_error{ "request 5 failed" };
+            return reply{ aRequest };
+        }, 4 };
+        for (std::uint8_t request = 0; request < 8; ++request)
+            server.send(message{ static_cast<std::uint8_t>((8 - request) * 10), request });
+        bool ordered = true;
+        for (std::uint8_t request = 0; request < 8; ++request)
+        {
+            auto const [status, payload] = server.receive();
+            if (request == 5)
+                ordered = ordered && status == response_status::Error && std::string(payload.begin(), payload.end()) == "request 5 failed";
+            else
+                ordered = ordered && status == response_status::Ok && payload.size() == 2u && payload[1] == request;
+        }
+        test_check(ordered, "pipelined responses in request order");
+    }
+    {
+        // one worker held by the first request and room for one more queued: the third is refused
+        worker_pool workers{ 1, 1 };
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> const released = release.get_future().share();
+        test_session_server server{ workers, [&](message const& aRequest)
+        {
+            if (aRequest[0] == 1)
+            {
+                started.set_value();
+                released.wait();
+            }
+            return reply{ aRequest };
+        }, 16 };
+        server.send(message{ 1 });
+        started.get_future().wait();
+        server.send(message{ 2 });
+        server.send(message{ 3 });
+        // give the session time to read and dispatch both before the worker is freed
+        std::this_thread::sleep_for(std::chrono::milliseconds{ 200 });
+        release.set_value();
+        auto const first = server.receive();
+        auto const second = server.receive();
+        auto const third = server.receive();
+        test_check(first.first == response_status::Ok && first.second == message{ 1 } && second.first == response_status::Ok && second.second == message{ 2 } &&
+            third.first == response_status::Busy && third.second.empty(), "request refused as busy when the worker queue is full");
+    }
+    {
+        worker_pool workers{ 2, 64 };
+        test_session_server server{ workers, [](message const& aRequest)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 20 });
+            return reply{ aRequest };
+        }, 16 };
+        for (std::uint8_t request = 0; request < 3; ++request)
+            server.send(message{ request });
+        server.shutdown_sending();
+        bool drained = true;
+        for (std::uint8_t request = 0; request < 3; ++request)
+        {
+            auto const [status, payload] = server.receive();
+            drained = drained && status == response_status::Ok && payload == message{ request };
+        }
+        test_check(drained && server.closed_by_server(), "responses drained after the client stops sending");
+    }
+}
+
+// A database service on a loopback port, its sessions run by a thread of its own.
+class test_database_server
+{
+public:
+    test_database_server(std::filesystem::path const& aDatabasePath) :
+        iWorkers{ 4, 1024 },
+        iService{ aDatabasePath, 256, iWorkers, 1 },
+        iHandler{ [this](message const& aRequest) { ++iRequests; return iService.handle(aRequest); } },
+        iWork{ boost::asio::make_work_guard(iIoContext) },
+        iAcceptor{ iIoContext, boost::asio::ip::tcp::endpoint{ boost::asio::ip::address_v4::loopback(), 0 } }
+    {
+        accept();
+        iThread = std::thread{ [this]() { iIoContext.run(); } };
+    }
+    ~test_database_server()
+    {
+        boost::asio::post(iIoContext, [this]()
+        {
+            boost::system::error_code ignored;
+            iAcceptor.close(ignored);
+        });
+        iWork.reset();
+        iThread.join();
+        iWorkers.stop();
+    }
+public:
+    unsigned short port() const
+    {
+        return iAcceptor.local_endpoint().port();
+    }
+    std::size_t requests() const
+    {
+        return iRequests;
+    }
+private:
+    void accept()
+    {
+        iAcceptor.async_accept([this](boost::system::error_code const& aError, boost::asio::ip::tcp::socket aSocket)
+        {
+            if (aError)
+                return;
+            std::make_shared<session>(std::move(aSocket), iWorkers, iHandler, 64)->start();
+            accept();
+        });
+    }
+private:
+    worker_pool iWorkers;
+    database_service iService;
+    std::atomic<std::size_t> iRequests = 0u;
+    request_handler iHandler;
+    boost::asio::io_context iIoContext;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> iWork;
+    boost::asio::ip::tcp::acceptor iAcceptor;
+    std::thread iThread;
+};
+
+void test_client()
+{
+    for (auto const* file : { "/tmp/accounts.db", "/tmp/accounts.db.wal" })
+        std::filesystem::remove(file);
+    typedef typed_schema<primary_key<uint64_t>, std::int64_t> account_schema;
+    typedef account_schema::row_layout_type account_layout;
+    account_schema const schema{ "Accounts"_s, "Account"_s, "Balance"_s };
+    auto account_row = [](std::uint64_t aAccount, std::int64_t aBalance)
+    {
+        client::row row(account_layout::size);
+        account_layout::encode(row.data(), aAccount, aBalance);
+        return row;
+    };
+    auto account_key = [](std::uint64_t aAccount)
+    {
+        std::array<std::uint8_t, index_key_traits<std::uint64_t>::width> key;
+        index_key_traits<std::uint64_t>::encode(aAccount, key.data());
+        return key;
+    };
+    auto lost = [](auto& aFuture)
+    {
+        try
+        {
+            aFuture.get();
+        }
+        catch (connection_lost const&)
+        {
+            return true;
+        }
+        return false;
+    };
+    {
+        test_database_server server{ "/tmp/accounts.db" };
+        // batches go when full or flushed, never on the timer, so the request count does not depend on speed
+        client connection{ "127.0.0.1", server.port(), client_options{ 2, 8, 16, std::chrono::hours{ 1 } } };
+        connection.create_table(schema).get();
+        auto const setUp = server.requests();
+        // each lookup is made right after the insert of its row, which may still be in flight
+        std::vector<std::future<bool>> inserted;
+        std::vector<std::future<std::optional<client::row>>> found;
+        for (std::uint64_t account = 1; account <= 1000; ++account)
+        {
+            auto const row = account_row(account, static_cast<std::int64_t>(account * 10));
+            inserted.push_back(connection.insert("Accounts", row.data(), row.size()));
+            auto const key = account_key(account);
+            found.push_back(connection.find("Accounts", key.data(), key.size()));
+        }
+        connection.flush();
+        bool allInserted = true;
+        bool allFound = true;
+        for (std::uint64_t account = 1; account <= 1000; ++account)
+        {
+            allInserted = allInserted && inserted[account - 1].get();
+            auto const row = found[account - 1].get();
+            allFound = allFound && row && account_layout::get<1>(row->data()) == static_cast<std::int64_t>(account * 10);
+        }
+        test_check(allInserted && allFound, "pipelined lookups see the inserts made before them");
+        test_check(server.requests() - setUp <= 2 * (1000 / 16 + 2), "inserts and lookups sent in batches");
+        auto const duplicateRow = account_row(5, -1);
+        auto const newRow = account_row(1001, 10010);
+        auto duplicate = connection.insert("Accounts", duplicateRow.data(), duplicateRow.size());
+        auto added = connection.insert("Accounts", newRow.data(), newRow.size());
+        auto again = connection.insert("Accounts", newRow.data(), newRow.size());
+        connection.flush();
+        test_check(!duplicate.get() && added.get() && !again.get(), "duplicate key fails only its own insert in a batch");
+        auto unchangedFound = connection.find("Accounts", account_key(5).data(), 8u);
+        connection.flush();
+        auto const unchanged = unchangedFound.get();
+        test_check(unchanged && account_layout::get<1>(unchanged->data()) == 50 && connection.count("Accounts").get() == 1001u, "batch with a duplicate keeps the other rows");
+        connection.commit().get();
+    }
+    {
+        boost::asio::io_context io;
+        boost::asio::ip::tcp::acceptor acceptor{ io, boost::asio::ip::tcp::endpoint{ boost::asio::ip::address_v4::loopback(), 0 } };
+        client connection{ "127.0.0.1", acceptor.local_endpoint().port() };
+        auto socket = acceptor.accept();
+        auto const key = account_key(1);
+        auto pending = connection.find("Accounts", key.data(), key.size());
+        connection.flush();
+        std::array<std::uint8_t, 4> header;
+        boost::asio::read(socket, boost::asio::buffer(header));
+        socket.close();
+        auto later = connection.count("Accounts");
+        test_check(lost(pending) && lost(later), "requests fail once the connection is lost");
+    }
+}
+
+void test_file_database()
+{
+    std::filesystem::remove("/tmp/accounts.db");
+    {
+        file_database database{ "/tmp/accounts.db" };
+
+        create_table<primary_key<char_string<255>>>(
+            database,
+            "Companies"_s,
+            "Company Name"_s);
+
+        typedef int32_t currency;
+
+        create_table<primary_key<int32_t>, foreign_key<char_string<255>>, currency>(
+            database,
+            "Invoices"_s,
+            "Invoice Number"_s,
+            as_foreign_key<char_string<255>>{ "Company Name"_s, "Companies"_s, "Company Name"_s },
+            "Total"_s);
+    } 
+    {
+        file_database database{ "/tmp/accounts.db" };
+    }
+}
+
+void test_compressed_file_database()
+{
+    for (auto const* file : { "/tmp/archive.db", "/tmp/archive.db.wal", "/tmp/archive.db.slots", "/tmp/archive.db.map" })
+        std::filesystem::remove(file);
+    auto fill = [](page& aPage, std::size_t aSeed)
+    {
+        std::string text;
+        for (std::size_t line = 0; text.size() < aPage.data.size(); ++line)
+            text += "archived order " + std::to_string(aSeed * 1000 + line) + " shipped to warehouse " + std::to_string(line % 7) + "\n";
+        std::memcpy(aPage.data.data(), text.data(), aPage.data.size());
+    };
+    std::vector<page::pointer_type> pages;
+    page::data_type incompressible;
+    {
+        file_database_options options;
+        options.compressedPages = true;
+        file_database database{ "/tmp/archive.db", options };
+        test_check(database.compressed_pages(), "compressed page mode");
+        for (std::size_t index = 0; index < 64; ++index)
+        {
+            pages.push_back(database.allocate_page());
+            pinned_page archived{ database, pages.back() };
+            fill(*archived, index);
+            archived.set_dirty();
+        }
+        database.commit();
+        database.checkpoint();
+        auto const& pageIo = static_cast<compressed_page_io const&>(static_cast<checksummed_page_io&>(database.page_io()).next());
+        test_check(pageIo.stored_bytes() * 3 < pages.size() * page::size, "compressed pages take a third of the space or less");
+    }
+    test_check(std::filesystem::file_size("/tmp/archive.db.slots") * 3 < pages.size() * page::size, "compressed slot file size");
+    {
+        file_database database{ "/tmp/archive.db" };
+        test_check(database.compressed_pages(), "compressed page mode kept when reopened");
+        bool intact = true;
+        page expected;
+        for (std::size_t index = 0; index < pages.size(); ++index)
+        {
+            pinned_page archived{ database, pages[index] };
+            fill(expected, index);
+            intact = intact && archived->data == expected.data;
+        }
+        test_check(intact, "compressed pages read back");
+        {
+            pinned_page noise{ database, pages[5] };
+            std::uint64_t state = 42;
+            for (auto& byte : noise->data)
+            {
+                state = state * 6364136223846793005ull + 1442695040888963407ull;
+                byte = static_cast<std::uint8_t>(state >> 56);
+            }
+            noise.set_dirty();
+            incompressible = noise->data;
+        }
+        database.commit();
+        database.checkpoint();
+    }
+    {
+        file_database database{ "/tmp/archive.db" };
+        test_check(pinned_page{ database, pages[5] }->data == incompressible, "incompressible page stored as is");
+        page expected;
+        fill(expected, 6);
+        test_check(pinned_page{ database, pages[6] }->data == expected.data, "compressed page beside rewritten page");
+    }
+}
+
+void test_crc32c()
+{
+    char const check[] = "123456789";
+    for (auto implementation : { crc32c_implementation::Software, crc32c_implementation::Sse42, crc32c_implementation::Sse42Pclmul })
+        test_check(crc32c(check, 9, 0u, implementation) == 0xE3069283u, "crc32c check value");
+    std::vector<std::uint8_t> data(20000);
+    std::uint64_t state = 7;
+    for (auto& byte : data)
+    {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        byte = static_cast<std::uint8_t>(state >> 56);
+    }
+    bool agree = true;
+    for (std::size_t length : { 0u, 1u, 7u, 8u, 767u, 768u, 769u, 6144u, 6151u, 16376u, 20000u })
+    {
+        auto const expected = crc32c(data.data(), length, 0u, crc32c_implementation::Software);
+        agree = agree && crc32c(data.data() + 1, length - (length ? 1 : 0), crc32c(data.data(), length ? 1 : 0)) == expected;
+        for (auto implementation : { crc32c_implementation::Sse42, crc32c_implementation::Sse42Pclmul })
+            agree = agree && crc32c(data.data(), length, 0u, implementation) == expected;
+    }
+    test_check(agree, "crc32c implementations agree");
+}
+
+#ifdef NEODB_IO_URING
+void test_uring_page_io()
+{
+    std::filesystem::remove("/tmp/rings.db");
+    os_file file{ "/tmp/rings.db" };
+    auto io = uring_page_io::create(file);
+    if (!io)
+        return; // io_uring refused by the kernel or a sandbox
+    std::size_t const count = uring_page_io::QUEUE_DEPTH + 36;
+    std::vector<page> written(count);
+    std::vector<page_write> writes;
+    for (std::size_t index = 0; index < count; ++index)
+    {
+        std::memset(written[index].data.data(), static_cast<int>(index), written[index].data.size());
+        writes.push_back(page_write{ (index + 1) * page::size, &written[index] });
+    }
+    io->write_pages(writes.data(), writes.size());
+    std::vector<page> read(count);
+    std::vector<page_read> reads;
+    for (std::size_t index = 0; index < count; ++index)
+        reads.push_back(page_read{ (count - index) * page::size, &read[count - index - 1] });
+    io->read_pages(reads.data(), reads.size());
+    bool same = true;
+    for (std::size_t index = 0; index < count; ++index)
+        same = same && std::memcmp(&read[index], &written[index], sizeof(page)) == 0;
+    test_check(same, "io_uring batches span the queue depth");
+    page beyondEnd;
+    bool failed = false;
+    try
+    {
+        io->read_page((count + 10) * page::size, beyondEnd);
+    }
+    catch (page_io_error const&)
+    {
+        failed = true;
+    }
+    test_check(failed, "io_uring short read fails");
+    page first;
+    io->read_page(page::size, first);
+    test_check(std::memcmp(&first, &written[0], sizeof(page)) == 0, "io_uring ring usable after a failure");
+}
+#endif
+
+void test_page_checksums()
+{
+    for (auto const* file : { "/tmp/ledger.db", "/tmp/ledger.db.wal" })
+        std::filesystem::remove(file);
+    std::vector<page::pointer_type> pages;
+    {
+        file_database database{ "/tmp/ledger.db" };
+        for (std::size_t index = 0; index < 8; ++index)
+        {
+            pages.push_back(database.allocate_page());
+            pinned_page ledger{ database, pages.back() };
+            std::memset(ledger->data.data(), static_cast<int>(index + 1), ledger->data.size());
+            ledger.set_dirty();
+        }
+        database.commit();
+        database.checkpoint();
+        test_check(database.scrub().empty(), "scrub finds intact pages");
+    }
+    {
+        std::fstream file{ "/tmp/ledger.db", std::ios::in | std::ios::out | std::ios::binary };
+        file.seekp(static_cast<std::streamoff>(pages[3] + 1000));
+        file.put('\x7F');
+    }
+    {
+        file_database_options options;
+        options.scrubInterval = std::chrono::milliseconds{ 5 };
+        file_database database{ "/tmp/ledger.db", options };
+        test_check(database.scrub() == std::vector<page::pointer_type>{ pages[3] }, "scrub finds corrupt page");
+        bool detected = false;
+        try
+        {
+            pinned_page ledger{ database, pages[3] };
+        }
+        catch (bad_page_checksum const&)
+        {
+            detected = true;
+        }
+        test_check(detected, "corrupt page fails verification on read");
+        test_check(pinned_page{ database, pages[4] }->data[100] == 5, "intact page reads");
+        for (int wait = 0; wait < 200 && database.scrub_failures().empty(); ++wait)
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+        test_check(database.scrub_failures() == std::vector<page::pointer_type>{ pages[3] }, "background scrubber finds corrupt page");
+    }
+}
+
+void test_mmap_database()
+{
+    std::filesystem::remove("/tmp/players.db");
+    {
+        mmap_database database{ "/tmp/players.db" };
+        test_check(database.mapped_size() == mmap_database::DEFAULT_EXTENT_SIZE, "mmap database maps a whole extent");
+
+        typedef int64_t score;
+
+        create_table<primary_key<string>, score>(
+            database,
+            "High Scores"_s,
+            "Player Name"_s,
+            "Score"_s);
+    }
+    test_check(std::filesystem::file_size("/tmp/players.db") == 2 * page::size, "mmap database trims unused extent");
+    {
+        mmap_database database{ "/tmp/players.db" };
+    }
+}
+
+void test_memory_database()
+{
+    memory_database database{ "Players" };
+
+    typedef int64_t score;
+
+    create_table<primary_key<string>, score>(
+        database,
+        "High Scores"_s,
+        "Player Name"_s,
+        "Score"_s);
+
+    auto& scores = database.tables()[0];
+    auto const ada = scores->insert({ "Ada"_s, int64_t{ 1000 } });
+    auto const adaRow = scores->read(ada);
+    test_check(std::get<string>(adaRow[0]) == "Ada"_s && std::get<int64_t>(adaRow[1]) == 1000, "string field stored out of line");
+
+    create_table<primary_key<uint64_t>, string, optional<blob>>(
+        database,
+        "Nicknames"_s,
+        "Player"_s,
+        "Nickname"_s,
+        "Avatar"_s);
+
+    auto& nicknames = database.tables()[1];
+    auto const records = database.root().header.tableRecords.used;
+    nicknames->insert({ std::uint64_t{ 1 }, "Ace"_s, optional<blob>{ blob{ 1u, 2u, 3u } } });
+    nicknames->insert({ std::uint64_t{ 2 }, string{}, optional<blob>{} });
+    test_check(database.root().header.tableRecords.used == records + 4u, "empty and null values take no record");
+    auto const ace = nicknames->read(*nicknames->find(std::uint64_t{ 1 }));
+    auto const avatar = std::get<optional<blob>>(ace[2]);
+    test_check(std::get<string>(ace[1]) == "Ace"_s && avatar && avatar->size() == 3u && (*avatar)[2] == 3u, "string and blob values read back");
+    auto const none = nicknames->read(*nicknames->find(std::uint64_t{ 2 }));
+    test_check(std::get<string>(none[1]).size() == 0u && !std::get<optional<blob>>(none[2]), "empty and null values read back");
+    {
+        snapshot before{ database.versions() };
+        test_check(nicknames->update({ std::uint64_t{ 1 }, "Ace of Spades"_s, optional<blob>{} }), "update out-of-line value");
+        std::vector<std::uint8_t> row(nicknames->row_layout().size());
+        nicknames->read(*nicknames->find(std::uint64_t{ 1 }), row.data());
+        test_check(nicknames->update(row.data()), "update from a copy of the current row");
+        test_check(std::get<string>(nicknames->read(*nicknames->find(std::uint64_t{ 1 }, before.as_of()))[1]) == "Ace"_s, "snapshot reads the value of its version");
+    }
+    test_check(database.collect_garbage() == 2u, "superseded versions collected");
+    test_check(std::get<string>(nicknames->read(*nicknames->find(std::uint64_t{ 1 }))[1]) == "Ace of Spades"_s, "copied value outlives the version it was copied from");
+    test_check(database.root().header.tableRecords.used == records + 3u, "values freed with their versions");
+
+    bool threw = false;
+    try
+    {
+        nicknames->insert({ std::uint64_t{ 2 }, "Deuce"_s, optional<blob>{} });
+    }
+    catch (duplicate_key const&)
+    {
+        threw = true;
+    }
+    test_check(threw && database.root().header.tableRecords.used == records + 3u, "rejected row frees its values");
+}
+
+int main()
+{
+    try
+    {
+        test_buffer_pool();
+        test_page_allocator();
+        test_record_allocator();
+        test_record_pool();
+        test_write_ahead_log();
+        test_btree_index();
+        test_btree_index_readers();
+        test_hash_index();
+        test_table_rows();
+        test_mvcc();
+        test_mvcc_readers();
+        test_typed_row_layout();
+        test_table_facade();
+        test_column_store();
+        test_column_filter();
+        test_string_dictionary();
+        test_query_operators();
+        test_bulk_insert();
+        test_delimited_import();
+        test_protocol();
+        test_session();
+        test_client();
+        test_file_database();
+        test_compressed_file_database();
+        test_crc32c();
+#ifdef NEODB_IO_URING
+        test_uring_page_io();
+#endif
+        test_page_checksums();
+        test_mmap_database();
+        test_memory_database();
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    catch (...)
+    {
+        std::cerr << "Error: unknown error" << std::endl;
+        return EXIT_FAILURE;
+    }
 }
\ No newline at end of file